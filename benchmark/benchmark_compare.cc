@@ -0,0 +1,467 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//! Value in a JSON document.
+/*!
+ * Only the values written by the benchmarks are needed, so numbers are doubles and strings are not unescaped
+ * beyond simple escapes.
+ */
+struct JSONValue
+    {
+    enum Type { null, boolean, number, string, array, object };
+
+    Type type = null;
+    double num = 0.;
+    std::string str;
+    std::vector<JSONValue> items;
+    std::vector<std::pair<std::string,JSONValue>> members;
+
+    //! Get a member of an object, or nullptr if it does not exist.
+    const JSONValue* find(const std::string& key) const
+        {
+        for (const auto& m : members)
+            {
+            if (m.first == key) return &m.second;
+            }
+        return nullptr;
+        }
+    };
+
+//! Recursive-descent JSON parser.
+class JSONParser
+    {
+    public:
+        //! Parse a document.
+        /*!
+         * \param text Document.
+         * \returns The root value.
+         * \raises std::runtime_error if the document is not valid JSON.
+         */
+        static JSONValue parse(const std::string& text)
+            {
+            JSONParser p(text);
+            JSONValue value = p.parseValue();
+            p.skip();
+            if (p.m_pos != text.size()) p.fail("trailing characters");
+            return value;
+            }
+
+    private:
+        const std::string& m_text;  //!< Document
+        size_t m_pos;               //!< Current position
+
+        JSONParser(const std::string& text) : m_text(text), m_pos(0) {}
+
+        void fail(const std::string& what) const
+            {
+            throw std::runtime_error("Invalid JSON at character " + std::to_string(m_pos) + ": " + what + ".");
+            }
+
+        void skip()
+            {
+            while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos]))) ++m_pos;
+            }
+
+        char peek()
+            {
+            skip();
+            if (m_pos >= m_text.size()) fail("unexpected end");
+            return m_text[m_pos];
+            }
+
+        void expect(char c)
+            {
+            if (peek() != c) fail(std::string("expected '") + c + "'");
+            ++m_pos;
+            }
+
+        bool literal(const std::string& word)
+            {
+            if (m_text.compare(m_pos, word.size(), word) != 0) return false;
+            m_pos += word.size();
+            return true;
+            }
+
+        std::string parseString()
+            {
+            expect('"');
+            std::string s;
+            while (m_pos < m_text.size() && m_text[m_pos] != '"')
+                {
+                char c = m_text[m_pos++];
+                if (c == '\\')
+                    {
+                    if (m_pos >= m_text.size()) fail("unterminated escape");
+                    c = m_text[m_pos++];
+                    if (c == 'n') c = '\n';
+                    else if (c == 't') c = '\t';
+                    else if (c == 'u') { m_pos += 4; c = '?'; }
+                    }
+                s.push_back(c);
+                }
+            if (m_pos >= m_text.size()) fail("unterminated string");
+            ++m_pos;
+            return s;
+            }
+
+        JSONValue parseValue()
+            {
+            JSONValue v;
+            const char c = peek();
+            if (c == '{')
+                {
+                v.type = JSONValue::object;
+                ++m_pos;
+                if (peek() == '}') { ++m_pos; return v; }
+                while (true)
+                    {
+                    std::string key = parseString();
+                    expect(':');
+                    v.members.emplace_back(key, parseValue());
+                    if (peek() == ',') { ++m_pos; continue; }
+                    expect('}');
+                    break;
+                    }
+                }
+            else if (c == '[')
+                {
+                v.type = JSONValue::array;
+                ++m_pos;
+                if (peek() == ']') { ++m_pos; return v; }
+                while (true)
+                    {
+                    v.items.push_back(parseValue());
+                    if (peek() == ',') { ++m_pos; continue; }
+                    expect(']');
+                    break;
+                    }
+                }
+            else if (c == '"')
+                {
+                v.type = JSONValue::string;
+                v.str = parseString();
+                }
+            else if (literal("true"))
+                {
+                v.type = JSONValue::boolean;
+                v.num = 1.;
+                }
+            else if (literal("false"))
+                {
+                v.type = JSONValue::boolean;
+                }
+            else if (literal("null"))
+                {
+                v.type = JSONValue::null;
+                }
+            else
+                {
+                // numbers, including the nan and inf that iostreams write
+                const char* begin = m_text.c_str() + m_pos;
+                char* end;
+                v.num = std::strtod(begin, &end);
+                if (end == begin) fail("unexpected character");
+                v.type = JSONValue::number;
+                m_pos += end - begin;
+                }
+            return v;
+            }
+    };
+
+//! Samples of one phase of one benchmark configuration.
+struct Measurement
+    {
+    std::vector<double> samples;    //!< Time of each sample
+    double median;                  //!< Median time
+    };
+
+//! Fields that identify a configuration, if they are present in a result.
+const std::vector<std::string>& key_fields()
+    {
+    static const std::vector<std::string> fields = {"generator", "mode", "layout", "threads", "density", "N", "rcut"};
+    return fields;
+    }
+
+//! Get the median of samples.
+double median(std::vector<double> samples)
+    {
+    std::sort(samples.begin(), samples.end());
+    const size_t n = samples.size();
+    return (n % 2 == 1) ? samples[n/2] : 0.5*(samples[n/2-1] + samples[n/2]);
+    }
+
+//! Read the measurements of a benchmark result file.
+/*!
+ * \param filename JSON file written by a benchmark.
+ * \param benchmark Name of the benchmark in the file.
+ *
+ * \returns The measurements by configuration and phase, like "generator=liquid N=1000 rcut=1.5 build".
+ * \raises std::runtime_error if the file cannot be read or has no results.
+ */
+std::map<std::string,Measurement> read_results(const std::string& filename, std::string& benchmark)
+    {
+    std::ifstream in(filename.c_str());
+    if (!in)
+        {
+        throw std::runtime_error("Cannot open " + filename + ".");
+        }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    const JSONValue root = JSONParser::parse(buffer.str());
+
+    const JSONValue* name = root.find("benchmark");
+    benchmark = (name && name->type == JSONValue::string) ? name->str : "";
+    const JSONValue* results = root.find("results");
+    if (!results || results->type != JSONValue::array)
+        {
+        throw std::runtime_error(filename + " has no results.");
+        }
+
+    std::map<std::string,Measurement> measurements;
+    for (const auto& result : results->items)
+        {
+        std::ostringstream key;
+        for (const auto& field : key_fields())
+            {
+            const JSONValue* v = result.find(field);
+            if (!v) continue;
+            key << field << "=";
+            if (v->type == JSONValue::string)
+                key << v->str;
+            else
+                key << v->num;
+            key << " ";
+            }
+        const JSONValue* phases = result.find("phases");
+        if (!phases) continue;
+        for (const auto& phase : phases->members)
+            {
+            const JSONValue* samples = phase.second.find("samples");
+            if (!samples || samples->items.empty()) continue;
+            Measurement m;
+            for (const auto& s : samples->items)
+                {
+                m.samples.push_back(s.num);
+                }
+            m.median = median(m.samples);
+            measurements[key.str() + phase.first] = m;
+            }
+        }
+    return measurements;
+    }
+
+//! One-sided Mann-Whitney U test that the candidate samples are larger.
+/*!
+ * \param baseline Baseline samples.
+ * \param candidate Candidate samples.
+ *
+ * \returns The p-value of the candidate samples being no larger than the baseline samples.
+ *
+ * The exact distribution of U is used for small samples without ties, and the normal approximation with
+ * tie and continuity corrections otherwise. The test only uses the ranks of the samples, so a few outliers
+ * from the machine do not make a difference significant.
+ */
+double mann_whitney(const std::vector<double>& baseline, const std::vector<double>& candidate)
+    {
+    const unsigned int n1 = candidate.size(), n2 = baseline.size();
+    std::vector<std::pair<double,int>> all;
+    for (double x : candidate) all.push_back(std::make_pair(x, 1));
+    for (double x : baseline) all.push_back(std::make_pair(x, 0));
+    std::sort(all.begin(), all.end());
+
+    // midranks of the pooled samples
+    double rank_sum = 0., tie_term = 0.;
+    bool ties = false;
+    for (unsigned int i=0; i < all.size();)
+        {
+        unsigned int j = i;
+        while (j < all.size() && all[j].first == all[i].first) ++j;
+        const double rank = 0.5*(i + 1 + j);
+        for (unsigned int k=i; k < j; ++k)
+            {
+            if (all[k].second == 1) rank_sum += rank;
+            }
+        const double t = j - i;
+        tie_term += t*t*t - t;
+        ties |= (j - i > 1);
+        i = j;
+        }
+    // number of (candidate, baseline) pairs where the candidate is larger
+    const double U = rank_sum - 0.5*n1*(n1 + 1);
+
+    if (!ties && n1 + n2 <= 40)
+        {
+        // count[n][u]: arrangements of n candidate samples among the baseline samples with statistic u
+        const unsigned int max_u = n1*n2;
+        std::vector<std::vector<double>> count(n2+1, std::vector<double>(max_u+1, 0.));
+        for (unsigned int m=0; m <= n2; ++m) count[m][0] = 1.;
+        for (unsigned int n=1; n <= n1; ++n)
+            {
+            std::vector<std::vector<double>> next(n2+1, std::vector<double>(max_u+1, 0.));
+            next[0][0] = 1.;
+            for (unsigned int m=1; m <= n2; ++m)
+                for (unsigned int u=0; u <= max_u; ++u)
+                    {
+                    // the largest sample is either a candidate (larger than m baseline samples) or a baseline sample
+                    next[m][u] = ((u >= m) ? count[m][u-m] : 0.) + next[m-1][u];
+                    }
+            count.swap(next);
+            }
+        double total = 0., tail = 0.;
+        for (unsigned int u=0; u <= max_u; ++u)
+            {
+            total += count[n2][u];
+            if (u >= U - 1.e-9) tail += count[n2][u];
+            }
+        return tail/total;
+        }
+    else
+        {
+        const double N = n1 + n2;
+        const double mean = 0.5*n1*n2;
+        const double var = n1*n2/12.*((N + 1) - tie_term/(N*(N - 1)));
+        if (var <= 0.) return 1.;
+        const double z = (U - mean - 0.5)/std::sqrt(var);
+        return 0.5*std::erfc(z/std::sqrt(2.));
+        }
+    }
+
+//! Relative noise of samples.
+/*!
+ * \returns The median absolute deviation, scaled to the standard deviation of normal samples, divided by the median.
+ */
+double relative_noise(const Measurement& m)
+    {
+    std::vector<double> deviations;
+    for (double x : m.samples)
+        {
+        deviations.push_back(std::abs(x - m.median));
+        }
+    return (m.median > 0.) ? 1.4826*median(deviations)/m.median : 0.;
+    }
+
+//! Compare two benchmark result files and flag slowdowns.
+/*!
+ * The samples of each phase of each configuration (generator, N, rcut, and the density, scaling mode, pinning
+ * layout, and threads when a benchmark writes them) in a baseline file and a candidate file written by the same
+ * benchmark are compared. A phase is a regression if both:
+ *
+ * - its median time is slower than the baseline by more than the threshold, which is the larger of the given
+ *   threshold and twice the relative noise of the baseline and candidate samples, and
+ * - the candidate samples are larger than the baseline samples by a one-sided Mann-Whitney U test at the
+ *   significance level.
+ *
+ * Improvements are reported the same way. Phases in only one file are listed but are not regressions. With fewer
+ * than 4 samples per phase, the test cannot detect a difference at the default significance, so the benchmarks
+ * should be run with more samples (e.g., 10 or more). The program exits with status 2 if there is any regression,
+ * so it can be used as a gate.
+ *
+ * The command line parameters are:
+ *
+ *      ./benchmark_compare <baseline> <candidate> [threshold] [alpha]
+ *
+ * - <baseline>: JSON file of the baseline.
+ * - <candidate>: JSON file of the candidate.
+ * - [threshold]: Smallest relative change in the median that counts (default: 0.05).
+ * - [alpha]: Significance level of the test (default: 0.05).
+ */
+int main(int argc, char * argv[])
+    {
+    if (argc < 3 || argc > 5)
+        {
+        std::cout << "Usage: benchmark_compare <baseline> <candidate> [threshold] [alpha]" << std::endl;
+        return 1;
+        }
+    const std::string base_file(argv[1]), cand_file(argv[2]);
+    const double threshold = (argc > 3) ? std::stod(argv[3]) : 0.05;
+    const double alpha = (argc > 4) ? std::stod(argv[4]) : 0.05;
+
+    unsigned int regressions = 0, improvements = 0;
+    try
+        {
+        std::string base_name, cand_name;
+        const auto baseline = read_results(base_file, base_name);
+        const auto candidate = read_results(cand_file, cand_name);
+        if (base_name != cand_name)
+            {
+            throw std::runtime_error("Results are from different benchmarks (" + base_name + " and " + cand_name + ").");
+            }
+
+        std::cout << std::left << std::setw(60) << "configuration and phase" << std::right
+                  << std::setw(12) << "baseline" << std::setw(12) << "candidate" << std::setw(10) << "change"
+                  << std::setw(10) << "limit" << std::setw(10) << "p" << "  result" << std::endl;
+        bool few_samples = false;
+        for (const auto& b : baseline)
+            {
+            const auto c = candidate.find(b.first);
+            if (c == candidate.end())
+                {
+                std::cout << std::left << std::setw(60) << b.first << std::right << "  missing in candidate" << std::endl;
+                continue;
+                }
+            const Measurement& base = b.second;
+            const Measurement& cand = c->second;
+            few_samples |= (base.samples.size() < 4 || cand.samples.size() < 4);
+
+            const double change = cand.median/base.median - 1.;
+            const double limit = std::max(threshold, 2.*std::max(relative_noise(base), relative_noise(cand)));
+            const double p_slower = mann_whitney(base.samples, cand.samples);
+            const double p_faster = mann_whitney(cand.samples, base.samples);
+
+            std::string verdict = "same";
+            double p = std::min(p_slower, p_faster);
+            if (change > limit && p_slower < alpha)
+                {
+                verdict = "SLOWER";
+                p = p_slower;
+                ++regressions;
+                }
+            else if (-change > limit && p_faster < alpha)
+                {
+                verdict = "faster";
+                p = p_faster;
+                ++improvements;
+                }
+
+            std::cout << std::left << std::setw(60) << b.first << std::right << std::setprecision(4)
+                      << std::setw(12) << base.median << std::setw(12) << cand.median
+                      << std::setw(9) << std::fixed << std::setprecision(1) << 100.*change << "%"
+                      << std::setw(9) << 100.*limit << "%" << std::setw(10) << std::setprecision(4) << p
+                      << std::defaultfloat << "  " << verdict << std::endl;
+            }
+        for (const auto& c : candidate)
+            {
+            if (baseline.find(c.first) == baseline.end())
+                {
+                std::cout << std::left << std::setw(60) << c.first << std::right << "  missing in baseline" << std::endl;
+                }
+            }
+
+        if (few_samples)
+            {
+            std::cout << "Some phases have fewer than 4 samples, which is too few to detect a difference." << std::endl;
+            }
+        std::cout << regressions << " slower, " << improvements << " faster" << std::endl;
+        }
+    catch(const std::exception& e)
+        {
+        std::cerr << "**error** " << e.what() << std::endl;
+        return 1;
+        }
+
+    return (regressions > 0) ? 2 : 0;
+    }
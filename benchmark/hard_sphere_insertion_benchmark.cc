@@ -0,0 +1,199 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#include "neighbor/neighbor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+
+//! Profile a function call
+/*!
+ * \param f Function to profile.
+ * \param samples Number of samples to take.
+ * \returns Median time per call to \a f in milliseconds after 2 warmup calls.
+ */
+double profile(const std::function <void ()>& f, unsigned int samples)
+    {
+    for (unsigned int i=0; i < 2; ++i)
+        {
+        f();
+        }
+
+    std::vector<double> times(samples);
+    for (auto& t : times)
+        {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        t = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+    std::sort(times.begin(), times.end());
+    return times[samples/2];
+    }
+
+//! Benchmark of trial insertions into a dense hard-sphere system.
+/*!
+ * Hard spheres of unit diameter are placed on a face-centered cubic lattice in a periodic cube at a
+ * given packing fraction, and each sphere is displaced at random by up to a third of the gap between
+ * neighbors, so no spheres overlap. Trial spheres are placed uniformly at random, and each trial is
+ * accepted if it overlaps no sphere, which is a query sphere of unit radius centered on the trial.
+ *
+ * The trials are tested with the LBVH on the host and with a cell list, both by counting all overlaps
+ * (CountNeighborsOp) and by ending each traversal at the first overlap (AnyOverlapOp). The time per
+ * trial and the fraction of accepted trials are written to an output tabulated file.
+ *
+ * The command line parameters are:
+ *
+ *      ./hard_sphere_insertion_benchmark <N> <phi> <threads> <output>
+ *
+ * - <N>: Approximate number of spheres, rounded down to a whole lattice.
+ * - <phi>: Packing fraction (less than 0.74).
+ * - <threads>: Number of threads.
+ * - <output>: Name of tabulated file with output.
+ */
+int main(int argc, char * argv[])
+    {
+    unsigned int N, num_threads;
+    float phi;
+    std::string outf;
+    if (argc != 5)
+        {
+        std::cout << "Usage: hard_sphere_insertion_benchmark <N> <phi> <threads> <output>" << std::endl;
+        return 1;
+        }
+    else
+        {
+        N = std::stoul(argv[1]);
+        phi = std::stof(argv[2]);
+        num_threads = std::stoul(argv[3]);
+        outf = std::string(argv[4]);
+        }
+
+    try
+        {
+        // fcc lattice with 4 spheres per cell
+        const unsigned int n = std::max(1u, static_cast<unsigned int>(std::cbrt(N/4.)));
+        N = 4*n*n*n;
+        const float a = std::cbrt(4.f*M_PI/(6.f*phi));
+        const float L = n*a;
+        const float3 lo = make_float3(0.f, 0.f, 0.f);
+        const float3 hi = make_float3(L, L, L);
+        const float gap = a/std::sqrt(2.f) - 1.f;
+        if (gap <= 0.f)
+            {
+            std::cerr << "Packing fraction is too large for the lattice." << std::endl;
+            return 1;
+            }
+        std::cout << "Hard-sphere insertion benchmark for N = " << N << ", phi = " << phi << std::endl;
+
+        neighbor::shared_array<float3> points(N);
+            {
+            std::mt19937 mt(42);
+            std::uniform_real_distribution<float> U(-gap/(3.f*std::sqrt(3.f)), gap/(3.f*std::sqrt(3.f)));
+            const float3 basis[4] = {make_float3(0.f, 0.f, 0.f),
+                                     make_float3(0.5f, 0.5f, 0.f),
+                                     make_float3(0.5f, 0.f, 0.5f),
+                                     make_float3(0.f, 0.5f, 0.5f)};
+            unsigned int idx = 0;
+            for (unsigned int i=0; i < n; ++i)
+                for (unsigned int j=0; j < n; ++j)
+                    for (unsigned int k=0; k < n; ++k)
+                        for (const float3& b : basis)
+                            {
+                            points[idx++] = make_float3(a*(i+b.x+0.25f) + U(mt), a*(j+b.y+0.25f) + U(mt), a*(k+b.z+0.25f) + U(mt));
+                            }
+            }
+        const neighbor::PointInsertOp insert(points.get(), N);
+
+        // trial spheres
+        const unsigned int M = N;
+        neighbor::shared_array<float4> trials(M);
+            {
+            std::mt19937 mt(7);
+            std::uniform_real_distribution<float> U(0.f, L);
+            for (unsigned int i=0; i < M; ++i)
+                {
+                trials[i] = make_float4(U(mt), U(mt), U(mt), 1.f);
+                }
+            }
+        const neighbor::SphereQueryOp query(trials.get(), M);
+
+        neighbor::shared_array<float3> images(27);
+            {
+            unsigned int idx=0;
+            for (int ix=-1; ix <= 1; ++ix)
+                for (int iy=-1; iy <= 1; ++iy)
+                    for (int iz=-1; iz <= 1; ++iz)
+                        images[idx++] = make_float3(L*ix, L*iy, L*iz);
+            }
+        const neighbor::ImageListOp<float3> translate(images.get(), images.size());
+
+        neighbor::host::ThreadPool pool(num_threads);
+        neighbor::LBVH lbvh;
+        lbvh.build(pool, insert, lo, hi);
+        neighbor::LBVHTraverser traverser;
+        traverser.setup(pool, lbvh);
+        neighbor::CellList cells;
+        cells.build(pool, insert, lo, hi, 1.f);
+
+        neighbor::shared_array<unsigned int> result(M);
+        // a trial is accepted if it has no overlaps, for both the count and the flag
+        auto accepted = [&]
+            {
+            unsigned int count = 0;
+            for (unsigned int i=0; i < M; ++i)
+                {
+                if (result[i] == 0) ++count;
+                }
+            return static_cast<double>(count)/M;
+            };
+
+        struct Result
+            {
+            std::string method;
+            double time;
+            double accepted;
+            };
+        std::vector<Result> results;
+
+        const unsigned int samples = 5;
+        double t = profile([&]{ traverser.traverse(pool, lbvh, query, neighbor::CountNeighborsOp(result.get()), translate); }, samples);
+        results.push_back({"lbvh_count", t, accepted()});
+        t = profile([&]{ traverser.traverse(pool, lbvh, query, neighbor::AnyOverlapOp(result.get()), translate); }, samples);
+        results.push_back({"lbvh_any", t, accepted()});
+        t = profile([&]{ cells.traverse(pool, query, neighbor::CountNeighborsOp(result.get()), translate); }, samples);
+        results.push_back({"cell_count", t, accepted()});
+        t = profile([&]{ cells.traverse(pool, query, neighbor::AnyOverlapOp(result.get()), translate); }, samples);
+        results.push_back({"cell_any", t, accepted()});
+
+        std::ofstream output;
+        output.open(outf.c_str());
+        output << "# Hard-sphere insertion benchmark for N = " << N << ", phi = " << phi
+               << ", " << num_threads << " threads" << std::endl;
+        output << "#" << std::endl;
+        output << "# " << std::setw(10) << "method" << std::setw(16) << "time (us/trial)" << std::setw(16) << "accepted" << std::endl;
+        for (const auto& r : results)
+            {
+            const double per_trial = 1.e3*r.time/M;
+            std::cout << r.method << ": " << per_trial << " us/trial, accepted " << r.accepted << std::endl;
+            output << std::setw(12) << r.method
+                   << " " << std::setw(16) << std::fixed << std::setprecision(5) << per_trial
+                   << " " << std::setw(16) << std::fixed << std::setprecision(5) << r.accepted << std::endl;
+            }
+        }
+    catch(...)
+        {
+        std::cerr << "**error** Program terminated due to exception." << std::endl;
+        return 1;
+        }
+
+    return 0;
+    }
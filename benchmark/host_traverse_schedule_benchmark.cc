@@ -0,0 +1,277 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#include "neighbor/neighbor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+
+//! Load balance of one traversal.
+struct Balance
+    {
+    double time;        //!< Elapsed time (ms)
+    double tail;        //!< Time between the first and last thread running out of work (ms)
+    double utilization; //!< Fraction of the elapsed time the threads were busy
+    };
+
+//! Measure the load balance of a schedule
+/*!
+ * \param pool Thread pool.
+ * \param schedule Function running the traversal, called with a function that records the time
+ *                 a thread ran out of work and the time it was busy.
+ * \returns Median of 10 samples after warming up.
+ */
+Balance measure(neighbor::host::ThreadPool& pool,
+                const std::function<void (const std::function<void (unsigned int,double,double)>&)>& schedule)
+    {
+    const unsigned int num_threads = pool.getNumThreads();
+    std::vector<double> finish(num_threads), busy(num_threads);
+    auto record = [&](unsigned int thread, double f, double b)
+        {
+        finish[thread] = f;
+        busy[thread] = b;
+        };
+
+    for (unsigned int i=0; i < 3; ++i)
+        {
+        schedule(record);
+        }
+
+    std::vector<Balance> samples(10);
+    for (auto& s : samples)
+        {
+        const auto start = std::chrono::steady_clock::now();
+        schedule(record);
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        double sum_busy = 0.;
+        for (const double b : busy) sum_busy += b;
+        const auto minmax = std::minmax_element(finish.begin(), finish.end());
+        s.time = 1.e3*elapsed;
+        s.tail = 1.e3*(*minmax.second - *minmax.first);
+        s.utilization = sum_busy/(num_threads*elapsed);
+        }
+    std::sort(samples.begin(), samples.end(), [](const Balance& a, const Balance& b) { return a.time < b.time; });
+    return samples[samples.size()/2];
+    }
+
+//! Benchmark of host traversal schedules for a clustered system.
+/*!
+ * A fraction of the points is placed in a few dense spherical droplets, and the rest are a dilute gas
+ * filling a periodic cube, so the number of neighbors varies by about a factor of 100 between queries.
+ * A sphere centered on each point is traversed against an LBVH of the points, with the queries sorted in
+ * Morton order using the primitive order of the LBVH. For each number of threads (powers of 2 up to the
+ * maximum), the traversal is scheduled in three ways:
+ *
+ * - static: each thread traverses a contiguous block of queries of the same size.
+ * - dynamic: threads take chunks of 64 queries from a shared counter, like schedule(dynamic,64) in OpenMP.
+ * - stealing: host::WorkStealingScheduler, as used by LBVHTraverser::traverse on the host.
+ *
+ * The elapsed time, the tail time between the first and last thread running out of work, and the fraction
+ * of the time that the threads were busy traversing (utilization) are written to an output tabulated file.
+ *
+ * The command line parameters are:
+ *
+ *      ./host_traverse_schedule_benchmark <N> <max_threads> <output>
+ *
+ * - <N>: Number of points.
+ * - <max_threads>: Maximum number of threads.
+ * - <output>: Name of tabulated file with output.
+ */
+int main(int argc, char * argv[])
+    {
+    unsigned int N, max_threads;
+    std::string outf;
+    if (argc != 4)
+        {
+        std::cout << "Usage: host_traverse_schedule_benchmark <N> <max_threads> <output>" << std::endl;
+        return 1;
+        }
+    else
+        {
+        N = std::stoul(argv[1]);
+        max_threads = std::stoul(argv[2]);
+        outf = std::string(argv[3]);
+        }
+
+    try
+        {
+        std::cout << "Host traversal schedule benchmark for N = " << N << std::endl;
+
+        // gas at density 0.05 with 4 droplets at density 5 holding half the points
+        const unsigned int N_drop = N/2;
+        const float L = std::cbrt((N - N_drop)/0.05f);
+        const float R = std::cbrt(3.f*(N_drop/4)/(4.f*M_PI*5.f));
+        const float3 lo = make_float3(0.f, 0.f, 0.f);
+        const float3 hi = make_float3(L, L, L);
+        neighbor::shared_array<float3> points(N);
+            {
+            std::mt19937 mt(42);
+            std::uniform_real_distribution<float> U(0.f, 1.f);
+            std::vector<float3> centers(4);
+            for (auto& c : centers)
+                {
+                c = make_float3(R + (L-2.f*R)*U(mt), R + (L-2.f*R)*U(mt), R + (L-2.f*R)*U(mt));
+                }
+            for (unsigned int i=0; i < N; ++i)
+                {
+                if (i < N_drop)
+                    {
+                    // uniform in a sphere by rejection
+                    float3 r;
+                    do
+                        {
+                        r = make_float3(2.f*U(mt)-1.f, 2.f*U(mt)-1.f, 2.f*U(mt)-1.f);
+                        } while (r.x*r.x + r.y*r.y + r.z*r.z > 1.f);
+                    const float3 c = centers[i % centers.size()];
+                    points[i] = make_float3(c.x + R*r.x, c.y + R*r.y, c.z + R*r.z);
+                    }
+                else
+                    {
+                    points[i] = make_float3(L*U(mt), L*U(mt), L*U(mt));
+                    }
+                }
+            }
+
+        std::vector<unsigned int> threads;
+        for (unsigned int t=1; t < max_threads; t *= 2)
+            {
+            threads.push_back(t);
+            }
+        threads.push_back(max_threads);
+
+        std::ofstream output;
+        output.open(outf.c_str());
+        output << "# Host traversal schedule benchmark for N = " << N << std::endl;
+        output << "#" << std::endl;
+        output << "# " << std::setw(6) << "threads" << std::setw(10) << "schedule" << std::setw(16) << "time (ms)"
+               << std::setw(16) << "tail (ms)" << std::setw(16) << "utilization" << std::endl;
+
+        for (const unsigned int num_threads : threads)
+            {
+            neighbor::host::ThreadPool pool(num_threads);
+            neighbor::LBVH lbvh;
+            lbvh.build(pool, neighbor::PointInsertOp(points.get(), N), lo, hi);
+
+            // queries in Morton order
+            const float rcut = 1.5f;
+            neighbor::shared_array<float4> spheres(N);
+            for (unsigned int i=0; i < N; ++i)
+                {
+                const float3 r = points[lbvh.getPrimitives()[i]];
+                spheres[i] = make_float4(r.x, r.y, r.z, rcut);
+                }
+            const neighbor::SphereQueryOp query(spheres.get(), N);
+            neighbor::shared_array<unsigned int> hits(N);
+            const neighbor::CountNeighborsOp count(hits.get());
+
+            // compressed LBVH
+            neighbor::shared_array<int4> data(lbvh.getNNodes());
+            neighbor::shared_array<float3> clo(1), chi(1), bins(1);
+            neighbor::LBVHCompressedData clbvh;
+            clbvh.root = lbvh.getRoot();
+            clbvh.data = data.get();
+            clbvh.lo = clo.get();
+            clbvh.hi = chi.get();
+            clbvh.bins = bins.get();
+            neighbor::ConstLBVHData tree;
+            tree.parent = lbvh.getParents().get();
+            tree.left = lbvh.getLeftChildren().get();
+            tree.right = lbvh.getRightChildren().get();
+            tree.primitive = lbvh.getPrimitives().get();
+            tree.lo = lbvh.getLowerBounds().get();
+            tree.hi = lbvh.getUpperBounds().get();
+            tree.root = lbvh.getRoot();
+            neighbor::host::lbvh_compress_ropes(pool,
+                                                clbvh,
+                                                neighbor::NullTransformOp(),
+                                                tree,
+                                                lbvh.getNInternal(),
+                                                lbvh.getNNodes());
+            const neighbor::BoundingBox tree_box(clo[0], chi[0]);
+            const neighbor::SelfOp images;
+            auto traverse = [&](unsigned int idx)
+                {
+                neighbor::lbvh_traverse_query(count, clbvh, tree_box, bins[0], query, images, idx);
+                };
+
+            typedef std::chrono::steady_clock clock;
+            const Balance static_balance = measure(pool, [&](const std::function<void (unsigned int,double,double)>& record)
+                {
+                const auto start = clock::now();
+                pool.run([&](unsigned int thread)
+                    {
+                    const auto range = pool.getRange(thread, 0, N);
+                    for (unsigned int i=range.first; i < range.second; ++i)
+                        {
+                        traverse(i);
+                        }
+                    const double t = std::chrono::duration<double>(clock::now() - start).count();
+                    record(thread, t, t);
+                    });
+                });
+
+            const Balance dynamic_balance = measure(pool, [&](const std::function<void (unsigned int,double,double)>& record)
+                {
+                const auto start = clock::now();
+                std::atomic<unsigned int> next(0);
+                pool.run([&](unsigned int thread)
+                    {
+                    const unsigned int chunk = 64;
+                    unsigned int first;
+                    while ((first = next.fetch_add(chunk)) < N)
+                        {
+                        const unsigned int last = std::min(first + chunk, N);
+                        for (unsigned int i=first; i < last; ++i)
+                            {
+                            traverse(i);
+                            }
+                        }
+                    const double t = std::chrono::duration<double>(clock::now() - start).count();
+                    record(thread, t, t);
+                    });
+                });
+
+            neighbor::host::WorkStealingScheduler scheduler;
+            const Balance stealing_balance = measure(pool, [&](const std::function<void (unsigned int,double,double)>& record)
+                {
+                scheduler.run(pool, N, traverse);
+                for (unsigned int t=0; t < num_threads; ++t)
+                    {
+                    record(t, scheduler.getFinishTimes()[t], scheduler.getBusyTimes()[t]);
+                    }
+                });
+
+            const std::vector<std::pair<std::string,Balance>> results = {{"static", static_balance},
+                                                                         {"dynamic", dynamic_balance},
+                                                                         {"stealing", stealing_balance}};
+            for (const auto& r : results)
+                {
+                std::cout << num_threads << " threads, " << r.first << ": " << r.second.time << " ms, tail "
+                          << r.second.tail << " ms, utilization " << r.second.utilization << std::endl;
+                output << std::setw(8) << num_threads
+                       << " " << std::setw(9) << r.first
+                       << " " << std::setw(16) << std::fixed << std::setprecision(5) << r.second.time
+                       << " " << std::setw(16) << std::fixed << std::setprecision(5) << r.second.tail
+                       << " " << std::setw(16) << std::fixed << std::setprecision(5) << r.second.utilization << std::endl;
+                }
+            }
+        }
+    catch(...)
+        {
+        std::cerr << "**error** Program terminated due to exception." << std::endl;
+        return 1;
+        }
+
+    return 0;
+    }
@@ -0,0 +1,441 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#include "neighbor/neighbor.h"
+#include "synthetic_systems.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+//! Split a comma-separated list.
+std::vector<std::string> split(const std::string& list)
+    {
+    std::vector<std::string> items;
+    std::stringstream s(list);
+    std::string item;
+    while (std::getline(s, item, ','))
+        {
+        if (!item.empty()) items.push_back(item);
+        }
+    return items;
+    }
+
+//! Profile a function call
+/*!
+ * \param f Function to profile.
+ * \param samples Number of samples to take.
+ * \returns Time of each call to \a f in milliseconds after 1 warmup call.
+ */
+std::vector<double> profile(const std::function <void ()>& f, unsigned int samples)
+    {
+    f();
+    std::vector<double> times(samples);
+    for (auto& t : times)
+        {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        t = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+    return times;
+    }
+
+//! Get the median of samples.
+double median(std::vector<double> samples)
+    {
+    std::sort(samples.begin(), samples.end());
+    const size_t n = samples.size();
+    return (n % 2 == 1) ? samples[n/2] : 0.5*(samples[n/2-1] + samples[n/2]);
+    }
+
+//! Test all pairs of queries and primitives in tiles.
+/*!
+ * \param pool Thread pool.
+ * \param insert Insert operation of the primitives.
+ * \param query Query operation.
+ * \param out Output operation.
+ * \param images Translation operation.
+ *
+ * Each primitive is tested with the overlap and refine methods of \a query, like the leaves of an LBVH, so
+ * the same primitives are found. Tiles of 64 queries by 1024 primitives are processed so that the primitives of
+ * a tile stay in cache while the queries test them, and the tiles of queries are balanced between the threads.
+ */
+template<class InsertOpT, class QueryOpT, class OutputOpT, class TranslateOpT>
+void brute_force(neighbor::host::ThreadPool& pool,
+                 const InsertOpT& insert,
+                 const QueryOpT& query,
+                 const OutputOpT& out,
+                 const TranslateOpT& images)
+    {
+    const unsigned int query_tile = 64;
+    const unsigned int primitive_tile = 1024;
+    const unsigned int N = query.size();
+    const unsigned int num_primitives = insert.size();
+    const unsigned int num_images = images.size();
+    const unsigned int num_tiles = (N + query_tile - 1)/query_tile;
+
+    neighbor::host::WorkStealingScheduler scheduler;
+    scheduler.run(pool, num_tiles, [&](unsigned int tile)
+        {
+        const unsigned int first = tile*query_tile;
+        const unsigned int last = std::min(first + query_tile, N);
+
+        std::vector<typename QueryOpT::ThreadData> q;
+        std::vector<typename OutputOpT::ThreadData> t;
+        std::vector<typename QueryOpT::Volume> v;
+        std::vector<char> done(last-first, 0);
+        q.reserve(last-first);
+        t.reserve(last-first);
+        v.reserve((last-first)*num_images);
+        for (unsigned int i=first; i < last; ++i)
+            {
+            q.push_back(query.setup(i));
+            t.push_back(out.setup(i, q.back()));
+            for (unsigned int image=0; image < num_images; ++image)
+                {
+                v.push_back(query.get(q.back(), images.get(image)));
+                }
+            }
+
+        for (unsigned int j0=0; j0 < num_primitives; j0 += primitive_tile)
+            {
+            const unsigned int j1 = std::min(j0 + primitive_tile, num_primitives);
+            for (unsigned int i=0; i < last-first; ++i)
+                {
+                for (unsigned int image=0; image < num_images && !done[i]; ++image)
+                    {
+                    const typename QueryOpT::Volume& volume = v[i*num_images + image];
+                    for (unsigned int j=j0; j < j1; ++j)
+                        {
+                        if (query.overlap(volume, insert.get(j)) && query.refine(q[i], j)
+                            && neighbor::output_process(out, t[i], j))
+                            {
+                            done[i] = 1;
+                            break;
+                            }
+                        }
+                    }
+                }
+            }
+
+        for (unsigned int i=0; i < last-first; ++i)
+            {
+            out.finalize(t[i]);
+            }
+        });
+    }
+
+//! Neighbor lists of every query.
+struct NeighborLists
+    {
+    unsigned int max_neigh;                     //!< Neighbors allocated per query
+    neighbor::shared_array<unsigned int> list;  //!< Neighbors of each query
+    neighbor::shared_array<unsigned int> num;   //!< Number of neighbors of each query
+
+    NeighborLists(unsigned int N, unsigned int max_neigh_)
+        : max_neigh(max_neigh_), list(static_cast<size_t>(N)*max_neigh_), num(N)
+        {}
+
+    //! Get an output operation writing to the lists.
+    neighbor::NeighborListOp getOp()
+        {
+        return neighbor::NeighborListOp(list.get(), num.get(), max_neigh);
+        }
+
+    //! Remove the neighbors outside the spheres.
+    /*!
+     * \param spheres Query spheres.
+     * \param points Positions of the primitives.
+     * \param images Translation vectors of the periodic images.
+     * \param num_images Number of images.
+     *
+     * The traversal of the LBVH decompresses its boxes conservatively, and SphereQueryOp does not refine the primitives
+     * it overlaps, so the LBVH can find a few more primitives than the exact boxes of the cell list and brute force.
+     * The neighbors are refined with the exact distance to the nearest image so that the lists can be compared.
+     */
+    void refine(const float4* spheres, const float3* points, const float3* images, unsigned int num_images)
+        {
+        for (unsigned int i=0; i < num.size(); ++i)
+            {
+            const float4 s = spheres[i];
+            unsigned int* neigh = list.get() + i*max_neigh;
+            unsigned int n = 0;
+            for (unsigned int k=0; k < std::min(num[i], max_neigh); ++k)
+                {
+                const float3 r = points[neigh[k]];
+                bool inside = false;
+                for (unsigned int image=0; image < num_images && !inside; ++image)
+                    {
+                    const float dx = s.x + images[image].x - r.x;
+                    const float dy = s.y + images[image].y - r.y;
+                    const float dz = s.z + images[image].z - r.z;
+                    inside = (dx*dx + dy*dy + dz*dz <= s.w*s.w);
+                    }
+                if (inside) neigh[n++] = neigh[k];
+                }
+            num[i] = n;
+            }
+        }
+
+    //! Count the queries whose neighbors differ from another list.
+    unsigned int countMismatches(const NeighborLists& other) const
+        {
+        unsigned int mismatches = 0;
+        std::vector<unsigned int> a, b;
+        for (unsigned int i=0; i < num.size(); ++i)
+            {
+            if (num[i] != other.num[i] || num[i] > max_neigh)
+                {
+                ++mismatches;
+                continue;
+                }
+            a.assign(list.get() + i*max_neigh, list.get() + i*max_neigh + num[i]);
+            b.assign(other.list.get() + i*other.max_neigh, other.list.get() + i*other.max_neigh + num[i]);
+            std::sort(a.begin(), a.end());
+            std::sort(b.begin(), b.end());
+            if (a != b) ++mismatches;
+            }
+        return mismatches;
+        }
+    };
+
+//! Benchmark of the LBVH against brute force and a cell list on the host.
+/*!
+ * Each synthetic system (see synthetic_system_names) is generated for each number density and number of
+ * particles, and the neighbor list of a sphere around each particle is found for each cutoff, with the queries
+ * in Morton order. The radius of a sphere is the cutoff times the diameter of its particle, and the periodic
+ * images are traversed. Cutoffs that need more than one periodic image are skipped. The lists are found in three
+ * ways on the host, each timed from the primitives to the lists:
+ *
+ * - lbvh: neighbor::LBVH built, compressed, and traversed by neighbor::LBVHTraverser.
+ * - cell_list: neighbor::CellList built with cells as wide as the largest sphere diameter and traversed.
+ * - brute_force: every pair tested in cache-sized tiles, which is skipped above a maximum number of particles.
+ *
+ * The sorted neighbors of each query within the exact cutoff distance must be the same for all methods, or the
+ * benchmark fails after writing its output. The samples of each method and their median are written to an output JSON file in the same layout as
+ * lbvh_host_benchmark, with the methods as phases and the density added. The crossovers are also written: for each
+ * generator, density, and cutoff, the smallest number of particles at which the LBVH is faster than brute force and
+ * than the cell list (or null if it never is in the sweep).
+ *
+ * The command line parameters are:
+ *
+ *      ./lbvh_baseline_benchmark <N> <rcut> <density> <threads> <samples> <output> [generators] [max_brute_force]
+ *
+ * - <N>: Comma-separated numbers of particles.
+ * - <rcut>: Comma-separated cutoffs.
+ * - <density>: Comma-separated number densities.
+ * - <threads>: Number of host threads.
+ * - <samples>: Number of samples of each method.
+ * - <output>: Name of JSON file with output.
+ * - [generators]: Comma-separated generators (default: all).
+ * - [max_brute_force]: Largest number of particles for brute force (default: 20000).
+ */
+int main(int argc, char * argv[])
+    {
+    // every search runs on the host, so allocate host memory and run on nodes without a GPU
+    neighbor::Allocator::setDefault(std::make_shared<neighbor::host::HostAllocator>());
+
+    std::vector<unsigned int> Ns;
+    std::vector<float> rcuts, densities;
+    unsigned int num_threads, num_samples, max_brute_force = 20000;
+    std::vector<std::string> generators = synthetic_system_names();
+    std::string outf;
+    if (argc < 7 || argc > 9)
+        {
+        std::cout << "Usage: lbvh_baseline_benchmark <N> <rcut> <density> <threads> <samples> <output> [generators] [max_brute_force]" << std::endl;
+        return 1;
+        }
+    else
+        {
+        for (const auto& n : split(argv[1])) Ns.push_back(std::stoul(n));
+        for (const auto& r : split(argv[2])) rcuts.push_back(std::stof(r));
+        for (const auto& d : split(argv[3])) densities.push_back(std::stof(d));
+        num_threads = std::stoul(argv[4]);
+        num_samples = std::stoul(argv[5]);
+        outf = std::string(argv[6]);
+        if (argc > 7) generators = split(argv[7]);
+        if (argc > 8) max_brute_force = std::stoul(argv[8]);
+        }
+    if (num_samples == 0)
+        {
+        std::cerr << "**error** At least 1 sample is required." << std::endl;
+        return 1;
+        }
+    std::sort(Ns.begin(), Ns.end());
+
+    unsigned int total_mismatches = 0;
+    try
+        {
+        const unsigned int seed = 42;
+        std::cout << "LBVH baseline benchmark with " << num_threads << " threads" << std::endl;
+        neighbor::host::ThreadPool pool(num_threads);
+
+        std::ofstream output;
+        output.open(outf.c_str());
+        output << "{\"benchmark\": \"lbvh_baseline_benchmark\", \"threads\": " << num_threads << ", \"samples\": "
+               << num_samples << ", \"seed\": " << seed << "," << std::endl;
+        output << " \"results\": [";
+        bool first_result = true;
+
+        // median time of each method by (generator, density, rcut) and N
+        typedef std::tuple<std::string,float,float> Series;
+        std::map<Series, std::vector<std::tuple<unsigned int,double,double,double>>> series;
+
+        for (const auto& generator : generators)
+            for (const float density : densities)
+                for (const unsigned int N : Ns)
+                    {
+                    const SyntheticSystem sys = make_synthetic_system(generator, N, seed, density);
+                    const neighbor::PointInsertOp insert(sys.points.get(), N);
+                    const neighbor::shared_array<float3> images = sys.getImages();
+                    const neighbor::ImageListOp<float3> translate(images.get(), images.size());
+                    const float max_diameter = *std::max_element(sys.diameters.get(), sys.diameters.get() + N);
+
+                    neighbor::LBVH lbvh;
+                    neighbor::LBVHTraverser traverser;
+                    neighbor::CellList cells;
+                    lbvh.build(pool, insert, sys.lo, sys.hi);
+
+                    // queries in Morton order
+                    neighbor::shared_array<float4> spheres(N);
+                    const neighbor::SphereQueryOp query(spheres.get(), N);
+                    neighbor::shared_array<unsigned int> counts(N);
+
+                    for (const float rcut : rcuts)
+                        {
+                        if (rcut >= sys.getMaxCutoff())
+                            {
+                            std::cout << generator << ", density = " << density << ", N = " << N << ", rcut = " << rcut
+                                      << ": skipped (box too small)" << std::endl;
+                            continue;
+                            }
+                        for (unsigned int i=0; i < N; ++i)
+                            {
+                            const unsigned int p = lbvh.getPrimitives()[i];
+                            const float3 r = sys.points[p];
+                            spheres[i] = make_float4(r.x, r.y, r.z, rcut*sys.diameters[p]);
+                            }
+
+                        // size the lists
+                        traverser.traverse(pool, lbvh, query, neighbor::CountNeighborsOp(counts.get()), translate);
+                        const unsigned int max_neigh = std::max(1u, *std::max_element(counts.get(), counts.get() + N));
+
+                        NeighborLists lbvh_lists(N, max_neigh), cell_lists(N, max_neigh), brute_lists(N, max_neigh);
+                        const auto lbvh_times = profile([&]
+                            {
+                            lbvh.build(pool, insert, sys.lo, sys.hi);
+                            traverser.setup(pool, lbvh);
+                            traverser.traverse(pool, lbvh, query, lbvh_lists.getOp(), translate);
+                            }, num_samples);
+                        const auto cell_times = profile([&]
+                            {
+                            cells.build(pool, insert, sys.lo, sys.hi, rcut*max_diameter);
+                            cells.traverse(pool, query, cell_lists.getOp(), translate);
+                            }, num_samples);
+                        const bool run_brute_force = (N <= max_brute_force);
+                        std::vector<double> brute_times;
+                        if (run_brute_force)
+                            {
+                            brute_times = profile([&]
+                                {
+                                brute_force(pool, insert, query, brute_lists.getOp(), translate);
+                                }, num_samples);
+                            }
+
+                        lbvh_lists.refine(spheres.get(), sys.points.get(), images.get(), images.size());
+                        cell_lists.refine(spheres.get(), sys.points.get(), images.get(), images.size());
+                        unsigned int mismatches = lbvh_lists.countMismatches(cell_lists);
+                        if (run_brute_force)
+                            {
+                            brute_lists.refine(spheres.get(), sys.points.get(), images.get(), images.size());
+                            mismatches += lbvh_lists.countMismatches(brute_lists);
+                            }
+                        total_mismatches += mismatches;
+
+                        const double lbvh_time = median(lbvh_times);
+                        const double cell_time = median(cell_times);
+                        const double brute_time = run_brute_force ? median(brute_times) : NAN;
+                        series[Series(generator, density, rcut)].emplace_back(N, lbvh_time, cell_time, brute_time);
+
+                        std::cout << generator << ", density = " << density << ", N = " << N << ", rcut = " << rcut
+                                  << ": lbvh " << lbvh_time << " ms, cell list " << cell_time << " ms";
+                        if (run_brute_force) std::cout << ", brute force " << brute_time << " ms";
+                        std::cout << (mismatches == 0 ? "" : ", NEIGHBORS DIFFER") << std::endl;
+
+                        output << (first_result ? "" : ",") << std::endl;
+                        output << "  {\"generator\": \"" << generator << "\", \"density\": " << density << ", \"N\": " << N
+                               << ", \"rcut\": " << rcut << ", \"max_neighbors\": " << max_neigh
+                               << ", \"mismatches\": " << mismatches << ", \"phases\": {";
+                        std::vector<std::pair<std::string,const std::vector<double>*>> methods = {{"lbvh", &lbvh_times},
+                                                                                                  {"cell_list", &cell_times}};
+                        if (run_brute_force) methods.push_back({"brute_force", &brute_times});
+                        for (unsigned int m=0; m < methods.size(); ++m)
+                            {
+                            const auto& samples = *methods[m].second;
+                            output << (m > 0 ? ", " : "") << "\"" << methods[m].first << "\": {\"median\": "
+                                   << std::setprecision(6) << median(samples) << ", \"samples\": [";
+                            for (unsigned int j=0; j < samples.size(); ++j)
+                                {
+                                output << (j > 0 ? ", " : "") << samples[j];
+                                }
+                            output << "]}";
+                            }
+                        output << "}}";
+                        first_result = false;
+                        }
+                    }
+        output << std::endl << " ]," << std::endl;
+
+        // smallest N at which the LBVH wins
+        output << " \"crossovers\": [";
+        bool first_crossover = true;
+        std::cout << "Crossovers (smallest N where the LBVH is faster):" << std::endl;
+        for (const auto& s : series)
+            {
+            long long vs_brute = -1, vs_cell = -1;
+            for (const auto& r : s.second)
+                {
+                if (vs_brute < 0 && !std::isnan(std::get<3>(r)) && std::get<1>(r) < std::get<3>(r)) vs_brute = std::get<0>(r);
+                if (vs_cell < 0 && std::get<1>(r) < std::get<2>(r)) vs_cell = std::get<0>(r);
+                }
+            auto format = [](long long N) { return (N < 0) ? std::string("null") : std::to_string(N); };
+            std::cout << "    " << std::get<0>(s.first) << ", density = " << std::get<1>(s.first) << ", rcut = "
+                      << std::get<2>(s.first) << ": brute force " << format(vs_brute) << ", cell list " << format(vs_cell)
+                      << std::endl;
+            output << (first_crossover ? "" : ",") << std::endl;
+            output << "  {\"generator\": \"" << std::get<0>(s.first) << "\", \"density\": " << std::get<1>(s.first)
+                   << ", \"rcut\": " << std::get<2>(s.first) << ", \"brute_force\": " << format(vs_brute)
+                   << ", \"cell_list\": " << format(vs_cell) << "}";
+            first_crossover = false;
+            }
+        output << std::endl << " ]}" << std::endl;
+        }
+    catch(const std::exception& e)
+        {
+        std::cerr << "**error** " << e.what() << std::endl;
+        return 1;
+        }
+    catch(...)
+        {
+        std::cerr << "**error** Program terminated due to exception." << std::endl;
+        return 1;
+        }
+
+    if (total_mismatches > 0)
+        {
+        std::cerr << "**error** Neighbors differ between methods for " << total_mismatches << " queries." << std::endl;
+        return 1;
+        }
+    return 0;
+    }
@@ -0,0 +1,245 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#include "neighbor/neighbor.h"
+#include "synthetic_systems.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//! Split a comma-separated list.
+std::vector<std::string> split(const std::string& list)
+    {
+    std::vector<std::string> items;
+    std::stringstream s(list);
+    std::string item;
+    while (std::getline(s, item, ','))
+        {
+        if (!item.empty()) items.push_back(item);
+        }
+    return items;
+    }
+
+//! Timing and counts of one phase over the samples.
+struct PhaseResult
+    {
+    std::string name;                   //!< Name of the phase
+    std::vector<double> samples;        //!< Time of each sample in milliseconds
+    neighbor::host::PhaseCounters counters; //!< Hardware counts of one call
+
+    //! Get the median time.
+    double getMedian() const
+        {
+        std::vector<double> sorted(samples);
+        std::sort(sorted.begin(), sorted.end());
+        const size_t n = sorted.size();
+        return (n % 2 == 1) ? sorted[n/2] : 0.5*(sorted[n/2-1] + sorted[n/2]);
+        }
+    };
+
+//! Standalone benchmark of the host LBVH engine on synthetic systems.
+/*!
+ * Each synthetic system (see synthetic_system_names) is generated at number density 0.85 for each number of
+ * particles. An LBVH of the particles is built on the host, compressed for traversal, and traversed with a sphere
+ * around each particle for each cutoff, with the queries in Morton order. The radius of a sphere is the cutoff times
+ * the diameter of its particle, and the periodic images are traversed. Cutoffs that need more than one periodic
+ * image are skipped. The build, compression, and traversal are timed separately with neighbor::PhaseTimer for each
+ * sample after 2 warmup calls, and the samples, their median, and the mean number of neighbors are written to an
+ * output JSON file:
+ *
+ *      {"benchmark": "lbvh_host_benchmark", "threads": 4, "samples": 10, "seed": 42, "density": 0.85,
+ *       "results": [{"generator": "liquid", "N": 1000, "rcut": 1.5, "neighbors": 12.1,
+ *                    "phases": {"build": {"median": 0.1, "samples": [...]}, "compress": ..., "traverse": ...}}, ...]}
+ *
+ * If host::HardwareCounters are available, the cycles, instructions, cache misses, and TLB misses of one call are
+ * also written for each phase. The build of a system does not depend on the cutoff, but it is timed with each one
+ * so that every result is complete.
+ *
+ * The command line parameters are:
+ *
+ *      ./lbvh_host_benchmark <N> <rcut> <threads> <samples> <output> [generators] [seed]
+ *
+ * - <N>: Comma-separated numbers of particles.
+ * - <rcut>: Comma-separated cutoffs.
+ * - <threads>: Number of host threads.
+ * - <samples>: Number of samples of each phase.
+ * - <output>: Name of JSON file with output.
+ * - [generators]: Comma-separated generators (default: all).
+ * - [seed]: Seed of the generators (default: 42).
+ */
+int main(int argc, char * argv[])
+    {
+    // only the host engines are timed, so the arrays do not need a device
+    neighbor::Allocator::setDefault(std::make_shared<neighbor::host::HostAllocator>());
+
+    std::vector<unsigned int> Ns;
+    std::vector<float> rcuts;
+    unsigned int num_threads, num_samples, seed = 42;
+    std::vector<std::string> generators = synthetic_system_names();
+    std::string outf;
+    if (argc < 6 || argc > 8)
+        {
+        std::cout << "Usage: lbvh_host_benchmark <N> <rcut> <threads> <samples> <output> [generators] [seed]" << std::endl;
+        return 1;
+        }
+    else
+        {
+        for (const auto& n : split(argv[1])) Ns.push_back(std::stoul(n));
+        for (const auto& r : split(argv[2])) rcuts.push_back(std::stof(r));
+        num_threads = std::stoul(argv[3]);
+        num_samples = std::stoul(argv[4]);
+        outf = std::string(argv[5]);
+        if (argc > 6) generators = split(argv[6]);
+        if (argc > 7) seed = std::stoul(argv[7]);
+        }
+    if (num_samples == 0)
+        {
+        std::cerr << "**error** At least 1 sample is required." << std::endl;
+        return 1;
+        }
+
+    try
+        {
+        const float density = 0.85f;
+        std::cout << "Host LBVH benchmark with " << num_threads << " threads" << std::endl;
+
+        neighbor::host::ThreadPool pool(num_threads);
+        neighbor::host::HardwareCounters counters(pool);
+        if (!counters.isAvailable())
+            {
+            std::cout << "Hardware counters not available: " << counters.getError() << std::endl;
+            }
+
+        std::ofstream output;
+        output.open(outf.c_str());
+        output << "{\"benchmark\": \"lbvh_host_benchmark\", \"threads\": " << num_threads << ", \"samples\": "
+               << num_samples << ", \"seed\": " << seed << ", \"density\": " << density << "," << std::endl;
+        output << " \"results\": [";
+        bool first_result = true;
+
+        for (const auto& generator : generators)
+            {
+            for (const unsigned int N : Ns)
+                {
+                const SyntheticSystem sys = make_synthetic_system(generator, N, seed, density);
+                const neighbor::PointInsertOp insert(sys.points.get(), N);
+                const neighbor::shared_array<float3> images = sys.getImages();
+                const neighbor::ImageListOp<float3> translate(images.get(), images.size());
+
+                neighbor::LBVH lbvh;
+                neighbor::LBVHTraverser traverser;
+                neighbor::PhaseTimer timer;
+                lbvh.build(pool, insert, sys.lo, sys.hi);
+
+                // queries in Morton order
+                neighbor::shared_array<float4> spheres(N);
+                neighbor::shared_array<unsigned int> hits(N);
+                const neighbor::SphereQueryOp query(spheres.get(), N);
+                const neighbor::CountNeighborsOp count(hits.get());
+
+                for (const float rcut : rcuts)
+                    {
+                    if (rcut >= sys.getMaxCutoff())
+                        {
+                        std::cout << generator << ", N = " << N << ", rcut = " << rcut << ": skipped (box too small)" << std::endl;
+                        continue;
+                        }
+                    for (unsigned int i=0; i < N; ++i)
+                        {
+                        const unsigned int p = lbvh.getPrimitives()[i];
+                        const float3 r = sys.points[p];
+                        spheres[i] = make_float4(r.x, r.y, r.z, rcut*sys.diameters[p]);
+                        }
+
+                    std::vector<PhaseResult> phases = {{"build", {}, {}}, {"compress", {}, {}}, {"traverse", {}, {}}};
+                    for (unsigned int sample=0; sample < num_samples+2; ++sample)
+                        {
+                        lbvh.build(pool, insert, sys.lo, sys.hi, timer);
+                        const double build_time = timer.getTotalTime();
+                        traverser.setup(pool, lbvh, neighbor::NullTransformOp(), timer);
+                        const double compress_time = timer.getTotalTime();
+                        traverser.traverse(pool, lbvh, query, count, translate, neighbor::NullTransformOp(), timer);
+                        const double traverse_time = timer.getTotalTime();
+                        if (sample >= 2)
+                            {
+                            phases[0].samples.push_back(build_time);
+                            phases[1].samples.push_back(compress_time);
+                            phases[2].samples.push_back(traverse_time);
+                            }
+                        }
+                    // the primitive order is the same for every build, so the queries stay in Morton order
+
+                    if (counters.isAvailable())
+                        {
+                        lbvh.build(pool, insert, sys.lo, sys.hi, counters);
+                        phases[0].counters = counters.getTotal();
+                        traverser.setup(pool, lbvh, neighbor::NullTransformOp(), counters);
+                        phases[1].counters = counters.getTotal();
+                        traverser.traverse(pool, lbvh, query, count, translate, neighbor::NullTransformOp(), counters);
+                        phases[2].counters = counters.getTotal();
+                        }
+
+                    unsigned long long total_hits = 0;
+                    for (unsigned int i=0; i < N; ++i)
+                        {
+                        total_hits += hits[i];
+                        }
+                    const double neighbors = static_cast<double>(total_hits)/N - 1.;
+
+                    std::cout << generator << ", N = " << N << ", rcut = " << rcut << ": ";
+                    for (const auto& p : phases)
+                        {
+                        std::cout << p.name << " " << p.getMedian() << " ms, ";
+                        }
+                    std::cout << neighbors << " neighbors" << std::endl;
+
+                    output << (first_result ? "" : ",") << std::endl;
+                    output << "  {\"generator\": \"" << generator << "\", \"N\": " << N << ", \"rcut\": " << rcut
+                           << ", \"neighbors\": " << neighbors << ", \"phases\": {";
+                    for (unsigned int i=0; i < phases.size(); ++i)
+                        {
+                        const PhaseResult& p = phases[i];
+                        output << (i > 0 ? ", " : "") << "\"" << p.name << "\": {\"median\": "
+                               << std::setprecision(6) << p.getMedian() << ", \"samples\": [";
+                        for (unsigned int j=0; j < p.samples.size(); ++j)
+                            {
+                            output << (j > 0 ? ", " : "") << p.samples[j];
+                            }
+                        output << "]";
+                        if (counters.isAvailable())
+                            {
+                            output << ", \"cycles\": " << p.counters.cycles
+                                   << ", \"instructions\": " << p.counters.instructions
+                                   << ", \"cache_misses\": " << p.counters.cache_misses
+                                   << ", \"tlb_misses\": " << p.counters.tlb_misses;
+                            }
+                        output << "}";
+                        }
+                    output << "}}";
+                    first_result = false;
+                    }
+                }
+            }
+        output << std::endl << " ]}" << std::endl;
+        }
+    catch(const std::exception& e)
+        {
+        std::cerr << "**error** " << e.what() << std::endl;
+        return 1;
+        }
+    catch(...)
+        {
+        std::cerr << "**error** Program terminated due to exception." << std::endl;
+        return 1;
+        }
+
+    return 0;
+    }
@@ -0,0 +1,171 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#include "neighbor/neighbor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+
+//! Profile a function call
+/*!
+ * \param f Function to profile.
+ * \param samples Number of samples to take.
+ * \returns Average time per call to \a f in milliseconds.
+ */
+double profile(const std::function <void ()>& f, unsigned int samples)
+    {
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned int i=0; i < samples; ++i)
+        {
+        f();
+        }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    return std::chrono::duration<double,std::milli>(elapsed).count()/double(samples);
+    }
+
+//! Strong-scaling benchmark of the partitioned host LBVH build.
+/*!
+ * A fixed number of points is placed uniformly at random in a cube, and the host LBVH build
+ * is profiled for thread pools of increasing size (powers of 2 up to the maximum). Each build is
+ * warmed up for 5 calls before the median of 5 samples of 20 calls is taken. The speedup and parallel
+ * efficiency relative to 1 thread are written to an output tabulated file, together with the instructions per
+ * cycle and the last-level cache and data TLB misses per point of one build from host::HardwareCounters. The counts
+ * of each phase of the build are printed. If the counters are not available, the reason is written to the file
+ * and the counts are nan.
+ *
+ * The command line parameters are:
+ *
+ *      ./lbvh_host_build_benchmark <N> <max_threads> <output>
+ *
+ * - <N>: Number of points.
+ * - <max_threads>: Maximum number of threads.
+ * - <output>: Name of tabulated file with output.
+ */
+int main(int argc, char * argv[])
+    {
+    unsigned int N, max_threads;
+    std::string outf;
+    if (argc != 4)
+        {
+        std::cout << "Usage: lbvh_host_build_benchmark <N> <max_threads> <output>" << std::endl;
+        return 1;
+        }
+    else
+        {
+        N = std::stoul(argv[1]);
+        max_threads = std::stoul(argv[2]);
+        outf = std::string(argv[3]);
+        }
+
+    try
+        {
+        std::cout << "Host LBVH build benchmark for N = " << N << std::endl;
+
+        const float3 lo = make_float3(0.f, 0.f, 0.f);
+        const float3 hi = make_float3(100.f, 100.f, 100.f);
+        neighbor::shared_array<float3> points(N);
+            {
+            std::mt19937 mt(42);
+            std::uniform_real_distribution<float> U(0.f, 100.f);
+            for (unsigned int i=0; i < N; ++i)
+                {
+                points[i] = make_float3(U(mt), U(mt), U(mt));
+                }
+            }
+        neighbor::PointInsertOp insert(points.get(), N);
+
+        std::vector<unsigned int> threads;
+        for (unsigned int t=1; t < max_threads; t *= 2)
+            {
+            threads.push_back(t);
+            }
+        threads.push_back(max_threads);
+
+        std::ofstream output;
+        output.open(outf.c_str());
+        output << "# Host LBVH build benchmark for N = " << N << std::endl;
+            {
+            const neighbor::host::HardwareCounters probe;
+            if (!probe.isAvailable())
+                {
+                std::cout << "Hardware counters not available: " << probe.getError() << std::endl;
+                output << "# Hardware counters not available: " << probe.getError() << std::endl;
+                }
+            }
+        output << "#" << std::endl;
+        output << "# " << std::setw(6) << "threads" << std::setw(16) << "build (ms)" << std::setw(16) << "speedup"
+               << std::setw(16) << "efficiency" << std::setw(16) << "IPC" << std::setw(16) << "LLC miss / pt"
+               << std::setw(16) << "TLB miss / pt" << std::endl;
+
+        double serial_time = 0.;
+        for (const unsigned int num_threads : threads)
+            {
+            neighbor::host::ThreadPool pool(num_threads);
+            neighbor::LBVH lbvh;
+
+            for (unsigned int i=0; i < 5; ++i)
+                {
+                lbvh.build(pool, insert, lo, hi);
+                }
+
+            std::vector<double> times(5);
+            for (size_t i=0; i < times.size(); ++i)
+                {
+                times[i] = profile([&]{lbvh.build(pool, insert, lo, hi);}, 20);
+                }
+            std::sort(times.begin(), times.end());
+            const double time = times[times.size()/2];
+            if (num_threads == 1) serial_time = time;
+
+            const double speedup = serial_time/time;
+            const double efficiency = speedup/num_threads;
+            // hardware counters of one build
+            neighbor::host::HardwareCounters counters(pool);
+            lbvh.build(pool, insert, lo, hi, counters);
+            const neighbor::host::PhaseCounters total = counters.getTotal();
+            double ipc = NAN, cache_misses = NAN, tlb_misses = NAN;
+            if (counters.isAvailable())
+                {
+                ipc = total.getIPC();
+                if (counters.isSupported(neighbor::host::HardwareCounters::Event::CacheMisses))
+                    cache_misses = static_cast<double>(total.cache_misses)/N;
+                if (counters.isSupported(neighbor::host::HardwareCounters::Event::TLBMisses))
+                    tlb_misses = static_cast<double>(total.tlb_misses)/N;
+                }
+
+            std::cout << num_threads << " threads: " << time << " ms / build, speedup " << speedup << std::endl;
+            if (counters.isAvailable())
+                {
+                for (const auto& p : counters.getPhases())
+                    {
+                    std::cout << "    " << p.name << ": " << p.time << " ms, IPC " << p.getIPC() << ", "
+                              << p.cache_misses << " LLC misses, " << p.tlb_misses << " TLB misses" << std::endl;
+                    }
+                }
+            output << std::setw(8) << num_threads
+                   << " " << std::setw(16) << std::fixed << std::setprecision(5) << time
+                   << " " << std::setw(16) << std::fixed << std::setprecision(5) << speedup
+                   << " " << std::setw(16) << std::fixed << std::setprecision(5) << efficiency
+                   << " " << std::setw(16) << std::fixed << std::setprecision(5) << ipc
+                   << " " << std::setw(16) << std::fixed << std::setprecision(5) << cache_misses
+                   << " " << std::setw(16) << std::fixed << std::setprecision(5) << tlb_misses << std::endl;
+            }
+        }
+    catch(...)
+        {
+        std::cerr << "**error** Program terminated due to exception." << std::endl;
+        return 1;
+        }
+
+    return 0;
+    }
@@ -0,0 +1,543 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#include "neighbor/neighbor.h"
+#include "synthetic_systems.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+//! Split a comma-separated list.
+std::vector<std::string> split(const std::string& list)
+    {
+    std::vector<std::string> items;
+    std::stringstream s(list);
+    std::string item;
+    while (std::getline(s, item, ','))
+        {
+        if (!item.empty()) items.push_back(item);
+        }
+    return items;
+    }
+
+//! Get the median of samples.
+double median(std::vector<double> samples)
+    {
+    std::sort(samples.begin(), samples.end());
+    const size_t n = samples.size();
+    return (n % 2 == 1) ? samples[n/2] : 0.5*(samples[n/2-1] + samples[n/2]);
+    }
+
+//! Logical CPU available to the benchmark.
+struct CPU
+    {
+    int id;         //!< Index of the CPU
+    int package;    //!< Physical package (socket)
+    int core;       //!< Core in the package
+    int node;       //!< NUMA node
+    };
+
+//! Read an integer from a sysfs file.
+int read_sysfs(const std::string& file, int fallback)
+    {
+    std::ifstream in(file.c_str());
+    int value;
+    return (in >> value) ? value : fallback;
+    }
+
+//! Get the CPUs the process may run on.
+/*!
+ * \returns The CPUs in the affinity mask of the process, with their package, core, and NUMA node from sysfs.
+ *
+ * A CPU without topology in sysfs is its own core in package 0 and node 0.
+ */
+std::vector<CPU> read_topology()
+    {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    sched_getaffinity(0, sizeof(mask), &mask);
+
+    std::vector<CPU> cpus;
+    for (int id=0; id < CPU_SETSIZE; ++id)
+        {
+        if (!CPU_ISSET(id, &mask)) continue;
+
+        const std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(id);
+        CPU cpu;
+        cpu.id = id;
+        cpu.package = read_sysfs(dir + "/topology/physical_package_id", 0);
+        cpu.core = read_sysfs(dir + "/topology/core_id", id);
+        cpu.node = 0;
+        if (DIR* d = opendir(dir.c_str()))
+            {
+            while (dirent* entry = readdir(d))
+                {
+                const std::string name(entry->d_name);
+                if (name.size() > 4 && name.compare(0, 4, "node") == 0
+                    && name.find_first_not_of("0123456789", 4) == std::string::npos)
+                    {
+                    cpu.node = std::stoi(name.substr(4));
+                    }
+                }
+            closedir(d);
+            }
+        cpus.push_back(cpu);
+        }
+    return cpus;
+    }
+
+//! Order CPUs for a pinning layout.
+/*!
+ * \param cpus Available CPUs.
+ * \param layout Name of the layout.
+ *
+ * \returns The CPU of each thread, or no CPUs if the threads are not pinned.
+ *
+ * The layouts are:
+ *
+ * - none: the threads are not pinned.
+ * - compact: the threads fill the cores of one package, including their hardware threads, before the next.
+ * - scatter: the threads alternate between the packages, using every core before its other hardware threads.
+ * - socket: the threads are compact in the first package only.
+ */
+std::vector<CPU> make_layout(std::vector<CPU> cpus, const std::string& layout)
+    {
+    std::sort(cpus.begin(), cpus.end(), [](const CPU& a, const CPU& b)
+        {
+        return std::make_tuple(a.package, a.core, a.id) < std::make_tuple(b.package, b.core, b.id);
+        });
+
+    if (layout == "none")
+        {
+        return std::vector<CPU>();
+        }
+    else if (layout == "compact")
+        {
+        return cpus;
+        }
+    else if (layout == "socket")
+        {
+        std::vector<CPU> result;
+        for (const auto& cpu : cpus)
+            {
+            if (cpu.package == cpus.front().package) result.push_back(cpu);
+            }
+        return result;
+        }
+    else if (layout == "scatter")
+        {
+        // rank of each hardware thread in its core, then one list per package ordered by rank and core
+        std::map<int, std::vector<std::pair<int,CPU>>> packages;
+        for (unsigned int i=0; i < cpus.size(); ++i)
+            {
+            int rank = 0;
+            while (rank < static_cast<int>(i) && cpus[i-rank-1].package == cpus[i].package
+                   && cpus[i-rank-1].core == cpus[i].core) ++rank;
+            packages[cpus[i].package].push_back(std::make_pair(rank, cpus[i]));
+            }
+        for (auto& p : packages)
+            {
+            std::stable_sort(p.second.begin(), p.second.end(), [](const std::pair<int,CPU>& a, const std::pair<int,CPU>& b)
+                {
+                return a.first < b.first;
+                });
+            }
+
+        std::vector<CPU> result;
+        for (unsigned int i=0; result.size() < cpus.size(); ++i)
+            {
+            for (const auto& p : packages)
+                {
+                if (i < p.second.size()) result.push_back(p.second[i].second);
+                }
+            }
+        return result;
+        }
+    else
+        {
+        throw std::runtime_error("Unknown pinning layout " + layout + ".");
+        }
+    }
+
+//! Pin the threads of a pool.
+/*!
+ * \param pool Thread pool.
+ * \param layout CPU of each thread, or empty to allow each thread to run on any CPU in \a original.
+ * \param original Affinity mask of the process.
+ */
+void pin(neighbor::host::ThreadPool& pool, const std::vector<CPU>& layout, const cpu_set_t& original)
+    {
+    pool.run([&](unsigned int thread)
+        {
+        cpu_set_t mask = original;
+        if (!layout.empty())
+            {
+            CPU_ZERO(&mask);
+            CPU_SET(layout[thread].id, &mask);
+            }
+        if (pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) != 0)
+            {
+            throw std::runtime_error("Could not pin thread " + std::to_string(thread) + ".");
+            }
+        });
+    }
+
+//! Measure the bandwidth of a triad.
+/*!
+ * \param pool Thread pool.
+ * \param parallel If true, each thread first touches its own part of the arrays.
+ * \param samples Number of samples.
+ *
+ * \returns The best bandwidth of a[i] = b[i] + s*c[i] in GB/s.
+ *
+ * The arrays are 64 MB each so they do not fit in cache. Each thread touches the same part of the arrays in every
+ * sample. When \a parallel is true, the pages are placed on the node of the thread that uses them. Otherwise, the
+ * calling thread touches all the pages first, so they are placed on its node and threads on other nodes access
+ * remote memory.
+ */
+double triad_bandwidth(neighbor::host::ThreadPool& pool, bool parallel, unsigned int samples)
+    {
+    const unsigned int n = 1u << 23;
+    double* a = static_cast<double*>(std::malloc(n*sizeof(double)));
+    double* b = static_cast<double*>(std::malloc(n*sizeof(double)));
+    double* c = static_cast<double*>(std::malloc(n*sizeof(double)));
+    if (!a || !b || !c)
+        {
+        std::free(a); std::free(b); std::free(c);
+        throw std::runtime_error("Could not allocate triad arrays.");
+        }
+
+    auto touch = [&](unsigned int first, unsigned int last)
+        {
+        for (unsigned int i=first; i < last; ++i)
+            {
+            a[i] = 0.; b[i] = 1.; c[i] = 2.;
+            }
+        };
+    if (parallel)
+        {
+        pool.run([&](unsigned int thread)
+            {
+            const auto range = pool.getRange(thread, 0, n);
+            touch(range.first, range.second);
+            });
+        }
+    else
+        {
+        touch(0, n);
+        }
+
+    double best = 0.;
+    for (unsigned int sample=0; sample < samples+1; ++sample)
+        {
+        const auto start = std::chrono::steady_clock::now();
+        pool.run([&](unsigned int thread)
+            {
+            const auto range = pool.getRange(thread, 0, n);
+            for (unsigned int i=range.first; i < range.second; ++i)
+                {
+                a[i] = b[i] + 3.*c[i];
+                }
+            });
+        const double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (sample > 0) best = std::max(best, 3.*sizeof(double)*n/t*1.e-9);
+        }
+    std::free(a); std::free(b); std::free(c);
+    return best;
+    }
+
+//! Timing of one phase over the samples.
+struct PhaseResult
+    {
+    std::string name;               //!< Name of the phase
+    std::vector<double> samples;    //!< Time of each sample in milliseconds
+    unsigned long long bytes;       //!< Minimum number of bytes read and written
+    double efficiency;              //!< Parallel efficiency
+    };
+
+//! Result of one configuration.
+struct Result
+    {
+    std::string mode;               //!< Scaling mode
+    std::string layout;             //!< Pinning layout
+    unsigned int threads;           //!< Number of threads
+    unsigned int N;                 //!< Number of particles
+    unsigned int packages;          //!< Number of packages used by the threads
+    unsigned int nodes;             //!< Number of NUMA nodes used by the threads
+    std::vector<PhaseResult> phases;//!< Build, compression, and traversal
+    double local_bandwidth;         //!< Triad bandwidth with local first touch (GB/s)
+    double master_bandwidth;        //!< Triad bandwidth with first touch by thread 0 (GB/s)
+    };
+
+//! Thread-scaling benchmark of the host LBVH engine.
+/*!
+ * The host build, compression, and traversal of an LBVH are timed for each number of threads and pinning layout
+ * (see make_layout) with neighbor::PhaseTimer after 2 warmup calls. The system is a synthetic system (see
+ * synthetic_system_names) at number density 0.85, and each particle is queried with a sphere of the cutoff times its
+ * diameter, in Morton order. The scaling modes are:
+ *
+ * - strong: the number of particles is fixed.
+ * - weak: the number of particles per thread is fixed.
+ *
+ * The parallel efficiency of a phase is relative to the smallest number of threads p0 with the same mode and
+ * layout: p0*T(p0)/(p*T(p)) for strong scaling and T(p0)/T(p) for weak scaling. The bandwidth of a phase is the
+ * minimum number of bytes it reads and writes (PhaseTiming::bytes) divided by its median time, so it is a lower
+ * bound on the bandwidth achieved.
+ *
+ * The NUMA effects of each configuration are measured with a triad of arrays larger than the caches. The pages
+ * of the arrays are either first touched by the thread that uses them (local) or all by thread 0 (master), which
+ * places them on the node of thread 0 like the particles generated by the calling thread. The ratio of the local to
+ * the master bandwidth is the penalty of remote accesses. The number of packages and nodes used by the pinned
+ * threads is reported with each configuration. Configurations with more threads than CPUs in the layout are skipped.
+ *
+ * The command line parameters are:
+ *
+ *      ./lbvh_scaling_benchmark <mode> <N> <threads> <layouts> <samples> <output> [generator] [rcut]
+ *
+ * - <mode>: strong, weak, or both.
+ * - <N>: Number of particles (strong scaling) or particles per thread (weak scaling).
+ * - <threads>: Comma-separated numbers of threads.
+ * - <layouts>: Comma-separated pinning layouts (none, compact, scatter, socket).
+ * - <samples>: Number of samples of each phase.
+ * - <output>: Name of JSON file with output.
+ * - [generator]: Synthetic system (default: liquid).
+ * - [rcut]: Cutoff (default: 1.5).
+ */
+int main(int argc, char * argv[])
+    {
+    // the pools only touch host memory, which the default managed allocator would need a GPU for
+    neighbor::Allocator::setDefault(std::make_shared<neighbor::host::HostAllocator>());
+
+    std::vector<std::string> modes, layouts;
+    std::vector<unsigned int> thread_counts;
+    unsigned int N, num_samples;
+    std::string outf, generator = "liquid";
+    float rcut = 1.5f;
+    if (argc < 7 || argc > 9)
+        {
+        std::cout << "Usage: lbvh_scaling_benchmark <mode> <N> <threads> <layouts> <samples> <output> [generator] [rcut]" << std::endl;
+        return 1;
+        }
+    else
+        {
+        const std::string mode(argv[1]);
+        if (mode == "both")
+            modes = {"strong", "weak"};
+        else
+            modes = {mode};
+        N = std::stoul(argv[2]);
+        for (const auto& t : split(argv[3])) thread_counts.push_back(std::stoul(t));
+        layouts = split(argv[4]);
+        num_samples = std::stoul(argv[5]);
+        outf = std::string(argv[6]);
+        if (argc > 7) generator = std::string(argv[7]);
+        if (argc > 8) rcut = std::stof(argv[8]);
+        }
+    for (const auto& mode : modes)
+        {
+        if (mode != "strong" && mode != "weak")
+            {
+            std::cerr << "**error** Unknown scaling mode " << mode << "." << std::endl;
+            return 1;
+            }
+        }
+    if (num_samples == 0 || N == 0 || thread_counts.empty() || std::count(thread_counts.begin(), thread_counts.end(), 0u) > 0)
+        {
+        std::cerr << "**error** At least 1 sample, particle, and thread are required." << std::endl;
+        return 1;
+        }
+    std::sort(thread_counts.begin(), thread_counts.end());
+
+    try
+        {
+        const unsigned int seed = 42;
+        const float density = 0.85f;
+
+        cpu_set_t original;
+        CPU_ZERO(&original);
+        sched_getaffinity(0, sizeof(original), &original);
+        const std::vector<CPU> cpus = read_topology();
+        std::set<int> all_packages, all_nodes;
+        for (const auto& cpu : cpus)
+            {
+            all_packages.insert(cpu.package);
+            all_nodes.insert(cpu.node);
+            }
+        std::cout << "LBVH scaling benchmark on " << cpus.size() << " CPUs in " << all_packages.size() << " packages and "
+                  << all_nodes.size() << " NUMA nodes" << std::endl;
+
+        std::vector<Result> results;
+        for (const auto& mode : modes)
+            for (const unsigned int threads : thread_counts)
+                {
+                const unsigned int num_particles = (mode == "strong") ? N : N*threads;
+                const SyntheticSystem sys = make_synthetic_system(generator, num_particles, seed, density);
+                if (rcut >= sys.getMaxCutoff())
+                    {
+                    std::cout << mode << ", " << threads << " threads: skipped (box too small)" << std::endl;
+                    continue;
+                    }
+                const neighbor::PointInsertOp insert(sys.points.get(), num_particles);
+                const neighbor::shared_array<float3> images = sys.getImages();
+                const neighbor::ImageListOp<float3> translate(images.get(), images.size());
+
+                for (const auto& layout_name : layouts)
+                    {
+                    const std::vector<CPU> layout = make_layout(cpus, layout_name);
+                    if (layout_name != "none" && layout.size() < threads)
+                        {
+                        std::cout << mode << ", " << layout_name << ", " << threads << " threads: skipped (only "
+                                  << layout.size() << " CPUs)" << std::endl;
+                        continue;
+                        }
+
+                    neighbor::host::ThreadPool pool(threads);
+                    pin(pool, layout, original);
+
+                    Result r;
+                    r.mode = mode;
+                    r.layout = layout_name;
+                    r.threads = threads;
+                    r.N = num_particles;
+                    std::set<int> packages, nodes;
+                    for (unsigned int t=0; t < layout.size() && t < threads; ++t)
+                        {
+                        packages.insert(layout[t].package);
+                        nodes.insert(layout[t].node);
+                        }
+                    r.packages = layout.empty() ? all_packages.size() : packages.size();
+                    r.nodes = layout.empty() ? all_nodes.size() : nodes.size();
+
+                    neighbor::LBVH lbvh;
+                    neighbor::LBVHTraverser traverser;
+                    neighbor::PhaseTimer timer;
+                    lbvh.build(pool, insert, sys.lo, sys.hi);
+
+                    // queries in Morton order
+                    neighbor::shared_array<float4> spheres(num_particles);
+                    neighbor::shared_array<unsigned int> hits(num_particles);
+                    for (unsigned int i=0; i < num_particles; ++i)
+                        {
+                        const unsigned int p = lbvh.getPrimitives()[i];
+                        const float3 x = sys.points[p];
+                        spheres[i] = make_float4(x.x, x.y, x.z, rcut*sys.diameters[p]);
+                        }
+                    const neighbor::SphereQueryOp query(spheres.get(), num_particles);
+                    const neighbor::CountNeighborsOp count(hits.get());
+
+                    r.phases = {{"build", {}, 0, NAN}, {"compress", {}, 0, NAN}, {"traverse", {}, 0, NAN}};
+                    auto record = [&](PhaseResult& phase, bool keep)
+                        {
+                        unsigned long long bytes = 0;
+                        for (const auto& p : timer.getPhases())
+                            {
+                            bytes += p.bytes;
+                            }
+                        if (keep) phase.samples.push_back(timer.getTotalTime());
+                        phase.bytes = bytes;
+                        };
+                    for (unsigned int sample=0; sample < num_samples+2; ++sample)
+                        {
+                        lbvh.build(pool, insert, sys.lo, sys.hi, timer);
+                        record(r.phases[0], sample >= 2);
+                        traverser.setup(pool, lbvh, neighbor::NullTransformOp(), timer);
+                        record(r.phases[1], sample >= 2);
+                        traverser.traverse(pool, lbvh, query, count, translate, neighbor::NullTransformOp(), timer);
+                        record(r.phases[2], sample >= 2);
+                        }
+
+                    r.local_bandwidth = triad_bandwidth(pool, true, num_samples);
+                    r.master_bandwidth = triad_bandwidth(pool, false, num_samples);
+
+                    std::cout << mode << ", " << layout_name << ", " << threads << " threads, N = " << num_particles << ": ";
+                    for (const auto& p : r.phases)
+                        {
+                        std::cout << p.name << " " << median(p.samples) << " ms, ";
+                        }
+                    std::cout << "triad " << r.local_bandwidth << " GB/s local, " << r.master_bandwidth << " GB/s master"
+                              << std::endl;
+                    results.push_back(r);
+
+                    // unpin the calling thread
+                    pthread_setaffinity_np(pthread_self(), sizeof(original), &original);
+                    }
+                }
+
+        // efficiency relative to the fewest threads of the same mode and layout
+        for (auto& r : results)
+            {
+            const Result* ref = nullptr;
+            for (const auto& s : results)
+                {
+                if (s.mode == r.mode && s.layout == r.layout && (!ref || s.threads < ref->threads)) ref = &s;
+                }
+            for (unsigned int i=0; i < r.phases.size(); ++i)
+                {
+                const double t0 = median(ref->phases[i].samples);
+                const double t = median(r.phases[i].samples);
+                r.phases[i].efficiency = (r.mode == "strong") ? (ref->threads*t0)/(r.threads*t) : t0/t;
+                }
+            }
+
+        std::ofstream output;
+        output.open(outf.c_str());
+        output << "{\"benchmark\": \"lbvh_scaling_benchmark\", \"generator\": \"" << generator << "\", \"rcut\": " << rcut
+               << ", \"samples\": " << num_samples << ", \"seed\": " << seed << ", \"density\": " << density
+               << ", \"cpus\": " << cpus.size() << ", \"packages\": " << all_packages.size() << ", \"nodes\": "
+               << all_nodes.size() << "," << std::endl;
+        output << " \"results\": [";
+        for (unsigned int i=0; i < results.size(); ++i)
+            {
+            const Result& r = results[i];
+            output << (i > 0 ? "," : "") << std::endl;
+            output << "  {\"mode\": \"" << r.mode << "\", \"layout\": \"" << r.layout << "\", \"threads\": " << r.threads
+                   << ", \"N\": " << r.N << ", \"packages\": " << r.packages << ", \"nodes\": " << r.nodes
+                   << ", \"triad\": {\"local\": " << r.local_bandwidth << ", \"master\": " << r.master_bandwidth
+                   << ", \"remote_penalty\": " << r.local_bandwidth/r.master_bandwidth << "}, \"phases\": {";
+            for (unsigned int j=0; j < r.phases.size(); ++j)
+                {
+                const PhaseResult& p = r.phases[j];
+                const double t = median(p.samples);
+                output << (j > 0 ? ", " : "") << "\"" << p.name << "\": {\"median\": " << std::setprecision(6) << t
+                       << ", \"efficiency\": " << p.efficiency << ", \"bytes\": " << p.bytes << ", \"bandwidth\": "
+                       << p.bytes/t*1.e-6 << ", \"samples\": [";
+                for (unsigned int k=0; k < p.samples.size(); ++k)
+                    {
+                    output << (k > 0 ? ", " : "") << p.samples[k];
+                    }
+                output << "]}";
+                }
+            output << "}}";
+            }
+        output << std::endl << " ]}" << std::endl;
+        }
+    catch(const std::exception& e)
+        {
+        std::cerr << "**error** " << e.what() << std::endl;
+        return 1;
+        }
+    catch(...)
+        {
+        std::cerr << "**error** Program terminated due to exception." << std::endl;
+        return 1;
+        }
+
+    return 0;
+    }
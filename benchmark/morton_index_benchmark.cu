@@ -0,0 +1,153 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#include "neighbor/neighbor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+
+//! Profile a function call
+/*!
+ * \param f Function to profile.
+ * \param samples Number of samples to take.
+ * \returns Average time per call to \a f in milliseconds.
+ */
+double profile(const std::function <void ()>& f, unsigned int samples)
+    {
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned int i=0; i < samples; ++i)
+        {
+        f();
+        }
+    hipper::deviceSynchronize();
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    return std::chrono::duration<double,std::milli>(elapsed).count()/double(samples);
+    }
+
+//! Median time of a function call
+/*!
+ * \param f Function to profile.
+ * \returns Median of 5 samples of 10 calls after warming up.
+ */
+double median(const std::function <void ()>& f)
+    {
+    profile(f, 5);
+    std::vector<double> times(5);
+    for (size_t i=0; i < times.size(); ++i)
+        {
+        times[i] = profile(f, 10);
+        }
+    std::sort(times.begin(), times.end());
+    return times[times.size()/2];
+    }
+
+//! Benchmark of the sorted-codes index against an LBVH with few queries per build.
+/*!
+ * Points are placed uniformly at random in a cube at unit density, and a number of cubic box
+ * queries are placed at random points. For each number of queries (powers of 10 up to N), the time
+ * to build a MortonIndex and query it is compared to the time to build an LBVH and traverse it.
+ * The times include the build, since the index is intended to be rebuilt for every few queries.
+ *
+ * The command line parameters are:
+ *
+ *      ./morton_index_benchmark <N> <box> <output>
+ *
+ * - <N>: Number of points.
+ * - <box>: Edge length of the query boxes.
+ * - <output>: Name of tabulated file with output.
+ */
+int main(int argc, char * argv[])
+    {
+    unsigned int N;
+    float box;
+    std::string outf;
+    if (argc != 4)
+        {
+        std::cout << "Usage: morton_index_benchmark <N> <box> <output>" << std::endl;
+        return 1;
+        }
+    else
+        {
+        N = std::stoul(argv[1]);
+        box = std::stof(argv[2]);
+        outf = std::string(argv[3]);
+        }
+
+    try
+        {
+        std::cout << "Morton index benchmark for N = " << N << std::endl;
+
+        const float L = std::cbrt(static_cast<float>(N));
+        const float3 lo = make_float3(0.f, 0.f, 0.f);
+        const float3 hi = make_float3(L, L, L);
+        neighbor::shared_array<float3> points(N);
+        neighbor::shared_array<float3> qlo(N), qhi(N);
+            {
+            std::mt19937 mt(42);
+            std::uniform_real_distribution<float> U(0.f, L);
+            for (unsigned int i=0; i < N; ++i)
+                {
+                points[i] = make_float3(U(mt), U(mt), U(mt));
+                }
+            for (unsigned int i=0; i < N; ++i)
+                {
+                qlo[i] = make_float3(U(mt), U(mt), U(mt));
+                qhi[i] = make_float3(qlo[i].x + box, qlo[i].y + box, qlo[i].z + box);
+                }
+            }
+        const neighbor::PointInsertOp insert(points.get(), N);
+        neighbor::shared_array<unsigned int> hits(N);
+
+        std::ofstream output;
+        output.open(outf.c_str());
+        output << "# Morton index benchmark for N = " << N << ", box = " << box << std::endl;
+        output << "#" << std::endl;
+        output << "# " << std::setw(14) << "queries" << std::setw(16) << "index (ms)" << std::setw(16) << "lbvh (ms)"
+               << std::setw(16) << "speedup" << std::endl;
+
+        neighbor::MortonIndex index;
+        neighbor::LBVH lbvh;
+        neighbor::LBVHTraverser traverser;
+        for (unsigned int num_queries=1; num_queries <= N; num_queries *= 10)
+            {
+            const neighbor::BoxQueryOp query(qlo.get(), qhi.get(), num_queries);
+            const neighbor::CountNeighborsOp count(hits.get());
+
+            const double index_time = median([&]
+                {
+                index.build(insert, lo, hi);
+                index.query(query, count);
+                });
+            const double lbvh_time = median([&]
+                {
+                lbvh.build(insert, lo, hi);
+                traverser.traverse(lbvh, query, count);
+                });
+
+            const double speedup = lbvh_time/index_time;
+            std::cout << num_queries << " queries: index " << index_time << " ms, lbvh " << lbvh_time
+                      << " ms, speedup " << speedup << std::endl;
+            output << std::setw(16) << num_queries
+                   << " " << std::setw(16) << std::fixed << std::setprecision(5) << index_time
+                   << " " << std::setw(16) << std::fixed << std::setprecision(5) << lbvh_time
+                   << " " << std::setw(16) << std::fixed << std::setprecision(5) << speedup << std::endl;
+            }
+        }
+    catch(...)
+        {
+        std::cerr << "**error** Program terminated due to exception." << std::endl;
+        return 1;
+        }
+
+    return 0;
+    }
@@ -0,0 +1,228 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#ifndef NEIGHBOR_BENCHMARK_SYNTHETIC_SYSTEMS_H_
+#define NEIGHBOR_BENCHMARK_SYNTHETIC_SYSTEMS_H_
+
+#include "neighbor/neighbor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//! Synthetic particle configuration for benchmarks.
+/*!
+ * The particles are in the box [lo,hi), which is periodic along the directions in periodic. Each particle has a
+ * diameter, which is 1 except in polydisperse systems, and a query around a particle uses a cutoff scaled by
+ * its diameter.
+ */
+struct SyntheticSystem
+    {
+    std::string name;                           //!< Name of the generator
+    unsigned int N;                             //!< Number of particles
+    neighbor::shared_array<float3> points;      //!< Particle positions
+    neighbor::shared_array<float> diameters;    //!< Particle diameters
+    float3 lo;                                  //!< Lower bound of the box
+    float3 hi;                                  //!< Upper bound of the box
+    bool periodic[3];                           //!< Periodic directions
+
+    //! Get the number density of the particles in the box.
+    double getDensity() const
+        {
+        return N/(static_cast<double>(hi.x-lo.x)*(hi.y-lo.y)*(hi.z-lo.z));
+        }
+
+    //! Get the periodic images within one box length.
+    /*!
+     * \returns The translation vectors of the images in the periodic directions, including the zero vector first.
+     */
+    neighbor::shared_array<float3> getImages() const
+        {
+        const float3 L = make_float3(hi.x-lo.x, hi.y-lo.y, hi.z-lo.z);
+        std::vector<float3> images(1, make_float3(0.f, 0.f, 0.f));
+        for (int ix=-1; ix <= 1; ++ix)
+            for (int iy=-1; iy <= 1; ++iy)
+                for (int iz=-1; iz <= 1; ++iz)
+                    {
+                    if ((ix == 0 && iy == 0 && iz == 0) || (ix != 0 && !periodic[0]) || (iy != 0 && !periodic[1])
+                        || (iz != 0 && !periodic[2])) continue;
+                    images.push_back(make_float3(L.x*ix, L.y*iy, L.z*iz));
+                    }
+        neighbor::shared_array<float3> result(images.size());
+        std::copy(images.begin(), images.end(), result.get());
+        return result;
+        }
+
+    //! Get the largest cutoff that only needs the images within one box length.
+    /*!
+     * \returns Half the shortest periodic length divided by the largest diameter.
+     */
+    float getMaxCutoff() const
+        {
+        const float L[3] = {hi.x-lo.x, hi.y-lo.y, hi.z-lo.z};
+        float max_length = INFINITY;
+        for (unsigned int d=0; d < 3; ++d)
+            {
+            if (periodic[d]) max_length = std::min(max_length, 0.5f*L[d]);
+            }
+        const float max_diameter = (N > 0) ? *std::max_element(diameters.get(), diameters.get()+N) : 1.f;
+        return max_length/max_diameter;
+        }
+    };
+
+//! Get the names of the synthetic system generators.
+/*!
+ * \returns The names, in the order they are benchmarked.
+ *
+ * The generators are:
+ *
+ * - liquid: uniform random positions in a periodic cube, like a dense liquid.
+ * - fcc: a face-centered cubic crystal in a periodic cube with random vacancies and small displacements.
+ * - gel: strands of bonded particles on random walks through a periodic cube, leaving large voids.
+ * - slab: uniform random positions in a thin film that is periodic along x and y, 5 diameters thick.
+ * - polydisperse: uniform random positions in a periodic cube with log-normal diameters of mean 1.
+ */
+inline const std::vector<std::string>& synthetic_system_names()
+    {
+    static const std::vector<std::string> names = {"liquid", "fcc", "gel", "slab", "polydisperse"};
+    return names;
+    }
+
+//! Generate a synthetic system.
+/*!
+ * \param name Name of the generator (see synthetic_system_names).
+ * \param N Number of particles.
+ * \param seed Seed of the random number generator.
+ * \param density Number density of the particles.
+ *
+ * \returns The system.
+ *
+ * The same seed gives the same system with the same standard library. The wrapping of periodic positions
+ * keeps them in [lo,hi).
+ */
+inline SyntheticSystem make_synthetic_system(const std::string& name, unsigned int N, unsigned int seed, float density = 0.85f)
+    {
+    if (N == 0)
+        {
+        throw std::runtime_error("Synthetic system must have at least 1 particle.");
+        }
+    if (!(density > 0.f))
+        {
+        throw std::runtime_error("Synthetic system density must be positive.");
+        }
+
+    SyntheticSystem sys;
+    sys.name = name;
+    sys.N = N;
+    sys.points = neighbor::shared_array<float3>(N);
+    sys.diameters = neighbor::shared_array<float>(N);
+    std::fill(sys.diameters.get(), sys.diameters.get()+N, 1.f);
+    sys.lo = make_float3(0.f, 0.f, 0.f);
+    sys.periodic[0] = sys.periodic[1] = sys.periodic[2] = true;
+
+    std::mt19937 mt(seed);
+    std::uniform_real_distribution<float> U(0.f, 1.f);
+    auto wrap = [](float x, float L)
+        {
+        x -= L*std::floor(x/L);
+        return (x < L) ? x : 0.f;
+        };
+
+    if (name == "liquid" || name == "polydisperse")
+        {
+        const float L = std::cbrt(N/density);
+        sys.hi = make_float3(L, L, L);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            sys.points[i] = make_float3(L*U(mt), L*U(mt), L*U(mt));
+            }
+        if (name == "polydisperse")
+            {
+            const float sigma = 0.25f;
+            std::lognormal_distribution<float> D(-0.5f*sigma*sigma, sigma);
+            for (unsigned int i=0; i < N; ++i)
+                {
+                sys.diameters[i] = D(mt);
+                }
+            }
+        }
+    else if (name == "fcc")
+        {
+        // smallest cubic crystal holding N particles, with the lattice constant of the density
+        unsigned int m = static_cast<unsigned int>(std::ceil(std::cbrt(N/4.)));
+        while (4*m*m*m < N) ++m;
+        const float a = std::cbrt(4.f/density);
+        const float L = m*a;
+        sys.hi = make_float3(L, L, L);
+
+        std::vector<unsigned int> sites(4*m*m*m);
+        std::iota(sites.begin(), sites.end(), 0);
+        std::shuffle(sites.begin(), sites.end(), mt);
+        std::normal_distribution<float> G(0.f, 0.02f*a);
+        const float3 basis[4] = {make_float3(0.f, 0.f, 0.f),
+                                 make_float3(0.5f, 0.5f, 0.f),
+                                 make_float3(0.5f, 0.f, 0.5f),
+                                 make_float3(0.f, 0.5f, 0.5f)};
+        for (unsigned int i=0; i < N; ++i)
+            {
+            const unsigned int cell = sites[i]/4;
+            const float3 b = basis[sites[i] % 4];
+            const float x = a*(cell % m + b.x) + G(mt);
+            const float y = a*((cell/m) % m + b.y) + G(mt);
+            const float z = a*(cell/(m*m) + b.z) + G(mt);
+            sys.points[i] = make_float3(wrap(x,L), wrap(y,L), wrap(z,L));
+            }
+        }
+    else if (name == "gel")
+        {
+        const float L = std::cbrt(N/density);
+        sys.hi = make_float3(L, L, L);
+
+        // persistent random walks of unit bonds, 50 particles per strand
+        const unsigned int strand = 50;
+        std::normal_distribution<float> G(0.f, 1.f);
+        float3 r = make_float3(0.f, 0.f, 0.f), u = make_float3(1.f, 0.f, 0.f);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            if (i % strand == 0)
+                {
+                r = make_float3(L*U(mt), L*U(mt), L*U(mt));
+                }
+            else
+                {
+                float3 v = make_float3(u.x + 0.5f*G(mt), u.y + 0.5f*G(mt), u.z + 0.5f*G(mt));
+                const float norm = std::sqrt(v.x*v.x + v.y*v.y + v.z*v.z);
+                if (norm > 0.f)
+                    {
+                    u = make_float3(v.x/norm, v.y/norm, v.z/norm);
+                    }
+                r = make_float3(r.x + u.x, r.y + u.y, r.z + u.z);
+                }
+            sys.points[i] = make_float3(wrap(r.x,L), wrap(r.y,L), wrap(r.z,L));
+            }
+        }
+    else if (name == "slab")
+        {
+        const float h = 5.f;
+        const float L = std::sqrt(N/(density*h));
+        sys.hi = make_float3(L, L, h);
+        sys.periodic[2] = false;
+        for (unsigned int i=0; i < N; ++i)
+            {
+            sys.points[i] = make_float3(L*U(mt), L*U(mt), h*U(mt));
+            }
+        }
+    else
+        {
+        throw std::runtime_error("Unknown synthetic system " + name + ".");
+        }
+
+    return sys;
+    }
+
+#endif // NEIGHBOR_BENCHMARK_SYNTHETIC_SYSTEMS_H_
@@ -0,0 +1,259 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#include "neighbor/neighbor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//! Profile a function call
+/*!
+ * \param f Function to profile.
+ * \param samples Number of samples to take.
+ * \returns Median time per call to \a f in milliseconds after 2 warmup calls.
+ */
+double profile(const std::function <void ()>& f, unsigned int samples)
+    {
+    for (unsigned int i=0; i < 2; ++i)
+        {
+        f();
+        }
+
+    std::vector<double> times(samples);
+    for (auto& t : times)
+        {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        t = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+    std::sort(times.begin(), times.end());
+    return times[samples/2];
+    }
+
+//! Format a configuration as name=value pairs.
+std::string format(const neighbor::TuningSpace::Configuration& config)
+    {
+    std::ostringstream s;
+    for (auto it = config.begin(); it != config.end(); ++it)
+        {
+        if (it != config.begin()) s << ",";
+        s << it->first << "=" << it->second;
+        }
+    return s.str();
+    }
+
+//! Benchmark of tuning the LBVH traversal on the host and device.
+/*!
+ * Points are placed uniformly at random in a periodic cube at number density 1, and a sphere of radius
+ * 1.5 centered on each point is traversed against an LBVH of the points. The host and device traversals
+ * each have several parameters, which are tuned together with a neighbor::TuningSpace:
+ *
+ * - host: the traversal method (0: traverse, 1: traverseSelf, 2: traverseCached), the target chunk time of
+ *   the host::WorkStealingScheduler in microseconds, and its initial chunk size, which should not give a
+ *   thread more than its share of the queries.
+ * - device: the traversal method and the block size.
+ *
+ * Each space is searched by coordinate descent and by random sampling with the same number of evaluations.
+ * The time of the best configuration, the time of the default configuration, and the number of evaluations are
+ * written to an output tabulated file. The best configuration of coordinate descent is stored in the
+ * neighbor::TuningCache::getDefault cache. If the environment variable NEIGHBOR_TUNING_CACHE names a file holding a
+ * configuration from an earlier run on the same hardware, the searches are skipped and the cached configuration is
+ * timed instead.
+ *
+ * The command line parameters are:
+ *
+ *      ./traverser_tuning_benchmark <N> <threads> <output>
+ *
+ * - <N>: Number of points.
+ * - <threads>: Number of host threads.
+ * - <output>: Name of tabulated file with output.
+ */
+int main(int argc, char * argv[])
+    {
+    unsigned int N, num_threads;
+    std::string outf;
+    if (argc != 4)
+        {
+        std::cout << "Usage: traverser_tuning_benchmark <N> <threads> <output>" << std::endl;
+        return 1;
+        }
+    else
+        {
+        N = std::stoul(argv[1]);
+        num_threads = std::stoul(argv[2]);
+        outf = std::string(argv[3]);
+        }
+
+    try
+        {
+        std::cout << "Traverser tuning benchmark for N = " << N << std::endl;
+
+        const float L = std::cbrt(static_cast<float>(N));
+        const float3 lo = make_float3(0.f, 0.f, 0.f);
+        const float3 hi = make_float3(L, L, L);
+        neighbor::shared_array<float3> points(N);
+            {
+            std::mt19937 mt(42);
+            std::uniform_real_distribution<float> U(0.f, L);
+            for (unsigned int i=0; i < N; ++i)
+                {
+                points[i] = make_float3(U(mt), U(mt), U(mt));
+                }
+            }
+        const neighbor::PointInsertOp insert(points.get(), N);
+
+        neighbor::host::ThreadPool pool(num_threads);
+        neighbor::LBVH lbvh;
+        lbvh.build(pool, insert, lo, hi);
+
+        // self queries in Morton order
+        neighbor::shared_array<float4> spheres(N);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            const float3 r = points[lbvh.getPrimitives()[i]];
+            spheres[i] = make_float4(r.x, r.y, r.z, 1.5f);
+            }
+        const neighbor::SphereQueryOp query(spheres.get(), N);
+        neighbor::shared_array<unsigned int> hits(N);
+        const neighbor::CountNeighborsOp count(hits.get());
+
+        neighbor::shared_array<float3> images(27);
+            {
+            unsigned int idx=0;
+            for (int ix=-1; ix <= 1; ++ix)
+                for (int iy=-1; iy <= 1; ++iy)
+                    for (int iz=-1; iz <= 1; ++iz)
+                        images[idx++] = make_float3(L*ix, L*iy, L*iz);
+            }
+        const neighbor::ImageListOp<float3> translate(images.get(), images.size());
+
+        neighbor::LBVHTraverser traverser;
+        const unsigned int samples = 5;
+
+        // host engine
+        neighbor::TuningSpace host_space;
+        host_space.addDimension("method", {0, 1, 2});
+        host_space.addDimension("chunk_time_us", {10, 25, 50, 100, 200});
+        host_space.addDimension("initial_chunk", {16, 64, 256, 1024});
+        host_space.addConstraint([&](const neighbor::TuningSpace::Configuration& c)
+            {
+            return c.at("initial_chunk")*num_threads <= N;
+            });
+        auto host_cost = [&](const neighbor::TuningSpace::Configuration& c)
+            {
+            auto& scheduler = traverser.getScheduler();
+            scheduler.setTargetChunkTime(1.e-6*c.at("chunk_time_us"));
+            scheduler.setInitialChunkSize(c.at("initial_chunk"));
+            const unsigned int method = c.at("method");
+            return profile([&]
+                {
+                if (method == 0)
+                    traverser.traverse(pool, lbvh, query, count, translate);
+                else if (method == 1)
+                    traverser.traverseSelf(pool, lbvh, query, count, translate);
+                else
+                    traverser.traverseCached(pool, lbvh, query, count, translate);
+                }, samples);
+            };
+        const neighbor::TuningSpace::Configuration host_default = {{"method", 0}, {"chunk_time_us", 50}, {"initial_chunk", 64}};
+
+        // device engine
+        neighbor::TuningSpace device_space;
+        device_space.addDimension("method", {0, 1, 2});
+        device_space.addDimension("block_size", traverser.getTunableParameters());
+        auto device_cost = [&](const neighbor::TuningSpace::Configuration& c)
+            {
+            const neighbor::LBVHTraverser::LaunchParameters params(c.at("block_size"), 0);
+            const unsigned int method = c.at("method");
+            return profile([&]
+                {
+                if (method == 0)
+                    traverser.traverse(params, lbvh, query, count, translate, neighbor::NullTransformOp());
+                else if (method == 1)
+                    traverser.traverseSelf(params, lbvh, query, count, translate, neighbor::NullTransformOp());
+                else
+                    traverser.traverseCached(params, lbvh, query, count, translate, neighbor::NullTransformOp());
+                hipper::deviceSynchronize();
+                }, samples);
+            };
+        const neighbor::TuningSpace::Configuration device_default = {{"method", 0}, {"block_size", 32}};
+
+        struct Result
+            {
+            std::string engine;
+            std::string strategy;
+            neighbor::TuningSpace::Result result;
+            double default_time;
+            };
+        std::vector<Result> results;
+        auto cache = neighbor::TuningCache::getDefault();
+        auto tune = [&](const std::string& engine,
+                        const neighbor::TuningSpace& space,
+                        const neighbor::TuningSpace::CostFunction& cost,
+                        const neighbor::TuningSpace::Configuration& default_config)
+            {
+            const double default_time = cost(default_config);
+            const neighbor::TuningCache::Key key = {"traverser_tuning_benchmark",
+                                                    neighbor::TuningCache::getTypes<neighbor::SphereQueryOp,neighbor::CountNeighborsOp>(),
+                                                    neighbor::TuningCache::getBucket(N),
+                                                    (engine == "host") ? neighbor::TuningCache::getHostId() : neighbor::TuningCache::getDeviceId(),
+                                                    (engine == "host") ? num_threads : 0};
+            neighbor::TuningSpace::Result cached;
+            if (cache->find(key, cached.best) && space.isValid(cached.best))
+                {
+                cached.cost = cost(cached.best);
+                cached.evaluations = 0;
+                results.push_back({engine, "cached", cached, default_time});
+                return;
+                }
+
+            const auto descent = space.search(cost, default_config);
+            results.push_back({engine, "descent", descent, default_time});
+            const auto random = space.search(cost, neighbor::TuningSpace::Strategy::Random, descent.evaluations);
+            results.push_back({engine, "random", random, default_time});
+            cache->insert(key, descent.best);
+            };
+        lbvh.build(insert, lo, hi);
+        traverser.setup(lbvh);
+        hipper::deviceSynchronize();
+        tune("device", device_space, device_cost, device_default);
+        lbvh.build(pool, insert, lo, hi);
+        traverser.setup(pool, lbvh);
+        tune("host", host_space, host_cost, host_default);
+
+        std::ofstream output;
+        output.open(outf.c_str());
+        output << "# Traverser tuning benchmark for N = " << N << ", " << num_threads << " threads" << std::endl;
+        output << "#" << std::endl;
+        output << "# " << std::setw(6) << "engine" << std::setw(10) << "strategy" << std::setw(16) << "time (ms)"
+               << std::setw(16) << "default (ms)" << std::setw(12) << "evaluations" << "  configuration" << std::endl;
+        for (const auto& r : results)
+            {
+            std::cout << r.engine << ", " << r.strategy << ": " << r.result.cost << " ms (default " << r.default_time
+                      << " ms) after " << r.result.evaluations << " evaluations, " << format(r.result.best) << std::endl;
+            output << std::setw(8) << r.engine
+                   << " " << std::setw(9) << r.strategy
+                   << " " << std::setw(16) << std::fixed << std::setprecision(5) << r.result.cost
+                   << " " << std::setw(16) << std::fixed << std::setprecision(5) << r.default_time
+                   << " " << std::setw(11) << r.result.evaluations
+                   << "  " << format(r.result.best) << std::endl;
+            }
+        }
+    catch(...)
+        {
+        std::cerr << "**error** Program terminated due to exception." << std::endl;
+        return 1;
+        }
+
+    return 0;
+    }
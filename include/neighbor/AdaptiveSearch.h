@@ -0,0 +1,298 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#ifndef NEIGHBOR_ADAPTIVE_SEARCH_H_
+#define NEIGHBOR_ADAPTIVE_SEARCH_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "CellList.h"
+#include "LBVH.h"
+#include "LBVHTraverser.h"
+#include "MortonCode.h"
+#include "TransformOps.h"
+#include "TranslateOps.h"
+#include "host/ThreadPool.h"
+
+namespace neighbor
+{
+//! Host neighbor search that picks a CellList or an LBVH for each build.
+/*!
+ * A CellList is usually the fastest way to search a scene filled with primitives at a roughly uniform
+ * density, while an LBVH adapts to primitives that are clustered. An AdaptiveSearch estimates how uniform
+ * the primitives are every time it is built, and builds whichever method should be faster. Both methods are
+ * built and traversed on the host with the same operations, so the choice is hidden from the caller.
+ *
+ * The uniformity is estimated from a coarse histogram of the Morton codes of the primitive centers, which
+ * bins the scene into up to 32 cells per dimension. The fraction of the scene occupied by the primitives is
+ * estimated from the mean \f$\mu\f$ and the mean square \f$\langle c^2 \rangle\f$ of the counts as
+ * \f$\mu^2/(\langle c^2 \rangle - \mu)\f$, where \f$\mu\f$ is subtracted to remove the counting noise of
+ * uniformly random primitives. This is about 1 for a liquid, and it is about \f$f\f$ for primitives filling
+ * only a fraction \f$f\f$ of the scene, down to the resolution of the histogram. The number of cells in a
+ * CellList is capped by the number of primitives, so its cells widen when the primitives fill a small
+ * fraction of the scene, and queries then test many primitives that are far away. The LBVH is picked when
+ * the occupied fraction is less than ::getThreshold.
+ *
+ * The LBVH may find some extra primitives that are tested with QueryOpT::refine because its bounding boxes are
+ * compressed for traversal (see LBVHTraverser), but otherwise both methods find the same primitives.
+ */
+class AdaptiveSearch
+    {
+    public:
+        //! Search method.
+        enum class Method
+            {
+            CellList,   //!< Uniform grid of cells
+            LBVH        //!< Linear bounding volume hierarchy
+            };
+
+        //! Setup an unallocated search.
+        AdaptiveSearch();
+
+        //! Pick a method and build it.
+        template<class InsertOpT>
+        void build(host::ThreadPool& pool, const InsertOpT& insert, const float3& lo, const float3& hi, float width);
+
+        //! Traverse with translation and a primitive transform operation.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+        void traverse(host::ThreadPool& pool,
+                      const QueryOpT& query,
+                      const OutputOpT& out,
+                      const TranslateOpT& images,
+                      const TransformOpT& transform);
+
+        //! Traverse with translation.
+        /*!
+         * \param pool Thread pool.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         * \param images Translation operation for moving search volume around.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         * \tparam TranslateOpT The type of translation operation.
+         */
+        template<class QueryOpT, class OutputOpT, class TranslateOpT>
+        void traverse(host::ThreadPool& pool, const QueryOpT& query, const OutputOpT& out, const TranslateOpT& images)
+            {
+            traverse(pool, query, out, images, NullTransformOp());
+            }
+
+        //! Traverse.
+        /*!
+         * \param pool Thread pool.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         *
+         * Only the self image (no translation) is traversed.
+         */
+        template<class QueryOpT, class OutputOpT>
+        void traverse(host::ThreadPool& pool, const QueryOpT& query, const OutputOpT& out)
+            {
+            traverse(pool, query, out, SelfOp(), NullTransformOp());
+            }
+
+        //! Get the method picked by the last build.
+        Method getMethod() const
+            {
+            return m_method;
+            }
+
+        //! Get the fraction of the scene occupied by the primitives estimated by the last build.
+        float getOccupiedFraction() const
+            {
+            return m_fraction;
+            }
+
+        //! Get the occupied fraction below which the LBVH is picked.
+        float getThreshold() const
+            {
+            return m_threshold;
+            }
+
+        //! Set the occupied fraction below which the LBVH is picked.
+        /*!
+         * \param threshold Fraction of the scene (nonnegative).
+         *
+         * The default is 0.002, which is about where the CellList and the LBVH took the same time to
+         * build and traverse for 2000 to 40000 points filling a corner of the scene on one host thread.
+         * The best threshold depends on the machine and the queries, so it should be tuned for a given
+         * workload. A threshold of 0 always picks the CellList, while a threshold above 1 always picks the
+         * LBVH. The occupied fraction is not resolved below one bin of the histogram, which has at most
+         * one bin per primitive, so the LBVH is not picked for N primitives if the threshold is below 1/N.
+         * The threshold is used by the next call to ::build.
+         */
+        void setThreshold(float threshold)
+            {
+            if (!(threshold >= 0.f))
+                {
+                throw std::runtime_error("AdaptiveSearch threshold must be nonnegative.");
+                }
+            m_threshold = threshold;
+            }
+
+        //! Get the CellList.
+        const CellList& getCellList() const
+            {
+            return m_cells;
+            }
+
+        //! Get the LBVH.
+        const LBVH& getLBVH() const
+            {
+            return m_lbvh;
+            }
+
+    private:
+        Method m_method;        //!< Method picked by the last build
+        float m_fraction;       //!< Fraction of the scene occupied by the primitives
+        float m_threshold;      //!< Occupied fraction below which the LBVH is picked
+
+        CellList m_cells;               //!< Cell list
+        LBVH m_lbvh;                    //!< LBVH
+        LBVHTraverser m_traverser;      //!< Traverser for the LBVH
+
+        static const unsigned int max_bits = 5;     //!< Maximum number of bits per dimension of the histogram
+
+        //! Estimate the fraction of the scene occupied by the primitives.
+        template<class InsertOpT>
+        float estimateOccupiedFraction(host::ThreadPool& pool,
+                                       const InsertOpT& insert,
+                                       const float3& lo,
+                                       const float3& hi) const;
+    };
+
+inline AdaptiveSearch::AdaptiveSearch()
+    : m_method(Method::CellList), m_fraction(1.f), m_threshold(0.002f)
+    {}
+
+/*!
+ * \param pool Thread pool for the build.
+ * \param insert The insert operation determining AABB extents of primitives.
+ * \param lo Lower bound of the scene.
+ * \param hi Upper bound of the scene.
+ * \param width Minimum width of a cell of the CellList.
+ *
+ * \tparam InsertOpT The kind of insert operation.
+ *
+ * The occupied fraction of the scene is estimated, and then only the picked method is built.
+ * The CellList is always picked when there are no primitives. The \a insert operation must be
+ * callable from host code, and it is not needed after this method returns.
+ */
+template<class InsertOpT>
+void AdaptiveSearch::build(host::ThreadPool& pool, const InsertOpT& insert, const float3& lo, const float3& hi, float width)
+    {
+    m_fraction = estimateOccupiedFraction(pool, insert, lo, hi);
+    m_method = (insert.size() > 0 && m_fraction < m_threshold) ? Method::LBVH : Method::CellList;
+
+    if (m_method == Method::LBVH)
+        {
+        m_lbvh.build(pool, insert, lo, hi);
+        }
+    else
+        {
+        m_cells.build(pool, insert, lo, hi, width);
+        }
+    }
+
+/*!
+ * \param pool Thread pool.
+ * \param query Query operation for defining search volumes and overlaps.
+ * \param out Output operation for intersected primitives.
+ * \param images Translation operation for moving search volume around.
+ * \param transform Transformation operation for cached primitive indexes.
+ *
+ * \tparam QueryOpT The type of query operation.
+ * \tparam OutputOpT The type of output operation.
+ * \tparam TranslateOpT The type of translation operation.
+ * \tparam TransformOpT The type of transformation operation.
+ *
+ * The method picked by the last ::build is traversed (see CellList::traverse and LBVHTraverser::traverse).
+ * The LBVH is compressed for every traversal.
+ * The query volume must implement getBounds() for the CellList, and at most 32 \a images can be used for
+ * the LBVH.
+ */
+template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+void AdaptiveSearch::traverse(host::ThreadPool& pool,
+                              const QueryOpT& query,
+                              const OutputOpT& out,
+                              const TranslateOpT& images,
+                              const TransformOpT& transform)
+    {
+    if (m_method == Method::LBVH)
+        {
+        m_traverser.traverse(pool, m_lbvh, query, out, images, transform);
+        }
+    else
+        {
+        m_cells.traverse(pool, query, out, images, transform);
+        }
+    }
+
+/*!
+ * \param pool Thread pool.
+ * \param insert The insert operation determining AABB extents of primitives.
+ * \param lo Lower bound of the scene.
+ * \param hi Upper bound of the scene.
+ *
+ * \tparam InsertOpT The kind of insert operation.
+ *
+ * \returns The fraction of the scene occupied by the primitives.
+ *
+ * The histogram uses the top bits of the Morton codes of the primitive centers. The number of bits is
+ * reduced for small numbers of primitives so that there is at least 1 primitive per bin on average, and
+ * the estimate is bounded below by the fraction of the scene covered by one bin. Each thread fills its own
+ * histogram, and these are summed.
+ */
+template<class InsertOpT>
+float AdaptiveSearch::estimateOccupiedFraction(host::ThreadPool& pool,
+                                               const InsertOpT& insert,
+                                               const float3& lo,
+                                               const float3& hi) const
+    {
+    const unsigned int N = insert.size();
+    unsigned int bits = 0;
+    while (bits < max_bits && N >= (1u << (3*(bits+1))))
+        ++bits;
+    if (bits == 0) return 1.f;
+
+    const unsigned int num_bins = 1u << (3*bits);
+    const unsigned int shift = 30 - 3*bits;
+    std::vector<unsigned int> counts(pool.getNumThreads()*num_bins, 0);
+    pool.run([&](unsigned int thread)
+        {
+        unsigned int* hist = counts.data() + thread*num_bins;
+        const auto range = pool.getRange(thread, 0, N);
+        for (unsigned int i=range.first; i < range.second; ++i)
+            {
+            ++hist[calcMortonCode(insert.get(i).getCenter(), lo, hi) >> shift];
+            }
+        });
+
+    double sum2 = 0.0;
+    for (unsigned int b=0; b < num_bins; ++b)
+        {
+        double count = 0.0;
+        for (unsigned int t=0; t < pool.getNumThreads(); ++t)
+            {
+            count += counts[t*num_bins+b];
+            }
+        sum2 += count*count;
+        }
+    const double mean = static_cast<double>(N)/num_bins;
+    const double excess = sum2/num_bins - mean;
+    if (excess <= mean*mean) return 1.f;
+    return static_cast<float>(std::max(1.0/num_bins, mean*mean/excess));
+    }
+
+} // end namespace neighbor
+
+#endif // NEIGHBOR_ADAPTIVE_SEARCH_H_
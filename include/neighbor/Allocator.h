@@ -0,0 +1,330 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#ifndef NEIGHBOR_ALLOCATOR_H_
+#define NEIGHBOR_ALLOCATOR_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include <cstddef>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace neighbor
+{
+
+//! Source of memory for shared_array.
+/*!
+ * An Allocator hands out blocks of memory and takes them back with the size they were allocated with.
+ * The allocator of a shared_array is kept alive by the array until its memory is freed, so allocators are
+ * held by std::shared_ptr.
+ *
+ * The default allocator of new arrays is ManagedAllocator, and it can be changed with ::setDefault, e.g., to
+ * a CachingAllocator so that the arrays of all LBVH and LBVHTraverser objects recycle their memory.
+ */
+class Allocator
+    {
+    public:
+        virtual ~Allocator() {}
+
+        //! Allocate a block.
+        /*!
+         * \param bytes Size of the block in bytes, which is greater than 0.
+         * \returns The block.
+         * \raises std::runtime_error if the memory cannot be allocated.
+         */
+        virtual void* allocate(size_t bytes) = 0;
+
+        //! Free a block.
+        /*!
+         * \param ptr Block returned by ::allocate.
+         * \param bytes Size the block was allocated with.
+         */
+        virtual void deallocate(void* ptr, size_t bytes) = 0;
+
+        //! Get the allocator of new arrays.
+        static std::shared_ptr<Allocator> getDefault();
+
+        //! Set the allocator of new arrays.
+        /*!
+         * \param allocator Allocator, or nullptr to use a ManagedAllocator.
+         *
+         * Existing arrays keep the allocator they were allocated with.
+         */
+        static void setDefault(std::shared_ptr<Allocator> allocator);
+
+    private:
+        //! Storage of the default allocator.
+        static std::shared_ptr<Allocator>& defaultAllocator()
+            {
+            static std::shared_ptr<Allocator> allocator;
+            return allocator;
+            }
+
+        //! Mutex protecting the default allocator.
+        static std::mutex& defaultMutex()
+            {
+            static std::mutex mutex;
+            return mutex;
+            }
+    };
+
+//! Allocator of CUDA managed memory.
+/*!
+ * The memory is allocated with hipper::mallocManaged, so it can be accessed on the host and the device.
+ */
+class ManagedAllocator : public Allocator
+    {
+    public:
+        void* allocate(size_t bytes) override
+            {
+            void* ptr = nullptr;
+            if (hipper::mallocManaged(&ptr, bytes) != hipper::success)
+                {
+                throw std::runtime_error("Error allocating managed memory.");
+                }
+            return ptr;
+            }
+
+        void deallocate(void* ptr, size_t) override
+            {
+            hipper::free(ptr);
+            }
+    };
+
+inline std::shared_ptr<Allocator> Allocator::getDefault()
+    {
+    std::lock_guard<std::mutex> lock(defaultMutex());
+    std::shared_ptr<Allocator>& allocator = defaultAllocator();
+    if (!allocator)
+        {
+        allocator = std::make_shared<ManagedAllocator>();
+        }
+    return allocator;
+    }
+
+inline void Allocator::setDefault(std::shared_ptr<Allocator> allocator)
+    {
+    std::lock_guard<std::mutex> lock(defaultMutex());
+    defaultAllocator() = allocator;
+    }
+
+//! Allocator that recycles freed blocks by size class.
+/*!
+ * Blocks are allocated from an upstream allocator in size classes, and a freed block is kept to be reused for
+ * the next allocation of its class instead of being returned upstream. The classes are 256 B and then 4 per
+ * power of two (e.g., 1024, 1280, 1536, and 1792 B), so a block is at most 25% larger than requested. This
+ * removes the allocations and frees when arrays are resized back and forth, e.g., when an LBVH is rebuilt for
+ * a fluctuating number of primitives.
+ *
+ * At most ::getMaxCachedBytes are kept, and a freed block that does not fit is returned upstream. If the upstream
+ * allocator fails, the cached blocks are released and the allocation is tried again. All methods are thread safe.
+ *
+ * Freeing managed memory with hipper::free waits for the device, but a block returned to the cache may still
+ * be used by kernels that are running in any stream. By default, the device is synchronized before a cached
+ * block is reused if blocks were freed since the last synchronization, so recycling is as safe as freeing. This
+ * can be turned off for an upstream allocator whose memory the device does not use (e.g., host::HostAllocator),
+ * or when the caller guarantees that the device is done with every array before it is freed. Caching is opt-in:
+ * arrays only use a CachingAllocator that is given to them or set with ::setDefault.
+ *
+ * Blocks that are still allocated when the CachingAllocator is destroyed are leaked, but shared_array keeps its
+ * allocator alive, so this only happens to blocks allocated directly.
+ */
+class CachingAllocator : public Allocator
+    {
+    public:
+        //! Create an allocator.
+        /*!
+         * \param upstream Allocator of the blocks, or nullptr to use a ManagedAllocator.
+         * \param max_cached_bytes Most bytes to keep in freed blocks.
+         * \param synchronize If true, synchronize the device before a freed block is reused.
+         */
+        explicit CachingAllocator(std::shared_ptr<Allocator> upstream = nullptr,
+                                  size_t max_cached_bytes = std::numeric_limits<size_t>::max(),
+                                  bool synchronize = true)
+            : m_upstream(upstream ? upstream : std::make_shared<ManagedAllocator>()),
+              m_max_cached_bytes(max_cached_bytes), m_synchronize(synchronize), m_unsynchronized(false),
+              m_cached_bytes(0), m_allocated_bytes(0), m_hits(0), m_misses(0)
+            {}
+
+        //! Release the cached blocks.
+        ~CachingAllocator()
+            {
+            release();
+            }
+
+        void* allocate(size_t bytes) override;
+
+        void deallocate(void* ptr, size_t bytes) override;
+
+        //! Return all cached blocks to the upstream allocator.
+        void release();
+
+        //! Get the size class of an allocation.
+        /*!
+         * \param bytes Size of the allocation.
+         * \returns The size of the block that holds \a bytes.
+         */
+        static size_t getSizeClass(size_t bytes)
+            {
+            if (bytes <= 256) return 256;
+            size_t octave = 256;
+            while (octave <= (bytes-1)/2) octave <<= 1;
+            // octave < bytes <= 2*octave, so round up to a quarter of the octave
+            const size_t quarter = octave/4;
+            return octave + ((bytes - octave + quarter - 1)/quarter)*quarter;
+            }
+
+        //! Get the upstream allocator.
+        std::shared_ptr<Allocator> getUpstream() const
+            {
+            return m_upstream;
+            }
+
+        //! Get the most bytes kept in freed blocks.
+        size_t getMaxCachedBytes() const
+            {
+            return m_max_cached_bytes;
+            }
+
+        //! Check if the device is synchronized before a freed block is reused.
+        bool getSynchronize() const
+            {
+            return m_synchronize;
+            }
+
+        //! Get the bytes in freed blocks.
+        size_t getCachedBytes() const
+            {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_cached_bytes;
+            }
+
+        //! Get the bytes in blocks that are allocated.
+        size_t getAllocatedBytes() const
+            {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_allocated_bytes;
+            }
+
+        //! Get the number of allocations that reused a cached block.
+        unsigned long long getHits() const
+            {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_hits;
+            }
+
+        //! Get the number of allocations from the upstream allocator.
+        unsigned long long getMisses() const
+            {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_misses;
+            }
+
+    private:
+        std::shared_ptr<Allocator> m_upstream;              //!< Allocator of the blocks
+        const size_t m_max_cached_bytes;                    //!< Most bytes to keep in freed blocks
+        const bool m_synchronize;                           //!< If true, synchronize before reusing a block
+        bool m_unsynchronized;                              //!< If true, blocks were freed since the last synchronization
+        mutable std::mutex m_mutex;                         //!< Mutex protecting the blocks
+        std::map<size_t, std::vector<void*>> m_blocks;      //!< Freed blocks of each size class
+        size_t m_cached_bytes;                              //!< Bytes in freed blocks
+        size_t m_allocated_bytes;                           //!< Bytes in allocated blocks
+        unsigned long long m_hits;                          //!< Allocations reusing a freed block
+        unsigned long long m_misses;                        //!< Allocations from upstream
+
+        //! Return the cached blocks upstream while holding the mutex.
+        void releaseLocked();
+    };
+
+/*!
+ * \param bytes Size of the block in bytes.
+ * \returns A block of at least \a bytes.
+ * \raises std::runtime_error if the upstream allocator cannot allocate the block, even after releasing the cache.
+ */
+inline void* CachingAllocator::allocate(size_t bytes)
+    {
+    const size_t size = getSizeClass(bytes);
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_blocks.find(size);
+    if (it != m_blocks.end() && !it->second.empty())
+        {
+        // the device may still be using the block, so wait for it like hipper::free would
+        if (m_synchronize && m_unsynchronized)
+            {
+            hipper::deviceSynchronize();
+            m_unsynchronized = false;
+            }
+        void* ptr = it->second.back();
+        it->second.pop_back();
+        m_cached_bytes -= size;
+        m_allocated_bytes += size;
+        ++m_hits;
+        return ptr;
+        }
+
+    void* ptr = nullptr;
+    try
+        {
+        ptr = m_upstream->allocate(size);
+        }
+    catch (const std::runtime_error&)
+        {
+        if (m_cached_bytes == 0) throw;
+        releaseLocked();
+        ptr = m_upstream->allocate(size);
+        }
+    m_allocated_bytes += size;
+    ++m_misses;
+    return ptr;
+    }
+
+/*!
+ * \param ptr Block returned by ::allocate.
+ * \param bytes Size the block was allocated with.
+ */
+inline void CachingAllocator::deallocate(void* ptr, size_t bytes)
+    {
+    const size_t size = getSizeClass(bytes);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_allocated_bytes -= size;
+    if (m_cached_bytes + size <= m_max_cached_bytes)
+        {
+        m_blocks[size].push_back(ptr);
+        m_cached_bytes += size;
+        m_unsynchronized = true;
+        }
+    else
+        {
+        m_upstream->deallocate(ptr, size);
+        }
+    }
+
+inline void CachingAllocator::release()
+    {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    releaseLocked();
+    }
+
+inline void CachingAllocator::releaseLocked()
+    {
+    for (auto& b : m_blocks)
+        {
+        for (void* ptr : b.second)
+            {
+            m_upstream->deallocate(ptr, b.first);
+            }
+        }
+    m_blocks.clear();
+    m_cached_bytes = 0;
+    }
+
+} // end namespace neighbor
+
+#endif // NEIGHBOR_ALLOCATOR_H_
@@ -20,12 +20,19 @@
 #define NEIGHBOR_NO_INTRINSIC_ROUND
 #endif
 
+/*
+ * The intrinsics are also only available in device code, so the host always
+ * falls back to the approximate math functions.
+ */
+#if !defined(NEIGHBOR_NO_INTRINSIC_ROUND) && defined(__CUDA_ARCH__)
+#define NEIGHBOR_INTRINSIC_ROUND
+#endif
+
 // cfloat needed for FLT_MAX
-#ifdef NEIGHBOR_NO_INTRINSIC_ROUND
 #include <cfloat>
-#endif
+#include <cmath>
 
-#define DEVICE __device__ __forceinline__
+#define HOSTDEVICE __host__ __device__ __forceinline__
 
 namespace neighbor
 {
@@ -35,7 +42,8 @@ namespace neighbor
  * This namespace defines inline functions that wrap around "approximate" math operations.
  * Approximate operations are intended to mimic single-precision floating-point math having
  * different IEEE-754 rounding conventions. These operators are implemented as CUDA intrinsics,
- * requiring emulation or other names on the host or other architectures.
+ * requiring emulation or other names on the host or other architectures. All functions can be
+ * called from both host and device code.
  *
  * In neighbor, we never actually need *exactly* the IEEE-754 result. Instead, we want an fp32
  * result that is at least below or above this result (and as close as possible) to produce an
@@ -52,9 +60,9 @@ namespace approx
  * On CUDA devices, this is performed using the built-in intrinsic.
  * Otherwise, the same value is returned using a sequence of instructions.
  */
-DEVICE float double2float_rd(double x)
+HOSTDEVICE float double2float_rd(double x)
     {
-    #ifndef NEIGHBOR_NO_INTRINSIC_ROUND
+    #ifdef NEIGHBOR_INTRINSIC_ROUND
     return __double2float_rd(x);
     #else
     float y = static_cast<float>(x);
@@ -70,9 +78,9 @@ DEVICE float double2float_rd(double x)
  * On CUDA devices, this is performed using the built-in intrinsic.
  * Otherwise, the same value is returned using a sequence of instructions.
  */
-DEVICE float double2float_ru(double x)
+HOSTDEVICE float double2float_ru(double x)
     {
-    #ifndef NEIGHBOR_NO_INTRINSIC_ROUND
+    #ifdef NEIGHBOR_INTRINSIC_ROUND
     return __double2float_ru(x);
     #else
     float y = static_cast<float>(x);
@@ -93,9 +101,9 @@ DEVICE float double2float_ru(double x)
  * Otherwise, this returns the nextafter float toward -FLT_MAX, which may be the
  * same value or the next smaller value.
  */
-DEVICE float fadd_rd(float x, float y)
+HOSTDEVICE float fadd_rd(float x, float y)
     {
-    #ifndef NEIGHBOR_NO_INTRINSIC_ROUND
+    #ifdef NEIGHBOR_INTRINSIC_ROUND
     return __fadd_rd(x,y);
     #else
     return nextafterf(x+y, -FLT_MAX);
@@ -115,9 +123,9 @@ DEVICE float fadd_rd(float x, float y)
  * Otherwise, this returns the nextafter float toward FLT_MAX, which may be the
  * same value or the next greater value.
  */
-DEVICE float fadd_ru(float x, float y)
+HOSTDEVICE float fadd_ru(float x, float y)
     {
-    #ifndef NEIGHBOR_NO_INTRINSIC_ROUND
+    #ifdef NEIGHBOR_INTRINSIC_ROUND
     return __fadd_ru(x,y);
     #else
     return nextafterf(x+y, FLT_MAX);
@@ -137,9 +145,9 @@ DEVICE float fadd_ru(float x, float y)
  * Otherwise, this returns the nextafter float toward -FLT_MAX, which may be the
  * same value or the next smaller value.
  */
-DEVICE float fsub_rd(float x, float y)
+HOSTDEVICE float fsub_rd(float x, float y)
     {
-    #ifndef NEIGHBOR_NO_INTRINSIC_ROUND
+    #ifdef NEIGHBOR_INTRINSIC_ROUND
     return __fsub_rd(x,y);
     #else
     return nextafterf(x-y, -FLT_MAX);
@@ -159,9 +167,9 @@ DEVICE float fsub_rd(float x, float y)
  * Otherwise, this returns the nextafter float toward FLT_MAX, which may be the
  * same value or the next greater value.
  */
-DEVICE float fsub_ru(float x, float y)
+HOSTDEVICE float fsub_ru(float x, float y)
     {
-    #ifndef NEIGHBOR_NO_INTRINSIC_ROUND
+    #ifdef NEIGHBOR_INTRINSIC_ROUND
     return __fsub_ru(x,y);
     #else
     return nextafterf(x-y, FLT_MAX);
@@ -181,9 +189,9 @@ DEVICE float fsub_ru(float x, float y)
  * Otherwise, this returns the nextafter float toward -FLT_MAX, which may be the
  * same value or the next smaller value.
  */
-DEVICE float fmul_rd(float x, float y)
+HOSTDEVICE float fmul_rd(float x, float y)
     {
-    #ifndef NEIGHBOR_NO_INTRINSIC_ROUND
+    #ifdef NEIGHBOR_INTRINSIC_ROUND
     return __fmul_rd(x,y);
     #else
     return nextafterf(x*y, -FLT_MAX);
@@ -203,9 +211,9 @@ DEVICE float fmul_rd(float x, float y)
  * Otherwise, this returns the nextafter float toward FLT_MAX, which may be the
  * same value or the next greater value.
  */
-DEVICE float fmul_ru(float x, float y)
+HOSTDEVICE float fmul_ru(float x, float y)
     {
-    #ifndef NEIGHBOR_NO_INTRINSIC_ROUND
+    #ifdef NEIGHBOR_INTRINSIC_ROUND
     return __fmul_ru(x,y);
     #else
     return nextafterf(x*y, FLT_MAX);
@@ -225,9 +233,9 @@ DEVICE float fmul_ru(float x, float y)
  * Otherwise, this returns the nextafter float toward -FLT_MAX, which may be the
  * same value or the next smaller value.
  */
-DEVICE float fdiv_rd(float x, float y)
+HOSTDEVICE float fdiv_rd(float x, float y)
     {
-    #ifndef NEIGHBOR_NO_INTRINSIC_ROUND
+    #ifdef NEIGHBOR_INTRINSIC_ROUND
     return __fdiv_rd(x,y);
     #else
     return nextafterf(x/y, -FLT_MAX);
@@ -247,9 +255,9 @@ DEVICE float fdiv_rd(float x, float y)
  * Otherwise, this returns the nextafter float toward FLT_MAX, which may be the
  * same value or the next greater value.
  */
-DEVICE float fdiv_ru(float x, float y)
+HOSTDEVICE float fdiv_ru(float x, float y)
     {
-    #ifndef NEIGHBOR_NO_INTRINSIC_ROUND
+    #ifdef NEIGHBOR_INTRINSIC_ROUND
     return __fdiv_ru(x,y);
     #else
     return nextafterf(x/y, FLT_MAX);
@@ -268,9 +276,9 @@ DEVICE float fdiv_ru(float x, float y)
  * Otherwise, this returns the nextafter float toward -FLT_MAX, which may be the
  * same value or the next smaller value.
  */
-DEVICE float frcp_rd(float x)
+HOSTDEVICE float frcp_rd(float x)
     {
-    #ifndef NEIGHBOR_NO_INTRINSIC_ROUND
+    #ifdef NEIGHBOR_INTRINSIC_ROUND
     return __frcp_rd(x);
     #else
     return nextafterf(1.0f/x, -FLT_MAX);
@@ -289,9 +297,9 @@ DEVICE float frcp_rd(float x)
  * Otherwise, this returns the nextafter float toward FLT_MAX, which may be the
  * same value or the next greater value.
  */
-DEVICE float frcp_ru(float x)
+HOSTDEVICE float frcp_ru(float x)
     {
-    #ifndef NEIGHBOR_NO_INTRINSIC_ROUND
+    #ifdef NEIGHBOR_INTRINSIC_ROUND
     return __frcp_ru(x);
     #else
     return nextafterf(1.0f/x, FLT_MAX);
@@ -312,9 +320,9 @@ DEVICE float frcp_ru(float x)
  * Otherwise, this returns the nextafter float toward -FLT_MAX, which may be the
  * same value or the next smaller value.
  */
-DEVICE float fmaf_rd(float x, float y, float z)
+HOSTDEVICE float fmaf_rd(float x, float y, float z)
     {
-    #ifndef NEIGHBOR_NO_INTRINSIC_ROUND
+    #ifdef NEIGHBOR_INTRINSIC_ROUND
     return __fmaf_rd(x,y,z);
     #else
     return nextafterf(fmaf(x,y,z), -FLT_MAX);
@@ -335,17 +343,60 @@ DEVICE float fmaf_rd(float x, float y, float z)
  * Otherwise, this returns the nextafter float toward FLT_MAX, which may be the
  * same value or the next greater value.
  */
-DEVICE float fmaf_ru(float x, float y, float z)
+HOSTDEVICE float fmaf_ru(float x, float y, float z)
     {
-    #ifndef NEIGHBOR_NO_INTRINSIC_ROUND
+    #ifdef NEIGHBOR_INTRINSIC_ROUND
     return __fmaf_ru(x,y,z);
     #else
     return nextafterf(fmaf(x,y,z), FLT_MAX);
     #endif
     }
+
+//! Take the square root of a float, rounding the result down.
+/*!
+ * \param x Value (nonnegative).
+ * \returns The square root \f$\sqrt{x}\f$.
+ *
+ * This function guarantees that the resulting square root will be less than or equal to
+ * the IEEE-754 result in round-down mode.
+ *
+ * On CUDA devices, this is exactly satisfied using a device intrinsic.
+ * Otherwise, this returns the nextafter float toward 0, which may be the
+ * same value or the next smaller value.
+ */
+HOSTDEVICE float fsqrt_rd(float x)
+    {
+    #ifdef NEIGHBOR_INTRINSIC_ROUND
+    return __fsqrt_rd(x);
+    #else
+    return nextafterf(sqrtf(x), 0.f);
+    #endif
+    }
+
+//! Take the square root of a float, rounding the result up.
+/*!
+ * \param x Value (nonnegative).
+ * \returns The square root \f$\sqrt{x}\f$.
+ *
+ * This function guarantees that the resulting square root will be greater than or equal to
+ * the IEEE-754 result in round-up mode.
+ *
+ * On CUDA devices, this is exactly satisfied using a device intrinsic.
+ * Otherwise, this returns the nextafter float toward FLT_MAX, which may be the
+ * same value or the next greater value.
+ */
+HOSTDEVICE float fsqrt_ru(float x)
+    {
+    #ifdef NEIGHBOR_INTRINSIC_ROUND
+    return __fsqrt_ru(x);
+    #else
+    return nextafterf(sqrtf(x), FLT_MAX);
+    #endif
+    }
 } // end namespace approx
 } // end namespace neighbor
 
-#undef DEVICE
+#undef HOSTDEVICE
+#undef NEIGHBOR_INTRINSIC_ROUND
 
 #endif // NEIGHBOR_APPROXIMATE_MATH_H_
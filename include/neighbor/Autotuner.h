@@ -0,0 +1,442 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#ifndef NEIGHBOR_AUTOTUNER_H_
+#define NEIGHBOR_AUTOTUNER_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+
+namespace neighbor
+{
+
+//! Online autotuner for a tunable parameter.
+/*!
+ * The autotuner times calls of an operation and picks the fastest of a list of parameters, e.g.,
+ * the block sizes from Tunable::getTunableParameters. Each call is wrapped by ::begin and ::end, and the
+ * operation uses the parameter from ::getParameter:
+ *
+ *      tuner.begin(stream);
+ *      lbvh.build(LBVH::LaunchParameters(tuner.getParameter(), stream), insert, lo, hi);
+ *      tuner.end(stream);
+ *
+ * Calls are timed with events recorded in a stream, or with the host clock if no stream is given.
+ *
+ * The autotuner starts by scanning the parameters. Each parameter is used for a number of consecutive calls,
+ * and its time is the median (or trimmed mean) of those samples, which rejects outliers from, e.g., the first
+ * call after a change or a busy device. The fastest parameter is then used until the next scan, which starts
+ * after a fixed number of calls, or when the problem size set by ::setProblemSize moves to a different power
+ * of 2. Outside a scan, ::begin and ::end do nothing, so the operation stays asynchronous. During a scan, ::end
+ * waits for the stream to finish.
+ *
+ * The gain of autotuning over a fixed block size has only been checked under host emulation. It has not been
+ * measured on a device.
+ *
+ * The autotuner is not thread safe, and it should only time one sequence of calls.
+ */
+template<typename T>
+class Autotuner
+    {
+    public:
+        //! Statistic of the samples used to compare parameters.
+        enum class Statistic
+            {
+            Median,     //!< Median of the samples
+            TrimmedMean //!< Mean of the samples without the fastest and slowest quarter
+            };
+
+        //! Constructor.
+        Autotuner(const std::vector<T>& params, unsigned int samples = 5, unsigned int period = 100000);
+
+        //! Destructor.
+        ~Autotuner();
+
+        // events are owned by the autotuner
+        Autotuner(const Autotuner&) = delete;
+        Autotuner& operator=(const Autotuner&) = delete;
+
+        //! Start timing a call with the host clock.
+        void begin();
+
+        //! Stop timing a call with the host clock.
+        void end();
+
+        //! Start timing a call in a stream.
+        void begin(hipper::stream_t stream);
+
+        //! Stop timing a call in a stream.
+        void end(hipper::stream_t stream);
+
+        //! Get the parameter to use for the current call.
+        T getParameter() const
+            {
+            return m_params[m_scanning ? m_current : m_best];
+            }
+
+        //! Get the parameters being tuned.
+        const std::vector<T>& getParameters() const
+            {
+            return m_params;
+            }
+
+        //! Check if the autotuner is scanning the parameters.
+        bool isTuning() const
+            {
+            return m_scanning;
+            }
+
+        //! Get the time of the best parameter from the last scan, in milliseconds.
+        /*!
+         * The time is 0 before the first scan is complete, or if the parameter was set by ::setParameter.
+         */
+        double getBestTime() const
+            {
+            return m_best_time;
+            }
+
+        //! Get the number of samples per parameter.
+        unsigned int getNumSamples() const
+            {
+            return m_samples;
+            }
+
+        //! Get the number of calls between scans.
+        unsigned int getPeriod() const
+            {
+            return m_period;
+            }
+
+        //! Set the number of calls between scans.
+        /*!
+         * \param period Number of calls after a scan before the next scan, or 0 to never scan again.
+         */
+        void setPeriod(unsigned int period)
+            {
+            m_period = period;
+            }
+
+        //! Get the statistic used to compare parameters.
+        Statistic getStatistic() const
+            {
+            return m_statistic;
+            }
+
+        //! Set the statistic used to compare parameters.
+        void setStatistic(Statistic statistic)
+            {
+            m_statistic = statistic;
+            }
+
+        //! Check if the autotuner is enabled.
+        bool getEnabled() const
+            {
+            return m_enabled;
+            }
+
+        //! Enable or disable the autotuner.
+        /*!
+         * \param enabled If false, the best parameter so far is used and no more scans are done.
+         *
+         * Disabling the autotuner during a scan ends the scan, keeping the best parameter
+         * of the samples taken.
+         */
+        void setEnabled(bool enabled);
+
+        //! Set the problem size of the next calls.
+        bool setProblemSize(unsigned int N);
+
+        //! Use a parameter without scanning.
+        void setParameter(T param);
+
+        //! Start a new scan.
+        void scan();
+
+    private:
+        std::vector<T> m_params;    //!< Parameters to tune
+        unsigned int m_samples;     //!< Number of samples per parameter
+        unsigned int m_period;      //!< Number of calls between scans
+        Statistic m_statistic;      //!< Statistic to compare parameters
+        bool m_enabled;             //!< If true, scan the parameters
+
+        bool m_scanning;                            //!< If true, a scan is in progress
+        unsigned int m_current;                     //!< Parameter being sampled in the scan
+        std::vector<std::vector<double>> m_times;   //!< Samples of each parameter in the scan
+        unsigned int m_best;                        //!< Best parameter
+        double m_best_time;                         //!< Time of the best parameter
+        unsigned int m_calls;                       //!< Number of calls since the last scan
+        int m_size_bucket;                          //!< Power of 2 of the problem size, or -1 if not set
+
+        std::chrono::steady_clock::time_point m_start;  //!< Host clock at the start of a call
+        bool m_has_events;                              //!< If true, the events are created
+        hipper::event_t m_start_event;                  //!< Event at the start of a call
+        hipper::event_t m_stop_event;                   //!< Event at the end of a call
+
+        //! Record the time of a call.
+        void record(double time);
+
+        //! Finish the scan and pick the best parameter.
+        void finish();
+
+        //! Compute the statistic of samples.
+        double reduce(std::vector<double> samples) const;
+    };
+
+/*!
+ * \param params Parameters to tune.
+ * \param samples Number of samples per parameter in a scan.
+ * \param period Number of calls after a scan before the next scan, or 0 to never scan again.
+ *
+ * \raises An error if \a params is empty or \a samples is 0.
+ *
+ * The first scan starts immediately.
+ */
+template<typename T>
+Autotuner<T>::Autotuner(const std::vector<T>& params, unsigned int samples, unsigned int period)
+    : m_params(params), m_samples(samples), m_period(period), m_statistic(Statistic::Median),
+      m_enabled(true), m_scanning(false), m_current(0), m_best(0), m_best_time(0.), m_calls(0),
+      m_size_bucket(-1), m_has_events(false)
+    {
+    if (m_params.empty())
+        {
+        throw std::runtime_error("Autotuner requires at least one parameter.");
+        }
+    if (m_samples == 0)
+        {
+        throw std::runtime_error("Autotuner requires at least one sample per parameter.");
+        }
+    scan();
+    }
+
+template<typename T>
+Autotuner<T>::~Autotuner()
+    {
+    if (m_has_events)
+        {
+        hipper::eventDestroy(m_start_event);
+        hipper::eventDestroy(m_stop_event);
+        }
+    }
+
+template<typename T>
+void Autotuner<T>::begin()
+    {
+    if (m_scanning)
+        {
+        m_start = std::chrono::steady_clock::now();
+        }
+    }
+
+/*!
+ * The caller must make sure that the timed work is complete, e.g., by synchronizing a stream.
+ */
+template<typename T>
+void Autotuner<T>::end()
+    {
+    if (m_scanning)
+        {
+        record(std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - m_start).count());
+        }
+    else
+        {
+        record(0.);
+        }
+    }
+
+/*!
+ * \param stream Stream of the call.
+ *
+ * The events are created on first use.
+ */
+template<typename T>
+void Autotuner<T>::begin(hipper::stream_t stream)
+    {
+    if (m_scanning)
+        {
+        if (!m_has_events)
+            {
+            hipper::eventCreate(&m_start_event);
+            hipper::eventCreate(&m_stop_event);
+            m_has_events = true;
+            }
+        hipper::eventRecord(m_start_event, stream);
+        }
+    }
+
+/*!
+ * \param stream Stream of the call.
+ *
+ * During a scan, this waits for the work in the stream to finish.
+ */
+template<typename T>
+void Autotuner<T>::end(hipper::stream_t stream)
+    {
+    if (m_scanning)
+        {
+        hipper::eventRecord(m_stop_event, stream);
+        hipper::eventSynchronize(m_stop_event);
+        float time;
+        hipper::eventElapsedTime(&time, m_start_event, m_stop_event);
+        record(time);
+        }
+    else
+        {
+        record(0.);
+        }
+    }
+
+template<typename T>
+void Autotuner<T>::setEnabled(bool enabled)
+    {
+    m_enabled = enabled;
+    if (!m_enabled && m_scanning)
+        {
+        finish();
+        }
+    }
+
+/*!
+ * \param N Number of primitives or queries.
+ *
+ * \returns True if \a N is in a different power of 2 than the problem size of the last call.
+ *
+ * A new scan starts if the power of 2 changes. Small changes do not trigger a scan, so the problem size
+ * can be set before every call.
+ */
+template<typename T>
+bool Autotuner<T>::setProblemSize(unsigned int N)
+    {
+    int bucket = -1;
+    for (unsigned int n = N; n > 0; n >>= 1)
+        {
+        ++bucket;
+        }
+
+    if (bucket != m_size_bucket)
+        {
+        m_size_bucket = bucket;
+        scan();
+        return true;
+        }
+    else
+        {
+        return false;
+        }
+    }
+
+/*!
+ * \param param Parameter to use, e.g., the best parameter found by an earlier process (see TuningCache).
+ *
+ * \raises An error if \a param is not one of the parameters being tuned.
+ *
+ * Any scan in progress ends, and \a param is used until the next scan.
+ */
+template<typename T>
+void Autotuner<T>::setParameter(T param)
+    {
+    auto it = std::find(m_params.begin(), m_params.end(), param);
+    if (it == m_params.end())
+        {
+        throw std::runtime_error("Autotuner parameter is not being tuned.");
+        }
+    m_best = static_cast<unsigned int>(it - m_params.begin());
+    m_best_time = 0.;
+    m_scanning = false;
+    m_calls = 0;
+    }
+
+/*!
+ * The scan does not start if the autotuner is disabled.
+ */
+template<typename T>
+void Autotuner<T>::scan()
+    {
+    if (!m_enabled) return;
+
+    m_scanning = true;
+    m_current = 0;
+    m_times.assign(m_params.size(), std::vector<double>());
+    for (auto& t : m_times)
+        {
+        t.reserve(m_samples);
+        }
+    }
+
+/*!
+ * \param time Time of the call in milliseconds.
+ */
+template<typename T>
+void Autotuner<T>::record(double time)
+    {
+    if (m_scanning)
+        {
+        m_times[m_current].push_back(time);
+        if (m_times[m_current].size() == m_samples && ++m_current == m_params.size())
+            {
+            finish();
+            }
+        }
+    else if (m_enabled && m_period > 0 && ++m_calls >= m_period)
+        {
+        scan();
+        }
+    }
+
+/*!
+ * Parameters without samples are skipped. If no parameter has samples, the best parameter is unchanged.
+ */
+template<typename T>
+void Autotuner<T>::finish()
+    {
+    bool found = false;
+    for (unsigned int i=0; i < m_params.size(); ++i)
+        {
+        if (m_times[i].empty()) continue;
+
+        const double time = reduce(m_times[i]);
+        if (!found || time < m_best_time)
+            {
+            m_best = i;
+            m_best_time = time;
+            found = true;
+            }
+        }
+    m_scanning = false;
+    m_calls = 0;
+    }
+
+/*!
+ * \param samples Samples of one parameter (nonempty).
+ *
+ * \returns The median of the samples, or the mean without the fastest and slowest quarter.
+ */
+template<typename T>
+double Autotuner<T>::reduce(std::vector<double> samples) const
+    {
+    std::sort(samples.begin(), samples.end());
+    const size_t n = samples.size();
+    if (m_statistic == Statistic::Median)
+        {
+        return (n % 2 == 1) ? samples[n/2] : 0.5*(samples[n/2-1] + samples[n/2]);
+        }
+    else
+        {
+        const size_t trim = n/4;
+        double sum = 0.;
+        for (size_t i=trim; i < n-trim; ++i)
+            {
+            sum += samples[i];
+            }
+        return sum/(n-2*trim);
+        }
+    }
+
+} // end namespace neighbor
+
+#endif // NEIGHBOR_AUTOTUNER_H_
@@ -8,6 +8,8 @@
 #include <hipper/hipper_runtime.h>
 #include "ApproximateMath.h"
 
+#define HOSTDEVICE __host__ __device__ __forceinline__
+
 namespace neighbor
 {
 
@@ -31,14 +33,14 @@ struct BoundingBox
     /*!
      * This constructor may not assign anything, as it causes issues inside kernels.
      */
-    __device__ BoundingBox() {}
+    __host__ __device__ BoundingBox() {}
 
     //! Single-precision constructor
     /*!
      * \param lo_ Lower bound of box.
      * \param hi_ Upper bound of box.
      */
-    __device__ BoundingBox(const float3& lo_, const float3& hi_)
+    __host__ __device__ BoundingBox(const float3& lo_, const float3& hi_)
         : lo(lo_), hi(hi_)
         {}
 
@@ -48,10 +50,8 @@ struct BoundingBox
      * \param hi_ Upper bound of box.
      *
      * \a lo_ is rounded down and \a hi_ is rounded up to the nearest fp32 representable value.
-     *
-     * \todo This needs a __host__ implementation that does not rely on CUDA intrinsics.
      */
-    __device__ BoundingBox(const double3& lo_, const double3& hi_)
+    __host__ __device__ BoundingBox(const double3& lo_, const double3& hi_)
         {
         lo = make_float3(approx::double2float_rd(lo_.x), approx::double2float_rd(lo_.y), approx::double2float_rd(lo_.z));
         hi = make_float3(approx::double2float_ru(hi_.x), approx::double2float_ru(hi_.y), approx::double2float_ru(hi_.z));
@@ -61,7 +61,7 @@ struct BoundingBox
     /*!
      * \returns The center of the box, which is the arithmetic mean of the bounds.
      */
-    __device__ __forceinline__ float3 getCenter() const
+    HOSTDEVICE float3 getCenter() const
         {
         float3 c;
         c.x = 0.5f*(lo.x+hi.x);
@@ -71,6 +71,15 @@ struct BoundingBox
         return c;
         }
 
+    //! Get a box enclosing the box.
+    /*!
+     * \returns The box itself.
+     */
+    HOSTDEVICE BoundingBox getBounds() const
+        {
+        return *this;
+        }
+
     //! Test for overlap between two bounding boxes.
     /*!
      * \param box Bounding box.
@@ -80,7 +89,7 @@ struct BoundingBox
      * The overlap test is performed using cheap comparison operators.
      * The two overlap if none of the dimensions of the box overlap.
      */
-    __device__ __forceinline__ bool overlap(const BoundingBox& box) const
+    HOSTDEVICE bool overlap(const BoundingBox& box) const
         {
         return !(hi.x < box.lo.x || lo.x > box.hi.x ||
                  hi.y < box.lo.y || lo.y > box.hi.y ||
@@ -105,7 +114,7 @@ struct BoundingSphere
     /*!
      * This constructor may not assign anything, as it causes issues inside kernels.
      */
-    __device__ BoundingSphere() {}
+    __host__ __device__ BoundingSphere() {}
 
     //! Single-precision constructor.
     /*!
@@ -113,10 +122,8 @@ struct BoundingSphere
      * \param rsq Squared radius of sphere.
      *
      * \a r is rounded up to ensure it fully encloses all data.
-     *
-     * \todo This needs a __host__ implementation.
      */
-    __device__ BoundingSphere(const float3& o, const float r)
+    __host__ __device__ BoundingSphere(const float3& o, const float r)
         {
         origin = o;
         Rsq = approx::fmul_ru(r,r);
@@ -129,10 +136,8 @@ struct BoundingSphere
      *
      * \a o is rounded down and \a r is padded to ensure the sphere
      * encloses all data.
-     *
-     * \todo This needs a __host__ implementation.
      */
-    __device__ BoundingSphere(const double3& o, const double r)
+    __host__ __device__ BoundingSphere(const double3& o, const double r)
         {
         const float3 lo = make_float3(approx::double2float_rd(o.x),
                                       approx::double2float_rd(o.y),
@@ -146,6 +151,20 @@ struct BoundingSphere
         Rsq = approx::fmul_ru(R,R);
         }
 
+    //! Get a box enclosing the sphere.
+    /*!
+     * \returns The box enclosing the sphere.
+     *
+     * The radius is rounded up, and the bounds are rounded outward, so the box always
+     * encloses the sphere.
+     */
+    HOSTDEVICE BoundingBox getBounds() const
+        {
+        const float R = approx::fsqrt_ru(Rsq);
+        return BoundingBox(make_float3(approx::fsub_rd(origin.x,R), approx::fsub_rd(origin.y,R), approx::fsub_rd(origin.z,R)),
+                           make_float3(approx::fadd_ru(origin.x,R), approx::fadd_ru(origin.y,R), approx::fadd_ru(origin.z,R)));
+        }
+
     //! Test for overlap between a sphere and a BoundingBox.
     /*!
      * \param box Bounding box.
@@ -157,10 +176,8 @@ struct BoundingSphere
      * to this point from \a o is then computed in round down mode. If the squared
      * distance between the point and \a o is less than \a Rsq, then the two
      * objects intersect.
-     *
-     * \todo This needs a __host__ implementation.
      */
-    __device__ __forceinline__ bool overlap(const BoundingBox& box) const
+    HOSTDEVICE bool overlap(const BoundingBox& box) const
         {
         const float3 dr = make_float3(approx::fsub_rd(fminf(fmaxf(origin.x, box.lo.x), box.hi.x), origin.x),
                                       approx::fsub_rd(fminf(fmaxf(origin.y, box.lo.y), box.hi.y), origin.y),
@@ -176,4 +193,6 @@ struct BoundingSphere
 
 } // end namespace neighbor
 
+#undef HOSTDEVICE
+
 #endif // NEIGHBOR_BOUNDING_VOLUMES_H_
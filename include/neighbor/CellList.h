@@ -0,0 +1,348 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#ifndef NEIGHBOR_CELL_LIST_H_
+#define NEIGHBOR_CELL_LIST_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "ApproximateMath.h"
+#include "BoundingVolumes.h"
+#include "OutputOps.h"
+#include "TransformOps.h"
+#include "TranslateOps.h"
+#include "host/ThreadPool.h"
+
+namespace neighbor
+{
+//! Uniform grid of cells on the host.
+/*!
+ * A CellList bins primitives into a uniform grid of cells by the centers of their bounding boxes. It is
+ * usually faster than an LBVH to build and traverse when the primitives fill the scene with a roughly
+ * uniform density, as in a liquid, but it degrades when they are clustered because most cells are then
+ * empty or crowded.
+ *
+ * The cells have at least the width given to ::build. Primitives are counting sorted by cell, so the
+ * primitives in a cell are contiguous and are kept in order of their indexes. Primitives whose centers
+ * are outside the scene are placed in the nearest cell on its boundary.
+ *
+ * The CellList uses the same insert, query, output, translate, and transform operations as LBVHTraverser,
+ * but they must be callable from host code. A query visits every cell that could hold the center of a
+ * primitive overlapping the bounds of its volume, so the \a Volume of the query operation must also
+ * implement getBounds() (see BoundingBox and BoundingSphere). The primitives in these cells are then tested
+ * with the query operation in the same way as the leaves of an LBVH, so the same primitives are found.
+ */
+class CellList
+    {
+    public:
+        //! Setup an unallocated CellList.
+        CellList();
+
+        //! Build the CellList.
+        template<class InsertOpT>
+        void build(host::ThreadPool& pool, const InsertOpT& insert, const float3& lo, const float3& hi, float width);
+
+        //! Traverse the CellList with translation and a primitive transform operation.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+        void traverse(host::ThreadPool& pool,
+                      const QueryOpT& query,
+                      const OutputOpT& out,
+                      const TranslateOpT& images,
+                      const TransformOpT& transform) const;
+
+        //! Traverse the CellList with translation.
+        /*!
+         * \param pool Thread pool.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         * \param images Translation operation for moving search volume around.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         * \tparam TranslateOpT The type of translation operation.
+         */
+        template<class QueryOpT, class OutputOpT, class TranslateOpT>
+        void traverse(host::ThreadPool& pool, const QueryOpT& query, const OutputOpT& out, const TranslateOpT& images) const
+            {
+            traverse(pool, query, out, images, NullTransformOp());
+            }
+
+        //! Traverse the CellList.
+        /*!
+         * \param pool Thread pool.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         *
+         * Only the self image (no translation) is traversed.
+         */
+        template<class QueryOpT, class OutputOpT>
+        void traverse(host::ThreadPool& pool, const QueryOpT& query, const OutputOpT& out) const
+            {
+            traverse(pool, query, out, SelfOp(), NullTransformOp());
+            }
+
+        //! Get the number of primitives.
+        unsigned int getN() const
+            {
+            return m_N;
+            }
+
+        //! Get the number of cells in each dimension.
+        uint3 getDimensions() const
+            {
+            return m_dim;
+            }
+
+        //! Get the width of the cells in each dimension.
+        float3 getWidth() const
+            {
+            return m_width;
+            }
+
+        //! Get the first sorted primitive of each cell.
+        /*!
+         * The cells are ordered with x varying fastest. The last entry is one past the last primitive.
+         */
+        const std::vector<unsigned int>& getCellStarts() const
+            {
+            return m_cell_starts;
+            }
+
+        //! Get the original indexes of the primitives in sorted order.
+        const std::vector<unsigned int>& getPrimitives() const
+            {
+            return m_primitives;
+            }
+
+    private:
+        unsigned int m_N;   //!< Number of primitives
+        float3 m_lo;        //!< Lower bound of scene
+        float3 m_hi;        //!< Upper bound of scene
+        uint3 m_dim;        //!< Number of cells per dimension
+        float3 m_width;     //!< Width of cells
+        float3 m_scale;     //!< Number of cells per unit length
+        float3 m_pad;       //!< Largest extent of a primitive from its center
+
+        std::vector<unsigned int> m_cells;          //!< Cell of each primitive (by index)
+        std::vector<unsigned int> m_cell_starts;    //!< First primitive of each cell
+        std::vector<unsigned int> m_primitives;     //!< Primitive indexes
+        std::vector<float3> m_prim_lo;              //!< Lower bound of sorted primitives
+        std::vector<float3> m_prim_hi;              //!< Upper bound of sorted primitives
+
+        static const unsigned int max_cells_per_primitive = 8;  //!< Cap on the number of cells per primitive
+
+        //! Get the cell coordinate of a position.
+        /*!
+         * \param x Position.
+         * \param lo Lower bound of scene.
+         * \param scale Number of cells per unit length.
+         * \param dim Number of cells.
+         *
+         * \returns The cell holding \a x, which is clamped into the grid.
+         *
+         * The coordinate does not decrease when \a x increases, so a range of positions maps onto a range of cells.
+         */
+        static unsigned int getBin(float x, float lo, float scale, unsigned int dim)
+            {
+            const float f = std::floor((x - lo)*scale);
+            return static_cast<unsigned int>(std::min(std::max(f, 0.f), static_cast<float>(dim-1)));
+            }
+    };
+
+inline CellList::CellList()
+    : m_N(0)
+    {
+    m_lo = m_hi = m_width = m_scale = m_pad = make_float3(0.f, 0.f, 0.f);
+    m_dim = make_uint3(1, 1, 1);
+    }
+
+/*!
+ * \param pool Thread pool for the build.
+ * \param insert The insert operation determining AABB extents of primitives.
+ * \param lo Lower bound of the scene.
+ * \param hi Upper bound of the scene.
+ * \param width Minimum width of a cell.
+ *
+ * \tparam InsertOpT The kind of insert operation.
+ *
+ * The \a width should typically be the largest range of the queries, so that each query only visits
+ * the neighboring cells. The number of cells is capped at 8 per primitive, so the cells may be wider
+ * for dilute scenes. The cell of each primitive is computed in parallel, the primitives are counting
+ * sorted serially, and then their bounds are stored in sorted order in parallel. The \a insert operation
+ * is not needed after this method returns.
+ */
+template<class InsertOpT>
+void CellList::build(host::ThreadPool& pool, const InsertOpT& insert, const float3& lo, const float3& hi, float width)
+    {
+    if (!(width > 0.f))
+        {
+        throw std::runtime_error("CellList width must be positive.");
+        }
+    if (!(hi.x >= lo.x && hi.y >= lo.y && hi.z >= lo.z))
+        {
+        throw std::runtime_error("CellList upper bound must not be less than lower bound.");
+        }
+
+    m_N = insert.size();
+    m_lo = lo;
+    m_hi = hi;
+
+    // choose the number of cells, widening them until there are not too many
+    const float3 L = make_float3(hi.x-lo.x, hi.y-lo.y, hi.z-lo.z);
+    const double max_cells = std::max(64.0, static_cast<double>(max_cells_per_primitive)*m_N);
+    double w = width;
+    for (;;)
+        {
+        m_dim.x = static_cast<unsigned int>(std::max(1.0, std::min(1024.0, std::floor(L.x/w))));
+        m_dim.y = static_cast<unsigned int>(std::max(1.0, std::min(1024.0, std::floor(L.y/w))));
+        m_dim.z = static_cast<unsigned int>(std::max(1.0, std::min(1024.0, std::floor(L.z/w))));
+        const double num_cells = static_cast<double>(m_dim.x)*m_dim.y*m_dim.z;
+        if (num_cells <= max_cells) break;
+        w *= std::max(1.01, std::cbrt(num_cells/max_cells));
+        }
+    m_width = make_float3(L.x/m_dim.x, L.y/m_dim.y, L.z/m_dim.z);
+    m_scale = make_float3((L.x > 0.f) ? m_dim.x/L.x : 0.f,
+                          (L.y > 0.f) ? m_dim.y/L.y : 0.f,
+                          (L.z > 0.f) ? m_dim.z/L.z : 0.f);
+    const unsigned int num_cells = m_dim.x*m_dim.y*m_dim.z;
+
+    // bin the primitives by their centers, and find their largest extent from the centers
+    m_cells.resize(m_N);
+    std::vector<float3> pads(pool.getNumThreads(), make_float3(0.f, 0.f, 0.f));
+    pool.run([&](unsigned int thread)
+        {
+        const auto range = pool.getRange(thread, 0, m_N);
+        float3 pad = make_float3(0.f, 0.f, 0.f);
+        for (unsigned int i=range.first; i < range.second; ++i)
+            {
+            const BoundingBox b = insert.get(i);
+            const float3 c = b.getCenter();
+            pad.x = std::max(pad.x, std::max(approx::fsub_ru(c.x, b.lo.x), approx::fsub_ru(b.hi.x, c.x)));
+            pad.y = std::max(pad.y, std::max(approx::fsub_ru(c.y, b.lo.y), approx::fsub_ru(b.hi.y, c.y)));
+            pad.z = std::max(pad.z, std::max(approx::fsub_ru(c.z, b.lo.z), approx::fsub_ru(b.hi.z, c.z)));
+
+            const unsigned int x = getBin(c.x, m_lo.x, m_scale.x, m_dim.x);
+            const unsigned int y = getBin(c.y, m_lo.y, m_scale.y, m_dim.y);
+            const unsigned int z = getBin(c.z, m_lo.z, m_scale.z, m_dim.z);
+            m_cells[i] = x + m_dim.x*(y + m_dim.y*z);
+            }
+        pads[thread] = pad;
+        });
+    m_pad = make_float3(0.f, 0.f, 0.f);
+    for (const float3& pad : pads)
+        {
+        m_pad.x = std::max(m_pad.x, pad.x);
+        m_pad.y = std::max(m_pad.y, pad.y);
+        m_pad.z = std::max(m_pad.z, pad.z);
+        }
+
+    // counting sort by cell, keeping the primitives of each cell in order
+    m_cell_starts.assign(num_cells+1, 0);
+    for (unsigned int i=0; i < m_N; ++i)
+        {
+        ++m_cell_starts[m_cells[i]+1];
+        }
+    for (unsigned int c=0; c < num_cells; ++c)
+        {
+        m_cell_starts[c+1] += m_cell_starts[c];
+        }
+    m_primitives.resize(m_N);
+        {
+        std::vector<unsigned int> next(m_cell_starts.begin(), m_cell_starts.end()-1);
+        for (unsigned int i=0; i < m_N; ++i)
+            {
+            m_primitives[next[m_cells[i]]++] = i;
+            }
+        }
+
+    // store the bounds in sorted order
+    m_prim_lo.resize(m_N);
+    m_prim_hi.resize(m_N);
+    pool.parallelFor(0, m_N, [&](unsigned int i)
+        {
+        const BoundingBox b = insert.get(m_primitives[i]);
+        m_prim_lo[i] = b.lo;
+        m_prim_hi[i] = b.hi;
+        });
+    }
+
+/*!
+ * \param pool Thread pool.
+ * \param query Query operation for defining search volumes and overlaps.
+ * \param out Output operation for intersected primitives.
+ * \param images Translation operation for moving search volume around.
+ * \param transform Transformation operation for cached primitive indexes.
+ *
+ * \tparam QueryOpT The type of query operation.
+ * \tparam OutputOpT The type of output operation.
+ * \tparam TranslateOpT The type of translation operation.
+ * \tparam TransformOpT The type of transformation operation.
+ *
+ * One thread is used per query, and queries are assigned to the threads dynamically in small chunks.
+ * For each image, the bounds of the query volume are padded by the largest extent of a primitive from
+ * its center, and the cells overlapping the padded bounds are visited. There is no limit on the number
+ * of \a images. The \a out operation is set up and finalized for every query, even if the CellList is empty.
+ */
+template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+void CellList::traverse(host::ThreadPool& pool,
+                        const QueryOpT& query,
+                        const OutputOpT& out,
+                        const TranslateOpT& images,
+                        const TransformOpT& transform) const
+    {
+    const unsigned int N = query.size();
+    pool.dynamicFor(0, N, 64, [&](unsigned int idx, unsigned int)
+        {
+        const typename QueryOpT::ThreadData qdata = query.setup(idx);
+        typename OutputOpT::ThreadData result = out.setup(idx, qdata);
+
+        bool done = false;
+        for (unsigned int i=0; !done && m_N > 0 && i < images.size(); ++i)
+            {
+            const typename QueryOpT::Volume q = query.get(qdata, images.get(i));
+            const BoundingBox b = q.getBounds();
+
+            const uint3 cell_lo = make_uint3(getBin(approx::fsub_rd(b.lo.x, m_pad.x), m_lo.x, m_scale.x, m_dim.x),
+                                             getBin(approx::fsub_rd(b.lo.y, m_pad.y), m_lo.y, m_scale.y, m_dim.y),
+                                             getBin(approx::fsub_rd(b.lo.z, m_pad.z), m_lo.z, m_scale.z, m_dim.z));
+            const uint3 cell_hi = make_uint3(getBin(approx::fadd_ru(b.hi.x, m_pad.x), m_lo.x, m_scale.x, m_dim.x),
+                                             getBin(approx::fadd_ru(b.hi.y, m_pad.y), m_lo.y, m_scale.y, m_dim.y),
+                                             getBin(approx::fadd_ru(b.hi.z, m_pad.z), m_lo.z, m_scale.z, m_dim.z));
+            for (unsigned int z=cell_lo.z; !done && z <= cell_hi.z; ++z)
+                {
+                for (unsigned int y=cell_lo.y; !done && y <= cell_hi.y; ++y)
+                    {
+                    const unsigned int row = m_dim.x*(y + m_dim.y*z);
+                    const unsigned int begin = m_cell_starts[row + cell_lo.x];
+                    const unsigned int end = m_cell_starts[row + cell_hi.x + 1];
+                    for (unsigned int j=begin; !done && j < end; ++j)
+                        {
+                        if (!query.overlap(q, BoundingBox(m_prim_lo[j], m_prim_hi[j])))
+                            continue;
+
+                        const unsigned int primitive = transform(m_primitives[j]);
+                        if (query.refine(qdata, primitive))
+                            done = output_process(out, result, primitive);
+                        }
+                    }
+                }
+            }
+
+        out.finalize(result);
+        });
+    }
+
+} // end namespace neighbor
+
+#endif // NEIGHBOR_CELL_LIST_H_
@@ -32,7 +32,7 @@ struct PointInsertOp
      *
      * \returns The enclosing BoundingBox
      */
-    __device__ __forceinline__ BoundingBox get(const unsigned int idx) const
+    __host__ __device__ __forceinline__ BoundingBox get(const unsigned int idx) const
         {
         const float3 p = points[idx];
 
@@ -72,7 +72,7 @@ struct SphereInsertOp
      *
      * \returns The enclosing BoundingBox
      */
-    __device__ __forceinline__ BoundingBox get(unsigned int idx) const
+    __host__ __device__ __forceinline__ BoundingBox get(unsigned int idx) const
         {
         const float3 point = points[idx];
         const float3 lo = make_float3(point.x-r, point.y-r, point.z-r);
@@ -95,6 +95,51 @@ struct SphereInsertOp
     const unsigned int N;  //!< Number of spheres
     };
 
+//! Insertion operation for a subset of the primitives of another insertion operation
+/*!
+ * Primitive \a idx of the subset is primitive \a indexes[idx] of the wrapped operation. The
+ * \a indexes must be accessible wherever get() is called.
+ *
+ * \tparam InsertOpT The kind of insert operation holding the primitives.
+ */
+template<class InsertOpT>
+struct SubsetInsertOp
+    {
+    //! Constructor
+    /*!
+     * \param insert_ The insert operation holding the primitives
+     * \param indexes_ Indexes of the primitives in the subset
+     * \param N_ The number of primitives in the subset
+     */
+    SubsetInsertOp(const InsertOpT& insert_, const unsigned int* indexes_, unsigned int N_)
+        : insert(insert_), indexes(indexes_), N(N_)
+        {}
+
+    //! Get the bounding volume for a given primitive
+    /*!
+     * \param idx the index of the primitive in the subset
+     *
+     * \returns The enclosing BoundingBox
+     */
+    __host__ __device__ __forceinline__ BoundingBox get(unsigned int idx) const
+        {
+        return insert.get(indexes[idx]);
+        }
+
+    //! Get the number of leaf node bounding volumes
+    /*!
+     * \returns The number of primitives in the subset
+     */
+    __host__ __device__ __forceinline__ unsigned int size() const
+        {
+        return N;
+        }
+
+    const InsertOpT insert;         //!< Insert operation holding the primitives
+    const unsigned int* indexes;    //!< Indexes of the primitives in the subset
+    const unsigned int N;           //!< Number of primitives in the subset
+    };
+
 } // end namespace neighbor
 
 #endif // NEIGHBOR_INSERT_OPS_H_
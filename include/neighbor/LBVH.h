@@ -8,11 +8,20 @@
 #include <assert.h>
 #include <hipper/hipper_runtime.h>
 
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "InsertOps.h"
 #include "Memory.h"
+#include "PhaseTimer.h"
 #include "Tunable.h"
 
 #include "LBVHData.h"
 #include "kernels/LBVH.cuh"
+#include "host/LBVH.h"
+#include "host/ThreadPool.h"
 
 namespace neighbor
 {
@@ -43,6 +52,16 @@ namespace neighbor
  *
  * For processing the LBVH in GPU kernels, it may be useful to obtain an object containing
  * only the raw pointers to the tree data using ::data (see LBVHData).
+ *
+ * When only a few primitives are added or removed, the LBVH can be updated in place on the host
+ * using ::insertPrimitives and ::removePrimitives instead of being rebuilt. These updates degrade
+ * the quality of the tree, which is tracked by ::getQuality. The ::update method applies
+ * a set of changes and falls back to a full ::build when the quality exceeds the
+ * rebuild threshold (see ::setRebuildThreshold). When the primitives have only moved a little,
+ * ::refit updates the bounding boxes without changing the hierarchy.
+ *
+ * The methods taking a host::ThreadPool can be compiled by a host compiler. The methods in a stream are
+ * only defined when the header is compiled by a device compiler (nvcc or hipcc).
  */
 class LBVH : public Tunable<unsigned int>
     {
@@ -54,7 +73,7 @@ class LBVH : public Tunable<unsigned int>
         template<class InsertOpT>
         void setup(const LaunchParameters& params, const InsertOpT& insert)
             {
-            allocate(params, insert.size());
+            allocate(insert.size());
             }
 
         //! Setup LBVH memory for building.
@@ -73,7 +92,19 @@ class LBVH : public Tunable<unsigned int>
 
         //! Build the LBVH in a stream with tunable parameters.
         template<class InsertOpT>
-        void build(const LaunchParameters& params, const InsertOpT& insert, const float3& lo, const float3& hi);
+        void build(const LaunchParameters& params, const InsertOpT& insert, const float3& lo, const float3& hi)
+            {
+            NullPhaseTimer timer;
+            build(params, insert, lo, hi, timer);
+            }
+
+        //! Build the LBVH in a stream with tunable parameters and timed phases.
+        template<class InsertOpT, class TimerT>
+        void build(const LaunchParameters& params,
+                   const InsertOpT& insert,
+                   const float3& lo,
+                   const float3& hi,
+                   TimerT& timer);
 
         //! Build the LBVH in a stream.
         /*!
@@ -84,12 +115,15 @@ class LBVH : public Tunable<unsigned int>
          *
          * \tparam InsertOpT The kind of insert operation.
          *
-         * The tunable block size defaults to 32 threads per block.
+         * The tunable block size defaults to 32 threads per block, or it is autotuned (see ::setAutotuning).
          */
         template<class InsertOpT>
         void build(hipper::stream_t stream, const InsertOpT& insert, const float3& lo, const float3& hi)
             {
-            build(LaunchParameters(32,stream), insert, lo, hi);
+            tune("LBVH", "build", TuningCache::Types<InsertOpT>(), insert.size(), stream, 32, [&](const LaunchParameters& params)
+                {
+                build(params, insert, lo, hi);
+                });
             }
 
         //! Build the LBVH.
@@ -108,6 +142,156 @@ class LBVH : public Tunable<unsigned int>
             build(0, insert, lo, hi);
             }
 
+        //! Build the LBVH on the host.
+        template<class InsertOpT>
+        void build(host::ThreadPool& pool, const InsertOpT& insert, const float3& lo, const float3& hi)
+            {
+            NullPhaseTimer timer;
+            build(pool, insert, lo, hi, timer);
+            }
+
+        //! Build the LBVH on the host with timed phases.
+        template<class InsertOpT, class TimerT>
+        void build(host::ThreadPool& pool, const InsertOpT& insert, const float3& lo, const float3& hi, TimerT& timer);
+
+        //! Refit the bounding boxes of the LBVH in a stream with tunable parameters.
+        template<class InsertOpT>
+        void refit(const LaunchParameters& params, const InsertOpT& insert);
+
+        //! Refit the bounding boxes of the LBVH in a stream.
+        /*!
+         * \param stream CUDA stream for kernel execution.
+         * \param insert The insert operation holding the primitives.
+         *
+         * \tparam InsertOpT The kind of insert operation.
+         *
+         * The tunable block size defaults to 32 threads per block, or it is autotuned (see ::setAutotuning).
+         */
+        template<class InsertOpT>
+        void refit(hipper::stream_t stream, const InsertOpT& insert)
+            {
+            tune("LBVH", "refit", TuningCache::Types<InsertOpT>(), insert.size(), stream, 32, [&](const LaunchParameters& params)
+                {
+                refit(params, insert);
+                });
+            }
+
+        //! Refit the bounding boxes of the LBVH.
+        /*!
+         * \param insert The insert operation holding the primitives.
+         *
+         * \tparam InsertOpT The kind of insert operation.
+         *
+         * The tunable block size defaults to 32 threads per block, and the kernel executes in the default stream.
+         */
+        template<class InsertOpT>
+        void refit(const InsertOpT& insert)
+            {
+            refit(0, insert);
+            }
+
+        //! Refit the bounding boxes of the LBVH on the host.
+        template<class InsertOpT>
+        void refit(host::ThreadPool& pool, const InsertOpT& insert);
+
+        //! Insert primitives into the LBVH without rebuilding it.
+        template<class InsertOpT>
+        void insertPrimitives(const InsertOpT& insert, const unsigned int* primitives, unsigned int count);
+
+        //! Remove primitives from the LBVH without rebuilding it.
+        void removePrimitives(const unsigned int* primitives, unsigned int count);
+
+        //! Update the LBVH in a stream with tunable parameters, rebuilding only if needed.
+        template<class InsertOpT>
+        bool update(const LaunchParameters& params,
+                    const InsertOpT& insert,
+                    const float3& lo,
+                    const float3& hi,
+                    const unsigned int* removed,
+                    unsigned int num_removed,
+                    const unsigned int* inserted,
+                    unsigned int num_inserted);
+
+        //! Update the LBVH in a stream, rebuilding only if needed.
+        /*!
+         * \param stream CUDA stream for kernel execution.
+         * \param insert The insert operation holding the primitives.
+         * \param lo Lower bound of the scene.
+         * \param hi Upper bound of the scene.
+         * \param removed Primitives to remove.
+         * \param num_removed Number of primitives to remove.
+         * \param inserted Primitives to insert.
+         * \param num_inserted Number of primitives to insert.
+         *
+         * \returns True if the LBVH was rebuilt.
+         *
+         * \tparam InsertOpT The kind of insert operation.
+         *
+         * The tunable block size defaults to 32 threads per block.
+         */
+        template<class InsertOpT>
+        bool update(hipper::stream_t stream,
+                    const InsertOpT& insert,
+                    const float3& lo,
+                    const float3& hi,
+                    const unsigned int* removed,
+                    unsigned int num_removed,
+                    const unsigned int* inserted,
+                    unsigned int num_inserted)
+            {
+            return update(LaunchParameters(32,stream), insert, lo, hi, removed, num_removed, inserted, num_inserted);
+            }
+
+        //! Update the LBVH, rebuilding only if needed.
+        /*!
+         * \param insert The insert operation holding the primitives.
+         * \param lo Lower bound of the scene.
+         * \param hi Upper bound of the scene.
+         * \param removed Primitives to remove.
+         * \param num_removed Number of primitives to remove.
+         * \param inserted Primitives to insert.
+         * \param num_inserted Number of primitives to insert.
+         *
+         * \returns True if the LBVH was rebuilt.
+         *
+         * \tparam InsertOpT The kind of insert operation.
+         *
+         * The tunable block size defaults to 32 threads per block, and the kernel executes in the default stream.
+         */
+        template<class InsertOpT>
+        bool update(const InsertOpT& insert,
+                    const float3& lo,
+                    const float3& hi,
+                    const unsigned int* removed,
+                    unsigned int num_removed,
+                    const unsigned int* inserted,
+                    unsigned int num_inserted)
+            {
+            return update(0, insert, lo, hi, removed, num_removed, inserted, num_inserted);
+            }
+
+        //! Get the quality of the LBVH relative to the last build.
+        float getQuality() const;
+
+        //! Get the quality at which ::update rebuilds the LBVH.
+        float getRebuildThreshold() const
+            {
+            return m_rebuild_threshold;
+            }
+
+        //! Set the quality at which ::update rebuilds the LBVH.
+        /*!
+         * \param threshold Ratio of the current to built surface area heuristic cost (must be at least 1).
+         */
+        void setRebuildThreshold(float threshold)
+            {
+            if (!(threshold >= 1.f))
+                {
+                throw std::runtime_error("LBVH rebuild threshold must be at least 1.");
+                }
+            m_rebuild_threshold = threshold;
+            }
+
         //! Get the LBVH root node.
         int getRoot() const
             {
@@ -200,8 +384,48 @@ class LBVH : public Tunable<unsigned int>
 
         shared_array<unsigned int> m_locks; //!< Node locks for generating aabb hierarchy
 
+        float m_rebuild_threshold;  //!< Quality at which to rebuild during update
+        mutable bool m_area_valid;  //!< If true, the internal node area is current
+        mutable float m_area;       //!< Summed surface area of the internal nodes
+        mutable float m_build_cost; //!< Cost of the tree after the last build (0 if unknown)
+
+        std::unordered_map<unsigned int,int> m_leaves;  //!< Leaf node holding each primitive
+        bool m_leaves_valid;                            //!< If true, the leaf map is current
+
+        bool m_touched; //!< If true, the arrays were first touched in parallel by a host build
+
         //! Allocate.
-        void allocate(const LaunchParameters& params, unsigned int N);
+        void allocate(unsigned int N);
+
+        //! Resize the LBVH for dynamic updates, preserving its data.
+        void resize(unsigned int N);
+
+        //! Grow an array, preserving its data.
+        template<typename T>
+        static void grow(shared_array<T>& array, size_t size, size_t keep);
+
+        //! Mark tree data computed on the host as stale.
+        void invalidate()
+            {
+            m_area_valid = false;
+            m_build_cost = 0.f;
+            m_leaves_valid = false;
+            }
+
+        //! Compute the summed internal node area if it is not current.
+        void computeArea() const;
+
+        //! Compute the surface area heuristic cost of the tree.
+        float computeCost() const;
+
+        //! Map primitives to leaf nodes if the map is not current.
+        void mapLeaves();
+
+        //! Insert one primitive into the LBVH.
+        void insertPrimitive(unsigned int primitive, const float3& lo, const float3& hi);
+
+        //! Remove one primitive from the LBVH.
+        void removePrimitive(unsigned int primitive);
 
         //! Get the pointer version of the data in the tree.
         const LBVHData data()
@@ -223,27 +447,42 @@ class LBVH : public Tunable<unsigned int>
  */
 LBVH::LBVH()
     : Tunable<unsigned int>(32, 1024, 32),
-      m_root(LBVHSentinel), m_N(0), m_N_internal(0), m_N_nodes(0)
+      m_root(LBVHSentinel), m_N(0), m_N_internal(0), m_N_nodes(0),
+      m_rebuild_threshold(1.25f), m_area_valid(false), m_area(0.f), m_build_cost(0.f),
+      m_leaves_valid(false), m_touched(false)
     {}
 
+#if defined(__CUDACC__) || defined(__HIPCC__)
 /*!
  * \param params Launch parameters for kernel execution, including tunable block size and stream.
  * \param insert The insert operation holding the primitives.
  * \param lo Lower bound of the scene.
  * \param hi Upper bound of the scene.
+ * \param timer Timer of the phases.
  *
  * \tparam InsertOpT The kind of insert operation.
+ * \tparam TimerT The kind of phase timer (PhaseTimer, or NullPhaseTimer for no timing).
  *
  * The LBVH is constructed using the algorithm due to Karras using 30-bit Morton codes.
  * The caller should ensure that all \a points lie within \a lo and \a hi for best performance.
  * Points lying outside this range are clamped to it during the Morton code calculation, which
  * may lead to a low quality LBVH.
+ *
+ * The phases of the build are timed in the stream: "codes" (Morton code generation), "sort" (radix sort of
+ * the codes), "tree" (hierarchy generation), and "bubble" (fitting the bounding boxes).
  */
-template<class InsertOpT>
-void LBVH::build(const LaunchParameters& params, const InsertOpT& insert, const float3& lo, const float3& hi)
+template<class InsertOpT, class TimerT>
+void LBVH::build(const LaunchParameters& params,
+                 const InsertOpT& insert,
+                 const float3& lo,
+                 const float3& hi,
+                 TimerT& timer)
     {
+    timer.reset();
+
     // resize memory for the tree (will do nothing if setup already called)
     setup(params, insert);
+    invalidate();
 
     // if N = 0, don't do anything and quit, since this is an empty lbvh
     if (m_N == 0) return;
@@ -252,7 +491,7 @@ void LBVH::build(const LaunchParameters& params, const InsertOpT& insert, const
     if (m_N == 1)
         {
         LBVHData tree = data();
-        gpu::lbvh_one_primitive(tree, insert, params.stream);
+        gpu::lbvh_one_primitive(tree, insert, false, params.stream);
         return;
         }
 
@@ -260,6 +499,7 @@ void LBVH::build(const LaunchParameters& params, const InsertOpT& insert, const
     checkParameter(params);
 
     // calculate morton codes
+    timer.begin("codes", params.stream);
     gpu::lbvh_gen_codes(m_codes.current().get(),
                         m_indexes.current().get(),
                         insert,
@@ -268,8 +508,11 @@ void LBVH::build(const LaunchParameters& params, const InsertOpT& insert, const
                         m_N,
                         params.tunable,
                         params.stream);
+    timer.addWork(m_N, 8ull*m_N);
+    timer.end(params.stream);
 
     // sort morton codes
+    timer.begin("sort", params.stream);
         {
         uchar2 swap;
 
@@ -283,8 +526,13 @@ void LBVH::build(const LaunchParameters& params, const InsertOpT& insert, const
                              m_N,
                              params.stream);
 
-        // allocation already be taken care of by setup() call above, so assume here.
-        assert(m_tmp.size() >= tmp_bytes);
+        // the CUB storage is sized here rather than in setup() so that host-only code does not depend on CUB
+        if (tmp_bytes == 0) tmp_bytes = 4; // make at least 4 bytes (old workaround)
+        if (tmp_bytes > m_tmp.size())
+            {
+            shared_array<unsigned char> tmp(tmp_bytes);
+            m_tmp.swap(tmp);
+            }
 
         swap = gpu::lbvh_sort_codes((void*)m_tmp.get(),
                                     tmp_bytes,
@@ -299,16 +547,132 @@ void LBVH::build(const LaunchParameters& params, const InsertOpT& insert, const
         if (swap.x) m_codes.flip();
         if (swap.y) m_indexes.flip();
         }
+    timer.addWork(m_N, 16ull*m_N);
+    timer.end(params.stream);
 
     // process hierarchy and bubble aabbs
     LBVHData tree = data();
 
+    timer.begin("tree", params.stream);
     gpu::lbvh_gen_tree(tree,
                        m_codes.current().get(),
                        m_N,
                        params.tunable,
                        params.stream);
+    timer.addWork(m_N_internal, 4ull*m_N + 8ull*m_N_internal + 4ull*m_N_nodes);
+    timer.end(params.stream);
+
+    timer.begin("bubble", params.stream);
+    gpu::lbvh_bubble_aabbs(tree,
+                           insert,
+                           m_locks.get(),
+                           m_N,
+                           params.tunable,
+                           params.stream);
+    timer.addWork(m_N, 4ull*m_N + 24ull*m_N_nodes);
+    timer.end(params.stream);
+    }
+#endif // __CUDACC__ || __HIPCC__
+
+/*!
+ * \param pool Thread pool for the build.
+ * \param insert The insert operation holding the primitives.
+ * \param lo Lower bound of the scene.
+ * \param hi Upper bound of the scene.
+ * \param timer Timer of the phases.
+ *
+ * \tparam InsertOpT The kind of insert operation.
+ * \tparam TimerT The kind of phase timer (PhaseTimer, or NullPhaseTimer for no timing).
+ *
+ * The LBVH is constructed on the host by partitioning the primitives into buckets by the top bits of their
+ * Morton codes and building the buckets in parallel (see host::lbvh_build_partitioned). The resulting LBVH is
+ * equivalent to one constructed by the GPU build, so it can be traversed in the same way. The \a insert operation
+ * must be callable from host code, and the caller must ensure any work on the LBVH in other streams has
+ * completed. The LBVH is ready to use when this method returns.
+ *
+ * The first build after the memory of the LBVH is allocated touches it in parallel with the same partitioning as the
+ * Morton codes (see host::lbvh_first_touch), so that its pages are spread over the NUMA nodes of the threads. This
+ * pass is not timed.
+ *
+ * The phases of the build are timed on the host: "partition" (Morton codes and buckets), "buckets" (sorting,
+ * generating, and fitting the buckets), and "top" (stitching the buckets together).
+ *
+ * \note
+ * The parallel scaling of this build has not been measured: it has only been run on one core, so the speedup with
+ * more threads and the benefit of the first touch are unverified.
+ */
+template<class InsertOpT, class TimerT>
+void LBVH::build(host::ThreadPool& pool, const InsertOpT& insert, const float3& lo, const float3& hi, TimerT& timer)
+    {
+    timer.reset();
+    setup(insert);
+    invalidate();
+
+    if (m_N == 0) return;
+
+    LBVHData tree = data();
+    if (m_N == 1)
+        {
+        const BoundingBox b = insert.get(0);
+        tree.parent[0] = LBVHSentinel;
+        tree.lo[0] = b.lo;
+        tree.hi[0] = b.hi;
+        tree.primitive[0] = 0;
+        return;
+        }
+
+    // place the pages of new arrays near the threads that use them
+    if (!m_touched)
+        {
+        host::lbvh_first_touch(pool,
+                               tree,
+                               m_codes.current().get(),
+                               m_codes.alternate().get(),
+                               m_indexes.alternate().get(),
+                               m_N);
+        m_touched = true;
+        }
+
+    host::lbvh_build_partitioned(pool,
+                                 tree,
+                                 m_codes.current().get(),
+                                 m_indexes.current().get(),
+                                 m_codes.alternate().get(),
+                                 m_indexes.alternate().get(),
+                                 insert,
+                                 lo,
+                                 hi,
+                                 m_N,
+                                 timer);
+    }
+
+#if defined(__CUDACC__) || defined(__HIPCC__)
+/*!
+ * \param params Launch parameters for kernel execution, including tunable block size and stream.
+ * \param insert The insert operation holding the primitives.
+ *
+ * \tparam InsertOpT The kind of insert operation.
+ *
+ * The bounding boxes of the leaves are recomputed from \a insert for the primitives already in the
+ * LBVH, and the bounding boxes of the internal nodes are refit bottom-up, but the hierarchy is not changed.
+ * This is much cheaper than ::build when the primitives have only moved a little, and the node indexes
+ * remain the same (e.g., for LBVHTraverser::traverseCached). The quality of the tree degrades as the
+ * primitives move, which is tracked by ::getQuality, so the LBVH should be rebuilt periodically.
+ */
+template<class InsertOpT>
+void LBVH::refit(const LaunchParameters& params, const InsertOpT& insert)
+    {
+    m_area_valid = false;
+    if (m_N == 0) return;
+
+    LBVHData tree = data();
+    if (m_N == 1)
+        {
+        gpu::lbvh_one_primitive(tree, insert, true, params.stream);
+        return;
+        }
 
+    checkParameter(params);
     gpu::lbvh_bubble_aabbs(tree,
                            insert,
                            m_locks.get(),
@@ -316,9 +680,42 @@ void LBVH::build(const LaunchParameters& params, const InsertOpT& insert, const
                            params.tunable,
                            params.stream);
     }
+#endif // __CUDACC__ || __HIPCC__
+
+/*!
+ * \param pool Thread pool for the refit.
+ * \param insert The insert operation holding the primitives.
+ *
+ * \tparam InsertOpT The kind of insert operation.
+ *
+ * This is the host equivalent of ::refit in a stream. The leaves are fit in parallel, and then
+ * the internal nodes are refit serially (see host::lbvh_bubble_aabb). The \a insert operation
+ * must be callable from host code, and the caller must ensure any work on the LBVH in other
+ * streams has completed.
+ */
+template<class InsertOpT>
+void LBVH::refit(host::ThreadPool& pool, const InsertOpT& insert)
+    {
+    m_area_valid = false;
+    if (m_N == 0) return;
+
+    LBVHData tree = data();
+    const unsigned int N_internal = m_N_internal;
+    pool.parallelFor(0, m_N, [&](unsigned int i)
+        {
+        const BoundingBox b = insert.get(tree.primitive[i]);
+        tree.lo[N_internal+i] = b.lo;
+        tree.hi[N_internal+i] = b.hi;
+        });
+
+    std::vector<unsigned char> locks(N_internal, 0);
+    for (unsigned int i=0; i < m_N; ++i)
+        {
+        host::lbvh_bubble_aabb(tree, N_internal+i, m_root, locks.data(), 0);
+        }
+    }
 
 /*!
- * \param params Kernel launch parameters (only used for stream).
  * \param N Number of primitives.
  *
  * Initializes the memory for an LBVH holding \a N primitives. The memory
@@ -328,12 +725,13 @@ void LBVH::build(const LaunchParameters& params, const InsertOpT& insert, const
  * flag used to backpropagate the bounding boxes.
  *
  * Primitive sorting requires 4N integers of storage, which is allocated persistently
- * to avoid the overhead of repeated malloc / free calls.
+ * to avoid the overhead of repeated malloc / free calls. The temporary storage of the
+ * radix sort is sized by ::build in a stream, which is the only method that uses it.
  *
  * \note
  * Additional calls to allocate are ignored if \a N has not changed from the previous call.
  */
-void LBVH::allocate(const LaunchParameters& params, unsigned int N)
+void LBVH::allocate(unsigned int N)
     {
     // do nothing if N has not changed
     if (N == m_N) return;
@@ -348,6 +746,8 @@ void LBVH::allocate(const LaunchParameters& params, unsigned int N)
         {
         shared_array<int> parent(m_N_nodes);
         m_parent.swap(parent);
+
+        m_touched = false;
         }
 
     // internal nodes
@@ -359,6 +759,8 @@ void LBVH::allocate(const LaunchParameters& params, unsigned int N)
         shared_array<int> right(m_N_internal);
         m_right.swap(right);
 
+        m_touched = false;
+
         shared_array<unsigned int> locks(m_N_internal);
         m_locks.swap(locks);
         }
@@ -371,6 +773,8 @@ void LBVH::allocate(const LaunchParameters& params, unsigned int N)
 
         shared_array<float3> hi(m_N_nodes);
         m_hi.swap(hi);
+
+        m_touched = false;
         }
 
     // sorting arrays
@@ -381,24 +785,412 @@ void LBVH::allocate(const LaunchParameters& params, unsigned int N)
 
         buffered_array<unsigned int> indexes(m_N);
         m_indexes.swap(indexes);
+
+        m_touched = false;
+        }
+    }
+
+/*!
+ * \param insert The insert operation holding the primitives.
+ * \param primitives Indexes of the primitives to insert.
+ * \param count Number of primitives to insert.
+ *
+ * \tparam InsertOpT The kind of insert operation.
+ *
+ * Each primitive is inserted as a new leaf next to the sibling that minimizes the
+ * surface area heuristic cost (see host::lbvh_find_sibling), and the bounding boxes
+ * of its ancestors are refit. This is done on the host, so the \a insert operation must
+ * be callable from host code, and the caller must ensure any work on the LBVH in other streams
+ * has completed. The cost of each insertion is proportional to the depth of the tree, plus a
+ * copy of the primitive array to maintain the node layout.
+ *
+ * A std::runtime_error is thrown if a primitive is already in the LBVH.
+ */
+template<class InsertOpT>
+void LBVH::insertPrimitives(const InsertOpT& insert, const unsigned int* primitives, unsigned int count)
+    {
+    for (unsigned int i=0; i < count; ++i)
+        {
+        const BoundingBox b = insert.get(primitives[i]);
+        insertPrimitive(primitives[i], b.lo, b.hi);
+        }
+    }
+
+/*!
+ * \param primitives Indexes of the primitives to remove.
+ * \param count Number of primitives to remove.
+ *
+ * Each leaf is removed by splicing its sibling into the place of its parent, and the
+ * bounding boxes of the remaining ancestors are refit. The node storage is then compacted by
+ * moving at most one internal node and two leaves so that the usual layout of the LBVH is maintained.
+ * The same requirements as ::insertPrimitives apply.
+ *
+ * A std::runtime_error is thrown if a primitive is not in the LBVH.
+ */
+inline void LBVH::removePrimitives(const unsigned int* primitives, unsigned int count)
+    {
+    for (unsigned int i=0; i < count; ++i)
+        {
+        removePrimitive(primitives[i]);
+        }
+    }
+
+/*!
+ * \param params Launch parameters for kernel execution, including tunable block size and stream.
+ * \param insert The insert operation holding the primitives.
+ * \param lo Lower bound of the scene.
+ * \param hi Upper bound of the scene.
+ * \param removed Primitives to remove.
+ * \param num_removed Number of primitives to remove.
+ * \param inserted Primitives to insert.
+ * \param num_inserted Number of primitives to insert.
+ *
+ * \returns True if the LBVH was rebuilt.
+ *
+ * \tparam InsertOpT The kind of insert operation.
+ *
+ * The \a removed primitives are first removed from the LBVH, and then the \a inserted primitives are
+ * inserted (see ::removePrimitives and ::insertPrimitives). If the quality of the resulting tree
+ * exceeds the rebuild threshold, the LBVH is rebuilt using ::build from the primitives of \a insert
+ * that are in the LBVH after the update. These can be any subset of the primitives of \a insert, so
+ * removed primitives do not need to be compacted out of \a insert. \a params.stream is synchronized
+ * before the tree is updated on the host and after a rebuild from a subset.
+ */
+template<class InsertOpT>
+bool LBVH::update(const LaunchParameters& params,
+                  const InsertOpT& insert,
+                  const float3& lo,
+                  const float3& hi,
+                  const unsigned int* removed,
+                  unsigned int num_removed,
+                  const unsigned int* inserted,
+                  unsigned int num_inserted)
+    {
+    hipper::streamSynchronize(params.stream);
+
+    removePrimitives(removed, num_removed);
+    insertPrimitives(insert, inserted, num_inserted);
+
+    if (getQuality() <= m_rebuild_threshold)
+        {
+        return false;
+        }
+
+    // the primitives are distinct, so they are all of insert if there are as many and each is in range
+    const unsigned int N = m_N;
+    const unsigned int* primitives = m_indexes.current().get();
+    if (N == insert.size() && std::all_of(primitives, primitives + N, [N](unsigned int p) { return p < N; }))
+        {
+        build(params, insert, lo, hi);
+        }
+    else
+        {
+        // build from the subset, then map the primitives back to the indexes in insert
+        shared_array<unsigned int> subset(N);
+        std::copy(primitives, primitives + N, subset.get());
+        build(params, SubsetInsertOp<InsertOpT>(insert, subset.get(), N), lo, hi);
+        hipper::streamSynchronize(params.stream);
+
+        unsigned int* built = m_indexes.current().get();
+        for (unsigned int i=0; i < N; ++i)
+            {
+            built[i] = subset[built[i]];
+            }
+        invalidate();
         }
+    return true;
+    }
+
+/*!
+ * \returns The ratio of the current surface area heuristic (SAH) cost to the cost after the last ::build.
+ *
+ * The SAH cost is the summed surface area of the internal nodes relative to the surface area of the root.
+ * A value of 1 means the tree is as good as when it was built, while larger values mean that more nodes are
+ * expected to be visited during traversal. The cost is computed on the host the first time it is needed
+ * after a build, so the caller must ensure the build has completed. Trees with fewer than 3 primitives
+ * always have a quality of 1.
+ */
+inline float LBVH::getQuality() const
+    {
+    if (m_N < 3) return 1.f;
+
+    computeArea();
+    const float cost = computeCost();
+    if (m_build_cost <= 0.f)
+        {
+        m_build_cost = cost;
+        }
+
+    return (m_build_cost > 0.f) ? cost/m_build_cost : 1.f;
+    }
 
-    // check for required size of CUB allocation
-    size_t tmp_bytes = 0;
-    gpu::lbvh_sort_codes(NULL,
-                         tmp_bytes,
-                         m_codes.current().get(),
-                         m_codes.alternate().get(),
-                         m_indexes.current().get(),
-                         m_indexes.alternate().get(),
-                         m_N,
-                         params.stream);
-    if (tmp_bytes == 0) tmp_bytes = 4; // make at least 4 bytes (old workaround)
-    if (tmp_bytes > m_tmp.size())
+/*!
+ * \param N Number of primitives.
+ *
+ * Unlike ::allocate, the tree data and primitives are preserved when the memory grows. The
+ * capacity grows geometrically so that repeated insertions do not reallocate every time.
+ */
+inline void LBVH::resize(unsigned int N)
+    {
+    if (N > m_codes.size())
         {
-        shared_array<unsigned char> tmp(tmp_bytes);
-        m_tmp.swap(tmp);
+        const unsigned int capacity = std::max(N, static_cast<unsigned int>(m_codes.size() + m_codes.size()/4));
+        const unsigned int capacity_internal = capacity - 1;
+        const unsigned int capacity_nodes = capacity + capacity_internal;
+
+        grow(m_parent, capacity_nodes, m_N_nodes);
+        grow(m_left, capacity_internal, m_N_internal);
+        grow(m_right, capacity_internal, m_N_internal);
+        grow(m_lo, capacity_nodes, m_N_nodes);
+        grow(m_hi, capacity_nodes, m_N_nodes);
+        if (capacity_internal > m_locks.size())
+            {
+            shared_array<unsigned int> locks(capacity_internal);
+            m_locks.swap(locks);
+            }
+
+        buffered_array<unsigned int> codes(capacity);
+        m_codes.swap(codes);
+
+        buffered_array<unsigned int> indexes(capacity);
+        std::copy(m_indexes.current().get(), m_indexes.current().get() + m_N, indexes.current().get());
+        m_indexes.swap(indexes);
+
+        m_touched = false;
         }
+
+    m_root = 0;
+    m_N = N;
+    m_N_internal = (m_N > 0) ? m_N - 1 : 0;
+    m_N_nodes = m_N + m_N_internal;
+    }
+
+/*!
+ * \param array Array to grow.
+ * \param size Minimum number of elements in the array.
+ * \param keep Number of elements to preserve.
+ */
+template<typename T>
+void LBVH::grow(shared_array<T>& array, size_t size, size_t keep)
+    {
+    if (size > array.size())
+        {
+        shared_array<T> tmp(size);
+        std::copy(array.get(), array.get() + keep, tmp.get());
+        array.swap(tmp);
+        }
+    }
+
+inline void LBVH::computeArea() const
+    {
+    if (!m_area_valid)
+        {
+        m_area = host::lbvh_internal_area(data(), m_N_internal);
+        m_area_valid = true;
+        if (m_build_cost <= 0.f)
+            {
+            m_build_cost = computeCost();
+            }
+        }
+    }
+
+inline float LBVH::computeCost() const
+    {
+    if (m_N < 2) return 0.f;
+
+    const float root_area = host::lbvh_surface_area(m_lo[m_root], m_hi[m_root]);
+    return (root_area > 0.f) ? m_area/root_area : 0.f;
+    }
+
+inline void LBVH::mapLeaves()
+    {
+    if (!m_leaves_valid)
+        {
+        const unsigned int* primitives = m_indexes.current().get();
+        m_leaves.clear();
+        m_leaves.reserve(m_N);
+        for (unsigned int i=0; i < m_N; ++i)
+            {
+            m_leaves[primitives[i]] = m_N_internal + i;
+            }
+        m_leaves_valid = true;
+        }
+    }
+
+/*!
+ * \param primitive Index of the primitive.
+ * \param lo Lower bound of the primitive.
+ * \param hi Upper bound of the primitive.
+ *
+ * The new internal node takes the place of the first leaf, which is moved to the end of the
+ * leaves ahead of the new leaf. The primitives shift down by one to match the new number of
+ * internal nodes. If the best sibling is the root, the root is moved so that it stays node 0.
+ */
+inline void LBVH::insertPrimitive(unsigned int primitive, const float3& lo, const float3& hi)
+    {
+    computeArea();
+    mapLeaves();
+    if (m_leaves.count(primitive))
+        {
+        throw std::runtime_error("Primitive is already in LBVH.");
+        }
+
+    const unsigned int N = m_N;
+    resize(N+1);
+    LBVHData tree = data();
+
+    if (N == 0)
+        {
+        tree.parent[0] = LBVHSentinel;
+        tree.lo[0] = lo;
+        tree.hi[0] = hi;
+        tree.primitive[0] = primitive;
+        m_leaves[primitive] = 0;
+        return;
+        }
+
+    // move the first leaf to the end of the leaves, then shift the primitives to match
+    host::lbvh_move_node(tree, N-1, N-1, 2*N-1);
+    m_leaves[tree.primitive[0]] = 2*N-1;
+    std::rotate(tree.primitive, tree.primitive + 1, tree.primitive + N);
+
+    const int leaf = 2*N;
+    tree.lo[leaf] = lo;
+    tree.hi[leaf] = hi;
+    tree.primitive[N] = primitive;
+    m_leaves[primitive] = leaf;
+
+    // with one primitive, the only leaf was the root and has already been moved
+    int sibling = (N > 1) ? host::lbvh_find_sibling(tree, m_N_internal, lo, hi) : 2*N-1;
+    int parent = N-1;
+    if (N == 1 || sibling == m_root)
+        {
+        // new parent becomes the root, so move the old root out of its way
+        if (N > 1)
+            {
+            host::lbvh_move_node(tree, m_N_internal, m_root, N-1);
+            sibling = N-1;
+            }
+        parent = m_root;
+        tree.parent[parent] = LBVHSentinel;
+        }
+    else
+        {
+        const int grandparent = tree.parent[sibling];
+        host::lbvh_replace_child(tree, grandparent, sibling, parent);
+        tree.parent[parent] = grandparent;
+        }
+
+    tree.left[parent] = sibling;
+    tree.right[parent] = leaf;
+    tree.parent[sibling] = parent;
+    tree.parent[leaf] = parent;
+    tree.lo[parent] = make_float3(fminf(tree.lo[sibling].x, lo.x),
+                                  fminf(tree.lo[sibling].y, lo.y),
+                                  fminf(tree.lo[sibling].z, lo.z));
+    tree.hi[parent] = make_float3(fmaxf(tree.hi[sibling].x, hi.x),
+                                  fmaxf(tree.hi[sibling].y, hi.y),
+                                  fmaxf(tree.hi[sibling].z, hi.z));
+    m_area += host::lbvh_surface_area(tree.lo[parent], tree.hi[parent]);
+    if (tree.parent[parent] != LBVHSentinel)
+        {
+        m_area += host::lbvh_refit(tree, tree.parent[parent]);
+        }
+    }
+
+/*!
+ * \param primitive Index of the primitive.
+ *
+ * After the leaf and its parent are spliced out, the last internal node fills the hole left by
+ * the parent, and the last leaves fill the hole left by the removed leaf and the first leaf slot,
+ * which is now past the end of the internal nodes. The primitives shift up by one to match.
+ */
+inline void LBVH::removePrimitive(unsigned int primitive)
+    {
+    computeArea();
+    mapLeaves();
+    auto it = m_leaves.find(primitive);
+    if (it == m_leaves.end())
+        {
+        throw std::runtime_error("Primitive is not in LBVH.");
+        }
+    const int leaf = it->second;
+    m_leaves.erase(it);
+
+    const unsigned int N = m_N;
+    const unsigned int N_internal = m_N_internal;
+    LBVHData tree = data();
+
+    if (N == 1)
+        {
+        resize(0);
+        return;
+        }
+    else if (N == 2)
+        {
+        const int sibling = (leaf == 1) ? 2 : 1;
+        tree.parent[0] = LBVHSentinel;
+        tree.lo[0] = tree.lo[sibling];
+        tree.hi[0] = tree.hi[sibling];
+        tree.primitive[0] = tree.primitive[sibling-1];
+        m_leaves[tree.primitive[0]] = 0;
+        m_area = 0.f;
+        resize(1);
+        return;
+        }
+
+    // splice the sibling into the place of the parent
+    const int parent = tree.parent[leaf];
+    const int sibling = (tree.left[parent] == leaf) ? tree.right[parent] : tree.left[parent];
+    const int grandparent = tree.parent[parent];
+    m_area -= host::lbvh_surface_area(tree.lo[parent], tree.hi[parent]);
+    int hole;
+    if (grandparent == LBVHSentinel)
+        {
+        // the sibling is internal, so move it to be the root
+        tree.parent[sibling] = LBVHSentinel;
+        host::lbvh_move_node(tree, N_internal, sibling, m_root);
+        hole = sibling;
+        }
+    else
+        {
+        host::lbvh_replace_child(tree, grandparent, parent, sibling);
+        tree.parent[sibling] = grandparent;
+        m_area += host::lbvh_refit(tree, grandparent);
+        hole = parent;
+        }
+
+    // fill the internal hole with the last internal node
+    host::lbvh_move_node(tree, N_internal, N-2, hole);
+
+    // move the last leaves into the first leaf slot and the removed leaf
+    int src[2], dst[2];
+    unsigned int moved[2];
+    unsigned int num_moved = 0;
+    for (int node = 2*N-3; node <= (int)(2*N-2); ++node)
+        {
+        if (node != leaf)
+            {
+            src[num_moved] = node;
+            moved[num_moved] = tree.primitive[node - N_internal];
+            ++num_moved;
+            }
+        }
+    dst[0] = N-2;
+    dst[1] = leaf;
+    for (unsigned int i=0; i < num_moved; ++i)
+        {
+        host::lbvh_move_node(tree, N_internal, src[i], dst[i]);
+        }
+
+    std::copy_backward(tree.primitive, tree.primitive + N-2, tree.primitive + N-1);
+    for (unsigned int i=0; i < num_moved; ++i)
+        {
+        tree.primitive[dst[i] - (N-2)] = moved[i];
+        m_leaves[moved[i]] = dst[i];
+        }
+
+    resize(N-1);
     }
 
 } // end namespace neighbor
@@ -0,0 +1,417 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#ifndef NEIGHBOR_LBVH_FOREST_H_
+#define NEIGHBOR_LBVH_FOREST_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Memory.h"
+
+#include "LBVHData.h"
+#include "LBVHTraverserData.h"
+#include "TransformOps.h"
+#include "TranslateOps.h"
+#include "host/LBVH.h"
+#include "host/LBVHTraverser.h"
+#include "host/ThreadPool.h"
+
+namespace neighbor
+{
+//! Forest of linear bounding volume hierarchies for many independent systems.
+/*!
+ * An LBVHForest holds one LBVH for each of many small, independent systems (e.g., replicas in
+ * an ensemble of simulations). Building and traversing each system with its own LBVH and LBVHTraverser
+ * requires many separate allocations and calls that are too small to keep all cores busy. Instead,
+ * the forest builds all systems in one parallel pass on the host, storing them in a shared arena of
+ * memory that is reused between builds (see host::lbvh_build_forest).
+ *
+ * The primitives of all systems are supplied by one insert operation, and the primitives of system \a s
+ * are [offsets[s], offsets[s+1]). Each system has its own scene bounds. The LBVH of each system
+ * has the same layout as an LBVH and can be accessed with ::data.
+ *
+ * Queries are tagged with the system they belong to, and all queries are traversed against the root of their
+ * system in a single parallel call to ::traverse. The traversal is the same stackless rope scheme used by
+ * LBVHTraverser, so the same query, output, translate, and transform operations can be used, but they must be
+ * callable from host code. The same translation operation is used for all systems.
+ */
+class LBVHForest
+    {
+    public:
+        //! Setup an unallocated forest.
+        LBVHForest();
+
+        //! Build the forest.
+        template<class InsertOpT>
+        void build(host::ThreadPool& pool,
+                   const InsertOpT& insert,
+                   const unsigned int* offsets,
+                   const float3* lo,
+                   const float3* hi,
+                   unsigned int num_systems);
+
+        //! Setup the forest for traversal with a primitive transform operation.
+        template<class TransformOpT>
+        void setup(host::ThreadPool& pool, const TransformOpT& transform);
+
+        //! Setup the forest for traversal.
+        /*!
+         * \param pool Thread pool.
+         */
+        void setup(host::ThreadPool& pool)
+            {
+            setup(pool, NullTransformOp());
+            }
+
+        //! Reset (nullify) the setup.
+        void reset()
+            {
+            m_replay = false;
+            }
+
+        //! Traverse the forest with translation and a primitive transform operation.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+        void traverse(host::ThreadPool& pool,
+                      const unsigned int* systems,
+                      const QueryOpT& query,
+                      const OutputOpT& out,
+                      const TranslateOpT& images,
+                      const TransformOpT& transform);
+
+        //! Traverse the forest with translation.
+        /*!
+         * \param pool Thread pool.
+         * \param systems System of each query.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         * \param images Translation operation for moving search volume around.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         * \tparam TranslateOpT The type of translation operation.
+         */
+        template<class QueryOpT, class OutputOpT, class TranslateOpT>
+        void traverse(host::ThreadPool& pool,
+                      const unsigned int* systems,
+                      const QueryOpT& query,
+                      const OutputOpT& out,
+                      const TranslateOpT& images)
+            {
+            traverse(pool, systems, query, out, images, NullTransformOp());
+            }
+
+        //! Traverse the forest.
+        /*!
+         * \param pool Thread pool.
+         * \param systems System of each query.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         *
+         * Only the self image (no translation) is traversed.
+         */
+        template<class QueryOpT, class OutputOpT>
+        void traverse(host::ThreadPool& pool,
+                      const unsigned int* systems,
+                      const QueryOpT& query,
+                      const OutputOpT& out)
+            {
+            traverse(pool, systems, query, out, SelfOp(), NullTransformOp());
+            }
+
+        //! Get the number of systems.
+        unsigned int getNumSystems() const
+            {
+            return m_num_systems;
+            }
+
+        //! Get the total number of primitives.
+        unsigned int getN() const
+            {
+            return m_offsets.back();
+            }
+
+        //! Get the number of primitives in a system.
+        unsigned int getN(unsigned int system) const
+            {
+            return m_offsets[system+1] - m_offsets[system];
+            }
+
+        //! Get the sorted primitives of all systems.
+        /*!
+         * The primitives of system \a s begin at offsets[s].
+         */
+        const shared_array<unsigned int>& getPrimitives() const
+            {
+            return m_primitives;
+            }
+
+        //! Get the pointer version of the read-only data of the LBVH of a system.
+        /*!
+         * \param system System index.
+         *
+         * \returns The LBVH data, with root 0. The data is not valid if the system has no primitives.
+         */
+        const ConstLBVHData data(unsigned int system) const
+            {
+            ConstLBVHData tree;
+            tree.parent = m_parent.get() + m_node_offsets[system];
+            tree.left = m_left.get() + m_internal_offsets[system];
+            tree.right = m_right.get() + m_internal_offsets[system];
+            tree.primitive = m_primitives.get() + m_offsets[system];
+            tree.lo = m_lo.get() + m_node_offsets[system];
+            tree.hi = m_hi.get() + m_node_offsets[system];
+            tree.root = 0;
+            return tree;
+            }
+
+    private:
+        unsigned int m_num_systems;                 //!< Number of systems
+        std::vector<unsigned int> m_offsets;        //!< First primitive of each system
+        std::vector<unsigned int> m_internal_offsets;   //!< First internal node of each system
+        std::vector<unsigned int> m_node_offsets;   //!< First node of each system
+
+        shared_array<int> m_parent; //!< Parent node
+        shared_array<int> m_left;   //!< Left child
+        shared_array<int> m_right;  //!< Right child
+        shared_array<float3> m_lo;  //!< Lower bound of AABB
+        shared_array<float3> m_hi;  //!< Upper bound of AABB
+        shared_array<unsigned int> m_codes;         //!< Morton codes
+        shared_array<unsigned int> m_primitives;    //!< Primitive indexes
+
+        shared_array<int4> m_data;      //!< Compressed LBVH data for traversal
+        shared_array<float3> m_clo;     //!< Lower bound of each compressed LBVH
+        shared_array<float3> m_chi;     //!< Upper bound of each compressed LBVH
+        shared_array<float3> m_bins;    //!< Bin size of each compressed LBVH
+        bool m_replay;                  //!< If true, the compressed forest has already been set explicitly
+
+        //! Allocate.
+        void allocate(const unsigned int* offsets, unsigned int num_systems);
+
+        //! Get the pointer version of the compressed LBVH of a system.
+        const LBVHCompressedData compressedData(unsigned int system)
+            {
+            LBVHCompressedData clbvh;
+            clbvh.root = 0;
+            clbvh.data = m_data.get() + m_node_offsets[system];
+            clbvh.lo = m_clo.get() + system;
+            clbvh.hi = m_chi.get() + system;
+            clbvh.bins = m_bins.get() + system;
+            return clbvh;
+            }
+
+        //! Grow an array without preserving its data.
+        template<typename T>
+        static void reserve(shared_array<T>& array, size_t size)
+            {
+            if (size > array.size())
+                {
+                shared_array<T> tmp(size);
+                array.swap(tmp);
+                }
+            }
+    };
+
+inline LBVHForest::LBVHForest()
+    : m_num_systems(0), m_offsets(1,0), m_internal_offsets(1,0), m_node_offsets(1,0), m_replay(false)
+    {}
+
+/*!
+ * \param pool Thread pool for the build.
+ * \param insert The insert operation holding the primitives of all systems.
+ * \param offsets First primitive of each system, with one extra entry for the total number of primitives.
+ * \param lo Lower bound of the scene of each system.
+ * \param hi Upper bound of the scene of each system.
+ * \param num_systems Number of systems.
+ *
+ * \tparam InsertOpT The kind of insert operation.
+ *
+ * The \a insert operation must be callable from host code. Each LBVH is constructed using 30-bit Morton
+ * codes within the scene of its system, like LBVH::build. The forest is ready to use when this method returns.
+ */
+template<class InsertOpT>
+void LBVHForest::build(host::ThreadPool& pool,
+                       const InsertOpT& insert,
+                       const unsigned int* offsets,
+                       const float3* lo,
+                       const float3* hi,
+                       unsigned int num_systems)
+    {
+    if (offsets[num_systems] != insert.size())
+        {
+        throw std::runtime_error("LBVHForest offsets do not match number of primitives.");
+        }
+    reset();
+    allocate(offsets, num_systems);
+
+    LBVHData trees;
+    trees.parent = m_parent.get();
+    trees.left = m_left.get();
+    trees.right = m_right.get();
+    trees.primitive = m_primitives.get();
+    trees.lo = m_lo.get();
+    trees.hi = m_hi.get();
+    trees.root = 0;
+
+    host::lbvh_build_forest(pool,
+                            trees,
+                            m_codes.get(),
+                            m_offsets.data(),
+                            m_internal_offsets.data(),
+                            m_node_offsets.data(),
+                            insert,
+                            lo,
+                            hi,
+                            m_num_systems);
+    }
+
+/*!
+ * \param pool Thread pool.
+ * \param transform Transformation operation for cached primitive indexes.
+ *
+ * \tparam TransformOpT The type of transformation operation.
+ *
+ * The LBVH of each system is compressed, and subsequent calls to ::traverse reuse it until ::reset
+ * or ::build is called. See LBVHTraverser::setup.
+ */
+template<class TransformOpT>
+void LBVHForest::setup(host::ThreadPool& pool, const TransformOpT& transform)
+    {
+    reset();
+
+    std::atomic<unsigned int> next_system(0);
+    pool.run([&](unsigned int thread)
+        {
+        unsigned int sys;
+        while ((sys = next_system++) < m_num_systems)
+            {
+            const unsigned int N = getN(sys);
+            if (N == 0) continue;
+            host::lbvh_compress_ropes(compressedData(sys), transform, data(sys), N-1, 2*N-1);
+            }
+        });
+
+    m_replay = true;
+    }
+
+/*!
+ * \param pool Thread pool.
+ * \param systems System of each query.
+ * \param query Query operation for defining search volumes and overlaps.
+ * \param out Output operation for intersected primitives.
+ * \param images Translation operation for moving search volume around.
+ * \param transform Transformation operation for cached primitive indexes.
+ *
+ * \tparam QueryOpT The type of query operation.
+ * \tparam OutputOpT The type of output operation.
+ * \tparam TranslateOpT The type of translation operation.
+ * \tparam TransformOpT The type of transformation operation.
+ *
+ * Query \a i is traversed against the LBVH of system \a systems[i]. The queries are processed in
+ * small chunks that are assigned dynamically to threads. A query against a system without primitives
+ * is still set up and finalized with no overlaps. An exception is raised before traversing if any
+ * system is not in the forest. See LBVHTraverser::traverse for the conventions
+ * of the traversal. The result is ready when this method returns.
+ */
+template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+void LBVHForest::traverse(host::ThreadPool& pool,
+                          const unsigned int* systems,
+                          const QueryOpT& query,
+                          const OutputOpT& out,
+                          const TranslateOpT& images,
+                          const TransformOpT& transform)
+    {
+    // don't traverse with no query objects or images
+    if (query.size() == 0 || images.size() == 0) return;
+
+    checkNumImages(images.size());
+
+    // every query must belong to a system in the forest
+    const unsigned int N = query.size();
+    for (unsigned int idx=0; idx < N; ++idx)
+        {
+        if (systems[idx] >= m_num_systems)
+            {
+            throw std::runtime_error("LBVHForest query " + std::to_string(idx) + " has an invalid system.");
+            }
+        }
+
+    // setup if this is not a replay
+    if (!m_replay)
+        {
+        setup(pool, transform);
+        m_replay = false;
+        }
+
+    pool.dynamicFor(0, N, 64, [&](unsigned int idx, unsigned int)
+        {
+        const unsigned int sys = systems[idx];
+        if (getN(sys) > 0)
+            {
+            const LBVHCompressedData clbvh = compressedData(sys);
+            lbvh_traverse_query(out, clbvh, BoundingBox(*clbvh.lo, *clbvh.hi), *clbvh.bins, query, images, idx);
+            }
+        else
+            {
+            const typename QueryOpT::ThreadData qdata = query.setup(idx);
+            typename OutputOpT::ThreadData result = out.setup(idx, qdata);
+            out.finalize(result);
+            }
+        });
+    }
+
+/*!
+ * \param offsets First primitive of each system, with one extra entry for the total number of primitives.
+ * \param num_systems Number of systems.
+ *
+ * The node offsets of each system in the arena are computed, and the arena grows if needed.
+ * Memory is never released, so it is reused by later builds.
+ */
+inline void LBVHForest::allocate(const unsigned int* offsets, unsigned int num_systems)
+    {
+    m_num_systems = num_systems;
+    m_offsets.assign(offsets, offsets + num_systems + 1);
+    m_internal_offsets.resize(num_systems+1);
+    m_node_offsets.resize(num_systems+1);
+
+    m_internal_offsets[0] = 0;
+    m_node_offsets[0] = 0;
+    for (unsigned int i=0; i < num_systems; ++i)
+        {
+        const unsigned int N = m_offsets[i+1] - m_offsets[i];
+        if (m_offsets[i+1] < m_offsets[i])
+            {
+            throw std::runtime_error("LBVHForest offsets must be nondecreasing.");
+            }
+        m_internal_offsets[i+1] = m_internal_offsets[i] + ((N > 0) ? N-1 : 0);
+        m_node_offsets[i+1] = m_node_offsets[i] + ((N > 0) ? 2*N-1 : 0);
+        }
+
+    const unsigned int N = m_offsets.back();
+    const unsigned int N_internal = m_internal_offsets.back();
+    const unsigned int N_nodes = m_node_offsets.back();
+
+    reserve(m_parent, N_nodes);
+    reserve(m_left, N_internal);
+    reserve(m_right, N_internal);
+    reserve(m_lo, N_nodes);
+    reserve(m_hi, N_nodes);
+    reserve(m_codes, N);
+    reserve(m_primitives, N);
+    reserve(m_data, N_nodes);
+    reserve(m_clo, num_systems);
+    reserve(m_chi, num_systems);
+    reserve(m_bins, num_systems);
+    }
+
+} // end namespace neighbor
+
+#endif // NEIGHBOR_LBVH_FOREST_H_
@@ -0,0 +1,312 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#ifndef NEIGHBOR_LBVH_QUALITY_H_
+#define NEIGHBOR_LBVH_QUALITY_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include "BoundingVolumes.h"
+#include "LBVH.h"
+#include "LBVHData.h"
+#include "TransformOps.h"
+#include "kernels/LBVHTraverser.cuh"
+#include "host/LBVH.h"
+#include "host/ThreadPool.h"
+#include "host/WorkStealingScheduler.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace neighbor
+{
+
+//! Quality metrics of an LBVH.
+/*!
+ * The metrics compare trees of the same primitives built with different options. Areas and volumes are
+ * relative to the root, so the metrics do not depend on the size of the system.
+ */
+struct LBVHQuality
+    {
+    double sah_cost;                //!< Surface area heuristic cost
+    double compressed_sah_cost;     //!< Surface area heuristic cost of the nodes compressed for traversal
+    double quantization_inflation;  //!< Ratio of the compressed to the exact cost (1 if the cost is 0)
+    double sibling_overlap;         //!< Summed overlap volume of the children of each internal node
+    double total_overlap;           //!< Summed overlap volume of all pairs of nodes in disjoint subtrees
+    double epo;                     //!< Effective primitive overlap, counting leaves instead of primitive areas
+    std::vector<unsigned int> depth_histogram;  //!< Number of leaves at each depth (the root has depth 0)
+    unsigned int max_depth;         //!< Largest depth of a leaf
+    double mean_depth;              //!< Mean depth of the leaves
+    double leaf_volume_ratio;       //!< Mean ratio of leaf to primitive volume (0 if no primitive has volume)
+    };
+
+namespace host
+{
+//! Compute the volume of the intersection of two boxes.
+/*!
+ * \param lo_a Lower bound of the first box.
+ * \param hi_a Upper bound of the first box.
+ * \param lo_b Lower bound of the second box.
+ * \param hi_b Upper bound of the second box.
+ *
+ * \returns The volume of the intersection, or 0 if the boxes do not overlap.
+ */
+inline double lbvh_overlap_volume(const float3& lo_a, const float3& hi_a, const float3& lo_b, const float3& hi_b)
+    {
+    const double Lx = static_cast<double>(std::min(hi_a.x,hi_b.x)) - std::max(lo_a.x,lo_b.x);
+    const double Ly = static_cast<double>(std::min(hi_a.y,hi_b.y)) - std::max(lo_a.y,lo_b.y);
+    const double Lz = static_cast<double>(std::min(hi_a.z,hi_b.z)) - std::max(lo_a.z,lo_b.z);
+    return (Lx > 0. && Ly > 0. && Lz > 0.) ? Lx*Ly*Lz : 0.;
+    }
+
+//! Compute the quality metrics of an LBVH on the host.
+/*!
+ * \param pool Thread pool.
+ * \param tree LBVH tree (raw pointers).
+ * \param N_internal Number of internal nodes.
+ * \param N_nodes Number of nodes.
+ * \param insert The insert operation the primitives are compared to.
+ * \param node_cost Cost of testing an internal node.
+ * \param leaf_cost Cost of testing a leaf.
+ *
+ * \returns The quality metrics.
+ *
+ * \tparam InsertOpT The type of insert operation.
+ *
+ * The metrics are:
+ *
+ * - The surface area heuristic cost, which is the sum of \a node_cost times the area of each internal node and
+ *   \a leaf_cost times the area of each leaf, divided by the area of the root. LBVH::update uses the internal node
+ *   term of this cost.
+ * - The cost of the nodes after compression for traversal (see LBVHTraverser), which always expands them. Its ratio
+ *   to the exact cost is the inflation introduced by quantizing the bounds to 10 bits.
+ * - The overlap volume of the two children of each internal node, and of all pairs of nodes where neither is an
+ *   ancestor of the other, relative to the volume of the root.
+ * - The effective primitive overlap, which is the sum over nodes of the number of leaves outside the subtree of the
+ *   node that overlap it, weighted by the area of the node relative to the root and divided by the number of leaves.
+ *   Leaves are counted instead of summing the area of primitives because points have no area.
+ * - The depth of each leaf.
+ * - The mean ratio of the volume of each leaf to the volume of its primitive from \a insert, which is larger than 1
+ *   if the leaves were grown (e.g., by a larger insert operation than \a insert).
+ *
+ * The overlap of all pairs is found by traversing the tree with each node, which takes time proportional to the
+ * number of overlapping pairs. The nodes are balanced between the threads by a work-stealing scheduler.
+ * The caller must synchronize any GPU work writing to \a tree first.
+ */
+template<class InsertOpT>
+LBVHQuality lbvh_quality(ThreadPool& pool,
+                         const ConstLBVHData& tree,
+                         unsigned int N_internal,
+                         unsigned int N_nodes,
+                         const InsertOpT& insert,
+                         float node_cost = 1.f,
+                         float leaf_cost = 1.f)
+    {
+    LBVHQuality quality;
+    quality.sah_cost = 0.;
+    quality.compressed_sah_cost = 0.;
+    quality.quantization_inflation = 1.;
+    quality.sibling_overlap = 0.;
+    quality.total_overlap = 0.;
+    quality.epo = 0.;
+    quality.max_depth = 0;
+    quality.mean_depth = 0.;
+    quality.leaf_volume_ratio = 0.;
+    if (N_nodes == 0) return quality;
+
+    const unsigned int N = N_nodes - N_internal;
+    const float3 root_lo = tree.lo[tree.root];
+    const float3 root_hi = tree.hi[tree.root];
+    const double root_area = lbvh_surface_area(root_lo, root_hi);
+    const double root_volume = lbvh_overlap_volume(root_lo, root_hi, root_lo, root_hi);
+
+    // compression of the nodes for traversal
+    const float3 bininv = lbvh_compression_scale(root_lo, root_hi);
+    const float3 bins = make_float3(approx::frcp_rd(bininv.x),approx::frcp_rd(bininv.y),approx::frcp_rd(bininv.z));
+    const BoundingBox root_box(root_lo, root_hi);
+    const NullTransformOp transform;
+
+    // per-node terms, which are summed in order so that the metrics do not depend on the number of threads
+    std::vector<double> area(N_nodes), compressed_area(N_nodes), sibling(N_nodes), overlap(N_nodes), foreign(N_nodes);
+    std::vector<unsigned int> depth(N_nodes, 0);
+    std::vector<double> volume_ratio(N, 0.);
+    std::vector<unsigned char> has_volume(N, 0);
+    pool.parallelFor(0, N_nodes, [&](unsigned int idx)
+        {
+        const float3 lo = tree.lo[idx];
+        const float3 hi = tree.hi[idx];
+        area[idx] = lbvh_surface_area(lo, hi);
+
+        const BoundingBox box = lbvh_decompress_bounds(lbvh_compress_node(transform, tree, N_internal, idx, root_lo, root_hi, bininv),
+                                                       root_box,
+                                                       bins);
+        compressed_area[idx] = lbvh_surface_area(box.lo, box.hi);
+
+        if (idx < N_internal)
+            {
+            const int left = tree.left[idx];
+            const int right = tree.right[idx];
+            sibling[idx] = lbvh_overlap_volume(tree.lo[left], tree.hi[left], tree.lo[right], tree.hi[right]);
+            }
+        else
+            {
+            sibling[idx] = 0.;
+
+            unsigned int d = 0;
+            for (int node = static_cast<int>(idx); node != tree.root; node = tree.parent[node])
+                {
+                ++d;
+                }
+            depth[idx] = d;
+
+            const unsigned int leaf = idx - N_internal;
+            const BoundingBox primitive = insert.get(tree.primitive[leaf]);
+            const double primitive_volume = lbvh_overlap_volume(primitive.lo, primitive.hi, primitive.lo, primitive.hi);
+            if (primitive_volume > 0.)
+                {
+                volume_ratio[leaf] = lbvh_overlap_volume(lo, hi, lo, hi)/primitive_volume;
+                has_volume[leaf] = 1;
+                }
+            }
+        });
+
+    // traverse the tree with each node to find the overlap with nodes in other subtrees
+    host::WorkStealingScheduler scheduler;
+    scheduler.run(pool, N_nodes, [&](unsigned int idx)
+        {
+        const int self = static_cast<int>(idx);
+        const float3 lo = tree.lo[idx];
+        const float3 hi = tree.hi[idx];
+        const BoundingBox box(lo, hi);
+
+        std::vector<int> ancestors;
+        for (int node = self; node != tree.root; )
+            {
+            node = tree.parent[node];
+            ancestors.push_back(node);
+            }
+
+        double volume = 0.;
+        unsigned int leaves = 0;
+        std::vector<int> stack(1, tree.root);
+        while (!stack.empty())
+            {
+            const int node = stack.back();
+            stack.pop_back();
+            if (node == self || !box.overlap(BoundingBox(tree.lo[node], tree.hi[node])))
+                continue;
+
+            const bool internal = (node < static_cast<int>(N_internal));
+            if (std::find(ancestors.begin(), ancestors.end(), node) == ancestors.end())
+                {
+                // count each pair once
+                if (node > self)
+                    volume += lbvh_overlap_volume(lo, hi, tree.lo[node], tree.hi[node]);
+                if (!internal)
+                    ++leaves;
+                }
+            if (internal)
+                {
+                stack.push_back(tree.right[node]);
+                stack.push_back(tree.left[node]);
+                }
+            }
+        overlap[idx] = volume;
+        foreign[idx] = leaves;
+        });
+
+    // reduce the terms
+    double internal_area = 0., leaf_area = 0., compressed_internal_area = 0., compressed_leaf_area = 0.;
+    double sibling_volume = 0., overlap_volume = 0., epo = 0.;
+    for (unsigned int idx=0; idx < N_nodes; ++idx)
+        {
+        if (idx < N_internal)
+            {
+            internal_area += area[idx];
+            compressed_internal_area += compressed_area[idx];
+            }
+        else
+            {
+            leaf_area += area[idx];
+            compressed_leaf_area += compressed_area[idx];
+            }
+        sibling_volume += sibling[idx];
+        overlap_volume += overlap[idx];
+        epo += area[idx]*foreign[idx];
+        }
+    if (root_area > 0.)
+        {
+        quality.sah_cost = (node_cost*internal_area + leaf_cost*leaf_area)/root_area;
+        quality.compressed_sah_cost = (node_cost*compressed_internal_area + leaf_cost*compressed_leaf_area)/root_area;
+        quality.epo = epo/(root_area*N);
+        }
+    if (quality.sah_cost > 0.)
+        {
+        quality.quantization_inflation = quality.compressed_sah_cost/quality.sah_cost;
+        }
+    if (root_volume > 0.)
+        {
+        quality.sibling_overlap = sibling_volume/root_volume;
+        quality.total_overlap = overlap_volume/root_volume;
+        }
+
+    unsigned long long total_depth = 0;
+    for (unsigned int idx=N_internal; idx < N_nodes; ++idx)
+        {
+        quality.max_depth = std::max(quality.max_depth, depth[idx]);
+        total_depth += depth[idx];
+        }
+    quality.depth_histogram.assign(quality.max_depth+1, 0);
+    for (unsigned int idx=N_internal; idx < N_nodes; ++idx)
+        {
+        ++quality.depth_histogram[depth[idx]];
+        }
+    quality.mean_depth = static_cast<double>(total_depth)/N;
+
+    double total_ratio = 0.;
+    unsigned int num_volume = 0;
+    for (unsigned int leaf=0; leaf < N; ++leaf)
+        {
+        if (has_volume[leaf])
+            {
+            total_ratio += volume_ratio[leaf];
+            ++num_volume;
+            }
+        }
+    if (num_volume > 0)
+        {
+        quality.leaf_volume_ratio = total_ratio/num_volume;
+        }
+
+    return quality;
+    }
+
+//! Compute the quality metrics of an LBVH on the host.
+/*!
+ * \param pool Thread pool.
+ * \param lbvh LBVH.
+ * \param insert The insert operation the primitives are compared to.
+ * \param node_cost Cost of testing an internal node.
+ * \param leaf_cost Cost of testing a leaf.
+ *
+ * \returns The quality metrics.
+ *
+ * \tparam InsertOpT The type of insert operation.
+ */
+template<class InsertOpT>
+LBVHQuality lbvh_quality(ThreadPool& pool,
+                         const LBVH& lbvh,
+                         const InsertOpT& insert,
+                         float node_cost = 1.f,
+                         float leaf_cost = 1.f)
+    {
+    return lbvh_quality(pool, lbvh.data(), lbvh.getNInternal(), lbvh.getNNodes(), insert, node_cost, leaf_cost);
+    }
+
+} // end namespace host
+} // end namespace neighbor
+
+#endif // NEIGHBOR_LBVH_QUALITY_H_
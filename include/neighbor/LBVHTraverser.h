@@ -11,12 +11,18 @@
 #include "Tunable.h"
 
 #include "LBVH.h"
+#include "PhaseTimer.h"
 #include "TransformOps.h"
 #include "TranslateOps.h"
+#include "TraversalStatistics.h"
 
 #include "LBVHTraverserData.h"
 #include "kernels/LBVHTraverser.cuh"
+#include "host/LBVHTraverser.h"
+#include "host/ThreadPool.h"
+#include "host/WorkStealingScheduler.h"
 
+#include <algorithm>
 #include <stdexcept>
 
 namespace neighbor
@@ -56,6 +62,9 @@ namespace neighbor
  * The LBVH is not aware of periodic boundary conditions of a scene. The LBVHTraverser accepts
  * an translation operator, which can move the same volume around the scene. By default, only
  * the self-image is traversed.
+ *
+ * The methods taking a host::ThreadPool can be compiled by a host compiler. The methods in a stream are
+ * only defined when the header is compiled by a device compiler (nvcc or hipcc).
  */
 class LBVHTraverser : public Tunable<unsigned int>
     {
@@ -65,7 +74,15 @@ class LBVHTraverser : public Tunable<unsigned int>
 
         //! Setup LBVH for traversal in a stream with tunable parameter and a primitive transform operation.
         template<class TransformOpT>
-        void setup(const LaunchParameters& params, const LBVH& lbvh, const TransformOpT& transform);
+        void setup(const LaunchParameters& params, const LBVH& lbvh, const TransformOpT& transform)
+            {
+            NullPhaseTimer timer;
+            setup(params, lbvh, transform, timer);
+            }
+
+        //! Setup LBVH for traversal in a stream with tunable parameter, a primitive transform operation, and timed phases.
+        template<class TransformOpT, class TimerT>
+        void setup(const LaunchParameters& params, const LBVH& lbvh, const TransformOpT& transform, TimerT& timer);
 
         //! Setup LBVH for traversal in a stream with tunable parameter.
         /*!
@@ -85,12 +102,15 @@ class LBVHTraverser : public Tunable<unsigned int>
          *
          * \tparam TransformOpT The type of transformation operation.
          *
-         * The default block size is 32 threads.
+         * The default block size is 32 threads, or it is autotuned (see ::setAutotuning).
          */
         template<class TransformOpT>
         void setup(hipper::stream_t stream, const LBVH& lbvh, const TransformOpT& transform)
             {
-            setup(LaunchParameters(32,stream), lbvh, transform);
+            tune("LBVHTraverser", "setup", TuningCache::Types<TransformOpT>(), lbvh.getN(), stream, 32, [&](const LaunchParameters& params)
+                {
+                setup(params, lbvh, transform);
+                });
             }
 
         //! Setup LBVH for traversal in a stream.
@@ -131,6 +151,28 @@ class LBVHTraverser : public Tunable<unsigned int>
             setup(0, lbvh, NullTransformOp());
             }
 
+        //! Setup LBVH for traversal on the host with a primitive transform operation.
+        template<class TransformOpT>
+        void setup(host::ThreadPool& pool, const LBVH& lbvh, const TransformOpT& transform)
+            {
+            NullPhaseTimer timer;
+            setup(pool, lbvh, transform, timer);
+            }
+
+        //! Setup LBVH for traversal on the host with a primitive transform operation and timed phases.
+        template<class TransformOpT, class TimerT>
+        void setup(host::ThreadPool& pool, const LBVH& lbvh, const TransformOpT& transform, TimerT& timer);
+
+        //! Setup LBVH for traversal on the host.
+        /*!
+         * \param pool Thread pool.
+         * \param lbvh LBVH to traverse.
+         */
+        void setup(host::ThreadPool& pool, const LBVH& lbvh)
+            {
+            setup(pool, lbvh, NullTransformOp());
+            }
+
         //! Reset (nullify) the setup
         void reset()
             {
@@ -144,7 +186,52 @@ class LBVHTraverser : public Tunable<unsigned int>
                       const QueryOpT& query,
                       const OutputOpT& out,
                       const TranslateOpT& images,
-                      const TransformOpT& transform);
+                      const TransformOpT& transform)
+            {
+            NullPhaseTimer timer;
+            traverse(params, lbvh, query, out, images, transform, timer);
+            }
+
+        //! Traverse the LBVH in a stream with tunable parameter, translation, a primitive transform operation, and timed phases.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT, class TimerT>
+        void traverse(const LaunchParameters& params,
+                      const LBVH& lbvh,
+                      const QueryOpT& query,
+                      const OutputOpT& out,
+                      const TranslateOpT& images,
+                      const TransformOpT& transform,
+                      TimerT& timer)
+            {
+            traverseRopes(params, lbvh, query, out, images, transform, timer, NullTraversalCounter());
+            }
+
+        //! Traverse the LBVH in a stream with tunable parameter, translation, a primitive transform operation, and statistics.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+        void traverse(const LaunchParameters& params,
+                      const LBVH& lbvh,
+                      const QueryOpT& query,
+                      const OutputOpT& out,
+                      const TranslateOpT& images,
+                      const TransformOpT& transform,
+                      TraversalStatistics& stats)
+            {
+            NullPhaseTimer timer;
+            traverseRopes(params, lbvh, query, out, images, transform, timer, stats.getCounter(query.size(), params.stream));
+            }
+
+        //! Traverse the LBVH in a stream with tunable parameter, translation, a primitive transform operation, timed phases, and statistics.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT, class TimerT>
+        void traverse(const LaunchParameters& params,
+                      const LBVH& lbvh,
+                      const QueryOpT& query,
+                      const OutputOpT& out,
+                      const TranslateOpT& images,
+                      const TransformOpT& transform,
+                      TimerT& timer,
+                      TraversalStatistics& stats)
+            {
+            traverseRopes(params, lbvh, query, out, images, transform, timer, stats.getCounter(query.size(), params.stream));
+            }
 
         //! Traverse the LBVH in a stream with tunable parameter and translation.
         /*!
@@ -203,7 +290,7 @@ class LBVHTraverser : public Tunable<unsigned int>
          * \tparam TranslateOpT The type of translation operation.
          * \tparam TransformOpT The type of transformation operation.
          *
-         * The default block size is 32 threads.
+         * The default block size is 32 threads, or it is autotuned (see ::setAutotuning).
          */
         template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
         void traverse(hipper::stream_t stream,
@@ -213,7 +300,10 @@ class LBVHTraverser : public Tunable<unsigned int>
                       const TranslateOpT& images,
                       const TransformOpT& transform)
             {
-            traverse(LaunchParameters(32,stream), lbvh, query, out, images, transform);
+            tune("LBVHTraverser", "traverse", TuningCache::Types<QueryOpT,OutputOpT,TranslateOpT,TransformOpT>(), query.size(), stream, 32, [&](const LaunchParameters& params)
+                {
+                traverse(params, lbvh, query, out, images, transform);
+                });
             }
 
         //! Traverse the LBVH in a stream with translation.
@@ -322,133 +412,1080 @@ class LBVHTraverser : public Tunable<unsigned int>
             traverse(0, lbvh, query, out, SelfOp(), NullTransformOp());
             }
 
-        //! Access the compressed LBVH data for traversal.
-        const shared_array<int4>& getData() const
+        //! Traverse the LBVH on the host with translation and a primitive transform operation.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+        void traverse(host::ThreadPool& pool,
+                      const LBVH& lbvh,
+                      const QueryOpT& query,
+                      const OutputOpT& out,
+                      const TranslateOpT& images,
+                      const TransformOpT& transform)
             {
-            return m_data;
+            NullPhaseTimer timer;
+            traverse(pool, lbvh, query, out, images, transform, timer);
             }
 
-    private:
-        int m_root;                     //!< Root node
-        shared_array<int4> m_data;      //!< Internal representation of the LBVH for traversal
-        shared_array<float3> m_lbvh_lo; //!< Lower bound of tree
-        shared_array<float3> m_lbvh_hi; //!< Upper bound of tree
-        shared_array<float3> m_bins;    //!< Bin size for compression
+        //! Traverse the LBVH on the host with translation, a primitive transform operation, and timed phases.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT, class TimerT>
+        void traverse(host::ThreadPool& pool,
+                      const LBVH& lbvh,
+                      const QueryOpT& query,
+                      const OutputOpT& out,
+                      const TranslateOpT& images,
+                      const TransformOpT& transform,
+                      TimerT& timer)
+            {
+            traverseRopes(pool, lbvh, query, out, images, transform, timer, NullTraversalCounter());
+            }
 
-        //! Compresses the lbvh into internal representation.
-        template<class TransformOpT>
-        void compress(const LaunchParameters& params, const LBVH& lbvh, const TransformOpT& transform);
+        //! Traverse the LBVH on the host with translation, a primitive transform operation, and statistics.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+        void traverse(host::ThreadPool& pool,
+                      const LBVH& lbvh,
+                      const QueryOpT& query,
+                      const OutputOpT& out,
+                      const TranslateOpT& images,
+                      const TransformOpT& transform,
+                      TraversalStatistics& stats)
+            {
+            NullPhaseTimer timer;
+            traverseRopes(pool, lbvh, query, out, images, transform, timer, stats.getCounter(query.size()));
+            }
 
-        bool m_replay;  //!< If true, the compressed structure has already been set explicitly
+        //! Traverse the LBVH on the host with translation, a primitive transform operation, timed phases, and statistics.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT, class TimerT>
+        void traverse(host::ThreadPool& pool,
+                      const LBVH& lbvh,
+                      const QueryOpT& query,
+                      const OutputOpT& out,
+                      const TranslateOpT& images,
+                      const TransformOpT& transform,
+                      TimerT& timer,
+                      TraversalStatistics& stats)
+            {
+            traverseRopes(pool, lbvh, query, out, images, transform, timer, stats.getCounter(query.size()));
+            }
 
-        //! Get the pointer version of the data in the traverser.
-        const LBVHCompressedData data()
+        //! Traverse the LBVH on the host with translation.
+        /*!
+         * \param pool Thread pool.
+         * \param lbvh LBVH to traverse.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         * \param images Translation operation for moving search volume around.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         * \tparam TranslateOpT The type of translation operation.
+         */
+        template<class QueryOpT, class OutputOpT, class TranslateOpT>
+        void traverse(host::ThreadPool& pool,
+                      const LBVH& lbvh,
+                      const QueryOpT& query,
+                      const OutputOpT& out,
+                      const TranslateOpT& images)
             {
-            LBVHCompressedData clbvh;
-            clbvh.root = m_root;
-            clbvh.data = m_data.get();
-            clbvh.lo = m_lbvh_lo.get();
-            clbvh.hi = m_lbvh_hi.get();
-            clbvh.bins = m_bins.get();
-            return clbvh;
+            traverse(pool, lbvh, query, out, images, NullTransformOp());
             }
-    };
 
-LBVHTraverser::LBVHTraverser()
-    : Tunable<unsigned int>(32, 1024, 32),
-      m_lbvh_lo(1), m_lbvh_hi(1), m_bins(1), m_replay(false)
-    {
-    }
+        //! Traverse the LBVH on the host.
+        /*!
+         * \param pool Thread pool.
+         * \param lbvh LBVH to traverse.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         *
+         * Only the self image (no translation) is traversed.
+         */
+        template<class QueryOpT, class OutputOpT>
+        void traverse(host::ThreadPool& pool, const LBVH& lbvh, const QueryOpT& query, const OutputOpT& out)
+            {
+            traverse(pool, lbvh, query, out, SelfOp(), NullTransformOp());
+            }
 
-/*!
- * \param params Launch parameters for kernel execution, including tunable block size and stream.
- * \param lbvh LBVH to traverse.
- * \param transform Transformation operation for cached primitive indexes.
- *
- * \tparam TransformOpT The type of transformation operation.
- *
- * This method just calls the compress method on the LBVH, and marks that this has been done
- * internally so that subsequent calls to traverse do not compress. This is useful if the same
- * LBVH is going to be traversed multiple times. It is the caller's responsibility to ensure
- * that the transform op and lbvh do not change between setup and traversal, or the result will
- * be incorrect.
- *
- * To clear a setup, call reset().
- */
-template<class TransformOpT>
-void LBVHTraverser::setup(const LaunchParameters& params, const LBVH& lbvh, const TransformOpT& transform)
-    {
-    // invalidate old setup
-    reset();
+        //! Traverse the LBVH for self-queries in a stream with tunable parameter, translation, and a primitive transform operation.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+        void traverseSelf(const LaunchParameters& params,
+                          const LBVH& lbvh,
+                          const QueryOpT& query,
+                          const OutputOpT& out,
+                          const TranslateOpT& images,
+                          const TransformOpT& transform)
+            {
+            traverseSelfRopes(params, lbvh, query, out, images, transform, NullTraversalCounter());
+            }
 
-    // compress new lbvh
-    if (lbvh.getN() != 0)
-        {
-        compress(params, lbvh, transform);
-        m_replay = true;
-        }
-    }
+        //! Traverse the LBVH for self-queries in a stream with tunable parameter, translation, a primitive transform operation, and statistics.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+        void traverseSelf(const LaunchParameters& params,
+                          const LBVH& lbvh,
+                          const QueryOpT& query,
+                          const OutputOpT& out,
+                          const TranslateOpT& images,
+                          const TransformOpT& transform,
+                          TraversalStatistics& stats)
+            {
+            traverseSelfRopes(params, lbvh, query, out, images, transform, stats.getCounter(query.size(), params.stream));
+            }
 
-/*!
- * \param params Launch parameters for kernel execution, including tunable block size and stream.
- * \param lbvh LBVH to traverse.
- * \param query Query operation for defining search volumes and overlaps.
- * \param out Output operation for intersected primitives.
- * \param images Translation operation for moving search volume around.
- * \param transform Transformation operation for cached primitive indexes.
- *
- * \tparam QueryOpT The type of query operation.
- * \tparam OutputOpT The type of output operation.
- * \tparam TranslateOpT The type of translation operation.
- * \tparam TransformOpT The type of transformation operation.
- *
- * A maximum of 32 \a images are allowed due to the internal representation of the image list
- * in the traversal CUDA kernel. This is more than enough to perform traversal in 3D periodic
- * boundary conditions (27 images). Multiple calls to ::traverse are required if
- * more images are needed, but \a out must be compatible with multiple calls.
- *
- * If a query volume overlaps an internal node, the traversal should descend to the left child.
- * If the query volume does not overlap OR it has reached a leaf node, the traversal should proceed
- * along the rope. Traversal terminates when the LBVHSentinel is reached for the rope.
- */
-template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
-void LBVHTraverser::traverse(const LaunchParameters& params,
-                             const LBVH& lbvh,
-                             const QueryOpT& query,
-                             const OutputOpT& out,
-                             const TranslateOpT& images,
-                             const TransformOpT& transform)
-    {
-    // don't traverse with empty lbvh
-    if (lbvh.getN() == 0) return;
+        //! Traverse the LBVH for self-queries in a stream with translation.
+        /*!
+         * \param stream CUDA stream for kernel execution.
+         * \param lbvh LBVH to traverse.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         * \param images Translation operation for moving search volume around.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         * \tparam TranslateOpT The type of translation operation.
+         *
+         * The default block size is 32 threads, or it is autotuned (see ::setAutotuning).
+         */
+        template<class QueryOpT, class OutputOpT, class TranslateOpT>
+        void traverseSelf(hipper::stream_t stream,
+                          const LBVH& lbvh,
+                          const QueryOpT& query,
+                          const OutputOpT& out,
+                          const TranslateOpT& images)
+            {
+            tune("LBVHTraverser", "traverse_self", TuningCache::Types<QueryOpT,OutputOpT,TranslateOpT>(), query.size(), stream, 32, [&](const LaunchParameters& params)
+                {
+                traverseSelf(params, lbvh, query, out, images, NullTransformOp());
+                });
+            }
 
-    // don't traverse with no query objects or images
-    if (query.size() == 0 || images.size() == 0) return;
+        //! Traverse the LBVH for self-queries in the default stream with translation.
+        /*!
+         * \param lbvh LBVH to traverse.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         * \param images Translation operation for moving search volume around.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         * \tparam TranslateOpT The type of translation operation.
+         *
+         * The default block size is 32 threads, and the kernel executes in the default stream.
+         */
+        template<class QueryOpT, class OutputOpT, class TranslateOpT>
+        void traverseSelf(const LBVH& lbvh, const QueryOpT& query, const OutputOpT& out, const TranslateOpT& images)
+            {
+            traverseSelf(0, lbvh, query, out, images);
+            }
 
-    // kernel uses int32 bitflags for the images, so limit to 32 images
-    if (images.size() > 32)
-        {
-        throw std::runtime_error("A maximum of 32 image vectores are supported by LBVH traversers.");
-        }
+        //! Traverse the LBVH for self-queries in the default stream.
+        /*!
+         * \param lbvh LBVH to traverse.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         *
+         * Only the self image (no translation) is traversed.
+         */
+        template<class QueryOpT, class OutputOpT>
+        void traverseSelf(const LBVH& lbvh, const QueryOpT& query, const OutputOpT& out)
+            {
+            traverseSelf(0, lbvh, query, out, SelfOp());
+            }
 
-    checkParameter(params);
+        //! Traverse the LBVH for self-queries on the host with translation and a primitive transform operation.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+        void traverseSelf(host::ThreadPool& pool,
+                          const LBVH& lbvh,
+                          const QueryOpT& query,
+                          const OutputOpT& out,
+                          const TranslateOpT& images,
+                          const TransformOpT& transform)
+            {
+            traverseSelfRopes(pool, lbvh, query, out, images, transform, NullTraversalCounter());
+            }
 
-    // setup if this is not a replay
-    if (!m_replay)
-        compress(params, lbvh, transform);
+        //! Traverse the LBVH for self-queries on the host with translation, a primitive transform operation, and statistics.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+        void traverseSelf(host::ThreadPool& pool,
+                          const LBVH& lbvh,
+                          const QueryOpT& query,
+                          const OutputOpT& out,
+                          const TranslateOpT& images,
+                          const TransformOpT& transform,
+                          TraversalStatistics& stats)
+            {
+            traverseSelfRopes(pool, lbvh, query, out, images, transform, stats.getCounter(query.size()));
+            }
 
-    // compressed lbvh data
-    LBVHCompressedData clbvh = data();
+        //! Traverse the LBVH for self-queries on the host with translation.
+        /*!
+         * \param pool Thread pool.
+         * \param lbvh LBVH to traverse.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         * \param images Translation operation for moving search volume around.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         * \tparam TranslateOpT The type of translation operation.
+         */
+        template<class QueryOpT, class OutputOpT, class TranslateOpT>
+        void traverseSelf(host::ThreadPool& pool,
+                          const LBVH& lbvh,
+                          const QueryOpT& query,
+                          const OutputOpT& out,
+                          const TranslateOpT& images)
+            {
+            traverseSelf(pool, lbvh, query, out, images, NullTransformOp());
+            }
 
-    // traversal data
-    gpu::lbvh_traverse_ropes(out,
-                             clbvh,
-                             query,
-                             images,
+        //! Traverse the LBVH for self-queries on the host.
+        /*!
+         * \param pool Thread pool.
+         * \param lbvh LBVH to traverse.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         *
+         * Only the self image (no translation) is traversed.
+         */
+        template<class QueryOpT, class OutputOpT>
+        void traverseSelf(host::ThreadPool& pool, const LBVH& lbvh, const QueryOpT& query, const OutputOpT& out)
+            {
+            traverseSelf(pool, lbvh, query, out, SelfOp(), NullTransformOp());
+            }
+
+        //! Traverse the LBVH from cached entry nodes in a stream with tunable parameter, translation, and a primitive transform operation.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+        void traverseCached(const LaunchParameters& params,
+                            const LBVH& lbvh,
+                            const QueryOpT& query,
+                            const OutputOpT& out,
+                            const TranslateOpT& images,
+                            const TransformOpT& transform)
+            {
+            traverseCachedRopes(params, lbvh, query, out, images, transform, NullTraversalCounter());
+            }
+
+        //! Traverse the LBVH from cached entry nodes in a stream with tunable parameter, translation, a primitive transform operation, and statistics.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+        void traverseCached(const LaunchParameters& params,
+                            const LBVH& lbvh,
+                            const QueryOpT& query,
+                            const OutputOpT& out,
+                            const TranslateOpT& images,
+                            const TransformOpT& transform,
+                            TraversalStatistics& stats)
+            {
+            traverseCachedRopes(params, lbvh, query, out, images, transform, stats.getCounter(query.size(), params.stream));
+            }
+
+        //! Traverse the LBVH from cached entry nodes in a stream with translation.
+        /*!
+         * \param stream CUDA stream for kernel execution.
+         * \param lbvh LBVH to traverse.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         * \param images Translation operation for moving search volume around.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         * \tparam TranslateOpT The type of translation operation.
+         *
+         * The default block size is 32 threads, or it is autotuned (see ::setAutotuning).
+         */
+        template<class QueryOpT, class OutputOpT, class TranslateOpT>
+        void traverseCached(hipper::stream_t stream,
+                            const LBVH& lbvh,
+                            const QueryOpT& query,
+                            const OutputOpT& out,
+                            const TranslateOpT& images)
+            {
+            tune("LBVHTraverser", "traverse_cached", TuningCache::Types<QueryOpT,OutputOpT,TranslateOpT>(), query.size(), stream, 32, [&](const LaunchParameters& params)
+                {
+                traverseCached(params, lbvh, query, out, images, NullTransformOp());
+                });
+            }
+
+        //! Traverse the LBVH from cached entry nodes in the default stream with translation.
+        /*!
+         * \param lbvh LBVH to traverse.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         * \param images Translation operation for moving search volume around.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         * \tparam TranslateOpT The type of translation operation.
+         *
+         * The default block size is 32 threads, and the kernel executes in the default stream.
+         */
+        template<class QueryOpT, class OutputOpT, class TranslateOpT>
+        void traverseCached(const LBVH& lbvh, const QueryOpT& query, const OutputOpT& out, const TranslateOpT& images)
+            {
+            traverseCached(0, lbvh, query, out, images);
+            }
+
+        //! Traverse the LBVH from cached entry nodes in the default stream.
+        /*!
+         * \param lbvh LBVH to traverse.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         *
+         * Only the self image (no translation) is traversed.
+         */
+        template<class QueryOpT, class OutputOpT>
+        void traverseCached(const LBVH& lbvh, const QueryOpT& query, const OutputOpT& out)
+            {
+            traverseCached(0, lbvh, query, out, SelfOp());
+            }
+
+        //! Traverse the LBVH from cached entry nodes on the host with translation and a primitive transform operation.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+        void traverseCached(host::ThreadPool& pool,
+                            const LBVH& lbvh,
+                            const QueryOpT& query,
+                            const OutputOpT& out,
+                            const TranslateOpT& images,
+                            const TransformOpT& transform)
+            {
+            traverseCachedRopes(pool, lbvh, query, out, images, transform, NullTraversalCounter());
+            }
+
+        //! Traverse the LBVH from cached entry nodes on the host with translation, a primitive transform operation, and statistics.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+        void traverseCached(host::ThreadPool& pool,
+                            const LBVH& lbvh,
+                            const QueryOpT& query,
+                            const OutputOpT& out,
+                            const TranslateOpT& images,
+                            const TransformOpT& transform,
+                            TraversalStatistics& stats)
+            {
+            traverseCachedRopes(pool, lbvh, query, out, images, transform, stats.getCounter(query.size()));
+            }
+
+        //! Traverse the LBVH from cached entry nodes on the host with translation.
+        /*!
+         * \param pool Thread pool.
+         * \param lbvh LBVH to traverse.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         * \param images Translation operation for moving search volume around.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         * \tparam TranslateOpT The type of translation operation.
+         */
+        template<class QueryOpT, class OutputOpT, class TranslateOpT>
+        void traverseCached(host::ThreadPool& pool,
+                            const LBVH& lbvh,
+                            const QueryOpT& query,
+                            const OutputOpT& out,
+                            const TranslateOpT& images)
+            {
+            traverseCached(pool, lbvh, query, out, images, NullTransformOp());
+            }
+
+        //! Traverse the LBVH from cached entry nodes on the host.
+        /*!
+         * \param pool Thread pool.
+         * \param lbvh LBVH to traverse.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         *
+         * Only the self image (no translation) is traversed.
+         */
+        template<class QueryOpT, class OutputOpT>
+        void traverseCached(host::ThreadPool& pool, const LBVH& lbvh, const QueryOpT& query, const OutputOpT& out)
+            {
+            traverseCached(pool, lbvh, query, out, SelfOp(), NullTransformOp());
+            }
+
+        //! Get the cached entry node of each query.
+        /*!
+         * An entry of -1 means that the query starts from the root. The entries are updated by the
+         * traversal, so they must only be read after it has completed.
+         */
+        const shared_array<int>& getEntries() const
+            {
+            return m_entries;
+            }
+
+        //! Forget the cached entry nodes.
+        /*!
+         * The next call to ::traverseCached starts all queries from the root. The entries are also
+         * forgotten when the number of queries changes.
+         */
+        void resetEntries()
+            {
+            shared_array<int> tmp;
+            m_entries.swap(tmp);
+            }
+
+        //! Access the compressed LBVH data for traversal.
+        const shared_array<int4>& getData() const
+            {
+            return m_data;
+            }
+
+        //! Access the scheduler for traversal on the host.
+        /*!
+         * The scheduler can be used to tune the chunk size or to inspect the load balance of the last
+         * traversal on the host.
+         */
+        host::WorkStealingScheduler& getScheduler()
+            {
+            return m_scheduler;
+            }
+
+    private:
+        int m_root;                     //!< Root node
+        shared_array<int4> m_data;      //!< Internal representation of the LBVH for traversal
+        shared_array<float3> m_lbvh_lo; //!< Lower bound of tree
+        shared_array<float3> m_lbvh_hi; //!< Upper bound of tree
+        shared_array<float3> m_bins;    //!< Bin size for compression
+
+        //! Compresses the lbvh into internal representation.
+        template<class TransformOpT>
+        void compress(const LaunchParameters& params, const LBVH& lbvh, const TransformOpT& transform)
+            {
+            NullPhaseTimer timer;
+            compress(params, lbvh, transform, timer);
+            }
+
+        //! Compresses the lbvh into internal representation with a timed phase.
+        template<class TransformOpT, class TimerT>
+        void compress(const LaunchParameters& params, const LBVH& lbvh, const TransformOpT& transform, TimerT& timer);
+
+        //! Compresses the lbvh into internal representation on the host.
+        template<class TransformOpT>
+        void compress(host::ThreadPool& pool, const LBVH& lbvh, const TransformOpT& transform)
+            {
+            NullPhaseTimer timer;
+            compress(pool, lbvh, transform, timer);
+            }
+
+        //! Compresses the lbvh into internal representation on the host with a timed phase.
+        template<class TransformOpT, class TimerT>
+        void compress(host::ThreadPool& pool, const LBVH& lbvh, const TransformOpT& transform, TimerT& timer);
+
+        //! Traverse the LBVH in a stream with timed phases and a statistics policy.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT, class TimerT, class CounterT>
+        void traverseRopes(const LaunchParameters& params,
+                           const LBVH& lbvh,
+                           const QueryOpT& query,
+                           const OutputOpT& out,
+                           const TranslateOpT& images,
+                           const TransformOpT& transform,
+                           TimerT& timer,
+                           const CounterT& counter);
+
+        //! Traverse the LBVH on the host with timed phases and a statistics policy.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT, class TimerT, class CounterT>
+        void traverseRopes(host::ThreadPool& pool,
+                           const LBVH& lbvh,
+                           const QueryOpT& query,
+                           const OutputOpT& out,
+                           const TranslateOpT& images,
+                           const TransformOpT& transform,
+                           TimerT& timer,
+                           const CounterT& counter);
+
+        //! Traverse the LBVH for self-queries in a stream with a statistics policy.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT, class CounterT>
+        void traverseSelfRopes(const LaunchParameters& params,
+                               const LBVH& lbvh,
+                               const QueryOpT& query,
+                               const OutputOpT& out,
+                               const TranslateOpT& images,
+                               const TransformOpT& transform,
+                               const CounterT& counter);
+
+        //! Traverse the LBVH for self-queries on the host with a statistics policy.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT, class CounterT>
+        void traverseSelfRopes(host::ThreadPool& pool,
+                               const LBVH& lbvh,
+                               const QueryOpT& query,
+                               const OutputOpT& out,
+                               const TranslateOpT& images,
+                               const TransformOpT& transform,
+                               const CounterT& counter);
+
+        //! Traverse the LBVH from cached entry nodes in a stream with a statistics policy.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT, class CounterT>
+        void traverseCachedRopes(const LaunchParameters& params,
+                                 const LBVH& lbvh,
+                                 const QueryOpT& query,
+                                 const OutputOpT& out,
+                                 const TranslateOpT& images,
+                                 const TransformOpT& transform,
+                                 const CounterT& counter);
+
+        //! Traverse the LBVH from cached entry nodes on the host with a statistics policy.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT, class CounterT>
+        void traverseCachedRopes(host::ThreadPool& pool,
+                                 const LBVH& lbvh,
+                                 const QueryOpT& query,
+                                 const OutputOpT& out,
+                                 const TranslateOpT& images,
+                                 const TransformOpT& transform,
+                                 const CounterT& counter);
+
+        bool m_replay;  //!< If true, the compressed structure has already been set explicitly
+
+        shared_array<int> m_leaves; //!< Leaf of each primitive for self-queries
+        bool m_has_leaves;          //!< If true, the leaves are mapped for the compressed structure
+
+        shared_array<int> m_entries;    //!< Cached entry node of each query
+
+        host::WorkStealingScheduler m_scheduler;    //!< Scheduler for traversal on the host
+
+        //! Get the pointer version of the data in the traverser.
+        const LBVHCompressedData data()
+            {
+            LBVHCompressedData clbvh;
+            clbvh.root = m_root;
+            clbvh.data = m_data.get();
+            clbvh.lo = m_lbvh_lo.get();
+            clbvh.hi = m_lbvh_hi.get();
+            clbvh.bins = m_bins.get();
+            return clbvh;
+            }
+    };
+
+LBVHTraverser::LBVHTraverser()
+    : Tunable<unsigned int>(32, 1024, 32),
+      m_lbvh_lo(1), m_lbvh_hi(1), m_bins(1), m_replay(false), m_has_leaves(false)
+    {
+    }
+
+/*!
+ * \param params Launch parameters for kernel execution, including tunable block size and stream.
+ * \param lbvh LBVH to traverse.
+ * \param transform Transformation operation for cached primitive indexes.
+ * \param timer Timer of the phases.
+ *
+ * \tparam TransformOpT The type of transformation operation.
+ * \tparam TimerT The kind of phase timer (PhaseTimer, or NullPhaseTimer for no timing).
+ *
+ * This method just calls the compress method on the LBVH, and marks that this has been done
+ * internally so that subsequent calls to traverse do not compress. This is useful if the same
+ * LBVH is going to be traversed multiple times. It is the caller's responsibility to ensure
+ * that the transform op and lbvh do not change between setup and traversal, or the result will
+ * be incorrect.
+ *
+ * To clear a setup, call reset(). The compression is timed as the "compress" phase.
+ */
+template<class TransformOpT, class TimerT>
+void LBVHTraverser::setup(const LaunchParameters& params, const LBVH& lbvh, const TransformOpT& transform, TimerT& timer)
+    {
+    timer.reset();
+
+    // invalidate old setup
+    reset();
+
+    // compress new lbvh
+    if (lbvh.getN() != 0)
+        {
+        compress(params, lbvh, transform, timer);
+        m_replay = true;
+        }
+    }
+
+/*!
+ * \param pool Thread pool.
+ * \param lbvh LBVH to traverse.
+ * \param transform Transformation operation for cached primitive indexes.
+ * \param timer Timer of the phases.
+ *
+ * \tparam TransformOpT The type of transformation operation.
+ * \tparam TimerT The kind of phase timer (PhaseTimer, or NullPhaseTimer for no timing).
+ *
+ * This is the host equivalent of ::setup, and it produces the same compressed LBVH. The caller
+ * must synchronize any GPU work writing to \a lbvh first.
+ */
+template<class TransformOpT, class TimerT>
+void LBVHTraverser::setup(host::ThreadPool& pool, const LBVH& lbvh, const TransformOpT& transform, TimerT& timer)
+    {
+    timer.reset();
+
+    // invalidate old setup
+    reset();
+
+    // compress new lbvh
+    if (lbvh.getN() != 0)
+        {
+        compress(pool, lbvh, transform, timer);
+        m_replay = true;
+        }
+    }
+
+#if defined(__CUDACC__) || defined(__HIPCC__)
+/*!
+ * \param params Launch parameters for kernel execution, including tunable block size and stream.
+ * \param lbvh LBVH to traverse.
+ * \param query Query operation for defining search volumes and overlaps.
+ * \param out Output operation for intersected primitives.
+ * \param images Translation operation for moving search volume around.
+ * \param transform Transformation operation for cached primitive indexes.
+ * \param timer Timer of the phases.
+ * \param counter Statistics policy of the traversal loop.
+ *
+ * \tparam QueryOpT The type of query operation.
+ * \tparam OutputOpT The type of output operation.
+ * \tparam TranslateOpT The type of translation operation.
+ * \tparam TransformOpT The type of transformation operation.
+ * \tparam TimerT The kind of phase timer (PhaseTimer, or NullPhaseTimer for no timing).
+ * \tparam CounterT The type of statistics policy (TraversalCounter, or NullTraversalCounter for no statistics).
+ *
+ * A maximum of 32 \a images are allowed due to the internal representation of the image list
+ * in the traversal CUDA kernel. This is more than enough to perform traversal in 3D periodic
+ * boundary conditions (27 images). Multiple calls to ::traverse are required if
+ * more images are needed, but \a out must be compatible with multiple calls.
+ *
+ * If a query volume overlaps an internal node, the traversal should descend to the left child.
+ * If the query volume does not overlap OR it has reached a leaf node, the traversal should proceed
+ * along the rope. Traversal terminates when the LBVHSentinel is reached for the rope.
+ *
+ * The phases are "compress" (if the LBVH was not set up) and "traverse", whose count is the number of
+ * query volumes (queries times images). The work of each query is counted by the \a counter, which the
+ * public ::traverse methods get from TraversalStatistics.
+ */
+template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT, class TimerT, class CounterT>
+void LBVHTraverser::traverseRopes(const LaunchParameters& params,
+                                  const LBVH& lbvh,
+                                  const QueryOpT& query,
+                                  const OutputOpT& out,
+                                  const TranslateOpT& images,
+                                  const TransformOpT& transform,
+                                  TimerT& timer,
+                                  const CounterT& counter)
+    {
+    timer.reset();
+
+    // don't traverse with empty lbvh
+    if (lbvh.getN() == 0) return;
+
+    // don't traverse with no query objects or images
+    if (query.size() == 0 || images.size() == 0) return;
+
+    checkNumImages(images.size());
+
+    checkParameter(params);
+
+    // setup if this is not a replay
+    if (!m_replay)
+        compress(params, lbvh, transform, timer);
+
+    // compressed lbvh data
+    LBVHCompressedData clbvh = data();
+
+    // traversal data
+    timer.begin("traverse", params.stream);
+    gpu::lbvh_traverse_ropes(out,
+                             clbvh,
+                             query,
+                             images,
+                             params.tunable,
+                             params.stream,
+                             counter);
+    timer.addWork(static_cast<unsigned long long>(query.size())*images.size(), 16ull*lbvh.getNNodes());
+    timer.end(params.stream);
+    }
+#endif // __CUDACC__ || __HIPCC__
+
+/*!
+ * \param pool Thread pool.
+ * \param lbvh LBVH to traverse.
+ * \param query Query operation for defining search volumes and overlaps.
+ * \param out Output operation for intersected primitives.
+ * \param images Translation operation for moving search volume around.
+ * \param transform Transformation operation for cached primitive indexes.
+ * \param timer Timer of the phases.
+ * \param counter Statistics policy of the traversal loop.
+ *
+ * \tparam QueryOpT The type of query operation.
+ * \tparam OutputOpT The type of output operation.
+ * \tparam TranslateOpT The type of translation operation.
+ * \tparam TransformOpT The type of transformation operation.
+ * \tparam TimerT The kind of phase timer (PhaseTimer, or NullPhaseTimer for no timing).
+ * \tparam CounterT The type of statistics policy (TraversalCounter, or NullTraversalCounter for no statistics).
+ *
+ * The LBVH is traversed on the host in the same way as the CUDA kernel, with one thread per query.
+ * Queries are assigned to the threads in contiguous chunks by a work-stealing scheduler (see ::getScheduler),
+ * so queries should be ordered spatially for the best performance. The same limit of 32 \a images applies.
+ * The caller must synchronize any GPU work writing to \a lbvh first, and the \a out operation must be
+ * writable from the host.
+ *
+ * The phases are the same as for the traversal in a stream, but they are timed on the host.
+ */
+template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT, class TimerT, class CounterT>
+void LBVHTraverser::traverseRopes(host::ThreadPool& pool,
+                                  const LBVH& lbvh,
+                                  const QueryOpT& query,
+                                  const OutputOpT& out,
+                                  const TranslateOpT& images,
+                                  const TransformOpT& transform,
+                                  TimerT& timer,
+                                  const CounterT& counter)
+    {
+    timer.reset();
+
+    // don't traverse with empty lbvh
+    if (lbvh.getN() == 0) return;
+
+    // don't traverse with no query objects or images
+    if (query.size() == 0 || images.size() == 0) return;
+
+    checkNumImages(images.size());
+
+    // setup if this is not a replay
+    if (!m_replay)
+        compress(pool, lbvh, transform, timer);
+
+    const LBVHCompressedData clbvh = data();
+    const BoundingBox tree_box(*clbvh.lo, *clbvh.hi);
+    const float3 bins = *clbvh.bins;
+
+    timer.begin("traverse");
+    m_scheduler.run(pool, query.size(), [&](unsigned int idx)
+        {
+        lbvh_traverse_query(out, clbvh, tree_box, bins, query, images, idx, NULL, -1, NULL, counter);
+        });
+    timer.addWork(static_cast<unsigned long long>(query.size())*images.size(), 16ull*lbvh.getNNodes());
+    timer.end();
+    }
+
+#if defined(__CUDACC__) || defined(__HIPCC__)
+/*!
+ * \param params Launch parameters for kernel execution, including tunable block size and stream.
+ * \param lbvh LBVH to traverse.
+ * \param query Query operation for defining search volumes and overlaps.
+ * \param out Output operation for intersected primitives.
+ * \param images Translation operation for moving search volume around.
+ * \param transform Transformation operation for cached primitive indexes.
+ * \param counter Statistics policy of the traversal loop.
+ *
+ * \tparam QueryOpT The type of query operation.
+ * \tparam OutputOpT The type of output operation.
+ * \tparam TranslateOpT The type of translation operation.
+ * \tparam TransformOpT The type of transformation operation.
+ * \tparam CounterT The type of statistics policy (TraversalCounter, or NullTraversalCounter for no statistics).
+ *
+ * This traversal is for self-queries, where query \a i is centered on primitive \a i of the LBVH
+ * (e.g., to build a neighbor list of the primitives). The self image (zero translation) of each query starts
+ * from the leaf of its primitive and ascends to the root, traversing only the siblings of the ancestors
+ * (see neighbor::lbvh_traverse_from_leaf). This skips testing the ancestors, which always overlap the query.
+ * Other images start from the root as in ::traverse. The same primitives are found as by ::traverse, but they
+ * may be processed in a different order. Queries that do not have a primitive in the LBVH start from the root.
+ * The gain over ::traverse has only been timed on one thread of the host emulation, not on a GPU or a multicore host.
+ *
+ * The leaf of each primitive is mapped the first time the compressed LBVH is traversed this way. The parents
+ * of the \a lbvh are read during traversal, so the \a lbvh must not change after ::setup.
+ *
+ * The work of each query, including the ascent from its starting node, is counted by the \a counter as for ::traverse.
+ */
+template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT, class CounterT>
+void LBVHTraverser::traverseSelfRopes(const LaunchParameters& params,
+                                      const LBVH& lbvh,
+                                      const QueryOpT& query,
+                                      const OutputOpT& out,
+                                      const TranslateOpT& images,
+                                      const TransformOpT& transform,
+                                      const CounterT& counter)
+    {
+    // don't traverse with empty lbvh
+    if (lbvh.getN() == 0) return;
+
+    // don't traverse with no query objects or images
+    if (query.size() == 0 || images.size() == 0) return;
+
+    checkNumImages(images.size());
+
+    checkParameter(params);
+
+    // setup if this is not a replay
+    if (!m_replay)
+        compress(params, lbvh, transform);
+
+    // map the leaves of the primitives
+    if (!m_has_leaves)
+        {
+        if (lbvh.getN() > m_leaves.size())
+            {
+            shared_array<int> tmp(lbvh.getN());
+            m_leaves.swap(tmp);
+            }
+        gpu::lbvh_map_leaves(m_leaves.get(),
+                             lbvh.getPrimitives().get(),
+                             lbvh.getNInternal(),
+                             lbvh.getN(),
                              params.tunable,
                              params.stream);
+        m_has_leaves = true;
+        }
+
+    gpu::lbvh_traverse_self_ropes(out,
+                                  data(),
+                                  lbvh.getParents().get(),
+                                  m_leaves.get(),
+                                  lbvh.getN(),
+                                  query,
+                                  images,
+                                  params.tunable,
+                                  params.stream,
+                                  counter);
     }
+#endif // __CUDACC__ || __HIPCC__
 
+/*!
+ * \param pool Thread pool.
+ * \param lbvh LBVH to traverse.
+ * \param query Query operation for defining search volumes and overlaps.
+ * \param out Output operation for intersected primitives.
+ * \param images Translation operation for moving search volume around.
+ * \param transform Transformation operation for cached primitive indexes.
+ * \param counter Statistics policy of the traversal loop.
+ *
+ * \tparam QueryOpT The type of query operation.
+ * \tparam OutputOpT The type of output operation.
+ * \tparam TranslateOpT The type of translation operation.
+ * \tparam TransformOpT The type of transformation operation.
+ * \tparam CounterT The type of statistics policy (TraversalCounter, or NullTraversalCounter for no statistics).
+ *
+ * This is the host equivalent of ::traverseSelf in a stream. The caller must synchronize any GPU work
+ * writing to \a lbvh first.
+ */
+template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT, class CounterT>
+void LBVHTraverser::traverseSelfRopes(host::ThreadPool& pool,
+                                      const LBVH& lbvh,
+                                      const QueryOpT& query,
+                                      const OutputOpT& out,
+                                      const TranslateOpT& images,
+                                      const TransformOpT& transform,
+                                      const CounterT& counter)
+    {
+    // don't traverse with empty lbvh
+    if (lbvh.getN() == 0) return;
+
+    // don't traverse with no query objects or images
+    if (query.size() == 0 || images.size() == 0) return;
+
+    checkNumImages(images.size());
+
+    // setup if this is not a replay
+    if (!m_replay)
+        compress(pool, lbvh, transform);
+
+    // map the leaves of the primitives
+    if (!m_has_leaves)
+        {
+        if (lbvh.getN() > m_leaves.size())
+            {
+            shared_array<int> tmp(lbvh.getN());
+            m_leaves.swap(tmp);
+            }
+        host::lbvh_map_leaves(pool, m_leaves.get(), lbvh.getPrimitives().get(), lbvh.getNInternal(), lbvh.getN());
+        m_has_leaves = true;
+        }
+
+    const LBVHCompressedData clbvh = data();
+    const BoundingBox tree_box(*clbvh.lo, *clbvh.hi);
+    const float3 bins = *clbvh.bins;
+    const int* parents = lbvh.getParents().get();
+    const int* leaves = m_leaves.get();
+    const unsigned int N_leaves = lbvh.getN();
+
+    m_scheduler.run(pool, query.size(), [&](unsigned int idx)
+        {
+        const int leaf = (idx < N_leaves) ? leaves[idx] : -1;
+        lbvh_traverse_query(out, clbvh, tree_box, bins, query, images, idx, parents, leaf, NULL, counter);
+        });
+    }
+
+#if defined(__CUDACC__) || defined(__HIPCC__)
+/*!
+ * \param params Launch parameters for kernel execution, including tunable block size and stream.
+ * \param lbvh LBVH to traverse.
+ * \param query Query operation for defining search volumes and overlaps.
+ * \param out Output operation for intersected primitives.
+ * \param images Translation operation for moving search volume around.
+ * \param transform Transformation operation for cached primitive indexes.
+ * \param counter Statistics policy of the traversal loop.
+ *
+ * \tparam QueryOpT The type of query operation.
+ * \tparam OutputOpT The type of output operation.
+ * \tparam TranslateOpT The type of translation operation.
+ * \tparam TransformOpT The type of transformation operation.
+ * \tparam CounterT The type of statistics policy (TraversalCounter, or NullTraversalCounter for no statistics).
+ *
+ * This traversal is for queries that are repeated with small changes, such as the neighbors of particles
+ * at each step of a simulation. The traverser remembers an entry node for each query: a leaf that overlapped
+ * the query volume during the previous traversal. The self image (zero translation) of each query ascends from
+ * its entry until a node overlaps the volume, then traverses that subtree and the siblings of its ancestors
+ * (see neighbor::lbvh_traverse_from_entry). This skips testing the ancestors, which always overlap the query.
+ * Other images start from the root as in ::traverse. The same primitives are found as by ::traverse, but they
+ * may be processed in a different order. Unlike ::traverseSelf, the queries do not need to be centered on the
+ * primitives.
+ *
+ * The entries are node indexes, so they stay meaningful when the LBVH is refit (see LBVH::refit) because its
+ * hierarchy does not change. They are still valid after the LBVH is rebuilt, but then they may point to
+ * unrelated nodes, so the traversal may ascend all the way to the root. Use ::resetEntries after a rebuild to
+ * avoid this cost. Entries that are not a node of the \a lbvh fall back to the root, and all entries are reset
+ * when the number of queries changes. The parents of the \a lbvh are read during traversal, so the \a lbvh
+ * must not change after ::setup.
+ *
+ * The work of each query, including the ascent from its starting node, is counted by the \a counter as for ::traverse.
+ */
+template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT, class CounterT>
+void LBVHTraverser::traverseCachedRopes(const LaunchParameters& params,
+                                        const LBVH& lbvh,
+                                        const QueryOpT& query,
+                                        const OutputOpT& out,
+                                        const TranslateOpT& images,
+                                        const TransformOpT& transform,
+                                        const CounterT& counter)
+    {
+    // don't traverse with empty lbvh
+    if (lbvh.getN() == 0) return;
+
+    // don't traverse with no query objects or images
+    if (query.size() == 0 || images.size() == 0) return;
+
+    checkNumImages(images.size());
+
+    checkParameter(params);
+
+    // setup if this is not a replay
+    if (!m_replay)
+        compress(params, lbvh, transform);
+
+    // start from the root if the entries are not for these queries
+    if (query.size() != m_entries.size())
+        {
+        shared_array<int> tmp(query.size());
+        m_entries.swap(tmp);
+        hipper::memsetAsync(m_entries.get(), 0xff, query.size()*sizeof(int), params.stream);
+        }
+
+    gpu::lbvh_traverse_cached_ropes(out,
+                                    data(),
+                                    lbvh.getParents().get(),
+                                    m_entries.get(),
+                                    lbvh.getNNodes(),
+                                    query,
+                                    images,
+                                    params.tunable,
+                                    params.stream,
+                                    counter);
+    }
+#endif // __CUDACC__ || __HIPCC__
+
+/*!
+ * \param pool Thread pool.
+ * \param lbvh LBVH to traverse.
+ * \param query Query operation for defining search volumes and overlaps.
+ * \param out Output operation for intersected primitives.
+ * \param images Translation operation for moving search volume around.
+ * \param transform Transformation operation for cached primitive indexes.
+ * \param counter Statistics policy of the traversal loop.
+ *
+ * \tparam QueryOpT The type of query operation.
+ * \tparam OutputOpT The type of output operation.
+ * \tparam TranslateOpT The type of translation operation.
+ * \tparam TransformOpT The type of transformation operation.
+ * \tparam CounterT The type of statistics policy (TraversalCounter, or NullTraversalCounter for no statistics).
+ *
+ * This is the host equivalent of ::traverseCached in a stream. The caller must synchronize any GPU work
+ * writing to \a lbvh first.
+ */
+template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT, class CounterT>
+void LBVHTraverser::traverseCachedRopes(host::ThreadPool& pool,
+                                        const LBVH& lbvh,
+                                        const QueryOpT& query,
+                                        const OutputOpT& out,
+                                        const TranslateOpT& images,
+                                        const TransformOpT& transform,
+                                        const CounterT& counter)
+    {
+    // don't traverse with empty lbvh
+    if (lbvh.getN() == 0) return;
+
+    // don't traverse with no query objects or images
+    if (query.size() == 0 || images.size() == 0) return;
+
+    checkNumImages(images.size());
+
+    // setup if this is not a replay
+    if (!m_replay)
+        compress(pool, lbvh, transform);
+
+    // start from the root if the entries are not for these queries
+    if (query.size() != m_entries.size())
+        {
+        shared_array<int> tmp(query.size());
+        m_entries.swap(tmp);
+        std::fill(m_entries.get(), m_entries.get() + query.size(), -1);
+        }
+
+    const LBVHCompressedData clbvh = data();
+    const BoundingBox tree_box(*clbvh.lo, *clbvh.hi);
+    const float3 bins = *clbvh.bins;
+    const int* parents = lbvh.getParents().get();
+    int* entries = m_entries.get();
+    const int N_nodes = lbvh.getNNodes();
+
+    m_scheduler.run(pool, query.size(), [&](unsigned int idx)
+        {
+        int entry = entries[idx];
+        if (entry < 0 || entry >= N_nodes)
+            entry = clbvh.root;
+        lbvh_traverse_query(out, clbvh, tree_box, bins, query, images, idx, parents, -1, &entry, counter);
+        entries[idx] = entry;
+        });
+    }
+
+/*!
+ * \param pool Thread pool.
+ * \param lbvh LBVH to compress
+ * \param transform Transformation operation for cached primitive indexes.
+ *
+ * \tparam TransformOpT The type of transformation operation.
+ *
+ * This is the host equivalent of compression in a stream.
+ */
+template<class TransformOpT, class TimerT>
+void LBVHTraverser::compress(host::ThreadPool& pool, const LBVH& lbvh, const TransformOpT& transform, TimerT& timer)
+    {
+    // resize the internal data array
+    const unsigned int num_data = lbvh.getNNodes();
+    if (num_data > m_data.size())
+        {
+        shared_array<int4> tmp(num_data);
+        m_data.swap(tmp);
+        }
+
+    // set root and compress the data
+    m_root = lbvh.getRoot();
+    m_has_leaves = false;
+    timer.begin("compress");
+    host::lbvh_compress_ropes(pool, data(), transform, lbvh.data(), lbvh.getNInternal(), lbvh.getNNodes());
+    timer.addWork(lbvh.getNNodes(), 44ull*lbvh.getNNodes() + 8ull*lbvh.getNInternal());
+    timer.end();
+    }
+
+#if defined(__CUDACC__) || defined(__HIPCC__)
 /*!
  * \param params Launch parameters for kernel execution, including tunable block size and stream.
  * \param lbvh LBVH to compress
@@ -478,8 +1515,8 @@ void LBVHTraverser::traverse(const LaunchParameters& params,
  * the original index of the primitive, but other times it might be useful to apply a mapping to the
  * index to save indirection when the index itself is not of interest.
  */
-template<class TransformOpT>
-void LBVHTraverser::compress(const LaunchParameters& params, const LBVH& lbvh, const TransformOpT& transform)
+template<class TransformOpT, class TimerT>
+void LBVHTraverser::compress(const LaunchParameters& params, const LBVH& lbvh, const TransformOpT& transform, TimerT& timer)
     {
     // check tuning parameter first
     checkParameter(params);
@@ -497,9 +1534,11 @@ void LBVHTraverser::compress(const LaunchParameters& params, const LBVH& lbvh, c
 
     // set root and acquire compressed tree data for writing
     m_root = lbvh.getRoot();
+    m_has_leaves = false;
     LBVHCompressedData ctree = data();
 
     // compress the data
+    timer.begin("compress", params.stream);
     gpu::lbvh_compress_ropes(ctree,
                              transform,
                              tree,
@@ -507,7 +1546,11 @@ void LBVHTraverser::compress(const LaunchParameters& params, const LBVH& lbvh, c
                              lbvh.getNNodes(),
                              params.tunable,
                              params.stream);
+    timer.addWork(lbvh.getNNodes(), 44ull*lbvh.getNNodes() + 8ull*lbvh.getNInternal());
+    timer.end(params.stream);
     }
+#endif // __CUDACC__ || __HIPCC__
+
 } // end namespace neighbor
 
 #endif // NEIGHBOR_LBVH_TRAVERSER_H_
@@ -7,6 +7,8 @@
 
 #include <hipper/hipper_runtime.h>
 
+#include <stdexcept>
+
 namespace neighbor
 {
 
@@ -20,6 +22,20 @@ struct LBVHCompressedData
     float3* bins;   //!< Bin spacing used in compression.
     };
 
+//! Check that the images fit in the bitflags used by the traversers.
+/*!
+ * \param num_images Number of images.
+ *
+ * \raises std::runtime_error if there are more than 32 images.
+ */
+inline void checkNumImages(unsigned int num_images)
+    {
+    if (num_images > 32)
+        {
+        throw std::runtime_error("A maximum of 32 image vectors are supported by LBVH traversers.");
+        }
+    }
+
 } // end namespace neighbor
 
 #endif // NEIGHBOR_LBVH_TRAVERSER_DATA_H_
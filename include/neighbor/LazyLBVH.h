@@ -0,0 +1,571 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#ifndef NEIGHBOR_LAZY_LBVH_H_
+#define NEIGHBOR_LAZY_LBVH_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "BoundingVolumes.h"
+#include "OutputOps.h"
+#include "TransformOps.h"
+#include "TranslateOps.h"
+#include "host/LBVH.h"
+#include "host/ThreadPool.h"
+
+namespace neighbor
+{
+//! Linear bounding volume hierarchy that is refined on demand.
+/*!
+ * A LazyLBVH is a host LBVH for workloads with a few queries that only touch a small region of a large
+ * scene, where building a full LBVH would take much longer than traversing it. The build only computes
+ * the Morton codes of the primitives and partitions them into buckets by the top bits of their codes
+ * (see host::lbvh_bucket_codes). A small top-level hierarchy is made over the buckets, and each bucket
+ * is a leaf of this hierarchy that has not been split. All of this work streams through the primitives,
+ * so it is much cheaper than sorting them.
+ *
+ * A node is split the first time a query overlaps it. If the node is an unsorted bucket, its primitives
+ * are sorted by Morton code. The node is then split at the highest differing bit of its codes (see
+ * host::lbvh_find_split), and the bounds of its children are computed from their primitives. Nodes with
+ * no more than ::getLeafSize primitives are not split, and their primitives are tested directly. The work
+ * done after the build is therefore proportional to the number of primitives in the buckets that are
+ * touched by queries rather than the total number of primitives. After all nodes have been split, the
+ * hierarchy has the same topology as an LBVH with the primitives in the same order.
+ *
+ * The hierarchy can be refined by many threads at once. A thread that splits a node claims it atomically,
+ * fills in its children, and then publishes them with release semantics. Other threads that reach the node
+ * while it is being split wait for it to be published. Nodes are stored in chunks that are allocated when
+ * they are first needed, so the memory used by the hierarchy also grows only with the touched region.
+ *
+ * The queries use the same query, output, translate, and transform operations as LBVHTraverser, but they
+ * must be callable from host code.
+ */
+class LazyLBVH
+    {
+    public:
+        //! Setup an unallocated LazyLBVH.
+        LazyLBVH();
+
+        //! Destroy the LazyLBVH.
+        ~LazyLBVH();
+
+        LazyLBVH(const LazyLBVH&) = delete;
+        LazyLBVH& operator=(const LazyLBVH&) = delete;
+
+        //! Build the top levels of the LazyLBVH.
+        template<class InsertOpT>
+        void build(host::ThreadPool& pool, const InsertOpT& insert, const float3& lo, const float3& hi);
+
+        //! Traverse the LazyLBVH with translation and a primitive transform operation.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+        void traverse(host::ThreadPool& pool,
+                      const QueryOpT& query,
+                      const OutputOpT& out,
+                      const TranslateOpT& images,
+                      const TransformOpT& transform);
+
+        //! Traverse the LazyLBVH with translation.
+        /*!
+         * \param pool Thread pool.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         * \param images Translation operation for moving search volume around.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         * \tparam TranslateOpT The type of translation operation.
+         */
+        template<class QueryOpT, class OutputOpT, class TranslateOpT>
+        void traverse(host::ThreadPool& pool, const QueryOpT& query, const OutputOpT& out, const TranslateOpT& images)
+            {
+            traverse(pool, query, out, images, NullTransformOp());
+            }
+
+        //! Traverse the LazyLBVH.
+        /*!
+         * \param pool Thread pool.
+         * \param query Query operation for defining search volumes and overlaps.
+         * \param out Output operation for intersected primitives.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         *
+         * Only the self image (no translation) is traversed.
+         */
+        template<class QueryOpT, class OutputOpT>
+        void traverse(host::ThreadPool& pool, const QueryOpT& query, const OutputOpT& out)
+            {
+            traverse(pool, query, out, SelfOp(), NullTransformOp());
+            }
+
+        //! Get the number of primitives.
+        unsigned int getN() const
+            {
+            return m_N;
+            }
+
+        //! Get the number of nodes that have been made.
+        /*!
+         * This is at most 2N-1, which is reached after all nodes are split.
+         */
+        unsigned int getNumNodes() const
+            {
+            return m_num_nodes.load(std::memory_order_relaxed);
+            }
+
+        //! Get the maximum number of primitives in a leaf node.
+        unsigned int getLeafSize() const
+            {
+            return m_leaf_size;
+            }
+
+        //! Set the maximum number of primitives in a leaf node.
+        /*!
+         * \param leaf_size Maximum number of primitives in a leaf node (at least 1).
+         *
+         * Larger leaves need fewer splits but test more primitives directly. The leaf size can be changed
+         * between traversals without rebuilding.
+         */
+        void setLeafSize(unsigned int leaf_size)
+            {
+            if (leaf_size == 0)
+                {
+                throw std::runtime_error("LazyLBVH leaf size must be at least 1.");
+                }
+            m_leaf_size = leaf_size;
+            }
+
+    private:
+        //! Node of the hierarchy.
+        struct Node
+            {
+            float3 lo;                  //!< Lower bound of AABB
+            float3 hi;                  //!< Upper bound of AABB
+            unsigned int first;         //!< First primitive
+            unsigned int last;          //!< One past the last primitive
+            std::atomic<int> left;      //!< Left child (right child follows it), or a split state
+            bool sorted;                //!< If true, the primitives are sorted by Morton code
+            };
+
+        static const int Unsplit = -1;  //!< Node has not been split
+        static const int Busy = -2;     //!< Node is being split
+
+        static const unsigned int chunk_bits = 12;  //!< Number of bits for the index of a node in a chunk
+        static const unsigned int max_bits = 16;    //!< Maximum number of Morton code bits for buckets
+
+        unsigned int m_N;               //!< Number of primitives
+        unsigned int m_leaf_size;       //!< Maximum number of primitives in a leaf
+
+        std::vector<unsigned int> m_codes;      //!< Morton codes
+        std::vector<unsigned int> m_primitives; //!< Primitive indexes
+        std::vector<float3> m_lo;               //!< Lower bound of each primitive (by index)
+        std::vector<float3> m_hi;               //!< Upper bound of each primitive (by index)
+
+        std::unique_ptr<std::atomic<Node*>[]> m_chunks; //!< Chunks of nodes
+        unsigned int m_num_chunks;                      //!< Number of chunk pointers
+        std::atomic<unsigned int> m_num_nodes;          //!< Number of nodes that have been made
+
+        //! Get a node.
+        Node& getNode(unsigned int idx) const
+            {
+            return m_chunks[idx >> chunk_bits].load(std::memory_order_acquire)[idx & ((1u << chunk_bits)-1)];
+            }
+
+        //! Make a pair of sibling nodes.
+        unsigned int makePair();
+
+        //! Make the hierarchy over the buckets.
+        void makeTop(unsigned int node,
+                     const std::vector<unsigned int>& buckets,
+                     unsigned int first,
+                     unsigned int last,
+                     const std::vector<unsigned int>& starts,
+                     const std::vector<float3>& bucket_lo,
+                     const std::vector<float3>& bucket_hi);
+
+        //! Get the children of a node, splitting it if needed.
+        int getChildren(unsigned int idx);
+
+        //! Split a node.
+        int split(Node& node);
+
+        //! Fit a node to its primitives.
+        void fit(Node& node) const;
+
+        //! Release the chunks of nodes.
+        void clear();
+    };
+
+inline LazyLBVH::LazyLBVH()
+    : m_N(0), m_leaf_size(4), m_num_chunks(0), m_num_nodes(0)
+    {}
+
+inline LazyLBVH::~LazyLBVH()
+    {
+    clear();
+    }
+
+/*!
+ * \param pool Thread pool for the build.
+ * \param insert The insert operation determining AABB extents of primitives.
+ * \param lo Lower bound of the scene.
+ * \param hi Upper bound of the scene.
+ *
+ * \tparam InsertOpT The kind of insert operation.
+ *
+ * The primitives are partitioned into buckets using up to 16 Morton code bits, with about 1024 primitives
+ * per bucket. The bounds of each bucket are computed in parallel, and a top-level hierarchy is made over
+ * the nonempty buckets. The \a insert operation must be callable from host code, and it is not needed
+ * after this method returns.
+ */
+template<class InsertOpT>
+void LazyLBVH::build(host::ThreadPool& pool, const InsertOpT& insert, const float3& lo, const float3& hi)
+    {
+    const unsigned int N = insert.size();
+    if (N > (1u << 30))
+        {
+        throw std::runtime_error("LazyLBVH supports at most 2^30 primitives.");
+        }
+
+    // release the old hierarchy, but keep memory for the primitives
+    clear();
+    m_N = N;
+    m_num_nodes = 0;
+    if (N == 0) return;
+
+    m_codes.resize(N);
+    m_primitives.resize(N);
+    m_lo.resize(N);
+    m_hi.resize(N);
+    m_num_chunks = ((2*N-1) >> chunk_bits) + 1;
+    m_chunks.reset(new std::atomic<Node*>[m_num_chunks]);
+    for (unsigned int i=0; i < m_num_chunks; ++i)
+        {
+        m_chunks[i].store(nullptr, std::memory_order_relaxed);
+        }
+
+    // partition into buckets
+    unsigned int bits = 0;
+    while (bits < max_bits && (N >> bits) > 1024)
+        {
+        ++bits;
+        }
+    std::vector<unsigned int> starts;
+        {
+        std::vector<unsigned int> tmp_codes(N);
+        host::lbvh_bucket_codes(pool, m_codes.data(), m_primitives.data(), tmp_codes.data(), starts, insert, lo, hi, N, bits);
+        }
+    std::vector<unsigned int> buckets;
+    for (unsigned int b=0; b+1 < starts.size(); ++b)
+        {
+        if (starts[b+1] > starts[b])
+            buckets.push_back(b);
+        }
+    const unsigned int num_buckets = static_cast<unsigned int>(buckets.size());
+
+    // bound the primitives and buckets
+    std::vector<float3> bucket_lo(num_buckets), bucket_hi(num_buckets);
+    std::atomic<unsigned int> next_bucket(0);
+    pool.run([&](unsigned int thread)
+        {
+        unsigned int b;
+        while ((b = next_bucket++) < num_buckets)
+            {
+            float3 blo = make_float3(FLT_MAX, FLT_MAX, FLT_MAX);
+            float3 bhi = make_float3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+            for (unsigned int i=starts[buckets[b]]; i < starts[buckets[b]+1]; ++i)
+                {
+                const unsigned int primitive = m_primitives[i];
+                const BoundingBox box = insert.get(primitive);
+                m_lo[primitive] = box.lo;
+                m_hi[primitive] = box.hi;
+                blo = make_float3(fminf(blo.x, box.lo.x), fminf(blo.y, box.lo.y), fminf(blo.z, box.lo.z));
+                bhi = make_float3(fmaxf(bhi.x, box.hi.x), fmaxf(bhi.y, box.hi.y), fmaxf(bhi.z, box.hi.z));
+                }
+            bucket_lo[b] = blo;
+            bucket_hi[b] = bhi;
+            }
+        });
+
+    // root is a single node, siblings are made in pairs after it
+    m_num_nodes = 1;
+    m_chunks[0].store(new Node[1u << chunk_bits], std::memory_order_release);
+    makeTop(0, buckets, 0, num_buckets-1, starts, bucket_lo, bucket_hi);
+    }
+
+/*!
+ * \param pool Thread pool.
+ * \param query Query operation for defining search volumes and overlaps.
+ * \param out Output operation for intersected primitives.
+ * \param images Translation operation for moving search volume around.
+ * \param transform Transformation operation for primitive indexes.
+ *
+ * \tparam QueryOpT The type of query operation.
+ * \tparam OutputOpT The type of output operation.
+ * \tparam TranslateOpT The type of translation operation.
+ * \tparam TransformOpT The type of transformation operation.
+ *
+ * Each query is traversed by one thread using a stack, and queries are assigned dynamically to threads
+ * in small chunks. Nodes that are overlapped are split if they have not been already. The primitive index
+ * passed to \a out is mapped by \a transform. The result is ready when this method returns.
+ *
+ * Queries may also be traversed concurrently by calls from different host threads (each with its own pool)
+ * because splitting is thread-safe, but the LazyLBVH must not be rebuilt during a traversal.
+ */
+template<class QueryOpT, class OutputOpT, class TranslateOpT, class TransformOpT>
+void LazyLBVH::traverse(host::ThreadPool& pool,
+                        const QueryOpT& query,
+                        const OutputOpT& out,
+                        const TranslateOpT& images,
+                        const TransformOpT& transform)
+    {
+    const unsigned int num_queries = query.size();
+    if (num_queries == 0 || images.size() == 0) return;
+
+    // each thread keeps its own stack between queries
+    std::vector<std::vector<unsigned int>> stacks(pool.getNumThreads());
+    pool.dynamicFor(0, num_queries, 64, [&](unsigned int idx, unsigned int thread)
+        {
+        std::vector<unsigned int>& stack = stacks[thread];
+        stack.reserve(64);
+
+        const typename QueryOpT::ThreadData qdata = query.setup(idx);
+        typename OutputOpT::ThreadData result = out.setup(idx, qdata);
+
+        bool done = false;
+        for (unsigned int i=0; !done && m_N > 0 && i < images.size(); ++i)
+            {
+            const typename QueryOpT::Volume q = query.get(qdata, images.get(i));
+            stack.push_back(0);
+            while (!done && !stack.empty())
+                {
+                const unsigned int node_idx = stack.back();
+                stack.pop_back();
+
+                const Node& node = getNode(node_idx);
+                if (!query.overlap(q, BoundingBox(node.lo, node.hi)))
+                    continue;
+
+                const int left = getChildren(node_idx);
+                if (left >= 0)
+                    {
+                    stack.push_back(left+1);
+                    stack.push_back(left);
+                    }
+                else
+                    {
+                    for (unsigned int j=node.first; !done && j < node.last; ++j)
+                        {
+                        const unsigned int primitive = m_primitives[j];
+                        if (!query.overlap(q, BoundingBox(m_lo[primitive], m_hi[primitive])))
+                            continue;
+
+                        const unsigned int index = transform(primitive);
+                        if (query.refine(qdata, index))
+                            done = output_process(out, result, index);
+                        }
+                    }
+                }
+            }
+        stack.clear();
+
+        out.finalize(result);
+        });
+    }
+
+/*!
+ * \returns The index of the first node of the pair.
+ *
+ * The chunks holding the nodes are allocated if needed. Only one thread keeps a chunk if several
+ * allocate it at the same time.
+ */
+inline unsigned int LazyLBVH::makePair()
+    {
+    const unsigned int idx = m_num_nodes.fetch_add(2, std::memory_order_relaxed);
+    for (unsigned int chunk = (idx >> chunk_bits); chunk <= ((idx+1) >> chunk_bits); ++chunk)
+        {
+        if (m_chunks[chunk].load(std::memory_order_acquire) == nullptr)
+            {
+            Node* nodes = new Node[1u << chunk_bits];
+            Node* expected = nullptr;
+            if (!m_chunks[chunk].compare_exchange_strong(expected, nodes, std::memory_order_acq_rel))
+                delete[] nodes;
+            }
+        }
+    return idx;
+    }
+
+/*!
+ * \param node Node to make.
+ * \param buckets Nonempty buckets.
+ * \param first First bucket of the node.
+ * \param last Last bucket of the node (inclusive).
+ * \param starts First primitive of each bucket.
+ * \param bucket_lo Lower bound of each nonempty bucket.
+ * \param bucket_hi Upper bound of each nonempty bucket.
+ *
+ * The buckets are split recursively in the same way as sorted Morton codes, since their
+ * indexes are the top bits of the codes.
+ */
+inline void LazyLBVH::makeTop(unsigned int node,
+                              const std::vector<unsigned int>& buckets,
+                              unsigned int first,
+                              unsigned int last,
+                              const std::vector<unsigned int>& starts,
+                              const std::vector<float3>& bucket_lo,
+                              const std::vector<float3>& bucket_hi)
+    {
+    Node& n = getNode(node);
+    n.first = starts[buckets[first]];
+    n.last = starts[buckets[last]+1];
+    if (first == last)
+        {
+        n.lo = bucket_lo[first];
+        n.hi = bucket_hi[first];
+        n.sorted = (n.last - n.first == 1);
+        n.left.store(Unsplit, std::memory_order_relaxed);
+        return;
+        }
+
+    const unsigned int split = host::lbvh_find_split(buckets.data(), first, last);
+    const unsigned int left = makePair();
+    makeTop(left, buckets, first, split, starts, bucket_lo, bucket_hi);
+    makeTop(left+1, buckets, split+1, last, starts, bucket_lo, bucket_hi);
+
+    const Node& l = getNode(left);
+    const Node& r = getNode(left+1);
+    n.lo = make_float3(fminf(l.lo.x, r.lo.x), fminf(l.lo.y, r.lo.y), fminf(l.lo.z, r.lo.z));
+    n.hi = make_float3(fmaxf(l.hi.x, r.hi.x), fmaxf(l.hi.y, r.hi.y), fmaxf(l.hi.z, r.hi.z));
+    n.sorted = false;
+    n.left.store(static_cast<int>(left), std::memory_order_relaxed);
+    }
+
+/*!
+ * \param idx Node index.
+ *
+ * \returns The left child of the node, or a negative value if the node is a leaf.
+ *
+ * A node with more than ::getLeafSize primitives is split by the first thread that claims it,
+ * and other threads wait until the children are published.
+ */
+inline int LazyLBVH::getChildren(unsigned int idx)
+    {
+    Node& node = getNode(idx);
+    int left = node.left.load(std::memory_order_acquire);
+    while (left < 0)
+        {
+        if (left == Unsplit)
+            {
+            if (node.last - node.first <= m_leaf_size)
+                break;
+
+            if (node.left.compare_exchange_weak(left, Busy, std::memory_order_acquire))
+                {
+                try
+                    {
+                    left = split(node);
+                    }
+                catch (...)
+                    {
+                    node.left.store(Unsplit, std::memory_order_release);
+                    throw;
+                    }
+                node.left.store(left, std::memory_order_release);
+                }
+            }
+        else
+            {
+            std::this_thread::yield();
+            left = node.left.load(std::memory_order_acquire);
+            }
+        }
+    return left;
+    }
+
+/*!
+ * \param node Node to split, which must be claimed by the caller.
+ *
+ * \returns The index of the left child.
+ *
+ * The primitives are sorted by Morton code and then by index if they have not been already,
+ * which is the same order as the full LBVH build.
+ */
+inline int LazyLBVH::split(Node& node)
+    {
+    const unsigned int first = node.first;
+    const unsigned int last = node.last;
+    if (!node.sorted)
+        {
+        std::vector<unsigned long long> keys(last - first);
+        for (unsigned int i=first; i < last; ++i)
+            {
+            keys[i-first] = (static_cast<unsigned long long>(m_codes[i]) << 32) | m_primitives[i];
+            }
+        std::sort(keys.begin(), keys.end());
+        for (unsigned int i=first; i < last; ++i)
+            {
+            m_codes[i] = static_cast<unsigned int>(keys[i-first] >> 32);
+            m_primitives[i] = static_cast<unsigned int>(keys[i-first] & 0xffffffffu);
+            }
+        node.sorted = true;
+        }
+
+    const unsigned int split = host::lbvh_find_split(m_codes.data(), first, last-1);
+    const unsigned int left = makePair();
+
+    Node& l = getNode(left);
+    l.first = first;
+    l.last = split+1;
+    l.sorted = true;
+    l.left.store(Unsplit, std::memory_order_relaxed);
+    fit(l);
+
+    Node& r = getNode(left+1);
+    r.first = split+1;
+    r.last = last;
+    r.sorted = true;
+    r.left.store(Unsplit, std::memory_order_relaxed);
+    fit(r);
+
+    return static_cast<int>(left);
+    }
+
+/*!
+ * \param node Node to fit.
+ */
+inline void LazyLBVH::fit(Node& node) const
+    {
+    float3 lo = make_float3(FLT_MAX, FLT_MAX, FLT_MAX);
+    float3 hi = make_float3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (unsigned int i=node.first; i < node.last; ++i)
+        {
+        const unsigned int primitive = m_primitives[i];
+        lo = make_float3(fminf(lo.x, m_lo[primitive].x), fminf(lo.y, m_lo[primitive].y), fminf(lo.z, m_lo[primitive].z));
+        hi = make_float3(fmaxf(hi.x, m_hi[primitive].x), fmaxf(hi.y, m_hi[primitive].y), fmaxf(hi.z, m_hi[primitive].z));
+        }
+    node.lo = lo;
+    node.hi = hi;
+    }
+
+inline void LazyLBVH::clear()
+    {
+    for (unsigned int i=0; i < m_num_chunks; ++i)
+        {
+        delete[] m_chunks[i].load(std::memory_order_relaxed);
+        }
+    m_chunks.reset();
+    m_num_chunks = 0;
+    }
+
+} // end namespace neighbor
+
+#endif // NEIGHBOR_LAZY_LBVH_H_
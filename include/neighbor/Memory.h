@@ -6,23 +6,43 @@
 #define NEIGHBOR_MEMORY_H_
 
 #include <hipper/hipper_runtime.h>
+#include <atomic>
 #include <memory>
 #include <stdexcept>
 
+#include "Allocator.h"
+
 namespace neighbor
 {
 
+//! Function recording the allocations and frees of shared_array.
+/*!
+ * \returns The function, which takes the name of the event and its size in bytes, or nullptr.
+ *
+ * The function is set by Tracer::setAllocationTracer, so arrays do not depend on the tracer.
+ */
+inline std::atomic<void (*)(const char*, size_t)>& allocation_hook()
+    {
+    static std::atomic<void (*)(const char*, size_t)> hook(nullptr);
+    return hook;
+    }
+
 //! Smart pointer for device array.
 /*!
  * This object is a thin wrapper around a std::shared_ptr. The underlying raw pointer can be acquired using the ::get()
- * method. The allocation is CUDA managed memory, so the pointer can also be accessed on the host (e.g., using the
- * [] operator). However, it is the responsibility of the caller to synchronize the GPU before accessing it if this is
- * required by their hardware.
+ * method. By default, the allocation is CUDA managed memory, so the pointer can also be accessed on the host (e.g.,
+ * using the [] operator). However, it is the responsibility of the caller to synchronize the GPU before accessing it
+ * if this is required by their hardware. Memory from a host::HostAllocator can only be accessed on the host.
  *
  * This array functions like a std::shared_ptr so that copies of the array point to the same underlying memory.
  * As such, the array cannot be resized after it is constructed. The memory will only be freed after all copies
  * have been destroyed.
  *
+ * The memory is allocated by an Allocator, which is Allocator::getDefault unless one is given. The array keeps its
+ * allocator alive until the memory is freed.
+ *
+ * Allocations and frees are recorded by the tracer set with Tracer::setAllocationTracer, if any.
+ *
  * \tparam T Data type to allocate.
  */
 template<typename T>
@@ -32,7 +52,7 @@ class shared_array
         //! Empty constructor.
         shared_array()
             {
-            allocate(0);
+            allocate(0, nullptr);
             }
 
         //! Constructor for fixed count.
@@ -41,7 +61,17 @@ class shared_array
          */
         explicit shared_array(size_t size)
             {
-            allocate(size);
+            allocate(size, Allocator::getDefault());
+            }
+
+        //! Constructor for fixed count with an allocator.
+        /*!
+         * \param count Number of elements to allocate.
+         * \param allocator Allocator of the memory.
+         */
+        shared_array(size_t size, std::shared_ptr<Allocator> allocator)
+            {
+            allocate(size, allocator ? allocator : Allocator::getDefault());
             }
 
         //! Copy constructor.
@@ -148,42 +178,64 @@ class shared_array
             return size_;
             }
 
+        //! Get the allocator of the memory.
+        /*!
+         * \returns The allocator, or nullptr if the array is empty.
+         */
+        std::shared_ptr<Allocator> getAllocator() const
+            {
+            const deleter* d = std::get_deleter<deleter>(data_);
+            return d ? d->allocator : nullptr;
+            }
+
     private:
         std::shared_ptr<T> data_;   //!< Underlying data
         size_t size_;               //!< Number of elements in array
 
-        //! Custom deleter for CUDA memory
+        //! Custom deleter returning memory to its allocator
         struct deleter
             {
+            size_t bytes;                           //!< Size of the allocation
+            std::shared_ptr<Allocator> allocator;   //!< Allocator of the memory
+
             void operator()(T* ptr)
                 {
-                if(ptr) hipper::free(ptr);
+                if(ptr)
+                    {
+                    allocator->deallocate(ptr, bytes);
+                    auto hook = allocation_hook().load(std::memory_order_relaxed);
+                    if (hook) hook("free", bytes);
+                    }
                 }
             };
 
         //! Allocate memory.
         /*!
          * \param size Number of elements to allocate.
+         * \param allocator Allocator of the memory.
          *
-         * The requested memory is allocated using hipper::mallocManaged. If an error occurs, no memory allocation occurs
+         * The requested memory is allocated using \a allocator. If an error occurs, no memory allocation occurs
          * and an exception is raised. If \a size is 0, then the memory is freed.
          */
-        void allocate(size_t size)
+        void allocate(size_t size, const std::shared_ptr<Allocator>& allocator)
             {
             if (size > 0)
                 {
                 T* data = nullptr;
-                hipper::error_t code = hipper::mallocManaged(reinterpret_cast<void**>(&data), size*sizeof(T));
-                if (code == hipper::success)
+                try
                     {
-                    data_ = std::shared_ptr<T>(data, deleter());
-                    size_ = size;
+                    data = static_cast<T*>(allocator->allocate(size*sizeof(T)));
                     }
-                else
+                catch (...)
                     {
                     deallocate();
-                    throw std::runtime_error("Error allocating managed memory.");
+                    throw;
                     }
+                data_ = std::shared_ptr<T>(data, deleter{size*sizeof(T), allocator});
+                size_ = size;
+
+                auto hook = allocation_hook().load(std::memory_order_relaxed);
+                if (hook) hook("allocate", size*sizeof(T));
                 }
             else
                 {
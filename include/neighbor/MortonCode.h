@@ -0,0 +1,218 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#ifndef NEIGHBOR_MORTON_CODE_H_
+#define NEIGHBOR_MORTON_CODE_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include <cmath>
+
+#define HOSTDEVICE __host__ __device__ __forceinline__
+
+namespace neighbor
+{
+//! Count the number of leading zero bits in an integer.
+/*!
+ * \param v unsigned integer
+ * \returns The number of consecutive zero bits starting from the most significant bit (32 if \a v is 0).
+ *
+ * The __clz intrinsic is used in device code, while a compiler builtin is used in host code.
+ */
+HOSTDEVICE int countLeadingZeros(unsigned int v)
+    {
+    #if defined(__CUDA_ARCH__) || defined(__HIP_DEVICE_COMPILE__)
+    return __clz(v);
+    #else
+    return (v != 0) ? __builtin_clz(v) : 32;
+    #endif
+    }
+
+//! Expand a 10-bit integer into 30 bits by inserting 2 zeros after each bit.
+/*!
+ * \param v unsigned integer with 10 bits set
+ * \returns The integer expanded with two zeros interleaved between bits
+ * http://devblogs.nvidia.com/parallelforall/thinking-parallel-part-iii-tree-construction-gpu/
+ */
+HOSTDEVICE unsigned int expandBits(unsigned int v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+//! Compute the 30-bit Morton code for a tuple of binned indexes.
+/*!
+ * \param point (x,y,z) tuple of bin indexes.
+ * \returns 30-bit Morton code corresponding to \a point.
+ *
+ * The Morton code is formed by first expanding the bits of each component (see ::expandBits),
+ * and then bitshifting to interleave them. The Morton code then has a representation::
+ *
+ *  x0y0z0x1y1z1...
+ *
+ * where indices refer to the bitwise representation of each component.
+ */
+HOSTDEVICE unsigned int calcMortonCode(uint3 point)
+    {
+    return 4 * expandBits(point.x) + 2 * expandBits(point.y) + expandBits(point.z);
+    }
+
+//! Convert a fraction to [0,1023]
+/*
+ * \param f Fractional coordinate lying in [0,1].
+ * \returns Bin integer lying in [0,1023]
+ *
+ * The range of the binned integer corresponds to the maximum value that can be
+ * stored in a 10-bit integer. When \a f lies outside [0,1], the bin is clamped to
+ * the ends of the range.
+ */
+HOSTDEVICE unsigned int fractionToBin(float f)
+    {
+    return static_cast<unsigned int>(fminf(fmaxf(f * 1023.f, 0.f), 1023.f));
+    }
+
+//! Compute the 30-bit Morton code for a point in a scene.
+/*!
+ * \param r Point.
+ * \param lo Lower bound of scene.
+ * \param hi Upper bound of scene.
+ * \returns 30-bit Morton code corresponding to \a r.
+ *
+ * The point is binned into one of 2^10 bins per dimension using its fractional coordinate
+ * between \a lo and \a hi, and the bins are converted to a Morton code.
+ */
+HOSTDEVICE unsigned int calcMortonCode(const float3& r, const float3& lo, const float3& hi)
+    {
+    // fractional coordinate
+    const float3 f = make_float3((r.x - lo.x) / (hi.x - lo.x),
+                                 (r.y - lo.y) / (hi.y - lo.y),
+                                 (r.z - lo.z) / (hi.z - lo.z));
+
+    // bin fractional coordinate
+    const uint3 q = make_uint3(fractionToBin(f.x), fractionToBin(f.y), fractionToBin(f.z));
+
+    return calcMortonCode(q);
+    }
+
+//! Test if a Morton code lies inside the box spanned by two other codes.
+/*!
+ * \param code Morton code to test.
+ * \param zmin Morton code of the lower corner of the box.
+ * \param zmax Morton code of the upper corner of the box.
+ * \returns True if the bins of \a code lie between the bins of \a zmin and \a zmax in every dimension.
+ *
+ * The bins of each dimension are compared without decoding them, since masking out the other
+ * dimensions preserves their order.
+ */
+HOSTDEVICE bool mortonInBox(unsigned int code, unsigned int zmin, unsigned int zmax)
+    {
+    const unsigned int mx = 0x24924924u, my = 0x12492492u, mz = 0x09249249u;
+    return ((code & mx) >= (zmin & mx) && (code & mx) <= (zmax & mx) &&
+            (code & my) >= (zmin & my) && (code & my) <= (zmax & my) &&
+            (code & mz) >= (zmin & mz) && (code & mz) <= (zmax & mz));
+    }
+
+//! Compute the smallest Morton code in a box that is greater than a code.
+/*!
+ * \param code Morton code, which lies between \a zmin and \a zmax but not inside their box.
+ * \param zmin Morton code of the lower corner of the box.
+ * \param zmax Morton code of the upper corner of the box.
+ * \returns The next Morton code after \a code inside the box (BIGMIN).
+ *
+ * The algorithm is due to <a href="https://doi.org/10.1007/BFb0048200">Tropf and Herzog</a>.
+ * The bits of the codes are compared from the most significant bit. When \a code leaves the
+ * box in some dimension, the candidate (or the box) is moved by setting that bit and clearing
+ * the lower bits of the same dimension (or the reverse for the upper corner of the box).
+ * This lets a search through sorted codes skip the codes that lie between the box's visits
+ * to the Z-order curve.
+ */
+HOSTDEVICE unsigned int mortonBigMin(unsigned int code, unsigned int zmin, unsigned int zmax)
+    {
+    unsigned int bigmin = 0;
+    for (int bit=29; bit >= 0; --bit)
+        {
+        const unsigned int mask = 1u << bit;
+        // lower bits of the same dimension as this bit
+        const unsigned int lower = (0x09249249u << (bit % 3)) & (mask - 1);
+
+        const unsigned int v = (code & mask) ? 1 : 0;
+        const unsigned int zlo = (zmin & mask) ? 1 : 0;
+        const unsigned int zhi = (zmax & mask) ? 1 : 0;
+        if (v == 0 && zlo == 0 && zhi == 1)
+            {
+            // the box continues above code: remember the first code in the upper half
+            bigmin = (zmin | mask) & ~lower;
+            zmax = (zmax & ~mask) | lower;
+            }
+        else if (v == 0 && zlo == 1 && zhi == 1)
+            {
+            // code is below the box
+            return zmin;
+            }
+        else if (v == 1 && zlo == 0 && zhi == 0)
+            {
+            // code is above the box
+            return bigmin;
+            }
+        else if (v == 1 && zlo == 0 && zhi == 1)
+            {
+            // code is in the upper half of the box
+            zmin = (zmin | mask) & ~lower;
+            }
+        }
+    return bigmin;
+    }
+
+//! Compute the number of bits shared by Morton codes for primitives \a i and \a j.
+/*!
+ * \param d_codes List of Morton codes.
+ * \param code_i Morton code corresponding to \a i.
+ * \param i First primitive.
+ * \param j Second primitive.
+ * \param N Number of primitives.
+ *
+ * \returns Number of bits in longest common prefix or -1 if \a j lies outside [0,N).
+ *
+ * The longest common prefix of the Morton codes for \a i and \j is computed
+ * using ::countLeadingZeros. When \a i and \a j are the same, they share all 32
+ * bits in the int representation of the Morton code. In that case, the common
+ * prefix of \a i and \a j is used as a tie breaker.
+ *
+ * The user is required to supply \a code_i (even though it could also be looked
+ * up from \a d_codes) for performance reasons, since code_i can be cached by
+ * the caller if making multiple calls to ::delta for different \a j.
+ */
+HOSTDEVICE int delta(const unsigned int *d_codes,
+                     const unsigned int code_i,
+                     const int i,
+                     const int j,
+                     const unsigned int N)
+    {
+    if (j < 0 || j >= (int)N)
+        {
+        return -1;
+        }
+
+    const unsigned int code_j = d_codes[j];
+
+    if (code_i == code_j)
+        {
+        return (32 + countLeadingZeros(i ^ j));
+        }
+    else
+        {
+        return countLeadingZeros(code_i ^ code_j);
+        }
+    }
+
+} // end namespace neighbor
+
+#undef HOSTDEVICE
+
+#endif // NEIGHBOR_MORTON_CODE_H_
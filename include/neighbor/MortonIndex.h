@@ -0,0 +1,340 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#ifndef NEIGHBOR_MORTON_INDEX_H_
+#define NEIGHBOR_MORTON_INDEX_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include <cassert>
+
+#include "Memory.h"
+#include "Tunable.h"
+#include "TranslateOps.h"
+
+#include "kernels/LBVH.cuh"
+#include "kernels/MortonIndex.cuh"
+
+namespace neighbor
+{
+//! Index of points sorted by Morton code.
+/*!
+ * A MortonIndex answers axis-aligned box queries on point data using only the sorted Morton codes and
+ * primitive indexes, without generating a hierarchy. The ::build method computes and sorts the codes in the
+ * same way as LBVH::build, then stores the bounds of the primitives in sorted order. It skips generating
+ * the tree and bubbling its bounding boxes, so it is cheaper than building an LBVH.
+ *
+ * A query bins the corners of its box like a point, and then scans the codes between the corners. Codes
+ * that leave the box are skipped with a binary search for the next code inside it, which is found from the
+ * BIGMIN of the code (see ::mortonBigMin). Each query is more expensive than an LBVH traversal, so the index
+ * is best when there are only a few queries per build. This crossover has only been timed with a serial host
+ * emulation of the kernels, so it has not been established on a GPU.
+ *
+ * The query operation must use a BoundingBox as its volume (e.g., BoxQueryOp). Primitives are matched by
+ * the Morton code of their centers, so the index should only be used for points. Primitives with a larger
+ * extent may be missed if their centers are outside the query box.
+ */
+class MortonIndex : public Tunable<unsigned int>
+    {
+    public:
+        //! Setup an unallocated index.
+        MortonIndex();
+
+        //! Build the index in a stream with tunable parameters.
+        template<class InsertOpT>
+        void build(const LaunchParameters& params, const InsertOpT& insert, const float3& lo, const float3& hi);
+
+        //! Build the index in a stream.
+        /*!
+         * \param stream CUDA stream for kernel execution.
+         * \param insert The insert operation holding the primitives.
+         * \param lo Lower bound of the scene.
+         * \param hi Upper bound of the scene.
+         *
+         * \tparam InsertOpT The kind of insert operation.
+         *
+         * The tunable block size defaults to 32 threads per block, or it is autotuned (see ::setAutotuning).
+         */
+        template<class InsertOpT>
+        void build(hipper::stream_t stream, const InsertOpT& insert, const float3& lo, const float3& hi)
+            {
+            tune("MortonIndex", "build", TuningCache::Types<InsertOpT>(), insert.size(), stream, 32, [&](const LaunchParameters& params)
+                {
+                build(params, insert, lo, hi);
+                });
+            }
+
+        //! Build the index.
+        /*!
+         * \param insert The insert operation holding the primitives.
+         * \param lo Lower bound of the scene.
+         * \param hi Upper bound of the scene.
+         *
+         * \tparam InsertOpT The kind of insert operation.
+         *
+         * The tunable block size defaults to 32 threads per block, and the kernel executes in the default stream.
+         */
+        template<class InsertOpT>
+        void build(const InsertOpT& insert, const float3& lo, const float3& hi)
+            {
+            build(0, insert, lo, hi);
+            }
+
+        //! Query the index in a stream with tunable parameters.
+        template<class QueryOpT, class OutputOpT, class TranslateOpT>
+        void query(const LaunchParameters& params, const QueryOpT& query, const OutputOpT& out, const TranslateOpT& images);
+
+        //! Query the index in a stream.
+        /*!
+         * \param stream CUDA stream for kernel execution.
+         * \param query Query operation for defining search volumes.
+         * \param out Output operation for intersected primitives.
+         * \param images Translation operation for moving search volume around.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         * \tparam TranslateOpT The type of translation operation.
+         *
+         * The tunable block size defaults to 32 threads per block, or it is autotuned (see ::setAutotuning).
+         */
+        template<class QueryOpT, class OutputOpT, class TranslateOpT>
+        void query(hipper::stream_t stream, const QueryOpT& query, const OutputOpT& out, const TranslateOpT& images)
+            {
+            tune("MortonIndex", "query", TuningCache::Types<QueryOpT,OutputOpT,TranslateOpT>(), query.size(), stream, 32, [&](const LaunchParameters& params)
+                {
+                this->query(params, query, out, images);
+                });
+            }
+
+        //! Query the index.
+        /*!
+         * \param query Query operation for defining search volumes.
+         * \param out Output operation for intersected primitives.
+         * \param images Translation operation for moving search volume around.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         * \tparam TranslateOpT The type of translation operation.
+         *
+         * The tunable block size defaults to 32 threads per block, and the kernel executes in the default stream.
+         */
+        template<class QueryOpT, class OutputOpT, class TranslateOpT>
+        void query(const QueryOpT& query, const OutputOpT& out, const TranslateOpT& images)
+            {
+            this->query(0, query, out, images);
+            }
+
+        //! Query the index.
+        /*!
+         * \param query Query operation for defining search volumes.
+         * \param out Output operation for intersected primitives.
+         *
+         * \tparam QueryOpT The type of query operation.
+         * \tparam OutputOpT The type of output operation.
+         *
+         * Only the self image (no translation) is queried in the default stream.
+         */
+        template<class QueryOpT, class OutputOpT>
+        void query(const QueryOpT& query, const OutputOpT& out)
+            {
+            this->query(0, query, out, SelfOp());
+            }
+
+        //! Get the number of primitives.
+        unsigned int getN() const
+            {
+            return m_N;
+            }
+
+        //! Get the sorted Morton codes.
+        const shared_array<unsigned int>& getCodes() const
+            {
+            return m_codes.current();
+            }
+
+        //! Get the original indexes of the primitives in sorted order.
+        const shared_array<unsigned int>& getPrimitives() const
+            {
+            return m_indexes.current();
+            }
+
+    private:
+        unsigned int m_N;   //!< Number of primitives
+        float3 m_lo;        //!< Lower bound of scene
+        float3 m_hi;        //!< Upper bound of scene
+
+        buffered_array<unsigned int> m_codes;   //!< Morton codes
+        buffered_array<unsigned int> m_indexes; //!< Primitive indexes
+        shared_array<unsigned char> m_tmp;      //!< Temporary memory for sorting
+        shared_array<float3> m_prim_lo;         //!< Lower bound of sorted primitives
+        shared_array<float3> m_prim_hi;         //!< Upper bound of sorted primitives
+
+        //! Allocate.
+        void allocate(const LaunchParameters& params, unsigned int N);
+    };
+
+/*!
+ * The constructor defers memory initialization to the first call to ::build.
+ */
+inline MortonIndex::MortonIndex()
+    : Tunable<unsigned int>(32, 1024, 32), m_N(0)
+    {
+    m_lo = make_float3(0.f, 0.f, 0.f);
+    m_hi = make_float3(0.f, 0.f, 0.f);
+    }
+
+/*!
+ * \param params Launch parameters for kernel execution, including tunable block size and stream.
+ * \param insert The insert operation holding the primitives.
+ * \param lo Lower bound of the scene.
+ * \param hi Upper bound of the scene.
+ *
+ * \tparam InsertOpT The kind of insert operation.
+ *
+ * The Morton codes are generated and sorted with the same methods as LBVH::build, and the bounds of the
+ * primitives are stored in sorted order. Points lying outside the scene are clamped to it.
+ */
+template<class InsertOpT>
+void MortonIndex::build(const LaunchParameters& params, const InsertOpT& insert, const float3& lo, const float3& hi)
+    {
+    allocate(params, insert.size());
+    m_lo = lo;
+    m_hi = hi;
+
+    if (m_N == 0) return;
+
+    // check tuning parameter first
+    checkParameter(params);
+
+    // calculate morton codes
+    gpu::lbvh_gen_codes(m_codes.current().get(),
+                        m_indexes.current().get(),
+                        insert,
+                        lo,
+                        hi,
+                        m_N,
+                        params.tunable,
+                        params.stream);
+
+    // sort morton codes
+        {
+        size_t tmp_bytes = 0;
+        gpu::lbvh_sort_codes(NULL,
+                             tmp_bytes,
+                             m_codes.current().get(),
+                             m_codes.alternate().get(),
+                             m_indexes.current().get(),
+                             m_indexes.alternate().get(),
+                             m_N,
+                             params.stream);
+
+        // allocation already be taken care of by allocate() call above, so assume here.
+        assert(m_tmp.size() >= tmp_bytes);
+
+        uchar2 swap = gpu::lbvh_sort_codes((void*)m_tmp.get(),
+                                           tmp_bytes,
+                                           m_codes.current().get(),
+                                           m_codes.alternate().get(),
+                                           m_indexes.current().get(),
+                                           m_indexes.alternate().get(),
+                                           m_N,
+                                           params.stream);
+
+        // flip the buffer selector if the sorted codes or indexes are in the alternate array
+        if (swap.x) m_codes.flip();
+        if (swap.y) m_indexes.flip();
+        }
+
+    // store the bounds in sorted order
+    gpu::morton_index_fit(m_prim_lo.get(),
+                          m_prim_hi.get(),
+                          m_indexes.current().get(),
+                          insert,
+                          m_N,
+                          params.tunable,
+                          params.stream);
+    }
+
+/*!
+ * \param params Launch parameters for kernel execution, including tunable block size and stream.
+ * \param query Query operation for defining search volumes.
+ * \param out Output operation for intersected primitives.
+ * \param images Translation operation for moving search volume around.
+ *
+ * \tparam QueryOpT The type of query operation.
+ * \tparam OutputOpT The type of output operation.
+ * \tparam TranslateOpT The type of translation operation.
+ *
+ * One thread is used per query (see gpu::morton_index_query). The \a out operation is set up and
+ * finalized for every query, even if the index is empty.
+ */
+template<class QueryOpT, class OutputOpT, class TranslateOpT>
+void MortonIndex::query(const LaunchParameters& params, const QueryOpT& query, const OutputOpT& out, const TranslateOpT& images)
+    {
+    if (query.size() == 0) return;
+
+    // check tuning parameter first
+    checkParameter(params);
+
+    gpu::morton_index_query(out,
+                            m_codes.current().get(),
+                            m_indexes.current().get(),
+                            m_prim_lo.get(),
+                            m_prim_hi.get(),
+                            m_lo,
+                            m_hi,
+                            m_N,
+                            query,
+                            images,
+                            params.tunable,
+                            params.stream);
+    }
+
+/*!
+ * \param params Kernel launch parameters (only used for stream).
+ * \param N Number of primitives.
+ *
+ * The memory requirements are O(N): 4 integers (16B) per primitive for sorting, and 2 float3s
+ * (24B) per primitive holding their bounds. Memory is only reallocated when it grows.
+ */
+inline void MortonIndex::allocate(const LaunchParameters& params, unsigned int N)
+    {
+    m_N = N;
+
+    if (m_N > m_codes.size())
+        {
+        buffered_array<unsigned int> codes(m_N);
+        m_codes.swap(codes);
+
+        buffered_array<unsigned int> indexes(m_N);
+        m_indexes.swap(indexes);
+
+        shared_array<float3> lo(m_N);
+        m_prim_lo.swap(lo);
+
+        shared_array<float3> hi(m_N);
+        m_prim_hi.swap(hi);
+        }
+
+    // check for required size of CUB allocation
+    size_t tmp_bytes = 0;
+    gpu::lbvh_sort_codes(NULL,
+                         tmp_bytes,
+                         m_codes.current().get(),
+                         m_codes.alternate().get(),
+                         m_indexes.current().get(),
+                         m_indexes.alternate().get(),
+                         m_N,
+                         params.stream);
+    if (tmp_bytes == 0) tmp_bytes = 4; // make at least 4 bytes (old workaround)
+    if (tmp_bytes > m_tmp.size())
+        {
+        shared_array<unsigned char> tmp(tmp_bytes);
+        m_tmp.swap(tmp);
+        }
+    }
+
+} // end namespace neighbor
+
+#endif // NEIGHBOR_MORTON_INDEX_H_
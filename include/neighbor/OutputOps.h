@@ -7,6 +7,8 @@
 
 #include <hipper/hipper_runtime.h>
 
+#include <type_traits>
+
 namespace neighbor
 {
 
@@ -24,6 +26,10 @@ namespace neighbor
  *  - finalize(): a method called at the end of the traversal kernel.
  *
  * See each method below for additional details of the type of functionality typically used.
+ *
+ * process() may also return a bool instead of void. Returning true ends the traversal of the
+ * query, which is still finalized. This saves work when the output is known before all overlapped
+ * primitives are found (see AnyOverlapOp).
  */
 struct CountNeighborsOp
     {
@@ -50,7 +56,7 @@ struct CountNeighborsOp
         /*!
          * \param idx_ The thread index of the search sphere processed by the thread.
          */
-        __device__ ThreadData(const unsigned int idx_)
+        __host__ __device__ ThreadData(const unsigned int idx_)
             : idx(idx_), num_neigh(0)
             {}
 
@@ -66,7 +72,7 @@ struct CountNeighborsOp
      * Setup functions may do additional processing of variables if needed.
      */
     template<class QueryDataT>
-    __device__ __forceinline__ ThreadData setup(const unsigned int idx, const QueryDataT& q) const
+    __host__ __device__ __forceinline__ ThreadData setup(const unsigned int idx, const QueryDataT& q) const
         {
         return ThreadData(idx);
         }
@@ -81,7 +87,7 @@ struct CountNeighborsOp
      * Note that this processing step occurs deep in the traversal, and so it is advised
      * to avoid unnecessarily divergent execution.
      */
-    __device__ __forceinline__ void process(ThreadData& t, const int primitive) const
+    __host__ __device__ __forceinline__ void process(ThreadData& t, const int primitive) const
         {
         ++t.num_neigh;
         }
@@ -94,7 +100,7 @@ struct CountNeighborsOp
      * It is called at the very end of the traversal kernel, and so allows additional
      * custom output operations to be injected without significant cost during the traversal.
      */
-    __device__ __forceinline__ void finalize(const ThreadData& t) const
+    __host__ __device__ __forceinline__ void finalize(const ThreadData& t) const
         {
         nneigh[t.idx] = t.num_neigh;
         }
@@ -102,6 +108,51 @@ struct CountNeighborsOp
     unsigned int* nneigh;   //!< Number of neighbors per-search sphere
     };
 
+//! Count the number of neighbors up to a maximum
+/*!
+ * The number of neighbors is counted like CountNeighborsOp, but the traversal of a query
+ * ends once \a max_count neighbors are found. The output is the smaller of the number of
+ * neighbors and \a max_count, which is enough to test a threshold (e.g., a query has at least
+ * 12 neighbors if its count is 12 with \a max_count = 12).
+ */
+struct SaturatingCountNeighborsOp : public CountNeighborsOp
+    {
+    //! Constructor
+    /*!
+     * \param nneigh_ Number of neighbors array (output)
+     * \param max_count_ Count at which to stop
+     */
+    SaturatingCountNeighborsOp(unsigned int* nneigh_, unsigned int max_count_)
+        : CountNeighborsOp(nneigh_), max_count(max_count_)
+        {}
+
+    //! Process a new primitive that is overlapped.
+    /*!
+     * \param t The ThreadData being operated on.
+     * \param primitive The new primitive index to add.
+     *
+     * \returns True if the count has reached the maximum.
+     */
+    __host__ __device__ __forceinline__ bool process(ThreadData& t, const int primitive) const
+        {
+        ++t.num_neigh;
+        return (t.num_neigh >= max_count);
+        }
+
+    //! Finalize output operations.
+    /*!
+     * \param t The ThreadData being operated on.
+     *
+     * The count is capped at the maximum, which only matters if the maximum is 0.
+     */
+    __host__ __device__ __forceinline__ void finalize(const ThreadData& t) const
+        {
+        nneigh[t.idx] = (t.num_neigh < max_count) ? t.num_neigh : max_count;
+        }
+
+    const unsigned int max_count;   //!< Count at which to stop
+    };
+
 //! Generate a neighbor list
 /*!
  * The indexes of primitives overlapping the search spheres are saved into a list.
@@ -121,7 +172,7 @@ struct NeighborListOp
     //! Thread-local data
     struct ThreadData
         {
-        __device__ ThreadData(const unsigned int idx_, unsigned int first_)
+        __host__ __device__ ThreadData(const unsigned int idx_, unsigned int first_)
             : idx(idx_), first(first_), num_neigh(0)
             {}
 
@@ -135,7 +186,7 @@ struct NeighborListOp
      * \param idx Index of search sphere.
      */
     template<class QueryDataT>
-    __device__ __forceinline__ ThreadData setup(const unsigned int idx, const QueryDataT& q) const
+    __host__ __device__ __forceinline__ ThreadData setup(const unsigned int idx, const QueryDataT& q) const
         {
         return ThreadData(idx, max_neigh*idx);
         }
@@ -151,7 +202,7 @@ struct NeighborListOp
      * The number of neighbors is incremented regardless, but writing is defered until
      * finalize().
      */
-    __device__ __forceinline__ void process(ThreadData& t, const int primitive) const
+    __host__ __device__ __forceinline__ void process(ThreadData& t, const int primitive) const
         {
         if (t.num_neigh < max_neigh)
             neigh_list[t.first+t.num_neigh] = primitive;
@@ -165,7 +216,7 @@ struct NeighborListOp
      * The number of neighbors is written to global memory. This number may be larger
      * than the maximum allocation.
      */
-    __device__ __forceinline__ void finalize(const ThreadData& t) const
+    __host__ __device__ __forceinline__ void finalize(const ThreadData& t) const
         {
         nneigh[t.idx] = t.num_neigh;
         }
@@ -175,6 +226,152 @@ struct NeighborListOp
     const unsigned int max_neigh;   //!< Maximum number of neighbors allocated per sphere
     };
 
+//! Generate a neighbor list that stops once it is full
+/*!
+ * The traversal of a query ends once \a max_neigh neighbors are found. The list then holds the
+ * first neighbors that were found, in no particular order, and the number of neighbors is at most
+ * \a max_neigh, so overflow cannot be detected from it. This saves work when any \a max_neigh
+ * neighbors will do, or when overflow is treated as an error anyway.
+ *
+ * A NeighborListOp does not pay for the check, so use it when the full count is needed.
+ */
+struct CappedNeighborListOp : public NeighborListOp
+    {
+    CappedNeighborListOp(unsigned int* neigh_list_,
+                         unsigned int* nneigh_,
+                         unsigned int max_neigh_)
+        : NeighborListOp(neigh_list_, nneigh_, max_neigh_)
+        {}
+
+    //! Process a new primitive that is overlapped.
+    /*!
+     * \param t The ThreadData being operated on.
+     * \param primitive The new primitive index to add.
+     *
+     * \returns True if the list is full.
+     */
+    __host__ __device__ __forceinline__ bool process(ThreadData& t, const int primitive) const
+        {
+        if (t.num_neigh >= max_neigh)
+            return true;
+        neigh_list[t.first+t.num_neigh] = primitive;
+        ++t.num_neigh;
+        return (t.num_neigh == max_neigh);
+        }
+    };
+
+//! Find if a query overlaps any primitive
+/*!
+ * Each query is flagged 1 if it overlaps at least one primitive and 0 otherwise.
+ * The traversal of a query ends at the first overlapped primitive, so this is cheaper than
+ * counting the neighbors when only a yes or no answer is needed, e.g., to test if a trial
+ * particle can be inserted.
+ */
+struct AnyOverlapOp
+    {
+    //! Constructor
+    /*!
+     * \param overlap_ Overlap flag of each query (output)
+     */
+    AnyOverlapOp(unsigned int* overlap_)
+        : overlap(overlap_)
+        {}
+
+    //! Thread-local data
+    struct ThreadData
+        {
+        __host__ __device__ ThreadData(const unsigned int idx_)
+            : idx(idx_), overlap(false)
+            {}
+
+        const int idx;  //!< Index of the query
+        bool overlap;   //!< If true, a primitive is overlapped
+        };
+
+    //! Initialize the local ThreadData
+    /*!
+     * \param idx Index of the query.
+     */
+    template<class QueryDataT>
+    __host__ __device__ __forceinline__ ThreadData setup(const unsigned int idx, const QueryDataT& q) const
+        {
+        return ThreadData(idx);
+        }
+
+    //! Process a new primitive that is overlapped.
+    /*!
+     * \param t The ThreadData being operated on.
+     * \param primitive The overlapped primitive.
+     *
+     * \returns True, because the first overlap decides the output.
+     */
+    __host__ __device__ __forceinline__ bool process(ThreadData& t, const int primitive) const
+        {
+        t.overlap = true;
+        return true;
+        }
+
+    //! Finalize output operations.
+    /*!
+     * \param t The ThreadData being operated on.
+     */
+    __host__ __device__ __forceinline__ void finalize(const ThreadData& t) const
+        {
+        overlap[t.idx] = t.overlap ? 1u : 0u;
+        }
+
+    unsigned int* overlap;  //!< Overlap flag per query
+    };
+
+//! Process a primitive with an output operation whose process() returns void.
+/*!
+ * \returns False, because the operation never ends the traversal.
+ */
+template<class OutputOpT>
+__host__ __device__ __forceinline__ bool output_process(const OutputOpT& out,
+                                                        typename OutputOpT::ThreadData& t,
+                                                        const int primitive,
+                                                        std::false_type)
+    {
+    out.process(t, primitive);
+    return false;
+    }
+
+//! Process a primitive with an output operation whose process() returns bool.
+/*!
+ * \returns The value returned by process().
+ */
+template<class OutputOpT>
+__host__ __device__ __forceinline__ bool output_process(const OutputOpT& out,
+                                                        typename OutputOpT::ThreadData& t,
+                                                        const int primitive,
+                                                        std::true_type)
+    {
+    return out.process(t, primitive);
+    }
+
+//! Process an overlapped primitive during traversal.
+/*!
+ * \param out Output operation.
+ * \param t Thread data of the output operation.
+ * \param primitive The overlapped primitive.
+ *
+ * \returns True if the traversal of the query should end.
+ *
+ * \tparam OutputOpT The type of output operation.
+ *
+ * Traversals call process() through this function so that output operations may return either
+ * void or bool from process().
+ */
+template<class OutputOpT>
+__host__ __device__ __forceinline__ bool output_process(const OutputOpT& out,
+                                                        typename OutputOpT::ThreadData& t,
+                                                        const int primitive)
+    {
+    typedef typename std::is_same<decltype(out.process(t, primitive)), bool>::type returns_bool;
+    return output_process(out, t, primitive, returns_bool());
+    }
+
 } // end namespace neighbor
 
 #endif // NEIGHBOR_OUTPUT_OPS_H_
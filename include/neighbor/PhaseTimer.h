@@ -0,0 +1,244 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#ifndef NEIGHBOR_PHASE_TIMER_H_
+#define NEIGHBOR_PHASE_TIMER_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace neighbor
+{
+
+//! Time and work of one phase of an operation.
+struct PhaseTiming
+    {
+    std::string name;           //!< Name of the phase
+    double time;                //!< Elapsed time in milliseconds
+    unsigned long long count;   //!< Number of items processed (e.g., primitives or nodes)
+    unsigned long long bytes;   //!< Minimum number of bytes read and written
+    };
+
+//! Phase timer that does nothing.
+/*!
+ * This is the default timing policy of the instrumented methods (e.g., LBVH::build). All methods are empty,
+ * so the instrumentation compiles away.
+ *
+ * The instrumented methods add the work of a phase before ending it, so a policy can record a complete phase
+ * when it ends (see Tracer).
+ */
+class NullPhaseTimer
+    {
+    public:
+        //! Start timing an operation.
+        void reset() {}
+
+        //! Start a phase on the host.
+        void begin(const char*) {}
+
+        //! Start a phase in a stream.
+        void begin(const char*, hipper::stream_t) {}
+
+        //! End the current phase on the host.
+        void end() {}
+
+        //! End the current phase in a stream.
+        void end(hipper::stream_t) {}
+
+        //! Add work to the current phase.
+        void addWork(unsigned long long, unsigned long long) {}
+    };
+
+//! Timer of the phases of an operation.
+/*!
+ * A PhaseTimer can be passed to instrumented methods, e.g., LBVH::build or LBVHTraverser::traverse, to
+ * record the time of each phase, the number of items it processed, and the minimum number of bytes it read
+ * and wrote:
+ *
+ *      PhaseTimer timer;
+ *      lbvh.build(LBVH::LaunchParameters(128, stream), insert, lo, hi, timer);
+ *      for (const auto& phase : timer.getPhases()) ...
+ *
+ * The method resets the timer, so the phases are those of the last call. Phases in a stream are timed with
+ * events, which are only waited for when the phases are read, so timing does not synchronize the stream during
+ * the operation. Phases on the host are timed with the steady clock.
+ *
+ * The phase times have only been collected with an emulated runtime, where the events are not timed on a
+ * device. Neither the device phase times nor the overhead of timing have been checked on a GPU.
+ *
+ * The timer is not thread safe, and it can only time one operation at a time.
+ */
+class PhaseTimer
+    {
+    public:
+        //! Create a timer.
+        PhaseTimer()
+            : m_num_events(0), m_resolved(true)
+            {}
+
+        //! Destroy the timer.
+        ~PhaseTimer()
+            {
+            for (auto e : m_events)
+                {
+                hipper::eventDestroy(e);
+                }
+            }
+
+        // events are owned by the timer
+        PhaseTimer(const PhaseTimer&) = delete;
+        PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+        //! Start timing an operation.
+        /*!
+         * The phases of the last operation are cleared.
+         */
+        void reset()
+            {
+            m_phases.clear();
+            m_records.clear();
+            m_num_events = 0;
+            m_resolved = true;
+            }
+
+        //! Start a phase on the host.
+        /*!
+         * \param name Name of the phase.
+         */
+        void begin(const char* name)
+            {
+            m_phases.push_back({name, 0., 0, 0});
+            Record r;
+            r.device = false;
+            r.start = clock::now();
+            m_records.push_back(r);
+            }
+
+        //! Start a phase in a stream.
+        /*!
+         * \param name Name of the phase.
+         * \param stream Stream of the phase.
+         */
+        void begin(const char* name, hipper::stream_t stream)
+            {
+            m_phases.push_back({name, 0., 0, 0});
+            Record r;
+            r.device = true;
+            r.event = m_num_events;
+            m_records.push_back(r);
+            while (m_events.size() < m_num_events+2)
+                {
+                hipper::event_t e;
+                hipper::eventCreate(&e);
+                m_events.push_back(e);
+                }
+            hipper::eventRecord(m_events[m_num_events], stream);
+            m_num_events += 2;
+            m_resolved = false;
+            }
+
+        //! End the current phase on the host.
+        void end()
+            {
+            Record& r = m_records.back();
+            m_phases.back().time = std::chrono::duration<double,std::milli>(clock::now() - r.start).count();
+            }
+
+        //! End the current phase in a stream.
+        /*!
+         * \param stream Stream of the phase.
+         */
+        void end(hipper::stream_t stream)
+            {
+            hipper::eventRecord(m_events[m_records.back().event+1], stream);
+            }
+
+        //! Add work to the current phase.
+        /*!
+         * \param count Number of items processed.
+         * \param bytes Number of bytes read and written.
+         */
+        void addWork(unsigned long long count, unsigned long long bytes)
+            {
+            m_phases.back().count += count;
+            m_phases.back().bytes += bytes;
+            }
+
+        //! Get the phases of the last operation.
+        /*!
+         * \returns The phases in the order they started.
+         *
+         * This waits for the phases in a stream to finish.
+         */
+        const std::vector<PhaseTiming>& getPhases() const
+            {
+            if (!m_resolved)
+                {
+                for (unsigned int i=0; i < m_records.size(); ++i)
+                    {
+                    const Record& r = m_records[i];
+                    if (!r.device) continue;
+
+                    hipper::eventSynchronize(m_events[r.event+1]);
+                    float time;
+                    hipper::eventElapsedTime(&time, m_events[r.event], m_events[r.event+1]);
+                    m_phases[i].time = time;
+                    }
+                m_resolved = true;
+                }
+            return m_phases;
+            }
+
+        //! Get the time of a phase.
+        /*!
+         * \param name Name of the phase.
+         * \returns The summed time of the phases with \a name in milliseconds, or 0 if there are none.
+         */
+        double getTime(const std::string& name) const
+            {
+            double time = 0.;
+            for (const auto& p : getPhases())
+                {
+                if (p.name == name) time += p.time;
+                }
+            return time;
+            }
+
+        //! Get the summed time of all phases in milliseconds.
+        double getTotalTime() const
+            {
+            double time = 0.;
+            for (const auto& p : getPhases())
+                {
+                time += p.time;
+                }
+            return time;
+            }
+
+    private:
+        typedef std::chrono::steady_clock clock;
+
+        //! How a phase is timed.
+        struct Record
+            {
+            bool device;                //!< If true, the phase is timed with events
+            clock::time_point start;    //!< Start time on the host
+            unsigned int event;         //!< Index of the start event (the stop event follows it)
+            };
+
+        mutable std::vector<PhaseTiming> m_phases;  //!< Phases of the last operation
+        std::vector<Record> m_records;              //!< How each phase is timed
+        std::vector<hipper::event_t> m_events;      //!< Events, reused between operations
+        unsigned int m_num_events;                  //!< Number of events used by the last operation
+        mutable bool m_resolved;                    //!< If true, the times of the phases are known
+    };
+
+} // end namespace neighbor
+
+#endif // NEIGHBOR_PHASE_TIMER_H_
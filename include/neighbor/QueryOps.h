@@ -49,7 +49,7 @@ struct SphereQueryOp
      *
      * The reference position for the sphere is simply loaded into thread-local memory.
      */
-    __device__ __forceinline__ ThreadData setup(const unsigned int idx) const
+    __host__ __device__ __forceinline__ ThreadData setup(const unsigned int idx) const
         {
         return spheres[idx];
         }
@@ -61,7 +61,7 @@ struct SphereQueryOp
      *
      * \returns The enclosing BoundingSphere at \a image.
      */
-    __device__ __forceinline__ Volume get(const ThreadData& q, const float3& image) const
+    __host__ __device__ __forceinline__ Volume get(const ThreadData& q, const float3& image) const
         {
         const float3 t = make_float3(q.x + image.x, q.y + image.y, q.z + image.z);
         return BoundingSphere(t,q.w);
@@ -78,7 +78,7 @@ struct SphereQueryOp
      * already implemented. This overlap test should be *fast*, since it will be
      * applied against all internal nodes of the BVH.
      */
-    __device__ __forceinline__ bool overlap(const Volume& v, const BoundingBox& box) const
+    __host__ __device__ __forceinline__ bool overlap(const Volume& v, const BoundingBox& box) const
         {
         return v.overlap(box);
         }
@@ -101,7 +101,7 @@ struct SphereQueryOp
      * In this reference implementation, we do not need any additional refinement, and
      * so we simply return true for all overlapped primitives.
      */
-    __device__ __forceinline__ bool refine(const ThreadData& q, const int primitive) const
+    __host__ __device__ __forceinline__ bool refine(const ThreadData& q, const int primitive) const
         {
         return true;
         }
@@ -119,6 +119,173 @@ struct SphereQueryOp
     const unsigned int N;
     };
 
+//! Box query operation
+/*!
+ * Each query volume is an axis-aligned box with lower bound \a lo and upper bound \a hi. The box is
+ * translated in round-down (lower bound) and round-up (upper bound) mode so that it always encloses
+ * the exact translated box. Primitives overlapped by the box are not refined.
+ */
+struct BoxQueryOp
+    {
+    //! Constructor
+    /*!
+     * \param lo_ Lower bound of each query box.
+     * \param hi_ Upper bound of each query box.
+     * \param N_ The number of boxes.
+     */
+    BoxQueryOp(const float3 *lo_, const float3 *hi_, unsigned int N_)
+        : lo(lo_), hi(hi_), N(N_)
+        {}
+
+    typedef BoundingBox ThreadData;
+    typedef BoundingBox Volume;
+
+    //! Setup the thread data.
+    /*!
+     * \param idx The thread index for the query.
+     */
+    __host__ __device__ __forceinline__ ThreadData setup(const unsigned int idx) const
+        {
+        return BoundingBox(lo[idx], hi[idx]);
+        }
+
+    //! Get the bounding volume for a given translation image.
+    /*!
+     * \param q Thread data.
+     * \param image Translation vector for volume from reference position.
+     *
+     * \returns The enclosing BoundingBox at \a image.
+     */
+    __host__ __device__ __forceinline__ Volume get(const ThreadData& q, const float3& image) const
+        {
+        const float3 tlo = make_float3(approx::fadd_rd(q.lo.x, image.x),
+                                       approx::fadd_rd(q.lo.y, image.y),
+                                       approx::fadd_rd(q.lo.z, image.z));
+        const float3 thi = make_float3(approx::fadd_ru(q.hi.x, image.x),
+                                       approx::fadd_ru(q.hi.y, image.y),
+                                       approx::fadd_ru(q.hi.z, image.z));
+        return BoundingBox(tlo, thi);
+        }
+
+    //! Test for overlap between bounding volume and box.
+    /*!
+     * \param v Bounding volume being queried.
+     * \param box Bounding box from BVH.
+     *
+     * \returns True if \a v and \a box overlap.
+     */
+    __host__ __device__ __forceinline__ bool overlap(const Volume& v, const BoundingBox& box) const
+        {
+        return v.overlap(box);
+        }
+
+    //! Refine the overlap with a primitive.
+    /*!
+     * \param q Thread data.
+     * \param primitive Overlapped primitive.
+     *
+     * \returns True, since the box overlap is exact.
+     */
+    __host__ __device__ __forceinline__ bool refine(const ThreadData& q, const int primitive) const
+        {
+        return true;
+        }
+
+    //! Get the number of query volumes.
+    /*!
+     * \returns The number of query volumes.
+     */
+    __host__ __device__ __forceinline__ unsigned int size() const
+        {
+        return N;
+        }
+
+    const float3* lo;   //!< Lower bounds of the boxes
+    const float3* hi;   //!< Upper bounds of the boxes
+    const unsigned int N;
+    };
+
+//! Sphere query operation with a constant radius
+/*!
+ * Each query volume is a sphere of radius \a R centered on a point. This is the same as SphereQueryOp
+ * with the same radius for every sphere, but the points can be used directly from particle positions
+ * (e.g., a host::TrajectoryFrame) without packing them with the radius.
+ */
+struct RadiusQueryOp
+    {
+    //! Constructor
+    /*!
+     * \param points_ Centers of the spheres.
+     * \param R_ Radius of the spheres.
+     * \param N_ The number of spheres.
+     */
+    RadiusQueryOp(const float3 *points_, float R_, unsigned int N_)
+        : points(points_), R(R_), N(N_)
+        {}
+
+    typedef float3 ThreadData;
+    typedef BoundingSphere Volume;
+
+    //! Setup the thread data.
+    /*!
+     * \param idx The thread index for the query.
+     */
+    __host__ __device__ __forceinline__ ThreadData setup(const unsigned int idx) const
+        {
+        return points[idx];
+        }
+
+    //! Get the bounding volume for a given translation image.
+    /*!
+     * \param q Thread data.
+     * \param image Translation vector for volume from reference position.
+     *
+     * \returns The enclosing BoundingSphere at \a image.
+     */
+    __host__ __device__ __forceinline__ Volume get(const ThreadData& q, const float3& image) const
+        {
+        const float3 t = make_float3(q.x + image.x, q.y + image.y, q.z + image.z);
+        return BoundingSphere(t,R);
+        }
+
+    //! Test for overlap between bounding volume and box.
+    /*!
+     * \param v Bounding volume being queried.
+     * \param box Bounding box from BVH.
+     *
+     * \returns True if \a v and \a box overlap.
+     */
+    __host__ __device__ __forceinline__ bool overlap(const Volume& v, const BoundingBox& box) const
+        {
+        return v.overlap(box);
+        }
+
+    //! Refine the overlap with a primitive.
+    /*!
+     * \param q Thread data.
+     * \param primitive Overlapped primitive.
+     *
+     * \returns True, like SphereQueryOp.
+     */
+    __host__ __device__ __forceinline__ bool refine(const ThreadData& q, const int primitive) const
+        {
+        return true;
+        }
+
+    //! Get the number of query volumes.
+    /*!
+     * \returns The number of query volumes.
+     */
+    __host__ __device__ __forceinline__ unsigned int size() const
+        {
+        return N;
+        }
+
+    const float3* points;   //!< Centers of the spheres
+    const float R;          //!< Radius of the spheres
+    const unsigned int N;   //!< Number of spheres
+    };
+
 } // end namespace neighbor
 
 #endif // NEIGHBOR_QUERY_OPS_H_
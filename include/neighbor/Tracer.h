@@ -0,0 +1,411 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#ifndef NEIGHBOR_TRACER_H_
+#define NEIGHBOR_TRACER_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#include "Memory.h"
+
+namespace neighbor
+{
+
+//! Tracer of library events in the Chrome trace event format.
+/*!
+ * A Tracer records events of the library on a timeline that can be viewed with chrome://tracing or Perfetto,
+ * together with traces of the rest of an application. The events are:
+ *
+ * - Phases of operations, when the tracer is passed as the timer of an instrumented method (see PhaseTimer),
+ *   e.g., LBVH::build or LBVHTraverser::traverse. The count and bytes of the phase are recorded.
+ * - Chunks of indexes processed by each thread of a host::WorkStealingScheduler (see
+ *   host::WorkStealingScheduler::setTracer), with the number of indexes, and steals.
+ * - Allocations and frees of shared_array, with their size in bytes, when the tracer is set with
+ *   ::setAllocationTracer.
+ *
+ * The events are kept in a ring buffer of fixed capacity, so a long run only keeps its most recent events and
+ * tracing never allocates. Recording an event takes two atomic operations and two clock reads. Names are not
+ * copied, so they must outlive the tracer (e.g., string literals). Events can be recorded by any thread, but
+ * they should only be counted or written (see ::write) when no traced operation is running.
+ *
+ * Each slot of the buffer has a sequence number, which a thread claims before it writes its event. If the
+ * buffer wraps around onto a slot that another thread is still writing, the new event is dropped instead of
+ * overwriting the slot, so a written event is never torn.
+ *
+ * Times are read from std::chrono::steady_clock, which is the monotonic clock on Linux, and the process id is
+ * recorded on POSIX systems, so the trace can be merged with other traces of the process that use the same clock. Phases in a
+ * stream are timed on the host by synchronizing the stream at the start and end of the phase, so no GPU tools are
+ * needed, but tracing serializes the stream.
+ */
+class Tracer
+    {
+    public:
+        //! Create a tracer.
+        /*!
+         * \param capacity Number of events kept (at least 1).
+         */
+        explicit Tracer(unsigned int capacity = 65536)
+            : m_capacity(capacity), m_next(0), m_phase_name(nullptr), m_phase_count(0), m_phase_bytes(0)
+            {
+            if (capacity == 0)
+                {
+                throw std::runtime_error("Tracer capacity must be at least 1.");
+                }
+            m_slots.reset(new Slot[capacity]);
+            }
+
+        // events are recorded into the buffer by address
+        Tracer(const Tracer&) = delete;
+        Tracer& operator=(const Tracer&) = delete;
+
+        //! Get the number of events kept.
+        unsigned int getCapacity() const
+            {
+            return m_capacity;
+            }
+
+        //! Get the number of events in the buffer.
+        unsigned int getNumEvents() const
+            {
+            const unsigned long long next = m_next.load();
+            unsigned int num_events = 0;
+            for (unsigned long long i=getFirst(next); i < next; ++i)
+                {
+                if (isWritten(i)) ++num_events;
+                }
+            return num_events;
+            }
+
+        //! Get the number of events that were overwritten because the buffer was full, or dropped.
+        unsigned long long getNumDropped() const
+            {
+            return m_next.load() - getNumEvents();
+            }
+
+        //! Remove all events.
+        void clear()
+            {
+            for (unsigned int i=0; i < m_capacity; ++i)
+                {
+                m_slots[i].sequence.store(0, std::memory_order_relaxed);
+                }
+            m_next = 0;
+            }
+
+        //! Get the current time in nanoseconds.
+        static unsigned long long now()
+            {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+            }
+
+        //! Record an event with a duration.
+        /*!
+         * \param name Name of the event.
+         * \param category Category of the event.
+         * \param start Start time in nanoseconds (see ::now).
+         * \param end End time in nanoseconds.
+         * \param count Number of items processed.
+         * \param bytes Number of bytes.
+         */
+        void complete(const char* name,
+                      const char* category,
+                      unsigned long long start,
+                      unsigned long long end,
+                      unsigned long long count,
+                      unsigned long long bytes)
+            {
+            record({name, category, 'X', start, (end > start) ? end-start : 0, getThreadId(), count, bytes});
+            }
+
+        //! Record an event without a duration.
+        /*!
+         * \param name Name of the event.
+         * \param category Category of the event.
+         * \param count Number of items.
+         * \param bytes Number of bytes.
+         */
+        void instant(const char* name, const char* category, unsigned long long count, unsigned long long bytes)
+            {
+            record({name, category, 'i', now(), 0, getThreadId(), count, bytes});
+            }
+
+        //! \name Phase timer interface
+        //! The tracer can be passed as the timer of instrumented methods.
+        //! @{
+
+        //! Start timing an operation, which does nothing.
+        void reset() {}
+
+        //! Start a phase on the host.
+        void begin(const char* name)
+            {
+            m_phase_name = name;
+            m_phase_count = 0;
+            m_phase_bytes = 0;
+            m_phase_start = now();
+            }
+
+        //! Start a phase in a stream, which is synchronized first.
+        void begin(const char* name, hipper::stream_t stream)
+            {
+            hipper::streamSynchronize(stream);
+            begin(name);
+            }
+
+        //! End the current phase on the host.
+        void end()
+            {
+            complete(m_phase_name, "phase", m_phase_start, now(), m_phase_count, m_phase_bytes);
+            }
+
+        //! End the current phase in a stream, which is synchronized first.
+        void end(hipper::stream_t stream)
+            {
+            hipper::streamSynchronize(stream);
+            end();
+            }
+
+        //! Add work to the current phase.
+        void addWork(unsigned long long count, unsigned long long bytes)
+            {
+            m_phase_count += count;
+            m_phase_bytes += bytes;
+            }
+        //! @}
+
+        //! Write the events in the trace event format.
+        void write(std::ostream& os) const;
+
+        //! Write the events to a file in the trace event format.
+        void save(const std::string& filename) const;
+
+        //! Get the tracer of allocations.
+        static Tracer* getAllocationTracer()
+            {
+            return allocationTracer().load(std::memory_order_relaxed);
+            }
+
+        //! Set the tracer of allocations.
+        /*!
+         * \param tracer Tracer of the allocations and frees of shared_array, or nullptr to not trace them.
+         *
+         * The tracer must outlive the traced arrays or be unset before it is destroyed.
+         */
+        static void setAllocationTracer(Tracer* tracer)
+            {
+            allocationTracer().store(tracer);
+            allocation_hook().store(tracer ? &Tracer::traceAllocation : nullptr);
+            }
+
+        //! Get a small identifier of the calling thread.
+        /*!
+         * \returns The order in which the thread first asked for its identifier, starting from 1.
+         */
+        static unsigned int getThreadId()
+            {
+            static std::atomic<unsigned int> next_id(1);
+            thread_local unsigned int id = next_id++;
+            return id;
+            }
+
+    private:
+        typedef std::chrono::steady_clock clock;
+
+        //! One event.
+        struct Event
+            {
+            const char* name;           //!< Name
+            const char* category;       //!< Category
+            char type;                  //!< Trace event phase ('X' or 'i')
+            unsigned long long start;   //!< Start time in nanoseconds
+            unsigned long long duration;//!< Duration in nanoseconds
+            unsigned int thread;        //!< Thread identifier
+            unsigned long long count;   //!< Number of items
+            unsigned long long bytes;   //!< Number of bytes
+            };
+
+        //! Slot of the ring buffer.
+        /*!
+         * The sequence number is 2(i+1) once event i is written in the slot, and it is odd while an event
+         * is being written.
+         */
+        struct Slot
+            {
+            Slot() : sequence(0) {}
+
+            std::atomic<unsigned long long> sequence;   //!< Sequence number of the event
+            Event event;                                //!< Event
+            };
+        const unsigned int m_capacity;              //!< Number of slots
+        std::unique_ptr<Slot[]> m_slots;            //!< Ring buffer of events
+        std::atomic<unsigned long long> m_next;     //!< Number of events recorded
+
+        const char* m_phase_name;           //!< Name of the current phase
+        unsigned long long m_phase_start;   //!< Start of the current phase
+        unsigned long long m_phase_count;   //!< Number of items in the current phase
+        unsigned long long m_phase_bytes;   //!< Number of bytes in the current phase
+
+        //! Record an event, overwriting the oldest if the buffer is full.
+        /*!
+         * \param e Event.
+         *
+         * The event is dropped if its slot is being written by another thread or already holds a newer event.
+         */
+        void record(const Event& e)
+            {
+            const unsigned long long i = m_next.fetch_add(1, std::memory_order_relaxed);
+            Slot& slot = m_slots[i % m_capacity];
+            unsigned long long sequence = slot.sequence.load(std::memory_order_relaxed);
+            if ((sequence & 1) || sequence > 2*i
+                || !slot.sequence.compare_exchange_strong(sequence, 2*i+1, std::memory_order_acquire))
+                {
+                return;
+                }
+            slot.event = e;
+            slot.sequence.store(2*(i+1), std::memory_order_release);
+            }
+
+        //! Get the oldest event that can be in the buffer.
+        /*!
+         * \param next Number of events recorded.
+         */
+        unsigned long long getFirst(unsigned long long next) const
+            {
+            return (next > m_capacity) ? next - m_capacity : 0;
+            }
+
+        //! Check if an event is in the buffer.
+        /*!
+         * \param i Index of the event.
+         */
+        bool isWritten(unsigned long long i) const
+            {
+            return (m_slots[i % m_capacity].sequence.load(std::memory_order_acquire) == 2*(i+1));
+            }
+
+        //! Record an allocation or free of shared_array with the tracer of allocations.
+        static void traceAllocation(const char* name, size_t bytes)
+            {
+            Tracer* tracer = getAllocationTracer();
+            if (tracer) tracer->instant(name, "memory", 1, bytes);
+            }
+
+        //! Tracer of allocations.
+        static std::atomic<Tracer*>& allocationTracer()
+            {
+            static std::atomic<Tracer*> tracer(nullptr);
+            return tracer;
+            }
+
+        //! Write a string as a JSON string.
+        static void writeString(std::ostream& os, const char* s);
+    };
+
+/*!
+ * \param os Output stream.
+ *
+ * The events are written from oldest to newest as a JSON object with a "traceEvents" array. Times are in
+ * microseconds. The count and bytes of each event are its arguments, and the number of dropped events
+ * is written to "otherData".
+ */
+inline void Tracer::write(std::ostream& os) const
+    {
+    const unsigned long long next = m_next.load();
+
+    #if defined(__unix__) || defined(__APPLE__)
+    const int pid = static_cast<int>(::getpid());
+    #else
+    const int pid = 0;
+    #endif
+    os << "{\"traceEvents\":[";
+    bool first = true;
+    for (unsigned long long i=getFirst(next); i < next; ++i)
+        {
+        if (!isWritten(i)) continue;
+        const Event& e = m_slots[i % m_capacity].event;
+        if (!first) os << ",";
+        first = false;
+        os << "\n{\"name\":";
+        writeString(os, e.name);
+        os << ",\"cat\":";
+        writeString(os, e.category);
+        os << ",\"ph\":\"" << e.type << "\"";
+        char time[64];
+        std::snprintf(time, sizeof(time), "%.3f", 1.e-3*static_cast<double>(e.start));
+        os << ",\"ts\":" << time;
+        if (e.type == 'X')
+            {
+            std::snprintf(time, sizeof(time), "%.3f", 1.e-3*static_cast<double>(e.duration));
+            os << ",\"dur\":" << time;
+            }
+        else
+            {
+            os << ",\"s\":\"t\"";
+            }
+        os << ",\"pid\":" << pid << ",\"tid\":" << e.thread
+           << ",\"args\":{\"count\":" << e.count << ",\"bytes\":" << e.bytes << "}}";
+        }
+    os << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":" << getNumDropped() << "}}" << std::endl;
+    }
+
+/*!
+ * \param filename Name of the file.
+ *
+ * \raises An error if the file cannot be written.
+ */
+inline void Tracer::save(const std::string& filename) const
+    {
+    std::ofstream file(filename.c_str());
+    write(file);
+    if (!file)
+        {
+        throw std::runtime_error("Cannot write trace " + filename + ".");
+        }
+    }
+
+/*!
+ * \param os Output stream.
+ * \param s String, which may be null.
+ */
+inline void Tracer::writeString(std::ostream& os, const char* s)
+    {
+    os << "\"";
+    for (const char* c = (s != nullptr) ? s : ""; *c != '\0'; ++c)
+        {
+        if (*c == '"' || *c == '\\')
+            {
+            os << '\\' << *c;
+            }
+        else if (static_cast<unsigned char>(*c) < 0x20)
+            {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned int>(*c));
+            os << escaped;
+            }
+        else
+            {
+            os << *c;
+            }
+        }
+    os << "\"";
+    }
+
+} // end namespace neighbor
+
+#endif // NEIGHBOR_TRACER_H_
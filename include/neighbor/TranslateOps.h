@@ -30,7 +30,7 @@ struct SelfOp
      * No check is done to ensure that index does not run past the size of the vector.
      * This method always returns a zero vector.
      */
-    __device__ __forceinline__ float3 get(const unsigned int idx) const
+    __host__ __device__ __forceinline__ float3 get(const unsigned int idx) const
         {
         return make_float3(0.f,0.f,0.f);
         }
@@ -75,7 +75,7 @@ struct ImageListOp
      * No check is done to ensure that index does not run past the size of the vector.
      * This behavior is undefined.
      */
-    __device__ __forceinline__ Real3 get(const unsigned int idx) const
+    __host__ __device__ __forceinline__ Real3 get(const unsigned int idx) const
         {
         return images[idx];
         }
@@ -0,0 +1,322 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#ifndef NEIGHBOR_TRAVERSAL_STATISTICS_H_
+#define NEIGHBOR_TRAVERSAL_STATISTICS_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "Memory.h"
+
+namespace neighbor
+{
+
+//! Work of the traversal of one query.
+struct TraversalCounts
+    {
+    unsigned int nodes;         //!< Number of nodes tested for overlap
+    unsigned int leaves;        //!< Number of overlapped leaves whose primitive was refined
+    unsigned int rejections;    //!< Number of refined primitives rejected by the query operation
+    unsigned int images;        //!< Number of images traversed
+    };
+
+//! Traversal counter that does not count.
+/*!
+ * This is the default statistics policy of the traversal loop (see ::lbvh_traverse_query). All methods
+ * are empty, so the loop is the same as without statistics.
+ *
+ * A statistics policy must supply the following, like an output operation:
+ *
+ *  - ThreadData: a lightweight structure for the counts of a query during traversal.
+ *  - setup(): a method called before the traversal of a query.
+ *  - visitNode(): a method called when a node is tested for overlap.
+ *  - testLeaf(): a method called when the primitive of an overlapped leaf is refined.
+ *  - traverseImage(): a method called when an image of the query is traversed.
+ *  - finalize(): a method called after the traversal of a query.
+ */
+struct NullTraversalCounter
+    {
+    //! Thread data, which is empty.
+    struct ThreadData {};
+
+    //! Setup the thread data before traversal begins.
+    __host__ __device__ __forceinline__ ThreadData setup(const unsigned int) const
+        {
+        return ThreadData();
+        }
+
+    //! Count a node tested for overlap.
+    __host__ __device__ __forceinline__ void visitNode(ThreadData&) const {}
+
+    //! Count a refined primitive.
+    __host__ __device__ __forceinline__ void testLeaf(ThreadData&, const bool) const {}
+
+    //! Count a traversed image.
+    __host__ __device__ __forceinline__ void traverseImage(ThreadData&) const {}
+
+    //! Finalize the counts.
+    __host__ __device__ __forceinline__ void finalize(const ThreadData&) const {}
+    };
+
+//! Traversal counter of the work of each query.
+/*!
+ * The counts of each query are kept in registers during its traversal and written
+ * to \a counts once it finishes, so counting adds little memory traffic.
+ */
+struct TraversalCounter
+    {
+    //! Constructor
+    /*!
+     * \param counts_ Counts of each query (output).
+     */
+    TraversalCounter(TraversalCounts* counts_)
+        : counts(counts_)
+        {}
+
+    //! Counts of the query processed by a thread.
+    struct ThreadData
+        {
+        //! Constructor
+        /*!
+         * \param idx_ The index of the query.
+         */
+        __host__ __device__ ThreadData(const unsigned int idx_)
+            : idx(idx_), nodes(0), leaves(0), rejections(0), images(0)
+            {}
+
+        const unsigned int idx;     //!< Index of the query
+        unsigned int nodes;         //!< Number of nodes tested for overlap
+        unsigned int leaves;        //!< Number of refined primitives
+        unsigned int rejections;    //!< Number of rejected primitives
+        unsigned int images;        //!< Number of traversed images
+        };
+
+    //! Setup the thread data before traversal begins.
+    /*!
+     * \param idx The index of the query.
+     * \returns Zero counts.
+     */
+    __host__ __device__ __forceinline__ ThreadData setup(const unsigned int idx) const
+        {
+        return ThreadData(idx);
+        }
+
+    //! Count a node tested for overlap.
+    __host__ __device__ __forceinline__ void visitNode(ThreadData& t) const
+        {
+        ++t.nodes;
+        }
+
+    //! Count a refined primitive.
+    /*!
+     * \param t The ThreadData being operated on.
+     * \param accepted True if the query operation accepted the primitive.
+     */
+    __host__ __device__ __forceinline__ void testLeaf(ThreadData& t, const bool accepted) const
+        {
+        ++t.leaves;
+        if (!accepted) ++t.rejections;
+        }
+
+    //! Count a traversed image.
+    __host__ __device__ __forceinline__ void traverseImage(ThreadData& t) const
+        {
+        ++t.images;
+        }
+
+    //! Write the counts of the query.
+    __host__ __device__ __forceinline__ void finalize(const ThreadData& t) const
+        {
+        TraversalCounts c;
+        c.nodes = t.nodes;
+        c.leaves = t.leaves;
+        c.rejections = t.rejections;
+        c.images = t.images;
+        counts[t.idx] = c;
+        }
+
+    TraversalCounts* counts;    //!< Counts of each query
+    };
+
+//! Statistics of a traversal.
+/*!
+ * TraversalStatistics can be passed to LBVHTraverser::traverse to count the work of each query: the nodes tested
+ * for overlap, the leaves whose primitive was refined, the primitives rejected by QueryOp::refine, and the images
+ * traversed. The counts are reduced into totals and histograms on the host, which can guide the choice of cutoffs,
+ * leaf sizes, or the order of the queries. The caller must synchronize the stream of the traversal before reading
+ * the statistics.
+ *
+ * Counting is a compile-time policy: the traversal without TraversalStatistics uses NullTraversalCounter, so its
+ * loop is unchanged.
+ */
+class TraversalStatistics
+    {
+    public:
+        //! Counts that can be reduced.
+        enum class Count
+            {
+            Nodes,      //!< Nodes tested for overlap
+            Leaves,     //!< Refined primitives
+            Rejections, //!< Rejected primitives
+            Images      //!< Traversed images
+            };
+
+        //! Create empty statistics.
+        TraversalStatistics() {}
+
+        //! Get a counter for a traversal on the host.
+        /*!
+         * \param N Number of queries.
+         * \returns A counter writing to the counts of the statistics, which are zeroed.
+         *
+         * The counts are zeroed on the host, like the host traversal writes them. The zeros are only
+         * kept if nothing is traversed, e.g., for an empty LBVH.
+         */
+        TraversalCounter getCounter(unsigned int N)
+            {
+            resize(N);
+            if (N > 0)
+                {
+                std::memset(m_counts.get(), 0, N*sizeof(TraversalCounts));
+                }
+            return TraversalCounter(m_counts.get());
+            }
+
+        //! Get a counter for a traversal in a stream.
+        /*!
+         * \param N Number of queries.
+         * \param stream Stream of the traversal.
+         * \returns A counter writing to the counts of the statistics, which are zeroed in \a stream.
+         *
+         * The counts are zeroed in \a stream so that the zeroing is ordered with the traversal and any
+         * earlier work in the stream using the statistics.
+         */
+        TraversalCounter getCounter(unsigned int N, hipper::stream_t stream)
+            {
+            resize(N);
+            if (N > 0)
+                {
+                hipper::memsetAsync(m_counts.get(), 0, N*sizeof(TraversalCounts), stream);
+                }
+            return TraversalCounter(m_counts.get());
+            }
+
+        //! Get the number of queries.
+        unsigned int getN() const
+            {
+            return static_cast<unsigned int>(m_counts.size());
+            }
+
+        //! Get the counts of each query.
+        const shared_array<TraversalCounts>& getCounts() const
+            {
+            return m_counts;
+            }
+
+        //! Get the count of a query.
+        /*!
+         * \param idx Index of the query.
+         * \param count Count to get.
+         * \returns The count.
+         */
+        unsigned int get(unsigned int idx, Count count) const
+            {
+            if (idx >= m_counts.size())
+                {
+                throw std::runtime_error("Query index out of range for traversal statistics.");
+                }
+            return select(m_counts[idx], count);
+            }
+
+        //! Get the total of a count over all queries.
+        unsigned long long getTotal(Count count) const
+            {
+            unsigned long long total = 0;
+            for (unsigned int i=0; i < m_counts.size(); ++i)
+                {
+                total += select(m_counts[i], count);
+                }
+            return total;
+            }
+
+        //! Get the mean of a count over all queries, or 0 if there are none.
+        double getMean(Count count) const
+            {
+            return (m_counts.size() > 0) ? static_cast<double>(getTotal(count))/static_cast<double>(m_counts.size()) : 0.;
+            }
+
+        //! Get the largest count of any query.
+        unsigned int getMax(Count count) const
+            {
+            unsigned int max_count = 0;
+            for (unsigned int i=0; i < m_counts.size(); ++i)
+                {
+                max_count = std::max(max_count, select(m_counts[i], count));
+                }
+            return max_count;
+            }
+
+        //! Get the histogram of a count over all queries.
+        /*!
+         * \param count Count to bin.
+         * \param width Width of the bins.
+         * \returns The number of queries in each bin, where bin b holds the counts in [b*width, (b+1)*width).
+         *          The last bin holds the largest count.
+         *
+         * \raises An error if \a width is 0.
+         */
+        std::vector<unsigned int> getHistogram(Count count, unsigned int width = 1) const
+            {
+            if (width == 0)
+                {
+                throw std::runtime_error("Histogram bin width must be positive.");
+                }
+            std::vector<unsigned int> histogram(getMax(count)/width + 1, 0);
+            for (unsigned int i=0; i < m_counts.size(); ++i)
+                {
+                ++histogram[select(m_counts[i], count)/width];
+                }
+            return histogram;
+            }
+
+    private:
+        shared_array<TraversalCounts> m_counts;  //!< Counts of each query
+
+        //! Resize the counts to a number of queries.
+        void resize(unsigned int N)
+            {
+            if (m_counts.size() != N)
+                {
+                shared_array<TraversalCounts> counts(N);
+                m_counts.swap(counts);
+                }
+            }
+
+        //! Select a count.
+        static unsigned int select(const TraversalCounts& c, Count count)
+            {
+            switch (count)
+                {
+                case Count::Nodes:
+                    return c.nodes;
+                case Count::Leaves:
+                    return c.leaves;
+                case Count::Rejections:
+                    return c.rejections;
+                default:
+                    return c.images;
+                }
+            }
+    };
+
+} // end namespace neighbor
+
+#endif // NEIGHBOR_TRAVERSAL_STATISTICS_H_
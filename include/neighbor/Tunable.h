@@ -8,10 +8,16 @@
 #define NEIGHBOR_TUNER_H_
 
 #include <hipper/hipper_runtime.h>
+#include <map>
+#include <memory>
 #include <set>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
+#include "Autotuner.h"
+#include "TuningCache.h"
+
 namespace neighbor
 {
 
@@ -23,6 +29,11 @@ namespace neighbor
  * that can be used to pack this parameter with other kernel launch parameters like the CUDA stream. Last, the tunable
  * class supplies a method for checking if a set of LaunchParameters is valid. This can be used to validate parameters
  * before a kernel launch.
+ *
+ * The class can also tune itself (see ::setAutotuning). Each operation (e.g., "build") then has its own Autotuner,
+ * which picks the parameter for the methods that take a stream instead of LaunchParameters. The parameters found
+ * are stored in a TuningCache, which is shared by the process and read from a file at construction, so a new
+ * process starts from the parameters tuned by an earlier one, even if it does not tune itself.
  */
 template<typename T>
 class Tunable
@@ -37,6 +48,7 @@ class Tunable
          * The parameter list is filled with values in the range [begin,end] in steps of \a step.
          */
         Tunable(T begin, T end, T step)
+            : m_autotuning(false), m_cache(TuningCache::getDefault())
             {
             for (T param=begin; param <= end; param += step)
                 {
@@ -49,6 +61,7 @@ class Tunable
          * \param params Vector of valid tunable parameters.
          */
         Tunable(const std::vector<T>& params)
+            : m_autotuning(false), m_cache(TuningCache::getDefault())
             {
             setTunableParameters(params);
             }
@@ -65,10 +78,65 @@ class Tunable
         //! Set the list of valid tuner parameters.
         /*!
          * \param params Vector of valid tunable parameters.
+         *
+         * The autotuners are reset to tune the new parameters.
          */
         void setTunableParameters(const std::vector<T>& params)
             {
             m_params = std::set<T>(params.begin(), params.end());
+            m_tuners.clear();
+            }
+
+        //! Check if the methods that take a stream are autotuned.
+        bool getAutotuning() const
+            {
+            return m_autotuning;
+            }
+
+        //! Autotune the methods that take a stream.
+        /*!
+         * \param autotuning If true, methods that take a stream instead of LaunchParameters use the parameter
+         *                   picked by the Autotuner of their operation. Otherwise, they use the cached parameter
+         *                   if there is one (see ::setTuningCache), or a default parameter.
+         *
+         * Autotuning is off by default because the stream is synchronized during each scan of the parameters.
+         */
+        void setAutotuning(bool autotuning)
+            {
+            m_autotuning = autotuning;
+            }
+
+        //! Get the autotuner of an operation.
+        /*!
+         * \param operation Name of the operation.
+         * \returns The autotuner, which is created for the valid parameters on first use.
+         */
+        Autotuner<T>& getAutotuner(const std::string& operation)
+            {
+            auto tuner = m_tuners.find(operation);
+            if (tuner == m_tuners.end())
+                {
+                tuner = m_tuners.emplace(operation, std::make_shared<Autotuner<T>>(getTunableParameters())).first;
+                }
+            return *tuner->second;
+            }
+
+        //! Get the cache of tuned parameters.
+        std::shared_ptr<TuningCache> getTuningCache() const
+            {
+            return m_cache;
+            }
+
+        //! Set the cache of tuned parameters.
+        /*!
+         * \param cache Cache of tuned parameters, or a null pointer to not cache them.
+         *
+         * The default is TuningCache::getDefault. A cached parameter is used the next time an autotuner
+         * starts with a new problem size, or by every call if autotuning is off.
+         */
+        void setTuningCache(std::shared_ptr<TuningCache> cache)
+            {
+            m_cache = cache;
             }
 
         //! Structure holding the kernel launch parameters.
@@ -117,8 +185,91 @@ class Tunable
             return params.tunable;
             }
 
+    protected:
+        //! Call an operation with autotuned launch parameters.
+        /*!
+         * \param name Name of the tunable class.
+         * \param operation Name of the operation.
+         * \param types Tag of the types of the operations in the call (see TuningCache::Types).
+         * \param N Problem size of the call.
+         * \param stream Stream for execution.
+         * \param param Parameter to use if autotuning is off.
+         * \param f Function that calls the operation with LaunchParameters.
+         *
+         * \tparam TypesT Type of the tag.
+         * \tparam Func Type of the function.
+         *
+         * When the problem size of an operation moves to a new power of 2, its autotuner starts from the
+         * cached parameter if there is one. The parameter is cached whenever a scan finishes. If autotuning is
+         * off, the cached parameter is used instead of \a param, so a process reuses the parameters tuned by an
+         * earlier one without tuning itself. The cache key is only made when autotuning or when the cache has
+         * entries, so an untuned call without a cache file does no string work. The cached operation is
+         * qualified by \a name (e.g., "LBVH.build"), so classes with an operation of the same name do not share
+         * an entry. Only the device methods are tuned, so the key is always for the current device with 0 host
+         * threads.
+         */
+        template<class TypesT, class Func>
+        void tune(const char* name,
+                  const char* operation,
+                  const TypesT& types,
+                  unsigned int N,
+                  hipper::stream_t stream,
+                  T param,
+                  const Func& f)
+            {
+            auto key = [&]
+                {
+                return TuningCache::Key({std::string(name) + "." + operation,
+                                         types.get(),
+                                         TuningCache::getBucket(N),
+                                         TuningCache::getDeviceId(),
+                                         0});
+                };
+            auto cached = [&](T& value)
+                {
+                TuningSpace::Configuration config;
+                if (m_cache->find(key(), config) && config.count("param") && inParameterSet(config["param"]))
+                    {
+                    value = config["param"];
+                    return true;
+                    }
+                return false;
+                };
+
+            if (m_autotuning)
+                {
+                Autotuner<T>& tuner = getAutotuner(operation);
+                T value;
+                if (tuner.setProblemSize(N) && m_cache && cached(value))
+                    {
+                    tuner.setParameter(value);
+                    }
+
+                const bool scanning = tuner.isTuning();
+                tuner.begin(stream);
+                f(LaunchParameters(tuner.getParameter(), stream));
+                tuner.end(stream);
+                if (scanning && !tuner.isTuning() && m_cache)
+                    {
+                    m_cache->insert(key(), {{"param", static_cast<unsigned int>(tuner.getParameter())}});
+                    }
+                }
+            else
+                {
+                if (m_cache && m_cache->size() > 0)
+                    {
+                    cached(param);
+                    }
+                f(LaunchParameters(param, stream));
+                }
+            }
+
     private:
         std::set<T> m_params;   //!< Set of tunable parameters
+        bool m_autotuning;      //!< If true, tune the methods that take a stream
+
+        std::map<std::string,std::shared_ptr<Autotuner<T>>> m_tuners;  //!< Autotuner of each operation
+        std::shared_ptr<TuningCache> m_cache;                           //!< Cache of tuned parameters
 
         //! Check if a parameter is in the tuning set.
         /*!
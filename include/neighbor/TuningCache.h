@@ -0,0 +1,450 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#ifndef NEIGHBOR_TUNING_CACHE_H_
+#define NEIGHBOR_TUNING_CACHE_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <typeinfo>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "TuningSpace.h"
+
+namespace neighbor
+{
+
+//! Persistent cache of tuned parameters.
+/*!
+ * Tuning an operation takes many calls, which a new process would otherwise repeat. The cache stores the best
+ * configuration of an operation for a problem signature, which is the operation name qualified by its class
+ * (e.g., "LBVH.build"), the types of its operations (e.g., the query and output operations), the power of 2 of
+ * the problem size, the hardware, and the number of host threads (0 for the device). The cache is kept in a small text file with one
+ * tab-separated entry per line, which is written whenever an entry is inserted.
+ *
+ * Tunable classes share the cache from ::getDefault, which is read from the file named by the environment
+ * variable NEIGHBOR_TUNING_CACHE the first time a tunable class is constructed. If the variable is not set, the
+ * cache is only kept in memory. An autotuned operation (see Tunable::setAutotuning) then starts from the cached
+ * parameter for its signature instead of scanning, and it stores the parameter it finds otherwise.
+ *
+ * The cache is thread safe. Processes sharing the file merge their entries when writing, but an entry written
+ * by one process is only seen by another when it reads the file. The cache is only an optimization, so a file
+ * that cannot be written is not an error, and the entries are still kept in memory.
+ *
+ * Tunable classes only tune their device methods, so their entries use ::getDeviceId and 0 threads. Entries
+ * for host methods must be keyed by ::getHostId and the number of threads of the ThreadPool instead.
+ */
+class TuningCache
+    {
+    public:
+        //! Signature of a tuned problem.
+        struct Key
+            {
+            std::string operation;  //!< Name of the operation
+            std::string types;      //!< Types of the operations (see ::getTypes)
+            unsigned int bucket;    //!< Power of 2 of the problem size (see ::getBucket)
+            std::string hardware;   //!< Hardware (see ::getDeviceId and ::getHostId)
+            unsigned int threads;   //!< Number of host threads, or 0 for the device
+
+            //! Order keys.
+            bool operator<(const Key& other) const
+                {
+                return std::tie(operation, types, bucket, hardware, threads)
+                       < std::tie(other.operation, other.types, other.bucket, other.hardware, other.threads);
+                }
+            };
+
+        //! Create a cache in memory.
+        TuningCache() {}
+
+        //! Create a cache kept in a file.
+        explicit TuningCache(const std::string& filename);
+
+        //! Get the shared cache of the process.
+        static std::shared_ptr<TuningCache> getDefault();
+
+        //! Get the name of the file, or an empty string if the cache is only in memory.
+        const std::string& getFilename() const
+            {
+            return m_filename;
+            }
+
+        //! Get the number of entries.
+        unsigned int size() const
+            {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return static_cast<unsigned int>(m_entries.size());
+            }
+
+        //! Find the configuration of a problem.
+        bool find(const Key& key, TuningSpace::Configuration& config) const;
+
+        //! Insert the configuration of a problem.
+        void insert(const Key& key, const TuningSpace::Configuration& config);
+
+        //! Remove all entries.
+        void clear()
+            {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_entries.clear();
+            }
+
+        //! Read the entries from the file.
+        void load();
+
+        //! Write the entries to the file.
+        bool save() const;
+
+        //! Get the bucket of a problem size.
+        /*!
+         * \param N Problem size.
+         * \returns The power of 2 of \a N rounded down, or 0 for \a N = 0.
+         */
+        static unsigned int getBucket(unsigned int N)
+            {
+            unsigned int bucket = 0;
+            while (N >>= 1)
+                {
+                ++bucket;
+                }
+            return bucket;
+            }
+
+        //! Get the identifier of a list of types.
+        /*!
+         * \tparam Ts Types, e.g., of the query and output operations.
+         * \returns The implementation-defined names of the types separated by commas.
+         *
+         * The names are the same for the same types compiled by the same compiler.
+         */
+        template<class... Ts>
+        static std::string getTypes()
+            {
+            const char* names[] = {typeid(Ts).name()...};
+            std::string types;
+            for (const char* name : names)
+                {
+                if (!types.empty()) types += ",";
+                types += name;
+                }
+            return types;
+            }
+
+        //! Tag of a list of types whose identifier is only made when it is needed.
+        /*!
+         * \tparam Ts Types, e.g., of the query and output operations.
+         */
+        template<class... Ts>
+        struct Types
+            {
+            //! Get the identifier of the types (see TuningCache::getTypes).
+            static std::string get()
+                {
+                return TuningCache::getTypes<Ts...>();
+                }
+            };
+
+        //! Get the identifier of the current device.
+        static std::string getDeviceId();
+
+        //! Get the identifier of the host.
+        static std::string getHostId();
+
+    private:
+        std::string m_filename;                                 //!< File of the cache
+        std::map<Key,TuningSpace::Configuration> m_entries;     //!< Cached configurations
+        mutable std::mutex m_mutex;                             //!< Mutex protecting the entries and file
+
+        //! Read entries from the file into a map.
+        void read(std::map<Key,TuningSpace::Configuration>& entries) const;
+
+        //! Make a key safe to store in the file.
+        static Key sanitize(const Key& key);
+
+        //! Make a string safe to store in the file.
+        static std::string sanitize(const std::string& s, const std::string& separators);
+    };
+
+/*!
+ * \param filename Name of the file, which is read if it exists.
+ */
+inline TuningCache::TuningCache(const std::string& filename)
+    : m_filename(filename)
+    {
+    load();
+    }
+
+/*!
+ * \returns The cache shared by all tunable classes in the process.
+ *
+ * The cache is created on first use, and it is kept in the file named by NEIGHBOR_TUNING_CACHE if it is set.
+ */
+inline std::shared_ptr<TuningCache> TuningCache::getDefault()
+    {
+    static std::shared_ptr<TuningCache> cache = []
+        {
+        const char* filename = std::getenv("NEIGHBOR_TUNING_CACHE");
+        return (filename != nullptr && filename[0] != '\0') ? std::make_shared<TuningCache>(std::string(filename))
+                                                            : std::make_shared<TuningCache>();
+        }();
+    return cache;
+    }
+
+/*!
+ * \param key Signature of the problem.
+ * \param config Cached configuration (output).
+ * \returns True if the problem is in the cache.
+ */
+inline bool TuningCache::find(const Key& key, TuningSpace::Configuration& config) const
+    {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(sanitize(key));
+    if (it == m_entries.end()) return false;
+    config = it->second;
+    return true;
+    }
+
+/*!
+ * \param key Signature of the problem.
+ * \param config Configuration to cache, which replaces any cached configuration.
+ *
+ * The file is written if the configuration changed, and the configuration is kept in memory even if the
+ * file cannot be written. Separators of the file in \a key and in the
+ * names of \a config are replaced by spaces.
+ */
+inline void TuningCache::insert(const Key& key, const TuningSpace::Configuration& config)
+    {
+    const Key safe_key = sanitize(key);
+    TuningSpace::Configuration safe_config;
+    for (const auto& c : config)
+        {
+        safe_config[sanitize(c.first, "\t\n\r,=")] = c.second;
+        }
+
+        {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(safe_key);
+        if (it != m_entries.end() && it->second == safe_config) return;
+        m_entries[safe_key] = safe_config;
+        }
+    save();
+    }
+
+/*!
+ * Entries in the file replace the entries in memory. Lines that cannot be read are skipped, so a damaged
+ * file only loses its damaged entries. Nothing is done if the cache is only in memory or the file does not exist.
+ */
+inline void TuningCache::load()
+    {
+    if (m_filename.empty()) return;
+
+    std::map<Key,TuningSpace::Configuration> entries;
+    read(entries);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& e : entries)
+        {
+        m_entries[e.first] = e.second;
+        }
+    }
+
+/*!
+ * \returns True if the file was written, or false if it could not be written.
+ *
+ * Entries that another process wrote to the file since it was read are kept. The file is written to a
+ * temporary file with a unique name that is renamed, so a reader never sees a partial file and processes
+ * saving at the same time do not write to the same file. The file can be read by all users, so the cache
+ * can be shared. On systems without POSIX, the file is written in place instead. Nothing is done if the
+ * cache is only in memory.
+ */
+inline bool TuningCache::save() const
+    {
+    if (m_filename.empty()) return true;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::map<Key,TuningSpace::Configuration> entries;
+    read(entries);
+    for (const auto& e : m_entries)
+        {
+        entries[e.first] = e.second;
+        }
+
+    std::ostringstream out;
+    out << "# neighbor tuning cache: operation, types, bucket, hardware, threads, configuration" << std::endl;
+    for (const auto& e : entries)
+        {
+        out << e.first.operation << "\t"
+            << e.first.types << "\t"
+            << e.first.bucket << "\t"
+            << e.first.hardware << "\t"
+            << e.first.threads << "\t";
+        for (auto it = e.second.begin(); it != e.second.end(); ++it)
+            {
+            if (it != e.second.begin()) out << ",";
+            out << it->first << "=" << it->second;
+            }
+        out << std::endl;
+        }
+    const std::string contents = out.str();
+
+    #if defined(__unix__) || defined(__APPLE__)
+    std::string tmp = m_filename + ".XXXXXX";
+    const int fd = mkstemp(&tmp[0]);
+    if (fd < 0) return false;
+    // mkstemp only lets the owner read the file
+    FILE* file = (fchmod(fd, 0644) == 0) ? fdopen(fd, "w") : nullptr;
+    if (file == nullptr)
+        {
+        close(fd);
+        std::remove(tmp.c_str());
+        return false;
+        }
+    const bool written = (std::fwrite(contents.data(), 1, contents.size(), file) == contents.size());
+    if (std::fclose(file) != 0 || !written || std::rename(tmp.c_str(), m_filename.c_str()) != 0)
+        {
+        std::remove(tmp.c_str());
+        return false;
+        }
+    return true;
+    #else
+    std::ofstream file(m_filename.c_str());
+    file << contents;
+    file.close();
+    return static_cast<bool>(file);
+    #endif
+    }
+
+/*!
+ * \returns The name of the device and its number of multiprocessors.
+ */
+inline std::string TuningCache::getDeviceId()
+    {
+    int device;
+    hipper::getDevice(&device);
+    hipper::deviceProp_t prop;
+    hipper::getDeviceProperties(&prop, device);
+    std::ostringstream id;
+    id << prop.name << " (" << prop.multiProcessorCount << " SMs)";
+    return id.str();
+    }
+
+/*!
+ * \returns The model name of the processor (if it can be read from /proc/cpuinfo) and its number of
+ *          hardware threads.
+ */
+inline std::string TuningCache::getHostId()
+    {
+    std::string model = "host";
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line))
+        {
+        if (line.compare(0, 10, "model name") == 0)
+            {
+            const size_t colon = line.find(':');
+            if (colon != std::string::npos && colon+2 <= line.size())
+                {
+                model = line.substr(colon+2);
+                }
+            break;
+            }
+        }
+    std::ostringstream id;
+    id << model << " (" << std::thread::hardware_concurrency() << " threads)";
+    return id.str();
+    }
+
+/*!
+ * \param entries Map to fill with the entries in the file.
+ */
+inline void TuningCache::read(std::map<Key,TuningSpace::Configuration>& entries) const
+    {
+    std::ifstream file(m_filename.c_str());
+    std::string line;
+    while (std::getline(file, line))
+        {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream fields(line);
+        Key key;
+        std::string bucket, threads, values;
+        if (!std::getline(fields, key.operation, '\t') ||
+            !std::getline(fields, key.types, '\t') ||
+            !std::getline(fields, bucket, '\t') ||
+            !std::getline(fields, key.hardware, '\t') ||
+            !std::getline(fields, threads, '\t') ||
+            !std::getline(fields, values))
+            {
+            continue;
+            }
+
+        try
+            {
+            key.bucket = static_cast<unsigned int>(std::stoul(bucket));
+            key.threads = static_cast<unsigned int>(std::stoul(threads));
+            TuningSpace::Configuration config;
+            std::istringstream pairs(values);
+            std::string pair;
+            while (std::getline(pairs, pair, ','))
+                {
+                const size_t eq = pair.find('=');
+                if (eq == std::string::npos) throw std::invalid_argument("missing value");
+                config[pair.substr(0, eq)] = static_cast<unsigned int>(std::stoul(pair.substr(eq+1)));
+                }
+            entries[key] = config;
+            }
+        catch (const std::logic_error&)
+            {
+            continue;
+            }
+        }
+    }
+
+/*!
+ * \param key Key.
+ * \returns \a key with tabs and newlines in its strings replaced by spaces.
+ */
+inline TuningCache::Key TuningCache::sanitize(const Key& key)
+    {
+    Key safe = key;
+    safe.operation = sanitize(key.operation, "\t\n\r");
+    safe.types = sanitize(key.types, "\t\n\r");
+    safe.hardware = sanitize(key.hardware, "\t\n\r");
+    return safe;
+    }
+
+/*!
+ * \param s String.
+ * \param separators Characters to replace.
+ * \returns \a s with the \a separators replaced by spaces.
+ */
+inline std::string TuningCache::sanitize(const std::string& s, const std::string& separators)
+    {
+    std::string safe = s;
+    for (auto& c : safe)
+        {
+        if (separators.find(c) != std::string::npos) c = ' ';
+        }
+    return safe;
+    }
+
+} // end namespace neighbor
+
+#endif // NEIGHBOR_TUNING_CACHE_H_
@@ -0,0 +1,414 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#ifndef NEIGHBOR_TUNING_SPACE_H_
+#define NEIGHBOR_TUNING_SPACE_H_
+
+#include <functional>
+#include <map>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace neighbor
+{
+
+//! Space of configurations with several tunable parameters.
+/*!
+ * The Tunable class tunes one parameter of a method, but the speed of an engine often depends on several
+ * parameters together, e.g., the block size and traversal method on the device, or the chunk size of the
+ * WorkStealingScheduler and the traversal method on the host. A TuningSpace has named dimensions, each with a
+ * list of valid values, and constraints on their combinations. A Configuration maps the name of each dimension
+ * to a value:
+ *
+ *      TuningSpace space;
+ *      space.addDimension("block_size", traverser.getTunableParameters());
+ *      space.addDimension("method", {0, 1, 2});
+ *      space.addConstraint([](const TuningSpace::Configuration& c) { return c.at("block_size") <= 512; });
+ *      auto result = space.search(cost, TuningSpace::Strategy::CoordinateDescent);
+ *
+ * The space is searched for the configuration of least cost (e.g., the time of a traversal) measured by a
+ * function that the caller supplies. The number of configurations grows quickly with the number of dimensions,
+ * so the space can be searched by coordinate descent, which changes one dimension at a time, or by random
+ * sampling within a budget of evaluations, as well as exhaustively.
+ */
+class TuningSpace
+    {
+    public:
+        //! Values of the dimensions, by name.
+        typedef std::map<std::string,unsigned int> Configuration;
+
+        //! Constraint that a valid configuration satisfies.
+        typedef std::function<bool (const Configuration&)> Constraint;
+
+        //! Cost of a configuration, e.g., a time.
+        typedef std::function<double (const Configuration&)> CostFunction;
+
+        //! Strategy to search the space.
+        enum class Strategy
+            {
+            Exhaustive,         //!< Evaluate every valid configuration
+            CoordinateDescent,  //!< Minimize the cost along one dimension at a time
+            Random              //!< Evaluate valid configurations sampled at random
+            };
+
+        //! Result of a search.
+        struct Result
+            {
+            Configuration best;         //!< Configuration with the least cost
+            double cost;                //!< Cost of the best configuration
+            unsigned int evaluations;   //!< Number of configurations evaluated
+            };
+
+        //! Create an empty space.
+        TuningSpace()
+            : m_seed(42)
+            {}
+
+        //! Add a dimension.
+        void addDimension(const std::string& name, const std::vector<unsigned int>& values);
+
+        //! Add a constraint.
+        /*!
+         * \param constraint Function that returns true if a configuration is valid.
+         */
+        void addConstraint(const Constraint& constraint)
+            {
+            m_constraints.push_back(constraint);
+            }
+
+        //! Get the number of dimensions.
+        unsigned int getNumDimensions() const
+            {
+            return static_cast<unsigned int>(m_names.size());
+            }
+
+        //! Get the names of the dimensions, in the order they were added.
+        const std::vector<std::string>& getNames() const
+            {
+            return m_names;
+            }
+
+        //! Get the valid values of a dimension.
+        const std::vector<unsigned int>& getValues(const std::string& name) const;
+
+        //! Get the number of configurations, without applying the constraints.
+        unsigned long long size() const;
+
+        //! Check if a configuration is valid.
+        bool isValid(const Configuration& config) const;
+
+        //! Get the first valid configuration.
+        Configuration getFirstValid() const;
+
+        //! Get the seed of the random search.
+        unsigned int getSeed() const
+            {
+            return m_seed;
+            }
+
+        //! Set the seed of the random search.
+        void setSeed(unsigned int seed)
+            {
+            m_seed = seed;
+            }
+
+        //! Search the space for the configuration of least cost.
+        Result search(const CostFunction& cost, Strategy strategy, unsigned int budget = 0) const;
+
+        //! Search the space by coordinate descent from a configuration.
+        Result search(const CostFunction& cost, const Configuration& start, unsigned int budget = 0) const;
+
+    private:
+        std::vector<std::string> m_names;                   //!< Names of the dimensions
+        std::vector<std::vector<unsigned int>> m_values;    //!< Values of each dimension
+        std::vector<Constraint> m_constraints;              //!< Constraints on the configurations
+        unsigned int m_seed;                                //!< Seed of the random search
+
+        //! Get the configuration of an index into each dimension.
+        Configuration makeConfiguration(const std::vector<unsigned int>& idx) const;
+
+        //! Advance an index into each dimension to the next configuration.
+        bool next(std::vector<unsigned int>& idx) const;
+    };
+
+/*!
+ * \param name Name of the dimension.
+ * \param values Valid values of the dimension.
+ *
+ * \raises An error if the name is already used or \a values is empty.
+ */
+inline void TuningSpace::addDimension(const std::string& name, const std::vector<unsigned int>& values)
+    {
+    for (const auto& n : m_names)
+        {
+        if (n == name)
+            {
+            throw std::runtime_error("TuningSpace dimension " + name + " already exists.");
+            }
+        }
+    if (values.empty())
+        {
+        throw std::runtime_error("TuningSpace dimension " + name + " needs at least one value.");
+        }
+    m_names.push_back(name);
+    m_values.push_back(values);
+    }
+
+/*!
+ * \param name Name of the dimension.
+ * \returns The values of the dimension.
+ *
+ * \raises An error if there is no dimension with the name.
+ */
+inline const std::vector<unsigned int>& TuningSpace::getValues(const std::string& name) const
+    {
+    for (unsigned int i=0; i < m_names.size(); ++i)
+        {
+        if (m_names[i] == name) return m_values[i];
+        }
+    throw std::runtime_error("TuningSpace has no dimension " + name + ".");
+    }
+
+/*!
+ * \returns The product of the number of values in each dimension, or 0 for a space with no dimensions.
+ */
+inline unsigned long long TuningSpace::size() const
+    {
+    if (m_values.empty()) return 0;
+
+    unsigned long long n = 1;
+    for (const auto& v : m_values)
+        {
+        n *= v.size();
+        }
+    return n;
+    }
+
+/*!
+ * \param config Configuration to check.
+ * \returns True if \a config has a valid value for every dimension (and no other dimensions), and it
+ *          satisfies all the constraints.
+ */
+inline bool TuningSpace::isValid(const Configuration& config) const
+    {
+    if (config.size() != m_names.size()) return false;
+    for (unsigned int i=0; i < m_names.size(); ++i)
+        {
+        auto it = config.find(m_names[i]);
+        if (it == config.end()) return false;
+
+        bool found = false;
+        for (const unsigned int v : m_values[i])
+            {
+            if (v == it->second)
+                {
+                found = true;
+                break;
+                }
+            }
+        if (!found) return false;
+        }
+
+    for (const auto& constraint : m_constraints)
+        {
+        if (!constraint(config)) return false;
+        }
+    return true;
+    }
+
+/*!
+ * \returns The first valid configuration, taking the values of each dimension in order with the
+ *          first dimension varying slowest.
+ *
+ * \raises An error if the space has no valid configuration.
+ */
+inline TuningSpace::Configuration TuningSpace::getFirstValid() const
+    {
+    if (m_names.empty())
+        {
+        throw std::runtime_error("TuningSpace has no dimensions.");
+        }
+
+    std::vector<unsigned int> idx(m_names.size(), 0);
+    do
+        {
+        const Configuration config = makeConfiguration(idx);
+        if (isValid(config)) return config;
+        } while (next(idx));
+    throw std::runtime_error("TuningSpace has no valid configuration.");
+    }
+
+/*!
+ * \param cost Cost of a configuration.
+ * \param strategy Strategy to search the space.
+ * \param budget Maximum number of configurations to evaluate, or 0 for no limit.
+ *
+ * \returns The configuration of least cost among those evaluated.
+ *
+ * \raises An error if the space has no valid configuration, or if the random search has no budget.
+ *
+ * Each configuration is evaluated at most once. Coordinate descent starts from the first valid configuration
+ * (see ::getFirstValid). The random search stops when the budget is spent or when no new valid configuration
+ * is found after many samples.
+ */
+inline TuningSpace::Result TuningSpace::search(const CostFunction& cost, Strategy strategy, unsigned int budget) const
+    {
+    const Configuration first = getFirstValid();
+    if (strategy == Strategy::CoordinateDescent)
+        {
+        return search(cost, first, budget);
+        }
+
+    Result result;
+    result.best = first;
+    result.cost = 0.;
+    result.evaluations = 0;
+    auto evaluate = [&](const Configuration& config)
+        {
+        const double c = cost(config);
+        if (result.evaluations == 0 || c < result.cost)
+            {
+            result.best = config;
+            result.cost = c;
+            }
+        ++result.evaluations;
+        };
+
+    if (strategy == Strategy::Exhaustive)
+        {
+        std::vector<unsigned int> idx(m_names.size(), 0);
+        do
+            {
+            const Configuration config = makeConfiguration(idx);
+            if (isValid(config)) evaluate(config);
+            } while ((budget == 0 || result.evaluations < budget) && next(idx));
+        }
+    else
+        {
+        if (budget == 0)
+            {
+            throw std::runtime_error("Random TuningSpace search needs a budget.");
+            }
+
+        std::mt19937 mt(m_seed);
+        std::set<Configuration> seen;
+        std::vector<unsigned int> idx(m_names.size());
+        const unsigned int max_attempts = 100*budget;
+        for (unsigned int attempt=0; attempt < max_attempts && result.evaluations < budget; ++attempt)
+            {
+            for (unsigned int i=0; i < idx.size(); ++i)
+                {
+                idx[i] = std::uniform_int_distribution<unsigned int>(0, static_cast<unsigned int>(m_values[i].size())-1)(mt);
+                }
+            const Configuration config = makeConfiguration(idx);
+            if (!isValid(config)) continue;
+
+            if (!seen.insert(config).second) continue;
+            evaluate(config);
+            }
+        }
+
+    return result;
+    }
+
+/*!
+ * \param cost Cost of a configuration.
+ * \param start Valid configuration to start from, e.g., the current or default configuration.
+ * \param budget Maximum number of configurations to evaluate, or 0 for no limit.
+ *
+ * \returns The configuration of least cost among those evaluated.
+ *
+ * \raises An error if \a start is not valid.
+ *
+ * Each sweep tries every value of each dimension in turn with the other dimensions fixed at the best
+ * configuration so far, skipping invalid configurations. The search stops after a sweep that does not
+ * improve the cost, or when the budget is spent. The cost of each configuration is only evaluated once.
+ */
+inline TuningSpace::Result TuningSpace::search(const CostFunction& cost, const Configuration& start, unsigned int budget) const
+    {
+    if (!isValid(start))
+        {
+        throw std::runtime_error("TuningSpace search must start from a valid configuration.");
+        }
+
+    std::map<Configuration,double> costs;
+    auto evaluate = [&](const Configuration& config)
+        {
+        auto it = costs.find(config);
+        if (it == costs.end())
+            {
+            it = costs.emplace(config, cost(config)).first;
+            }
+        return it->second;
+        };
+
+    Result result;
+    result.best = start;
+    result.cost = evaluate(start);
+    bool improved = true;
+    while (improved && (budget == 0 || costs.size() < budget))
+        {
+        improved = false;
+        for (unsigned int i=0; i < m_names.size(); ++i)
+            {
+            for (const unsigned int v : m_values[i])
+                {
+                if (budget > 0 && costs.size() >= budget) break;
+
+                Configuration config = result.best;
+                config[m_names[i]] = v;
+                if (!isValid(config)) continue;
+
+                const double c = evaluate(config);
+                if (c < result.cost)
+                    {
+                    result.best = config;
+                    result.cost = c;
+                    improved = true;
+                    }
+                }
+            }
+        }
+    result.evaluations = static_cast<unsigned int>(costs.size());
+
+    return result;
+    }
+
+/*!
+ * \param idx Index into the values of each dimension.
+ * \returns The configuration.
+ */
+inline TuningSpace::Configuration TuningSpace::makeConfiguration(const std::vector<unsigned int>& idx) const
+    {
+    Configuration config;
+    for (unsigned int i=0; i < m_names.size(); ++i)
+        {
+        config[m_names[i]] = m_values[i][idx[i]];
+        }
+    return config;
+    }
+
+/*!
+ * \param idx Index into the values of each dimension, which is advanced with the last dimension varying fastest.
+ * \returns False if \a idx was the last configuration.
+ */
+inline bool TuningSpace::next(std::vector<unsigned int>& idx) const
+    {
+    for (int i=static_cast<int>(idx.size())-1; i >= 0; --i)
+        {
+        if (++idx[i] < m_values[i].size()) return true;
+        idx[i] = 0;
+        }
+    return false;
+    }
+
+} // end namespace neighbor
+
+#endif // NEIGHBOR_TUNING_SPACE_H_
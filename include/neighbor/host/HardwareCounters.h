@@ -0,0 +1,374 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#ifndef NEIGHBOR_HOST_HARDWARE_COUNTERS_H_
+#define NEIGHBOR_HOST_HARDWARE_COUNTERS_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "ThreadPool.h"
+
+namespace neighbor
+{
+namespace host
+{
+//! Hardware counts of one phase of an operation.
+struct PhaseCounters
+    {
+    std::string name;                   //!< Name of the phase
+    double time;                        //!< Elapsed time in milliseconds
+    unsigned long long count;           //!< Number of items processed (e.g., primitives or nodes)
+    unsigned long long bytes;           //!< Minimum number of bytes read and written
+    unsigned long long cycles;          //!< CPU cycles
+    unsigned long long instructions;    //!< Instructions retired
+    unsigned long long cache_misses;    //!< Last-level cache misses
+    unsigned long long tlb_misses;      //!< Data TLB read misses
+
+    //! Get the number of instructions per cycle, or 0 if no cycles were counted.
+    double getIPC() const
+        {
+        return (cycles > 0) ? static_cast<double>(instructions)/static_cast<double>(cycles) : 0.;
+        }
+    };
+
+//! Hardware performance counters of the phases of an operation.
+/*!
+ * HardwareCounters is a timing policy (see PhaseTimer) that reads CPU performance counters with the Linux
+ * perf_event_open interface at the start and end of each phase. It can be passed to the instrumented methods,
+ * e.g., LBVH::build or LBVHTraverser::traverse, to find the cycles, instructions, last-level cache misses, and
+ * data TLB misses of each phase:
+ *
+ *      host::HardwareCounters counters(pool);
+ *      lbvh.build(pool, insert, lo, hi, counters);
+ *      for (const auto& phase : counters.getPhases()) ...
+ *
+ * Counters only count the thread that opened them, so a group of counters is opened on each thread of the pool
+ * given to the constructor (including the calling thread), and the counts of the threads are summed. Work done by
+ * other threads is not counted. Only user-space events are counted, and counts are scaled up if the kernel
+ * multiplexed the counters. Phases in a stream are bracketed by synchronizing the stream, and only count the
+ * host threads.
+ *
+ * Counters may not be available, e.g., if /proc/sys/kernel/perf_event_paranoid forbids them, the CPU has no
+ * performance monitoring unit (as in some virtual machines), or the system is not Linux. Then ::isAvailable is
+ * false, ::getError explains why, and the phases are still timed but all counts are 0. An event that the CPU
+ * does not support has ::isSupported false and a count of 0.
+ *
+ * The counters are not thread safe, and they can only count one operation at a time.
+ */
+class HardwareCounters
+    {
+    public:
+        //! Counted events.
+        enum class Event
+            {
+            Cycles,         //!< CPU cycles
+            Instructions,   //!< Instructions retired
+            CacheMisses,    //!< Last-level cache misses
+            TLBMisses       //!< Data TLB read misses
+            };
+
+        //! Open counters on the calling thread.
+        HardwareCounters()
+            {
+            m_fds.resize(1);
+            m_errno.resize(1);
+            open(0);
+            check();
+            }
+
+        //! Open counters on each thread of a pool.
+        /*!
+         * \param pool Thread pool whose threads are counted.
+         */
+        explicit HardwareCounters(ThreadPool& pool)
+            {
+            m_fds.resize(pool.getNumThreads());
+            m_errno.resize(pool.getNumThreads());
+            pool.run([&](unsigned int thread)
+                {
+                open(thread);
+                });
+            check();
+            }
+
+        //! Close the counters.
+        ~HardwareCounters()
+            {
+            #ifdef __linux__
+            for (const auto& thread : m_fds)
+                {
+                for (const int fd : thread)
+                    {
+                    if (fd >= 0) ::close(fd);
+                    }
+                }
+            #endif
+            }
+
+        // file descriptors are owned by the counters
+        HardwareCounters(const HardwareCounters&) = delete;
+        HardwareCounters& operator=(const HardwareCounters&) = delete;
+
+        //! Check if any counter could be opened.
+        bool isAvailable() const
+            {
+            return m_error.empty();
+            }
+
+        //! Check if an event is counted.
+        bool isSupported(Event event) const
+            {
+            return m_supported[static_cast<unsigned int>(event)];
+            }
+
+        //! Get the reason the counters are not available, or an empty string if they are.
+        const std::string& getError() const
+            {
+            return m_error;
+            }
+
+        //! \name Phase timer interface
+        //! @{
+
+        //! Start counting an operation.
+        /*!
+         * The phases of the last operation are cleared.
+         */
+        void reset()
+            {
+            m_phases.clear();
+            }
+
+        //! Start a phase on the host.
+        /*!
+         * \param name Name of the phase.
+         */
+        void begin(const char* name)
+            {
+            m_phases.push_back({name, 0., 0, 0, 0, 0, 0, 0});
+            read(m_start);
+            m_start_time = clock::now();
+            }
+
+        //! Start a phase in a stream, which is synchronized first.
+        void begin(const char* name, hipper::stream_t stream)
+            {
+            hipper::streamSynchronize(stream);
+            begin(name);
+            }
+
+        //! End the current phase on the host.
+        void end()
+            {
+            const auto end_time = clock::now();
+            unsigned long long counts[num_events];
+            read(counts);
+
+            PhaseCounters& p = m_phases.back();
+            p.time = std::chrono::duration<double,std::milli>(end_time - m_start_time).count();
+            p.cycles = counts[0] - m_start[0];
+            p.instructions = counts[1] - m_start[1];
+            p.cache_misses = counts[2] - m_start[2];
+            p.tlb_misses = counts[3] - m_start[3];
+            }
+
+        //! End the current phase in a stream, which is synchronized first.
+        void end(hipper::stream_t stream)
+            {
+            hipper::streamSynchronize(stream);
+            end();
+            }
+
+        //! Add work to the current phase.
+        /*!
+         * \param count Number of items processed.
+         * \param bytes Number of bytes read and written.
+         */
+        void addWork(unsigned long long count, unsigned long long bytes)
+            {
+            m_phases.back().count += count;
+            m_phases.back().bytes += bytes;
+            }
+        //! @}
+
+        //! Get the phases of the last operation.
+        /*!
+         * \returns The phases in the order they started.
+         */
+        const std::vector<PhaseCounters>& getPhases() const
+            {
+            return m_phases;
+            }
+
+        //! Get the summed counts of phases.
+        /*!
+         * \param name Name of the phases, or an empty string for all phases.
+         * \returns The phases with \a name summed into one, which has that name.
+         */
+        PhaseCounters getTotal(const std::string& name = std::string()) const
+            {
+            PhaseCounters total = {name, 0., 0, 0, 0, 0, 0, 0};
+            for (const auto& p : m_phases)
+                {
+                if (!name.empty() && p.name != name) continue;
+                total.time += p.time;
+                total.count += p.count;
+                total.bytes += p.bytes;
+                total.cycles += p.cycles;
+                total.instructions += p.instructions;
+                total.cache_misses += p.cache_misses;
+                total.tlb_misses += p.tlb_misses;
+                }
+            return total;
+            }
+
+    private:
+        typedef std::chrono::steady_clock clock;
+        static const unsigned int num_events = 4;   //!< Number of counted events
+
+        std::vector<std::vector<int>> m_fds;    //!< File descriptor of each event on each thread (-1 if not open)
+        std::vector<int> m_errno;               //!< Error opening the leader on each thread (0 if none)
+        bool m_supported[num_events];           //!< If true, the event is counted on all threads
+        std::string m_error;                    //!< Reason the counters are not available
+
+        std::vector<PhaseCounters> m_phases;    //!< Phases of the last operation
+        unsigned long long m_start[num_events]; //!< Counts at the start of the current phase
+        clock::time_point m_start_time;         //!< Start time of the current phase
+
+        //! Open the counters of the calling thread.
+        /*!
+         * \param thread Index of the thread.
+         *
+         * The cycle counter leads the group, so all events are scheduled together. An event that cannot be opened
+         * is left closed, and the error opening the leader is kept.
+         */
+        void open(unsigned int thread)
+            {
+            std::vector<int>& fds = m_fds[thread];
+            fds.assign(num_events, -1);
+            m_errno[thread] = 0;
+            #ifdef __linux__
+            const unsigned int types[num_events] = {PERF_TYPE_HARDWARE,
+                                                    PERF_TYPE_HARDWARE,
+                                                    PERF_TYPE_HARDWARE,
+                                                    PERF_TYPE_HW_CACHE};
+            const unsigned long long configs[num_events] = {PERF_COUNT_HW_CPU_CYCLES,
+                                                            PERF_COUNT_HW_INSTRUCTIONS,
+                                                            PERF_COUNT_HW_CACHE_MISSES,
+                                                            PERF_COUNT_HW_CACHE_DTLB
+                                                            | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                                            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+            for (unsigned int e=0; e < num_events; ++e)
+                {
+                perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = types[e];
+                attr.config = configs[e];
+                attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+
+                // the cycle counter is the group leader, so the others need it
+                const int leader = (e == 0) ? -1 : fds[0];
+                if (e > 0 && leader < 0) break;
+                fds[e] = static_cast<int>(::syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0));
+                if (fds[e] < 0 && e == 0)
+                    {
+                    m_errno[thread] = errno;
+                    }
+                }
+            #else
+            (void)thread;
+            #endif
+            }
+
+        //! Decide which events are supported and why the counters are not available.
+        void check()
+            {
+            for (unsigned int e=0; e < num_events; ++e)
+                {
+                m_supported[e] = true;
+                for (const auto& fds : m_fds)
+                    {
+                    if (fds[e] < 0) m_supported[e] = false;
+                    }
+                }
+            std::fill(m_start, m_start + num_events, 0ull);
+
+            #ifdef __linux__
+            if (!m_supported[0])
+                {
+                int errno_open = 0;
+                for (const int e : m_errno)
+                    {
+                    if (e != 0)
+                        {
+                        errno_open = e;
+                        break;
+                        }
+                    }
+                m_error = std::string("perf_event_open failed: ") + std::strerror(errno_open);
+                if (errno_open == EACCES || errno_open == EPERM)
+                    {
+                    m_error += " (check /proc/sys/kernel/perf_event_paranoid)";
+                    }
+                else if (errno_open == ENOENT || errno_open == EOPNOTSUPP)
+                    {
+                    m_error += " (no hardware performance counters)";
+                    }
+                }
+            #else
+            m_error = "Hardware counters require Linux.";
+            #endif
+            }
+
+        //! Read the summed count of each event over the threads.
+        void read(unsigned long long* counts) const
+            {
+            for (unsigned int e=0; e < num_events; ++e)
+                {
+                counts[e] = 0;
+                if (!m_supported[e]) continue;
+                #ifdef __linux__
+                for (const auto& fds : m_fds)
+                    {
+                    // value, time enabled, time running
+                    unsigned long long values[3];
+                    if (::read(fds[e], values, sizeof(values)) != static_cast<ssize_t>(sizeof(values)))
+                        continue;
+
+                    // scale up if the counter was multiplexed
+                    if (values[2] > 0 && values[2] < values[1])
+                        {
+                        const double scale = static_cast<double>(values[1])/static_cast<double>(values[2]);
+                        counts[e] += static_cast<unsigned long long>(static_cast<double>(values[0])*scale);
+                        }
+                    else
+                        {
+                        counts[e] += values[0];
+                        }
+                    }
+                #endif
+                }
+            }
+    };
+
+} // end namespace host
+} // end namespace neighbor
+
+#endif // NEIGHBOR_HOST_HARDWARE_COUNTERS_H_
@@ -0,0 +1,155 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#ifndef NEIGHBOR_HOST_HOST_ALLOCATOR_H_
+#define NEIGHBOR_HOST_HOST_ALLOCATOR_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "../Allocator.h"
+
+namespace neighbor
+{
+namespace host
+{
+
+//! Allocator of aligned host memory.
+/*!
+ * Small blocks are allocated with posix_memalign, and blocks of at least ::getMapThreshold bytes are mapped
+ * directly with mmap so that freeing them returns the pages to the operating system. Mapped blocks are aligned to
+ * pages, or to the alignment if it is larger (by mapping extra pages and unmapping the slack), and the kernel is
+ * advised to back them with huge pages where it can, which reduces TLB misses when large arrays are traversed.
+ * On systems without POSIX, every block is allocated with std::malloc and aligned by hand instead.
+ *
+ * The memory can only be used on the host, so arrays from a HostAllocator should only be given to the host
+ * methods (e.g., LBVH::build with a ThreadPool). It is usually wrapped in a CachingAllocator. The pages of a block
+ * are placed on the NUMA node of the thread that first touches them, like the rest of the host memory.
+ *
+ * The device does not use the memory, so a CachingAllocator of it does not need to synchronize the device
+ * before reusing a block.
+ */
+class HostAllocator : public Allocator
+    {
+    public:
+        //! Create an allocator.
+        /*!
+         * \param alignment Alignment of the blocks in bytes, which is a power of two and a multiple of sizeof(void*).
+         * \param map_threshold Size of the smallest block that is mapped.
+         * \raises std::runtime_error if \a alignment is not valid.
+         */
+        explicit HostAllocator(size_t alignment = 64, size_t map_threshold = 2097152)
+            : m_alignment(alignment), m_map_threshold(map_threshold)
+            {
+            if (alignment < sizeof(void*) || (alignment & (alignment-1)) != 0)
+                {
+                throw std::runtime_error("Host allocator alignment must be a power of two of at least a pointer.");
+                }
+            }
+
+        void* allocate(size_t bytes) override;
+
+        void deallocate(void* ptr, size_t bytes) override;
+
+        //! Get the alignment of the blocks.
+        size_t getAlignment() const
+            {
+            return m_alignment;
+            }
+
+        //! Get the size of the smallest block that is mapped.
+        size_t getMapThreshold() const
+            {
+            return m_map_threshold;
+            }
+
+    private:
+        size_t m_alignment;     //!< Alignment of the blocks
+        size_t m_map_threshold; //!< Size of the smallest mapped block
+    };
+
+/*!
+ * \param bytes Size of the block in bytes.
+ * \returns The block.
+ * \raises std::runtime_error if the memory cannot be allocated.
+ */
+inline void* HostAllocator::allocate(size_t bytes)
+    {
+    void* ptr = nullptr;
+    #if defined(__unix__) || defined(__APPLE__)
+    if (bytes >= m_map_threshold)
+        {
+        // map extra pages for alignments larger than a page, and unmap the pages around the aligned block
+        const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const size_t slack = (m_alignment > page) ? m_alignment - page : 0;
+        void* map = mmap(nullptr, bytes + slack, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED)
+            {
+            throw std::runtime_error("Error mapping host memory.");
+            }
+        const uintptr_t begin = reinterpret_cast<uintptr_t>(map);
+        const uintptr_t aligned = (begin + m_alignment - 1) & ~static_cast<uintptr_t>(m_alignment - 1);
+        const uintptr_t end = aligned + ((bytes + page - 1)/page)*page;
+        if (aligned > begin)
+            {
+            munmap(map, aligned - begin);
+            }
+        if (begin + bytes + slack > end)
+            {
+            munmap(reinterpret_cast<void*>(end), begin + bytes + slack - end);
+            }
+        ptr = reinterpret_cast<void*>(aligned);
+        #ifdef MADV_HUGEPAGE
+        madvise(ptr, bytes, MADV_HUGEPAGE);
+        #endif
+        }
+    else if (posix_memalign(&ptr, m_alignment, bytes) != 0)
+        {
+        throw std::runtime_error("Error allocating host memory.");
+        }
+    #else
+    // keep the allocated pointer just before the aligned block, which has room for it
+    void* block = std::malloc(bytes + m_alignment);
+    if (block == nullptr)
+        {
+        throw std::runtime_error("Error allocating host memory.");
+        }
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(block);
+    const uintptr_t aligned = (begin + m_alignment) & ~static_cast<uintptr_t>(m_alignment - 1);
+    ptr = reinterpret_cast<void*>(aligned);
+    static_cast<void**>(ptr)[-1] = block;
+    #endif
+    return ptr;
+    }
+
+/*!
+ * \param ptr Block returned by ::allocate.
+ * \param bytes Size the block was allocated with.
+ */
+inline void HostAllocator::deallocate(void* ptr, size_t bytes)
+    {
+    #if defined(__unix__) || defined(__APPLE__)
+    if (bytes >= m_map_threshold)
+        {
+        munmap(ptr, bytes);
+        }
+    else
+        {
+        std::free(ptr);
+        }
+    #else
+    std::free(static_cast<void**>(ptr)[-1]);
+    #endif
+    }
+
+} // end namespace host
+} // end namespace neighbor
+
+#endif // NEIGHBOR_HOST_HOST_ALLOCATOR_H_
@@ -0,0 +1,755 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#ifndef NEIGHBOR_HOST_LBVH_H_
+#define NEIGHBOR_HOST_LBVH_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#include "../BoundingVolumes.h"
+#include "../LBVHData.h"
+#include "../MortonCode.h"
+#include "ThreadPool.h"
+
+namespace neighbor
+{
+namespace host
+{
+//! Compute the surface area of an axis-aligned box.
+/*!
+ * \param lo Lower bound of the box.
+ * \param hi Upper bound of the box.
+ *
+ * \returns The surface area of the box.
+ */
+inline float lbvh_surface_area(const float3& lo, const float3& hi)
+    {
+    const float3 L = make_float3(hi.x-lo.x, hi.y-lo.y, hi.z-lo.z);
+    return 2.f*(L.x*L.y + L.y*L.z + L.z*L.x);
+    }
+
+//! Compute the surface area of the union of two axis-aligned boxes.
+/*!
+ * \param lo_a Lower bound of the first box.
+ * \param hi_a Upper bound of the first box.
+ * \param lo_b Lower bound of the second box.
+ * \param hi_b Upper bound of the second box.
+ *
+ * \returns The surface area of the smallest box enclosing both boxes.
+ */
+inline float lbvh_union_area(const float3& lo_a, const float3& hi_a, const float3& lo_b, const float3& hi_b)
+    {
+    const float3 lo = make_float3(fminf(lo_a.x,lo_b.x), fminf(lo_a.y,lo_b.y), fminf(lo_a.z,lo_b.z));
+    const float3 hi = make_float3(fmaxf(hi_a.x,hi_b.x), fmaxf(hi_a.y,hi_b.y), fmaxf(hi_a.z,hi_b.z));
+    return lbvh_surface_area(lo, hi);
+    }
+
+//! Sum the surface areas of the internal nodes of an LBVH.
+/*!
+ * \param tree LBVH tree (raw pointers).
+ * \param N_internal Number of internal nodes.
+ *
+ * \returns The summed surface area of all internal nodes.
+ *
+ * Normalized by the area of the root, this sum is the surface area heuristic (SAH) cost
+ * of traversing the internal nodes of the tree.
+ */
+inline float lbvh_internal_area(const ConstLBVHData& tree, const unsigned int N_internal)
+    {
+    double area = 0.;
+    for (unsigned int i=0; i < N_internal; ++i)
+        {
+        area += lbvh_surface_area(tree.lo[i], tree.hi[i]);
+        }
+    return static_cast<float>(area);
+    }
+
+//! Find the best sibling for a new leaf in an LBVH.
+/*!
+ * \param tree LBVH tree (raw pointers).
+ * \param N_internal Number of internal nodes.
+ * \param lo Lower bound of the new leaf.
+ * \param hi Upper bound of the new leaf.
+ *
+ * \returns The node that should become the sibling of the new leaf.
+ *
+ * The tree is descended greedily from the root using the surface area heuristic, following
+ * the approach used in Box2D's dynamic tree. At each node, the cost of pairing the leaf with
+ * that node is compared to the cost of descending into either child, where the latter includes
+ * the area that would be added to all the ancestors of the child. The descent stops when pairing
+ * with the current node is cheapest, or when a leaf is reached.
+ */
+inline int lbvh_find_sibling(const LBVHData& tree,
+                             const unsigned int N_internal,
+                             const float3& lo,
+                             const float3& hi)
+    {
+    int node = tree.root;
+    while (node < (int)N_internal)
+        {
+        const float area = lbvh_surface_area(tree.lo[node], tree.hi[node]);
+        const float combined = lbvh_union_area(tree.lo[node], tree.hi[node], lo, hi);
+
+        // cost of creating a new parent for this node and the leaf
+        const float cost = 2.f*combined;
+
+        // minimum cost of pushing the leaf further down the tree
+        const float inherit = 2.f*(combined - area);
+
+        const int left = tree.left[node];
+        float cost_left = lbvh_union_area(tree.lo[left], tree.hi[left], lo, hi) + inherit;
+        if (left < (int)N_internal)
+            cost_left -= lbvh_surface_area(tree.lo[left], tree.hi[left]);
+
+        const int right = tree.right[node];
+        float cost_right = lbvh_union_area(tree.lo[right], tree.hi[right], lo, hi) + inherit;
+        if (right < (int)N_internal)
+            cost_right -= lbvh_surface_area(tree.lo[right], tree.hi[right]);
+
+        if (cost < cost_left && cost < cost_right)
+            break;
+
+        node = (cost_left < cost_right) ? left : right;
+        }
+    return node;
+    }
+
+//! Refit the bounding boxes of a node and its ancestors.
+/*!
+ * \param tree LBVH tree (raw pointers).
+ * \param node First internal node to refit.
+ *
+ * \returns The change in the summed surface area of the internal nodes.
+ *
+ * The bounding box of each node is recomputed from its children while walking toward the root.
+ * The walk stops early once a node's bounding box is unchanged, since none of its ancestors
+ * can change either.
+ */
+inline float lbvh_refit(const LBVHData& tree, int node)
+    {
+    float delta = 0.f;
+    while (node != LBVHSentinel)
+        {
+        const int left = tree.left[node];
+        const int right = tree.right[node];
+
+        const float3 lo = make_float3(fminf(tree.lo[left].x, tree.lo[right].x),
+                                      fminf(tree.lo[left].y, tree.lo[right].y),
+                                      fminf(tree.lo[left].z, tree.lo[right].z));
+        const float3 hi = make_float3(fmaxf(tree.hi[left].x, tree.hi[right].x),
+                                      fmaxf(tree.hi[left].y, tree.hi[right].y),
+                                      fmaxf(tree.hi[left].z, tree.hi[right].z));
+
+        const float3 old_lo = tree.lo[node];
+        const float3 old_hi = tree.hi[node];
+        if (lo.x == old_lo.x && lo.y == old_lo.y && lo.z == old_lo.z &&
+            hi.x == old_hi.x && hi.y == old_hi.y && hi.z == old_hi.z)
+            break;
+
+        delta += lbvh_surface_area(lo, hi) - lbvh_surface_area(old_lo, old_hi);
+        tree.lo[node] = lo;
+        tree.hi[node] = hi;
+
+        node = tree.parent[node];
+        }
+    return delta;
+    }
+
+//! Replace a child of a node.
+/*!
+ * \param tree LBVH tree (raw pointers).
+ * \param node Parent node.
+ * \param old_child Child to replace.
+ * \param new_child Replacement child.
+ */
+inline void lbvh_replace_child(const LBVHData& tree, const int node, const int old_child, const int new_child)
+    {
+    if (tree.left[node] == old_child)
+        {
+        tree.left[node] = new_child;
+        }
+    else
+        {
+        tree.right[node] = new_child;
+        }
+    }
+
+//! Move a node to a new location in the tree arrays.
+/*!
+ * \param tree LBVH tree (raw pointers).
+ * \param N_internal Number of internal nodes.
+ * \param src Current index of the node.
+ * \param dst New index of the node.
+ *
+ * The bounding box and parent of \a src are copied to \a dst, and the parent and children
+ * (if \a src is an internal node) are updated to point to \a dst. The primitive of a leaf
+ * is not moved because its storage depends on \a N_internal; the caller is responsible for it.
+ * The contents of \a src are undefined afterwards.
+ */
+inline void lbvh_move_node(const LBVHData& tree, const unsigned int N_internal, const int src, const int dst)
+    {
+    if (src == dst) return;
+
+    tree.lo[dst] = tree.lo[src];
+    tree.hi[dst] = tree.hi[src];
+
+    const int parent = tree.parent[src];
+    tree.parent[dst] = parent;
+    if (parent != LBVHSentinel)
+        {
+        lbvh_replace_child(tree, parent, src, dst);
+        }
+
+    if (src < (int)N_internal)
+        {
+        const int left = tree.left[src];
+        const int right = tree.right[src];
+        tree.left[dst] = left;
+        tree.right[dst] = right;
+        tree.parent[left] = dst;
+        tree.parent[right] = dst;
+        }
+    }
+
+//! Generate a Karras hierarchy for a range of sorted Morton codes.
+/*!
+ * \param tree LBVH tree (raw pointers).
+ * \param codes Sorted Morton codes for the range.
+ * \param N Number of codes in the range.
+ * \param internal_offset Node index of the first internal node in the range.
+ * \param leaf Map from an index in the range to the node index of its leaf.
+ *
+ * \tparam LeafMapT Type of the leaf map, called as leaf(i).
+ *
+ * The hierarchy over \a N codes has N-1 internal nodes, which are stored contiguously starting
+ * from \a internal_offset, so the root of the hierarchy is \a internal_offset. The algorithm is
+ * given by Figure 4 of <a href="https://dl.acm.org/citation.cfm?id=2383801">Karras</a> and is
+ * the same as gpu::kernel::lbvh_gen_tree, except that the node indexes are mapped so that
+ * hierarchies over different ranges can be stitched together. The parent of the root
+ * is not set.
+ */
+template<class LeafMapT>
+void lbvh_gen_subtree(const LBVHData& tree,
+                      const unsigned int *codes,
+                      const unsigned int N,
+                      const int internal_offset,
+                      const LeafMapT& leaf)
+    {
+    for (int i=0; i < (int)N-1; ++i)
+        {
+        const unsigned int code_i = codes[i];
+        const int forward_prefix = delta(codes, code_i, i, i+1, N);
+        const int backward_prefix = delta(codes, code_i, i, i-1, N);
+
+        // get direction of the range based on sign
+        const int d = (forward_prefix >= backward_prefix) - (forward_prefix < backward_prefix);
+
+        // get minimum prefix
+        const int min_prefix = delta(codes, code_i, i, i-d, N);
+
+        // get maximum prefix by binary search
+        int lmax = 2;
+        while( delta(codes, code_i, i, i + d*lmax, N) > min_prefix)
+            {
+            lmax = lmax << 1;
+            }
+        int l = 0; int t = lmax;
+        do
+            {
+            t = t >> 1;
+            if (delta(codes, code_i, i, i + (l+t)*d, N) > min_prefix)
+                l = l + t;
+            }
+        while (t > 1);
+        const int j = i + l*d;
+
+        // get the length of the common prefix
+        const int common_prefix = delta(codes, code_i, i, j, N);
+
+        // binary search to find split position
+        int s = 0; t = l;
+        do
+            {
+            t = (t + 1) >> 1;
+            // if proposed split lies within range
+            if (s+t < l)
+                {
+                const int split_prefix = delta(codes, code_i, i, i+(s+t)*d, N);
+
+                // if new split shares a longer number of bits, accept it
+                if (split_prefix > common_prefix)
+                    {
+                    s = s + t;
+                    }
+                }
+            }
+        while (t > 1);
+        const int split = i + s*d + std::min(d,0);
+
+        const int node = internal_offset + i;
+        const int left = (std::min(i,j) == split) ? leaf(split) : internal_offset + split;
+        const int right = (std::max(i,j) == (split + 1)) ? leaf(split + 1) : internal_offset + split + 1;
+
+        // children
+        tree.left[node] = left;
+        tree.right[node] = right;
+
+        // parents
+        tree.parent[left] = node;
+        tree.parent[right] = node;
+        }
+    }
+
+//! Bubble a bounding box up a hierarchy.
+/*!
+ * \param tree LBVH tree (raw pointers).
+ * \param node Node whose bounding box has been set.
+ * \param root Root of the hierarchy.
+ * \param locks Visit counters for internal nodes, initially 0.
+ * \param lock_offset Node index corresponding to the first counter in \a locks.
+ *
+ * This is the serial equivalent of gpu::kernel::lbvh_bubble_aabbs. Walking from \a node toward
+ * \a root, each internal node is processed by the second walk to reach it, when the bounding boxes of
+ * both of its children are known.
+ */
+inline void lbvh_bubble_aabb(const LBVHData& tree,
+                             int node,
+                             const int root,
+                             unsigned char *locks,
+                             const int lock_offset)
+    {
+    while (node != root)
+        {
+        const int current = tree.parent[node];
+        if (!locks[current - lock_offset]++)
+            return;
+
+        const int left = tree.left[current];
+        const int right = tree.right[current];
+        tree.lo[current] = make_float3(fminf(tree.lo[left].x, tree.lo[right].x),
+                                       fminf(tree.lo[left].y, tree.lo[right].y),
+                                       fminf(tree.lo[left].z, tree.lo[right].z));
+        tree.hi[current] = make_float3(fmaxf(tree.hi[left].x, tree.hi[right].x),
+                                       fmaxf(tree.hi[left].y, tree.hi[right].y),
+                                       fmaxf(tree.hi[left].z, tree.hi[right].z));
+
+        node = current;
+        }
+    }
+
+//! Choose the number of top Morton code bits used to partition a build.
+/*!
+ * \param N Number of primitives.
+ * \param num_threads Number of threads.
+ *
+ * \returns Number of bits.
+ *
+ * Enough buckets are made to balance the load between threads even when the primitives are not
+ * uniformly distributed, but the buckets are kept large enough that building them is not dominated
+ * by overhead.
+ */
+inline unsigned int lbvh_partition_bits(const unsigned int N, const unsigned int num_threads)
+    {
+    unsigned int bits = 0;
+    while (bits < 15 && (1u << bits) < 8*num_threads && (N >> (bits+1)) >= 256)
+        {
+        ++bits;
+        }
+    return bits;
+    }
+
+//! Find where to split a range of sorted Morton codes.
+/*!
+ * \param codes Sorted Morton codes.
+ * \param first First code in the range.
+ * \param last Last code in the range (inclusive, greater than \a first).
+ *
+ * \returns The last code of the left half of the range.
+ *
+ * The range is split at the highest bit that differs between its first and last codes, which is
+ * found by binary search. If all codes in the range are the same, the range is split in half.
+ */
+inline unsigned int lbvh_find_split(const unsigned int *codes, const unsigned int first, const unsigned int last)
+    {
+    const unsigned int first_code = codes[first];
+    const unsigned int last_code = codes[last];
+    if (first_code == last_code)
+        return (first + last) >> 1;
+
+    const int prefix = countLeadingZeros(first_code ^ last_code);
+    unsigned int split = first;
+    unsigned int step = last - first;
+    do
+        {
+        step = (step + 1) >> 1;
+        const unsigned int next = split + step;
+        if (next < last && countLeadingZeros(first_code ^ codes[next]) > prefix)
+            split = next;
+        } while (step > 1);
+
+    return split;
+    }
+
+//! Partition primitives into buckets by the top bits of their Morton codes.
+/*!
+ * \param pool Thread pool.
+ * \param d_codes Morton codes partitioned into buckets (output).
+ * \param d_indexes Primitive indexes partitioned into buckets (output).
+ * \param d_tmp_codes Temporary storage for N Morton codes.
+ * \param starts First primitive of each bucket, with one extra entry for \a N (output).
+ * \param insert Insert operation.
+ * \param lo Lower bound of scene.
+ * \param hi Upper bound of scene.
+ * \param N Number of primitives.
+ * \param bits Number of top Morton code bits used to make buckets.
+ *
+ * \tparam InsertOpT the kind of insert operation
+ *
+ * The Morton codes are computed and histogrammed by each thread, and then a bucket-major scan
+ * gives each thread its offset in each bucket for a stable parallel counting sort. Within a bucket,
+ * the primitives stay in order of their indexes, but they are not sorted by code.
+ */
+template<class InsertOpT>
+void lbvh_bucket_codes(ThreadPool& pool,
+                       unsigned int *d_codes,
+                       unsigned int *d_indexes,
+                       unsigned int *d_tmp_codes,
+                       std::vector<unsigned int>& starts,
+                       const InsertOpT& insert,
+                       const float3& lo,
+                       const float3& hi,
+                       const unsigned int N,
+                       const unsigned int bits)
+    {
+    const unsigned int num_threads = pool.getNumThreads();
+    const unsigned int shift = 30 - bits;
+    const unsigned int num_buckets = 1u << bits;
+
+    // compute codes and histogram the buckets per thread
+    std::vector<unsigned int> counts(num_threads*num_buckets, 0);
+    pool.run([&](unsigned int thread)
+        {
+        unsigned int* count = counts.data() + thread*num_buckets;
+        const auto range = pool.getRange(thread, 0, N);
+        for (unsigned int i=range.first; i < range.second; ++i)
+            {
+            const unsigned int code = calcMortonCode(insert.get(i).getCenter(), lo, hi);
+            d_tmp_codes[i] = code;
+            ++count[code >> shift];
+            }
+        });
+
+    // bucket-major exclusive scan gives each thread its offset in each bucket
+    starts.resize(num_buckets+1);
+        {
+        unsigned int sum = 0;
+        for (unsigned int b=0; b < num_buckets; ++b)
+            {
+            starts[b] = sum;
+            for (unsigned int t=0; t < num_threads; ++t)
+                {
+                const unsigned int count = counts[t*num_buckets+b];
+                counts[t*num_buckets+b] = sum;
+                sum += count;
+                }
+            }
+        starts[num_buckets] = sum;
+        }
+
+    // scatter into buckets, preserving the order of the indexes
+    pool.run([&](unsigned int thread)
+        {
+        unsigned int* offset = counts.data() + thread*num_buckets;
+        const auto range = pool.getRange(thread, 0, N);
+        for (unsigned int i=range.first; i < range.second; ++i)
+            {
+            const unsigned int code = d_tmp_codes[i];
+            const unsigned int dest = offset[code >> shift]++;
+            d_codes[dest] = code;
+            d_indexes[dest] = i;
+            }
+        });
+    }
+
+//! First touch the memory of a partitioned LBVH build in parallel.
+/*!
+ * \param pool Thread pool.
+ * \param tree LBVH tree (raw pointers).
+ * \param d_codes Storage for N Morton codes.
+ * \param d_tmp_codes Temporary storage for N Morton codes.
+ * \param d_tmp_indexes Temporary storage for N primitive indexes.
+ * \param N Number of primitives (at least 2).
+ *
+ * Each thread zeroes the same contiguous range of primitives that it codes in ::lbvh_bucket_codes, together with
+ * the leaves and internal nodes with the same offset, so the operating system places these pages on the thread's
+ * NUMA node. The primitives of \a tree are the sorted primitive indexes. Buckets are contiguous in the sorted order,
+ * so a bucket built by ::lbvh_build_partitioned mostly uses memory touched by one thread, but the buckets are assigned
+ * dynamically, so that thread is not necessarily the one that builds it.
+ */
+inline void lbvh_first_touch(ThreadPool& pool,
+                             const LBVHData& tree,
+                             unsigned int *d_codes,
+                             unsigned int *d_tmp_codes,
+                             unsigned int *d_tmp_indexes,
+                             const unsigned int N)
+    {
+    pool.run([&](unsigned int thread)
+        {
+        const auto range = pool.getRange(thread, 0, N);
+        const unsigned int n = range.second - range.first;
+        std::fill(d_codes + range.first, d_codes + range.second, 0u);
+        std::fill(tree.primitive + range.first, tree.primitive + range.second, 0u);
+        std::fill(d_tmp_codes + range.first, d_tmp_codes + range.second, 0u);
+        std::fill(d_tmp_indexes + range.first, d_tmp_indexes + range.second, 0u);
+
+        // leaves
+        const unsigned int leaf = N-1+range.first;
+        std::fill(tree.parent + leaf, tree.parent + leaf + n, 0);
+        std::fill(tree.lo + leaf, tree.lo + leaf + n, make_float3(0.f, 0.f, 0.f));
+        std::fill(tree.hi + leaf, tree.hi + leaf + n, make_float3(0.f, 0.f, 0.f));
+
+        // internal nodes
+        const unsigned int last = std::min(range.second, N-1);
+        if (range.first < last)
+            {
+            std::fill(tree.parent + range.first, tree.parent + last, 0);
+            std::fill(tree.left + range.first, tree.left + last, 0);
+            std::fill(tree.right + range.first, tree.right + last, 0);
+            std::fill(tree.lo + range.first, tree.lo + last, make_float3(0.f, 0.f, 0.f));
+            std::fill(tree.hi + range.first, tree.hi + last, make_float3(0.f, 0.f, 0.f));
+            }
+        });
+    }
+
+//! Build an LBVH on the host by partitioning the primitives.
+/*!
+ * \param pool Thread pool.
+ * \param tree LBVH tree (raw pointers).
+ * \param d_codes Sorted Morton codes (output).
+ * \param d_indexes Sorted primitive indexes (output).
+ * \param d_tmp_codes Temporary storage for N Morton codes.
+ * \param d_tmp_indexes Temporary storage for N primitive indexes.
+ * \param insert Insert operation.
+ * \param lo Lower bound of scene.
+ * \param hi Upper bound of scene.
+ * \param N Number of primitives (at least 2).
+ * \param timer Timer of the phases (see PhaseTimer).
+ *
+ * \tparam InsertOpT the kind of insert operation
+ * \tparam TimerT the kind of phase timer
+ *
+ * The primitives are partitioned into buckets by the top bits of their Morton codes
+ * (see ::lbvh_partition_bits and ::lbvh_bucket_codes). Each bucket is then sorted,
+ * and a hierarchy is generated and fit for it independently of the other buckets (see
+ * ::lbvh_gen_subtree and ::lbvh_bubble_aabb). Buckets are assigned dynamically to threads,
+ * and each thread uses its own scratch memory, which is allocated by that thread. Last, the
+ * roots of the buckets are stitched together by a small top-level hierarchy generated from the
+ * bucket codes.
+ *
+ * Because a Karras hierarchy splits first on the highest differing bit, the result has the same
+ * topology as a global build with the primitives in the same order, up to how ties between identical
+ * codes are broken; only the node numbering differs.
+ * The top-level internal nodes are first, followed by the internal nodes of each bucket in order,
+ * then the leaves in sorted order. The primitives are sorted by Morton code and then by index, which
+ * is the same order as the stable radix sort used on the GPU.
+ */
+template<class InsertOpT, class TimerT>
+void lbvh_build_partitioned(ThreadPool& pool,
+                            const LBVHData& tree,
+                            unsigned int *d_codes,
+                            unsigned int *d_indexes,
+                            unsigned int *d_tmp_codes,
+                            unsigned int *d_tmp_indexes,
+                            const InsertOpT& insert,
+                            const float3& lo,
+                            const float3& hi,
+                            const unsigned int N,
+                            TimerT& timer)
+    {
+    const unsigned int bits = lbvh_partition_bits(N, pool.getNumThreads());
+    const unsigned int shift = 30 - bits;
+    const unsigned int num_buckets = 1u << bits;
+
+    // partition into buckets
+    timer.begin("partition");
+    std::vector<unsigned int> starts;
+    lbvh_bucket_codes(pool, d_codes, d_indexes, d_tmp_codes, starts, insert, lo, hi, N, bits);
+    std::vector<unsigned int> nonempty;
+    for (unsigned int b=0; b < num_buckets; ++b)
+        {
+        if (starts[b+1] > starts[b])
+            nonempty.push_back(b);
+        }
+    const unsigned int num_nonempty = static_cast<unsigned int>(nonempty.size());
+    timer.addWork(N, 16ull*N);
+    timer.end();
+
+    // sort, generate, and fit each bucket
+    timer.begin("buckets");
+    std::vector<int> roots(num_nonempty);
+    std::atomic<unsigned int> next_bucket(0);
+    pool.run([&](unsigned int thread)
+        {
+        std::vector<unsigned long long> keys;
+        std::vector<unsigned char> locks;
+        unsigned int b;
+        while ((b = next_bucket++) < num_nonempty)
+            {
+            const unsigned int first = starts[nonempty[b]];
+            const unsigned int n = starts[nonempty[b]+1] - first;
+
+            // sort by code, then by index, using thread-local scratch
+            keys.resize(n);
+            for (unsigned int i=0; i < n; ++i)
+                {
+                keys[i] = (static_cast<unsigned long long>(d_codes[first+i]) << 32) | d_indexes[first+i];
+                }
+            std::sort(keys.begin(), keys.end());
+            for (unsigned int i=0; i < n; ++i)
+                {
+                d_codes[first+i] = static_cast<unsigned int>(keys[i] >> 32);
+                d_indexes[first+i] = static_cast<unsigned int>(keys[i] & 0xffffffffu);
+                }
+
+            // internal nodes of the bucket follow the top-level internal nodes
+            const int leaf_offset = N-1+first;
+            const int internal_offset = (num_nonempty-1) + (first-b);
+            lbvh_gen_subtree(tree, d_codes + first, n, internal_offset, [=](int i){ return leaf_offset + i; });
+            const int root = (n > 1) ? internal_offset : leaf_offset;
+            roots[b] = root;
+
+            // fit the leaves, then bubble
+            locks.assign(n, 0);
+            for (unsigned int i=0; i < n; ++i)
+                {
+                const BoundingBox box = insert.get(d_indexes[first+i]);
+                tree.lo[leaf_offset+i] = box.lo;
+                tree.hi[leaf_offset+i] = box.hi;
+                lbvh_bubble_aabb(tree, leaf_offset+i, root, locks.data(), internal_offset);
+                }
+            }
+        });
+    timer.addWork(N, 48ull*N + 32ull*(N-num_nonempty));
+    timer.end();
+
+    // stitch the buckets together with a top-level hierarchy
+    timer.begin("top");
+    if (num_nonempty > 1)
+        {
+        std::vector<unsigned int> top_codes(num_nonempty);
+        for (unsigned int b=0; b < num_nonempty; ++b)
+            {
+            top_codes[b] = nonempty[b] << shift;
+            }
+        lbvh_gen_subtree(tree, top_codes.data(), num_nonempty, 0, [&](int b){ return roots[b]; });
+
+        std::vector<unsigned char> locks(num_nonempty-1, 0);
+        for (unsigned int b=0; b < num_nonempty; ++b)
+            {
+            lbvh_bubble_aabb(tree, roots[b], 0, locks.data(), 0);
+            }
+        }
+    tree.parent[0] = LBVHSentinel;
+    timer.addWork(num_nonempty, 36ull*num_nonempty);
+    timer.end();
+    }
+
+//! Build a forest of LBVHs on the host.
+/*!
+ * \param pool Thread pool.
+ * \param trees LBVH data arena (raw pointers), with the root ignored.
+ * \param d_codes Sorted Morton codes (output).
+ * \param offsets First primitive of each system, with one extra entry for the total number of primitives.
+ * \param internal_offsets First internal node of each system in the arena.
+ * \param node_offsets First node of each system in the arena.
+ * \param insert Insert operation for all primitives.
+ * \param lo Lower bound of the scene of each system.
+ * \param hi Upper bound of the scene of each system.
+ * \param num_systems Number of systems.
+ *
+ * \tparam InsertOpT the kind of insert operation
+ *
+ * The primitives of system \a s are [offsets[s], offsets[s+1]). All systems are built in one parallel pass,
+ * with systems assigned dynamically to threads. For each system, the primitives are sorted by
+ * (system, Morton code, index), which is a segmented sort because the systems are contiguous. A hierarchy
+ * is then generated and fit in the same way as a bucket of ::lbvh_build_partitioned.
+ *
+ * All systems share the same arena. The data of system \a s is a complete LBVH with root 0 when the pointers
+ * are offset by its \a internal_offsets (left and right children), \a node_offsets (parents and bounds),
+ * and \a offsets (primitives). The primitives are stored with their index in \a insert.
+ */
+template<class InsertOpT>
+void lbvh_build_forest(ThreadPool& pool,
+                       const LBVHData& trees,
+                       unsigned int *d_codes,
+                       const unsigned int *offsets,
+                       const unsigned int *internal_offsets,
+                       const unsigned int *node_offsets,
+                       const InsertOpT& insert,
+                       const float3 *lo,
+                       const float3 *hi,
+                       const unsigned int num_systems)
+    {
+    std::atomic<unsigned int> next_system(0);
+    pool.run([&](unsigned int thread)
+        {
+        std::vector<unsigned long long> keys;
+        std::vector<unsigned char> locks;
+        unsigned int sys;
+        while ((sys = next_system++) < num_systems)
+            {
+            const unsigned int first = offsets[sys];
+            const unsigned int n = offsets[sys+1] - first;
+            if (n == 0) continue;
+
+            // sort primitives in the system by code, then by index, using thread-local scratch
+            keys.resize(n);
+            for (unsigned int i=0; i < n; ++i)
+                {
+                const unsigned int code = calcMortonCode(insert.get(first+i).getCenter(), lo[sys], hi[sys]);
+                keys[i] = (static_cast<unsigned long long>(code) << 32) | (first+i);
+                }
+            std::sort(keys.begin(), keys.end());
+
+            LBVHData tree;
+            tree.parent = trees.parent + node_offsets[sys];
+            tree.left = trees.left + internal_offsets[sys];
+            tree.right = trees.right + internal_offsets[sys];
+            tree.primitive = trees.primitive + first;
+            tree.lo = trees.lo + node_offsets[sys];
+            tree.hi = trees.hi + node_offsets[sys];
+            tree.root = 0;
+            unsigned int* codes = d_codes + first;
+            for (unsigned int i=0; i < n; ++i)
+                {
+                codes[i] = static_cast<unsigned int>(keys[i] >> 32);
+                tree.primitive[i] = static_cast<unsigned int>(keys[i] & 0xffffffffu);
+                }
+
+            // generate, then fit the leaves and bubble
+            const int N_internal = n-1;
+            lbvh_gen_subtree(tree, codes, n, 0, [=](int i){ return N_internal + i; });
+            tree.parent[0] = LBVHSentinel;
+
+            locks.assign(n, 0);
+            for (unsigned int i=0; i < n; ++i)
+                {
+                const BoundingBox box = insert.get(tree.primitive[i]);
+                tree.lo[N_internal+i] = box.lo;
+                tree.hi[N_internal+i] = box.hi;
+                lbvh_bubble_aabb(tree, N_internal+i, 0, locks.data(), 0);
+                }
+            }
+        });
+    }
+
+} // end namespace host
+} // end namespace neighbor
+
+#endif // NEIGHBOR_HOST_LBVH_H_
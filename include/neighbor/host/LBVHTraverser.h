@@ -0,0 +1,119 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#ifndef NEIGHBOR_HOST_LBVH_TRAVERSER_H_
+#define NEIGHBOR_HOST_LBVH_TRAVERSER_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include "../ApproximateMath.h"
+#include "../LBVHData.h"
+#include "../LBVHTraverserData.h"
+#include "../kernels/LBVHTraverser.cuh"
+#include "ThreadPool.h"
+
+namespace neighbor
+{
+namespace host
+{
+//! Compress LBVH for rope traversal on the host.
+/*!
+ * \param ctree Compressed LBVH.
+ * \param transform Transformation operation.
+ * \param tree LBVH to compress.
+ * \param N_internal Number of internal nodes in LBVH.
+ * \param N_nodes Number of nodes in LBVH.
+ *
+ * \tparam TransformOpT Type of operation for transforming cached primitive index.
+ *
+ * This is the serial equivalent of gpu::lbvh_compress_ropes, and it produces the same compressed LBVH.
+ */
+template<class TransformOpT>
+void lbvh_compress_ropes(const LBVHCompressedData& ctree,
+                         const TransformOpT& transform,
+                         const ConstLBVHData& tree,
+                         const unsigned int N_internal,
+                         const unsigned int N_nodes)
+    {
+    const float3 tree_lo = tree.lo[tree.root];
+    const float3 tree_hi = tree.hi[tree.root];
+    const float3 tree_bininv = lbvh_compression_scale(tree_lo, tree_hi);
+
+    for (unsigned int idx=0; idx < N_nodes; ++idx)
+        {
+        ctree.data[idx] = lbvh_compress_node(transform, tree, N_internal, idx, tree_lo, tree_hi, tree_bininv);
+        }
+
+    *ctree.lo = tree_lo;
+    *ctree.hi = tree_hi;
+    *ctree.bins = make_float3(approx::frcp_rd(tree_bininv.x),approx::frcp_rd(tree_bininv.y),approx::frcp_rd(tree_bininv.z));
+    }
+
+//! Compress LBVH for rope traversal on the host with a pool of threads.
+/*!
+ * \param pool Thread pool.
+ * \param ctree Compressed LBVH.
+ * \param transform Transformation operation.
+ * \param tree LBVH to compress.
+ * \param N_internal Number of internal nodes in LBVH.
+ * \param N_nodes Number of nodes in LBVH.
+ *
+ * \tparam TransformOpT Type of operation for transforming cached primitive index.
+ *
+ * The nodes are compressed independently, so they are split evenly between the threads.
+ */
+template<class TransformOpT>
+void lbvh_compress_ropes(ThreadPool& pool,
+                         const LBVHCompressedData& ctree,
+                         const TransformOpT& transform,
+                         const ConstLBVHData& tree,
+                         const unsigned int N_internal,
+                         const unsigned int N_nodes)
+    {
+    const float3 tree_lo = tree.lo[tree.root];
+    const float3 tree_hi = tree.hi[tree.root];
+    const float3 tree_bininv = lbvh_compression_scale(tree_lo, tree_hi);
+
+    pool.parallelFor(0, N_nodes, [&](unsigned int idx)
+        {
+        ctree.data[idx] = lbvh_compress_node(transform, tree, N_internal, idx, tree_lo, tree_hi, tree_bininv);
+        });
+
+    *ctree.lo = tree_lo;
+    *ctree.hi = tree_hi;
+    *ctree.bins = make_float3(approx::frcp_rd(tree_bininv.x),approx::frcp_rd(tree_bininv.y),approx::frcp_rd(tree_bininv.z));
+    }
+
+//! Map primitives to their leaves on the host.
+/*!
+ * \param pool Thread pool.
+ * \param leaves Leaf of each primitive.
+ * \param primitives Primitive of each leaf.
+ * \param N_internal Number of internal nodes in LBVH.
+ * \param N Number of primitives.
+ *
+ * This is the host equivalent of gpu::lbvh_map_leaves.
+ */
+inline void lbvh_map_leaves(ThreadPool& pool,
+                            int* leaves,
+                            const unsigned int* primitives,
+                            unsigned int N_internal,
+                            unsigned int N)
+    {
+    pool.parallelFor(0, N, [&](unsigned int idx)
+        {
+        leaves[idx] = -1;
+        });
+    pool.parallelFor(0, N, [&](unsigned int idx)
+        {
+        const unsigned int primitive = primitives[idx];
+        if (primitive < N)
+            leaves[primitive] = N_internal + idx;
+        });
+    }
+
+} // end namespace host
+} // end namespace neighbor
+
+#endif // NEIGHBOR_HOST_LBVH_TRAVERSER_H_
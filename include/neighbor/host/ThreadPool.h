@@ -0,0 +1,281 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#ifndef NEIGHBOR_HOST_THREAD_POOL_H_
+#define NEIGHBOR_HOST_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace neighbor
+{
+namespace host
+{
+//! Persistent pool of host threads.
+/*!
+ * The ThreadPool launches its threads once and reuses them for each parallel region, which avoids
+ * the cost of creating threads in every call to a host algorithm. A parallel region is executed
+ * with ::run, where the calling thread participates as thread 0. Each thread is identified by a
+ * stable index in [0, ::getNumThreads), so threads can keep their own scratch memory between regions.
+ * Memory that is first touched by a thread is usually placed on that thread's NUMA node by the
+ * operating system, so allocating and initializing scratch memory inside the parallel region keeps
+ * it local.
+ *
+ * The pool can only run one parallel region at a time, and ::run should not be called from inside
+ * a parallel region.
+ */
+class ThreadPool
+    {
+    public:
+        //! Create a pool of threads.
+        explicit ThreadPool(unsigned int num_threads = 0);
+
+        //! Join the threads.
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        //! Get the number of threads in the pool, including the calling thread.
+        unsigned int getNumThreads() const
+            {
+            return m_num_threads;
+            }
+
+        //! Execute a function on all threads.
+        template<class Func>
+        void run(const Func& f);
+
+        //! Execute a function for a range of indexes.
+        template<class Func>
+        void parallelFor(unsigned int begin, unsigned int end, const Func& f);
+
+        //! Execute a function for a range of indexes assigned dynamically to the threads.
+        template<class Func>
+        void dynamicFor(unsigned int begin, unsigned int end, unsigned int chunk, const Func& f);
+
+        //! Get the subrange of indexes statically assigned to a thread.
+        /*!
+         * \param thread Index of the thread.
+         * \param begin First index in the range.
+         * \param end One past the last index in the range.
+         *
+         * \returns The first and one past the last index assigned to \a thread.
+         *
+         * The range is split into contiguous chunks whose sizes differ by at most 1.
+         */
+        std::pair<unsigned int,unsigned int> getRange(unsigned int thread, unsigned int begin, unsigned int end) const
+            {
+            const unsigned int N = end - begin;
+            const unsigned int chunk = N / m_num_threads;
+            const unsigned int extra = N % m_num_threads;
+            const unsigned int first = begin + thread*chunk + ((thread < extra) ? thread : extra);
+            const unsigned int last = first + chunk + ((thread < extra) ? 1 : 0);
+            return std::make_pair(first, last);
+            }
+
+    private:
+        unsigned int m_num_threads;         //!< Number of threads
+        std::vector<std::thread> m_threads; //!< Worker threads (excluding the calling thread)
+
+        std::mutex m_mutex;                 //!< Mutex protecting the task state
+        std::condition_variable m_start;    //!< Signal to start a task
+        std::condition_variable m_finish;   //!< Signal that all workers finished a task
+        std::function<void(unsigned int)> m_task;   //!< Current task
+        unsigned long long m_generation;    //!< Number of tasks started
+        unsigned int m_remaining;           //!< Number of workers still running the task
+        bool m_stop;                        //!< If true, workers should exit
+        std::exception_ptr m_error;         //!< First exception thrown by a worker
+
+        //! Loop run by each worker thread.
+        void work(unsigned int thread);
+    };
+
+/*!
+ * \param num_threads Number of threads, including the calling thread. If 0, the number of
+ *                    hardware threads is used.
+ */
+inline ThreadPool::ThreadPool(unsigned int num_threads)
+    : m_num_threads(num_threads), m_generation(0), m_remaining(0), m_stop(false)
+    {
+    if (m_num_threads == 0)
+        {
+        m_num_threads = std::thread::hardware_concurrency();
+        if (m_num_threads == 0) m_num_threads = 1;
+        }
+
+    m_threads.reserve(m_num_threads-1);
+    for (unsigned int i=1; i < m_num_threads; ++i)
+        {
+        m_threads.emplace_back(&ThreadPool::work, this, i);
+        }
+    }
+
+inline ThreadPool::~ThreadPool()
+    {
+        {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        }
+    m_start.notify_all();
+    for (auto& t : m_threads)
+        {
+        t.join();
+        }
+    }
+
+/*!
+ * \param f Function to execute, called as f(thread) with the thread index.
+ *
+ * \tparam Func Type of function.
+ *
+ * The call returns once \a f has completed on all threads. If \a f throws on any thread,
+ * the first exception is rethrown to the caller after all threads finish.
+ */
+template<class Func>
+void ThreadPool::run(const Func& f)
+    {
+    if (m_num_threads == 1)
+        {
+        f(0);
+        return;
+        }
+
+        {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = std::cref(f);
+        m_remaining = m_num_threads-1;
+        m_error = nullptr;
+        ++m_generation;
+        }
+    m_start.notify_all();
+
+    std::exception_ptr error;
+    try
+        {
+        f(0);
+        }
+    catch (...)
+        {
+        error = std::current_exception();
+        }
+
+        {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_finish.wait(lock, [this]{ return m_remaining == 0; });
+        m_task = nullptr;
+        if (!error) error = m_error;
+        }
+
+    if (error)
+        {
+        std::rethrow_exception(error);
+        }
+    }
+
+/*!
+ * \param begin First index.
+ * \param end One past the last index.
+ * \param f Function to execute, called as f(i) for each index.
+ *
+ * \tparam Func Type of function.
+ *
+ * The indexes are statically split into contiguous chunks (see ::getRange), which works well when
+ * each index has a similar cost.
+ */
+template<class Func>
+void ThreadPool::parallelFor(unsigned int begin, unsigned int end, const Func& f)
+    {
+    if (end <= begin) return;
+
+    run([&](unsigned int thread)
+        {
+        const auto range = getRange(thread, begin, end);
+        for (unsigned int i=range.first; i < range.second; ++i)
+            {
+            f(i);
+            }
+        });
+    }
+
+/*!
+ * \param begin First index.
+ * \param end One past the last index.
+ * \param chunk Number of indexes taken by a thread at once (at least 1).
+ * \param f Function to execute, called as f(i, thread) for each index.
+ *
+ * \tparam Func Type of function.
+ *
+ * The threads take contiguous chunks of indexes from a shared counter until the range is exhausted,
+ * which balances the work when the cost of each index varies. The thread index passed to \a f can be
+ * used to select per-thread scratch memory.
+ */
+template<class Func>
+void ThreadPool::dynamicFor(unsigned int begin, unsigned int end, unsigned int chunk, const Func& f)
+    {
+    if (end <= begin) return;
+    if (chunk == 0) chunk = 1;
+
+    std::atomic<unsigned int> next(begin);
+    run([&](unsigned int thread)
+        {
+        unsigned int first;
+        while ((first = next.fetch_add(chunk, std::memory_order_relaxed)) < end)
+            {
+            const unsigned int last = (end - first > chunk) ? first + chunk : end;
+            for (unsigned int i=first; i < last; ++i)
+                {
+                f(i, thread);
+                }
+            }
+        });
+    }
+
+/*!
+ * \param thread Index of the thread.
+ *
+ * The worker sleeps until a new task is started, runs it, and signals when it is done.
+ */
+inline void ThreadPool::work(unsigned int thread)
+    {
+    unsigned long long generation = 0;
+    while (true)
+        {
+        std::function<void(unsigned int)> task;
+            {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_start.wait(lock, [&]{ return m_stop || m_generation != generation; });
+            if (m_stop) return;
+            generation = m_generation;
+            task = m_task;
+            }
+
+        std::exception_ptr error;
+        try
+            {
+            task(thread);
+            }
+        catch (...)
+            {
+            error = std::current_exception();
+            }
+
+            {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (error && !m_error) m_error = error;
+            if (--m_remaining == 0) m_finish.notify_one();
+            }
+        }
+    }
+
+} // end namespace host
+} // end namespace neighbor
+
+#endif // NEIGHBOR_HOST_THREAD_POOL_H_
@@ -0,0 +1,868 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#ifndef NEIGHBOR_HOST_TRAJECTORY_READER_H_
+#define NEIGHBOR_HOST_TRAJECTORY_READER_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "../InsertOps.h"
+#include "../Memory.h"
+#include "../QueryOps.h"
+
+namespace neighbor
+{
+namespace host
+{
+//! One frame of a trajectory.
+/*!
+ * The box follows the HOOMD-blue convention: its lattice vectors are (Lx,0,0), (xy*Ly,Ly,0), and
+ * (xz*Lz,yz*Lz,Lz) from \a origin. The axis-aligned bounds \a lo and \a hi enclose the box and all
+ * positions, so they can be passed to LBVH::build.
+ *
+ * The positions and diameters are not owned by the frame (see TrajectoryReader::read).
+ */
+struct TrajectoryFrame
+    {
+    unsigned int N;             //!< Number of particles
+    const float3* positions;    //!< Particle positions
+    const float* diameters;     //!< Particle diameters, or nullptr if the file has none
+    float3 L;                   //!< Box lengths
+    float xy;                   //!< Box tilt factor xy
+    float xz;                   //!< Box tilt factor xz
+    float yz;                   //!< Box tilt factor yz
+    float3 origin;              //!< Corner of the box
+    bool periodic[3];           //!< Periodic directions
+    float3 lo;                  //!< Lower bound of the box and positions
+    float3 hi;                  //!< Upper bound of the box and positions
+
+    //! Get an insert operation for points at the positions.
+    PointInsertOp getInsertOp() const
+        {
+        return PointInsertOp(positions, N);
+        }
+
+    //! Get a query operation for spheres around the positions.
+    /*!
+     * \param rcut Radius of the spheres.
+     */
+    RadiusQueryOp getQueryOp(float rcut) const
+        {
+        return RadiusQueryOp(positions, rcut, N);
+        }
+
+    //! Get the periodic images within one lattice vector.
+    /*!
+     * \returns The translation vectors of the images in the periodic directions, including the zero vector first.
+     */
+    shared_array<float3> getImages() const
+        {
+        const float3 a1 = make_float3(L.x, 0.f, 0.f);
+        const float3 a2 = make_float3(xy*L.y, L.y, 0.f);
+        const float3 a3 = make_float3(xz*L.z, yz*L.z, L.z);
+        std::vector<float3> images(1, make_float3(0.f, 0.f, 0.f));
+        for (int i=-1; i <= 1; ++i)
+            for (int j=-1; j <= 1; ++j)
+                for (int k=-1; k <= 1; ++k)
+                    {
+                    if ((i == 0 && j == 0 && k == 0) || (i != 0 && !periodic[0]) || (j != 0 && !periodic[1])
+                        || (k != 0 && !periodic[2])) continue;
+                    const float fi = static_cast<float>(i), fj = static_cast<float>(j), fk = static_cast<float>(k);
+                    images.push_back(make_float3(fi*a1.x + fj*a2.x + fk*a3.x,
+                                                 fi*a1.y + fj*a2.y + fk*a3.y,
+                                                 fi*a1.z + fj*a2.z + fk*a3.z));
+                    }
+        shared_array<float3> result(images.size());
+        std::copy(images.begin(), images.end(), result.get());
+        return result;
+        }
+    };
+
+//! Reader of particle trajectories.
+/*!
+ * TrajectoryReader reads frames of GSD (HOOMD-blue schema), XYZ (including the extended XYZ Lattice), and LAMMPS
+ * text dump files without any dependencies. The file is memory mapped and only the requested frame is touched, so
+ * long trajectories can be streamed:
+ *
+ *      host::TrajectoryReader reader("traj.gsd");
+ *      for (unsigned int i=0; i < reader.getNumFrames(); ++i)
+ *          {
+ *          const host::TrajectoryFrame& frame = reader.read(i);
+ *          lbvh.build(pool, frame.getInsertOp(), frame.lo, frame.hi);
+ *          ...
+ *          }
+ *
+ * GSD positions and diameters stored as aligned 32-bit floats are used in place from the mapping without copying.
+ * The text formats and double-precision GSD chunks are parsed into buffers owned by the reader, which are reused
+ * between frames. GSD chunks missing from a frame take their value from frame 0, following the HOOMD-blue schema.
+ * LAMMPS dumps must have x, y, z columns (or their unwrapped xu or scaled xs variants), and the particles keep the
+ * order of the file.
+ *
+ * The mapping is host memory, so frames can only be used by the host engines (e.g., LBVH::build with a ThreadPool)
+ * unless the positions are copied to a shared_array first. On systems without POSIX, the whole file is read into
+ * memory instead of being mapped.
+ */
+class TrajectoryReader
+    {
+    public:
+        //! File formats.
+        enum class Format
+            {
+            GSD,    //!< GSD file with the HOOMD-blue schema
+            XYZ,    //!< XYZ or extended XYZ file
+            LAMMPS  //!< LAMMPS text dump
+            };
+
+        //! Open a trajectory, detecting its format.
+        /*!
+         * \param filename Name of the file.
+         *
+         * A file starting with the GSD magic number is a GSD file, a file starting with "ITEM:" is a LAMMPS dump,
+         * and any other file is read as XYZ.
+         */
+        explicit TrajectoryReader(const std::string& filename)
+            : m_data(nullptr), m_size(0), m_num_frames(0)
+            {
+            map(filename);
+            if (m_size >= sizeof(std::uint64_t) && load<std::uint64_t>(0) == gsd_magic)
+                m_format = Format::GSD;
+            else if (m_size >= 5 && std::strncmp(m_data, "ITEM:", 5) == 0)
+                m_format = Format::LAMMPS;
+            else
+                m_format = Format::XYZ;
+            index();
+            }
+
+        //! Open a trajectory of a given format.
+        /*!
+         * \param filename Name of the file.
+         * \param format Format of the file.
+         */
+        TrajectoryReader(const std::string& filename, Format format)
+            : m_data(nullptr), m_size(0), m_format(format), m_num_frames(0)
+            {
+            map(filename);
+            index();
+            }
+
+        //! Unmap the file.
+        ~TrajectoryReader()
+            {
+            unmap();
+            }
+
+        // the mapping is owned by the reader
+        TrajectoryReader(const TrajectoryReader&) = delete;
+        TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+        //! Get the format of the file.
+        Format getFormat() const
+            {
+            return m_format;
+            }
+
+        //! Get the number of frames in the file.
+        unsigned int getNumFrames() const
+            {
+            return m_num_frames;
+            }
+
+        //! Read a frame.
+        /*!
+         * \param frame Index of the frame.
+         * \returns The frame, whose positions and diameters are valid until the next call to ::read or until the
+         *          reader is destroyed.
+         *
+         * \raises An error if \a frame is out of range or the frame is malformed.
+         */
+        const TrajectoryFrame& read(unsigned int frame)
+            {
+            if (frame >= m_num_frames)
+                {
+                throw std::runtime_error("Trajectory frame out of range.");
+                }
+            m_frame.N = 0;
+            m_frame.positions = nullptr;
+            m_frame.diameters = nullptr;
+            m_frame.L = make_float3(0.f, 0.f, 0.f);
+            m_frame.xy = m_frame.xz = m_frame.yz = 0.f;
+            m_frame.origin = make_float3(0.f, 0.f, 0.f);
+            m_frame.periodic[0] = m_frame.periodic[1] = m_frame.periodic[2] = true;
+
+            if (m_format == Format::GSD)
+                readGSD(frame);
+            else if (m_format == Format::XYZ)
+                readXYZ(frame);
+            else
+                readLAMMPS(frame);
+            setBounds();
+            return m_frame;
+            }
+
+    private:
+        const char* m_data;     //!< Mapped file
+        size_t m_size;          //!< Size of the file in bytes
+        std::vector<char> m_contents;   //!< Contents of the file if it cannot be mapped
+        Format m_format;        //!< Format of the file
+        unsigned int m_num_frames;  //!< Number of frames
+
+        TrajectoryFrame m_frame;            //!< Last frame read
+        std::vector<float3> m_positions;    //!< Positions parsed from the last frame
+        std::vector<float> m_diameters;     //!< Diameters parsed from the last frame
+
+        std::vector<size_t> m_offsets;      //!< Start of each frame in a text file
+
+        //! Index entry of a GSD chunk.
+        struct GSDEntry
+            {
+            std::uint64_t frame;    //!< Frame of the chunk
+            std::uint64_t N;        //!< Number of rows
+            std::int64_t location;  //!< Offset of the data in the file
+            std::uint32_t M;        //!< Number of columns
+            std::uint16_t id;       //!< Index of the name
+            std::uint8_t type;      //!< Type of the data
+            std::uint8_t flags;     //!< Flags (unused)
+            };
+        enum GSDChunk {gsd_box=0, gsd_N, gsd_position, gsd_diameter, gsd_num_chunks};
+        std::vector<GSDEntry> m_entries;                //!< Index entries of the chunks that are read
+        std::vector<std::vector<int>> m_chunks;         //!< Entry of each chunk in each frame (-1 if none)
+
+        static const std::uint64_t gsd_magic = 0x65DF65DF65DF65DFull;   //!< Magic number of GSD files
+        static const std::uint8_t gsd_float = 9;                        //!< GSD type of 32-bit floats
+        static const std::uint8_t gsd_double = 10;                      //!< GSD type of 64-bit floats
+        static const std::uint8_t gsd_uint32 = 3;                       //!< GSD type of 32-bit unsigned integers
+
+        //! Map a file into memory.
+        void map(const std::string& filename)
+            {
+            #if defined(__unix__) || defined(__APPLE__)
+            const int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0)
+                {
+                throw std::runtime_error("Cannot open trajectory " + filename + ".");
+                }
+            struct stat st;
+            if (::fstat(fd, &st) != 0)
+                {
+                ::close(fd);
+                throw std::runtime_error("Cannot read size of trajectory " + filename + ".");
+                }
+            m_size = static_cast<size_t>(st.st_size);
+            if (m_size > 0)
+                {
+                void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data == MAP_FAILED)
+                    {
+                    ::close(fd);
+                    throw std::runtime_error("Cannot map trajectory " + filename + ".");
+                    }
+                m_data = static_cast<const char*>(data);
+                }
+            ::close(fd);
+            #else
+            std::ifstream file(filename.c_str(), std::ios::binary);
+            if (!file)
+                {
+                throw std::runtime_error("Cannot open trajectory " + filename + ".");
+                }
+            m_contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            if (file.bad())
+                {
+                throw std::runtime_error("Cannot read trajectory " + filename + ".");
+                }
+            m_size = m_contents.size();
+            if (m_size > 0)
+                {
+                m_data = m_contents.data();
+                }
+            #endif
+            }
+
+        //! Unmap the file.
+        void unmap()
+            {
+            if (m_data != nullptr)
+                {
+                #if defined(__unix__) || defined(__APPLE__)
+                ::munmap(const_cast<char*>(m_data), m_size);
+                #else
+                m_contents.clear();
+                m_contents.shrink_to_fit();
+                #endif
+                m_data = nullptr;
+                }
+            }
+
+        //! Index the mapped file, unmapping it if it is malformed.
+        void index()
+            {
+            try
+                {
+                scan();
+                }
+            catch (...)
+                {
+                unmap();
+                throw;
+                }
+            }
+
+        //! Load a value from the file, which need not be aligned.
+        template<typename T>
+        T load(size_t offset) const
+            {
+            if (offset > m_size || sizeof(T) > m_size - offset)
+                {
+                throw std::runtime_error("Trajectory is truncated.");
+                }
+            T value;
+            std::memcpy(&value, m_data + offset, sizeof(T));
+            return value;
+            }
+
+        //! Find the frames in the file.
+        void scan();
+
+        //! Read a frame of a GSD file.
+        void readGSD(unsigned int frame);
+
+        //! Read a frame of an XYZ file.
+        void readXYZ(unsigned int frame);
+
+        //! Read a frame of a LAMMPS dump.
+        void readLAMMPS(unsigned int frame);
+
+        //! Set the bounds of the frame.
+        void setBounds();
+
+        //! Get the next line of a text file.
+        /*!
+         * \param pos Start of the line, which is advanced to the start of the next line.
+         * \returns The line without its end.
+         */
+        std::string nextLine(size_t& pos) const
+            {
+            if (pos >= m_size)
+                {
+                throw std::runtime_error("Trajectory is truncated.");
+                }
+            const char* end = static_cast<const char*>(std::memchr(m_data + pos, '\n', m_size - pos));
+            const size_t stop = (end != nullptr) ? static_cast<size_t>(end - m_data) : m_size;
+            std::string line(m_data + pos, stop - pos);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            pos = (end != nullptr) ? stop + 1 : m_size;
+            return line;
+            }
+
+        //! Skip lines of a text file.
+        void skipLines(size_t& pos, size_t count) const
+            {
+            for (size_t i=0; i < count; ++i)
+                {
+                if (pos >= m_size)
+                    {
+                    throw std::runtime_error("Trajectory is truncated.");
+                    }
+                const char* end = static_cast<const char*>(std::memchr(m_data + pos, '\n', m_size - pos));
+                pos = (end != nullptr) ? static_cast<size_t>(end - m_data) + 1 : m_size;
+                }
+            }
+
+        //! Split a line into words.
+        static std::vector<std::string> split(const std::string& line)
+            {
+            std::vector<std::string> words;
+            size_t i = 0;
+            while (i < line.size())
+                {
+                while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i]))) ++i;
+                const size_t start = i;
+                while (i < line.size() && !std::isspace(static_cast<unsigned char>(line[i]))) ++i;
+                if (i > start) words.push_back(line.substr(start, i-start));
+                }
+            return words;
+            }
+
+        //! Parse a number.
+        static double parse(const std::string& word)
+            {
+            char* end = nullptr;
+            const double value = std::strtod(word.c_str(), &end);
+            if (end == word.c_str() || *end != '\0')
+                {
+                throw std::runtime_error("Trajectory has invalid number " + word + ".");
+                }
+            return value;
+            }
+
+        //! Check if a line is blank.
+        static bool blank(const std::string& line)
+            {
+            return std::all_of(line.begin(), line.end(), [](char c) { return std::isspace(static_cast<unsigned char>(c)); });
+            }
+    };
+
+/*!
+ * GSD files are indexed by the chunks of each frame that are read. Text files are indexed by the offset of each
+ * frame, skipping its particle lines without parsing them.
+ */
+inline void TrajectoryReader::scan()
+    {
+    m_num_frames = 0;
+    if (m_format == Format::GSD)
+        {
+        // header
+        if (load<std::uint64_t>(0) != gsd_magic)
+            {
+            throw std::runtime_error("Trajectory is not a GSD file.");
+            }
+        const std::uint64_t index_location = load<std::uint64_t>(8);
+        const std::uint64_t index_entries = load<std::uint64_t>(16);
+        const std::uint64_t namelist_location = load<std::uint64_t>(24);
+        const std::uint64_t namelist_entries = load<std::uint64_t>(32);
+        const std::uint32_t gsd_version = load<std::uint32_t>(44);
+
+        // names are in 64-byte slots before version 2, and packed after
+        const char* names[gsd_num_chunks] = {"configuration/box", "particles/N", "particles/position", "particles/diameter"};
+        std::vector<int> ids(gsd_num_chunks, -1);
+        const size_t namelist_size = 64*namelist_entries;
+        load<char>(namelist_location + namelist_size - 1);
+        const char* namelist = m_data + namelist_location;
+        unsigned int id = 0;
+        for (size_t pos = 0; pos < namelist_size; ++id)
+            {
+            const char* name = namelist + pos;
+            const size_t length = strnlen(name, namelist_size - pos);
+            if (length == 0) break;
+            for (unsigned int c=0; c < gsd_num_chunks; ++c)
+                {
+                if (std::strncmp(name, names[c], length) == 0 && names[c][length] == '\0') ids[c] = id;
+                }
+            pos += (gsd_version < (2u << 16)) ? 64 : length + 1;
+            }
+
+        // index
+        load<char>(index_location + 32*index_entries - 1);
+        std::uint64_t max_frame = 0;
+        for (std::uint64_t i=0; i < index_entries; ++i)
+            {
+            const size_t offset = index_location + 32*i;
+            GSDEntry e;
+            e.frame = load<std::uint64_t>(offset);
+            e.N = load<std::uint64_t>(offset + 8);
+            e.location = load<std::int64_t>(offset + 16);
+            e.M = load<std::uint32_t>(offset + 24);
+            e.id = load<std::uint16_t>(offset + 28);
+            e.type = load<std::uint8_t>(offset + 30);
+            e.flags = load<std::uint8_t>(offset + 31);
+            if (e.location == 0) continue;
+
+            max_frame = std::max(max_frame, e.frame + 1);
+            for (unsigned int c=0; c < gsd_num_chunks; ++c)
+                {
+                if (ids[c] >= 0 && e.id == static_cast<unsigned int>(ids[c]))
+                    {
+                    if (m_chunks.size() < e.frame + 1) m_chunks.resize(e.frame + 1, std::vector<int>(gsd_num_chunks, -1));
+                    m_chunks[e.frame][c] = static_cast<int>(m_entries.size());
+                    m_entries.push_back(e);
+                    }
+                }
+            }
+        m_num_frames = static_cast<unsigned int>(max_frame);
+        m_chunks.resize(m_num_frames, std::vector<int>(gsd_num_chunks, -1));
+        }
+    else if (m_format == Format::XYZ)
+        {
+        size_t pos = 0;
+        while (pos < m_size)
+            {
+            const size_t start = pos;
+            const std::string line = nextLine(pos);
+            if (blank(line)) continue;
+            const unsigned long N = static_cast<unsigned long>(parse(split(line).at(0)));
+            skipLines(pos, N+1);
+            m_offsets.push_back(start);
+            }
+        m_num_frames = static_cast<unsigned int>(m_offsets.size());
+        }
+    else
+        {
+        size_t pos = 0;
+        while (pos < m_size)
+            {
+            const size_t start = pos;
+            const std::string line = nextLine(pos);
+            if (line.compare(0, 14, "ITEM: TIMESTEP") == 0)
+                {
+                m_offsets.push_back(start);
+                }
+            else if (line.compare(0, 21, "ITEM: NUMBER OF ATOMS") == 0)
+                {
+                const unsigned long N = static_cast<unsigned long>(parse(split(nextLine(pos)).at(0)));
+                // box (4 lines) and atoms
+                skipLines(pos, 4 + 1 + N);
+                }
+            }
+        m_num_frames = static_cast<unsigned int>(m_offsets.size());
+        }
+    }
+
+/*!
+ * \param frame Index of the frame.
+ */
+inline void TrajectoryReader::readGSD(unsigned int frame)
+    {
+    // chunk of a frame, falling back to frame 0
+    auto find = [&](GSDChunk c) -> const GSDEntry*
+        {
+        int entry = m_chunks[frame][c];
+        if (entry < 0) entry = m_chunks[0][c];
+        return (entry >= 0) ? &m_entries[entry] : nullptr;
+        };
+    // check that the data of a chunk is in the file
+    auto check = [&](const GSDEntry& e, size_t size)
+        {
+        if (e.location < 0 || static_cast<std::uint64_t>(e.location) > m_size || e.N*e.M*size > m_size - e.location)
+            {
+            throw std::runtime_error("Trajectory is truncated.");
+            }
+        };
+    // load a float chunk, in place if possible
+    auto floats = [&](const GSDEntry& e, std::vector<float>& buffer) -> const float*
+        {
+        if (e.type == gsd_float)
+            {
+            check(e, sizeof(float));
+            if (e.location % alignof(float) == 0)
+                {
+                return reinterpret_cast<const float*>(m_data + e.location);
+                }
+            buffer.resize(e.N*e.M);
+            std::memcpy(buffer.data(), m_data + e.location, buffer.size()*sizeof(float));
+            return buffer.data();
+            }
+        else if (e.type == gsd_double)
+            {
+            check(e, sizeof(double));
+            buffer.resize(e.N*e.M);
+            for (size_t i=0; i < buffer.size(); ++i)
+                {
+                buffer[i] = static_cast<float>(load<double>(e.location + i*sizeof(double)));
+                }
+            return buffer.data();
+            }
+        else
+            {
+            throw std::runtime_error("Trajectory chunk must be floating point.");
+            }
+        };
+
+    const GSDEntry* box = find(gsd_box);
+    if (box != nullptr)
+        {
+        if (box->N*box->M != 6)
+            {
+            throw std::runtime_error("Trajectory box must have 6 values.");
+            }
+        std::vector<float> values;
+        const float* b = floats(*box, values);
+        m_frame.L = make_float3(b[0], b[1], b[2]);
+        m_frame.xy = b[3];
+        m_frame.xz = b[4];
+        m_frame.yz = b[5];
+        }
+    else
+        {
+        m_frame.periodic[0] = m_frame.periodic[1] = m_frame.periodic[2] = false;
+        }
+    m_frame.origin = make_float3(-0.5f*(m_frame.L.x + m_frame.xy*m_frame.L.y + m_frame.xz*m_frame.L.z),
+                                 -0.5f*(m_frame.L.y + m_frame.yz*m_frame.L.z),
+                                 -0.5f*m_frame.L.z);
+
+    const GSDEntry* position = find(gsd_position);
+    const GSDEntry* N = find(gsd_N);
+    if (N != nullptr)
+        {
+        if (N->type != gsd_uint32 || N->N*N->M != 1)
+            {
+            throw std::runtime_error("Trajectory particles/N must be one 32-bit unsigned integer.");
+            }
+        m_frame.N = load<std::uint32_t>(N->location);
+        }
+    else if (position != nullptr)
+        {
+        m_frame.N = static_cast<unsigned int>(position->N);
+        }
+    if (m_frame.N == 0) return;
+
+    if (position == nullptr || position->M != 3 || position->N != m_frame.N)
+        {
+        throw std::runtime_error("Trajectory particles/position must have N rows of 3 values.");
+        }
+    std::vector<float> buffer;
+    const float* p = floats(*position, buffer);
+    if (!buffer.empty())
+        {
+        m_positions.resize(m_frame.N);
+        std::memcpy(m_positions.data(), buffer.data(), m_frame.N*sizeof(float3));
+        p = reinterpret_cast<const float*>(m_positions.data());
+        }
+    m_frame.positions = reinterpret_cast<const float3*>(p);
+
+    const GSDEntry* diameter = find(gsd_diameter);
+    if (diameter != nullptr)
+        {
+        if (diameter->N*diameter->M != m_frame.N)
+            {
+            throw std::runtime_error("Trajectory particles/diameter must have N values.");
+            }
+        m_frame.diameters = floats(*diameter, m_diameters);
+        }
+    }
+
+/*!
+ * \param frame Index of the frame.
+ *
+ * A Lattice key in the comment line (extended XYZ) sets the box, which must be upper triangular, and an Origin key
+ * sets its corner. Without a lattice, the frame is not periodic.
+ */
+inline void TrajectoryReader::readXYZ(unsigned int frame)
+    {
+    size_t pos = m_offsets[frame];
+    m_frame.N = static_cast<unsigned int>(parse(split(nextLine(pos)).at(0)));
+    const std::string comment = nextLine(pos);
+
+    // extended XYZ keys
+    auto key = [&](const std::string& name) -> std::vector<std::string>
+        {
+        const size_t start = comment.find(name + "=\"");
+        if (start == std::string::npos) return std::vector<std::string>();
+        const size_t first = start + name.size() + 2;
+        const size_t last = comment.find('"', first);
+        if (last == std::string::npos)
+            {
+            throw std::runtime_error("Trajectory has unterminated " + name + ".");
+            }
+        return split(comment.substr(first, last-first));
+        };
+    const std::vector<std::string> lattice = key("Lattice");
+    if (lattice.size() == 9)
+        {
+        double a[9];
+        for (unsigned int i=0; i < 9; ++i) a[i] = parse(lattice[i]);
+        if (a[1] != 0. || a[2] != 0. || a[5] != 0.)
+            {
+            throw std::runtime_error("Trajectory lattice must be upper triangular.");
+            }
+        m_frame.L = make_float3(static_cast<float>(a[0]), static_cast<float>(a[4]), static_cast<float>(a[8]));
+        m_frame.xy = static_cast<float>(a[3]/a[4]);
+        m_frame.xz = static_cast<float>(a[6]/a[8]);
+        m_frame.yz = static_cast<float>(a[7]/a[8]);
+        const std::vector<std::string> origin = key("Origin");
+        if (origin.size() == 3)
+            {
+            m_frame.origin = make_float3(static_cast<float>(parse(origin[0])),
+                                         static_cast<float>(parse(origin[1])),
+                                         static_cast<float>(parse(origin[2])));
+            }
+        }
+    else if (lattice.empty())
+        {
+        m_frame.periodic[0] = m_frame.periodic[1] = m_frame.periodic[2] = false;
+        }
+    else
+        {
+        throw std::runtime_error("Trajectory lattice must have 9 values.");
+        }
+
+    m_positions.resize(m_frame.N);
+    for (unsigned int i=0; i < m_frame.N; ++i)
+        {
+        const std::vector<std::string> words = split(nextLine(pos));
+        if (words.size() < 4)
+            {
+            throw std::runtime_error("Trajectory particle line must have a type and 3 coordinates.");
+            }
+        m_positions[i] = make_float3(static_cast<float>(parse(words[1])),
+                                     static_cast<float>(parse(words[2])),
+                                     static_cast<float>(parse(words[3])));
+        }
+    m_frame.positions = m_positions.data();
+    }
+
+/*!
+ * \param frame Index of the frame.
+ *
+ * The box bounds are converted from the LAMMPS convention for triclinic boxes. Boundaries other than "pp"
+ * are not periodic. A diameter column is read if there is one.
+ */
+inline void TrajectoryReader::readLAMMPS(unsigned int frame)
+    {
+    size_t pos = m_offsets[frame];
+    skipLines(pos, 2);
+    if (nextLine(pos).compare(0, 21, "ITEM: NUMBER OF ATOMS") != 0)
+        {
+        throw std::runtime_error("Trajectory frame must give the number of atoms after the timestep.");
+        }
+    m_frame.N = static_cast<unsigned int>(parse(split(nextLine(pos)).at(0)));
+
+    const std::vector<std::string> bounds = split(nextLine(pos));
+    if (bounds.size() < 6 || bounds[1] != "BOX" || bounds[2] != "BOUNDS")
+        {
+        throw std::runtime_error("Trajectory frame must give the box bounds after the number of atoms.");
+        }
+    const bool triclinic = (bounds.size() >= 9 && bounds[3] == "xy");
+    double lo[3], hi[3], tilt[3] = {0., 0., 0.};
+    for (unsigned int d=0; d < 3; ++d)
+        {
+        const std::vector<std::string> words = split(nextLine(pos));
+        if (words.size() < (triclinic ? 3u : 2u))
+            {
+            throw std::runtime_error("Trajectory box bounds are incomplete.");
+            }
+        lo[d] = parse(words[0]);
+        hi[d] = parse(words[1]);
+        if (triclinic) tilt[d] = parse(words[2]);
+        m_frame.periodic[d] = (bounds[bounds.size()-3+d] == "pp");
+        }
+    if (triclinic)
+        {
+        // bounding box to box
+        const double xy = tilt[0], xz = tilt[1], yz = tilt[2];
+        lo[0] -= std::min(std::min(0., xy), std::min(xz, xy+xz));
+        hi[0] -= std::max(std::max(0., xy), std::max(xz, xy+xz));
+        lo[1] -= std::min(0., yz);
+        hi[1] -= std::max(0., yz);
+        }
+    m_frame.L = make_float3(static_cast<float>(hi[0]-lo[0]),
+                            static_cast<float>(hi[1]-lo[1]),
+                            static_cast<float>(hi[2]-lo[2]));
+    m_frame.origin = make_float3(static_cast<float>(lo[0]), static_cast<float>(lo[1]), static_cast<float>(lo[2]));
+    if (triclinic)
+        {
+        m_frame.xy = static_cast<float>(tilt[0]/m_frame.L.y);
+        m_frame.xz = static_cast<float>(tilt[1]/m_frame.L.z);
+        m_frame.yz = static_cast<float>(tilt[2]/m_frame.L.z);
+        }
+
+    // columns
+    const std::vector<std::string> columns = split(nextLine(pos));
+    if (columns.size() < 3 || columns[1] != "ATOMS")
+        {
+        throw std::runtime_error("Trajectory frame must list the atoms after the box.");
+        }
+    int x = -1, y = -1, z = -1, diameter = -1;
+    bool scaled = false;
+    for (unsigned int c=2; c < columns.size(); ++c)
+        {
+        const std::string& name = columns[c];
+        const int col = static_cast<int>(c) - 2;
+        if (name == "x" || name == "xu") x = col;
+        else if (name == "y" || name == "yu") y = col;
+        else if (name == "z" || name == "zu") z = col;
+        else if (name == "xs" || name == "ys" || name == "zs")
+            {
+            scaled = true;
+            if (name == "xs") x = col;
+            else if (name == "ys") y = col;
+            else z = col;
+            }
+        else if (name == "diameter") diameter = col;
+        }
+    if (x < 0 || y < 0 || z < 0)
+        {
+        throw std::runtime_error("Trajectory atoms must have x, y, and z columns.");
+        }
+
+    m_positions.resize(m_frame.N);
+    if (diameter >= 0) m_diameters.resize(m_frame.N);
+    const int num_columns = static_cast<int>(columns.size()) - 2;
+    for (unsigned int i=0; i < m_frame.N; ++i)
+        {
+        const std::vector<std::string> words = split(nextLine(pos));
+        if (static_cast<int>(words.size()) < num_columns)
+            {
+            throw std::runtime_error("Trajectory atom line is missing columns.");
+            }
+        double r[3] = {parse(words[x]), parse(words[y]), parse(words[z])};
+        if (scaled)
+            {
+            // fractional coordinates along the lattice vectors
+            const double sx = r[0], sy = r[1], sz = r[2];
+            r[0] = lo[0] + sx*m_frame.L.x + sy*tilt[0] + sz*tilt[1];
+            r[1] = lo[1] + sy*m_frame.L.y + sz*tilt[2];
+            r[2] = lo[2] + sz*m_frame.L.z;
+            }
+        m_positions[i] = make_float3(static_cast<float>(r[0]), static_cast<float>(r[1]), static_cast<float>(r[2]));
+        if (diameter >= 0) m_diameters[i] = static_cast<float>(parse(words[diameter]));
+        }
+    m_frame.positions = m_positions.data();
+    if (diameter >= 0) m_frame.diameters = m_diameters.data();
+    }
+
+/*!
+ * The bounds enclose the corners of the box and the positions, since text formats may have unwrapped positions.
+ * A frame without a box is bounded by its positions.
+ */
+inline void TrajectoryReader::setBounds()
+    {
+    const float3 o = m_frame.origin;
+    const float3 L = m_frame.L;
+    float3 lo = make_float3(INFINITY, INFINITY, INFINITY);
+    float3 hi = make_float3(-INFINITY, -INFINITY, -INFINITY);
+    auto extend = [&](const float3& r)
+        {
+        lo = make_float3(std::min(lo.x, r.x), std::min(lo.y, r.y), std::min(lo.z, r.z));
+        hi = make_float3(std::max(hi.x, r.x), std::max(hi.y, r.y), std::max(hi.z, r.z));
+        };
+    if (L.x > 0.f && L.y > 0.f && L.z > 0.f)
+        {
+        for (unsigned int i=0; i < 2; ++i)
+            for (unsigned int j=0; j < 2; ++j)
+                for (unsigned int k=0; k < 2; ++k)
+                    {
+                    const float fi = static_cast<float>(i), fj = static_cast<float>(j), fk = static_cast<float>(k);
+                    extend(make_float3(o.x + fi*L.x + fj*m_frame.xy*L.y + fk*m_frame.xz*L.z,
+                                       o.y + fj*L.y + fk*m_frame.yz*L.z,
+                                       o.z + fk*L.z));
+                    }
+        }
+    if (m_format != Format::GSD || !(L.x > 0.f && L.y > 0.f && L.z > 0.f))
+        {
+        for (unsigned int i=0; i < m_frame.N; ++i)
+            {
+            extend(m_frame.positions[i]);
+            }
+        }
+    if (lo.x > hi.x)
+        {
+        lo = hi = make_float3(0.f, 0.f, 0.f);
+        }
+    m_frame.lo = lo;
+    m_frame.hi = hi;
+    }
+
+} // end namespace host
+} // end namespace neighbor
+
+#endif // NEIGHBOR_HOST_TRAJECTORY_READER_H_
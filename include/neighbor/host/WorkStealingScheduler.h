@@ -0,0 +1,362 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#ifndef NEIGHBOR_HOST_WORK_STEALING_SCHEDULER_H_
+#define NEIGHBOR_HOST_WORK_STEALING_SCHEDULER_H_
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "ThreadPool.h"
+#include "../Tracer.h"
+
+namespace neighbor
+{
+namespace host
+{
+//! Work-stealing scheduler for loops with uneven costs per index.
+/*!
+ * The scheduler runs a loop over [0,N) on a ThreadPool. Each thread starts with a contiguous block of
+ * indexes (see ThreadPool::getRange) in its own deque, and it takes chunks of indexes from the front of the
+ * deque. A thread whose deque is empty steals the back half of the remaining indexes of another thread.
+ * Both the chunks and the stolen ranges stay contiguous, so a thread mostly processes neighboring indexes.
+ * If the indexes are in Morton order (e.g., queries on the primitives sorted by LBVH::getPrimitives), each
+ * chunk is a compact region of space, which keeps the nodes of the LBVH that it visits in cache.
+ *
+ * The size of the chunks adapts to the observed cost of the loop. After each chunk, a thread estimates
+ * the time per index and sets its next chunk size so that a chunk takes about ::getTargetChunkTime. Cheap
+ * indexes are then taken in large chunks with little scheduling overhead, while expensive indexes are taken
+ * in small chunks so that the work is balanced at the end of the loop. The chunk size shrinks immediately when
+ * the indexes become expensive, but it only doubles per chunk when they become cheap, so a few cheap indexes
+ * in an expensive region do not cause a large chunk to be taken. The chunk size of each thread is
+ * kept for the next call to ::run, which is usually a similar loop.
+ *
+ * The time each thread spent in chunks and when it ran out of work are recorded for the last call to ::run,
+ * so the load balance can be inspected (see ::getUtilization and ::getTailTime). Each chunk and steal can also be
+ * recorded on a timeline by a Tracer (see ::setTracer).
+ *
+ * The load balance of this scheduler has so far only been compared to static and dynamic schedules with
+ * oversubscribed threads on a single core, so the utilization it reaches on a multicore host is not yet known.
+ */
+class WorkStealingScheduler
+    {
+    public:
+        //! Create a scheduler.
+        WorkStealingScheduler();
+
+        //! Execute a function for a range of indexes.
+        template<class Func>
+        void run(ThreadPool& pool, unsigned int N, const Func& f);
+
+        //! Get the target time to process one chunk in seconds.
+        double getTargetChunkTime() const
+            {
+            return m_target_time;
+            }
+
+        //! Set the target time to process one chunk.
+        /*!
+         * \param time Target time in seconds (positive).
+         *
+         * The default is 50 microseconds. Shorter times balance the work better, but each chunk has a
+         * fixed scheduling cost of a lock and two clock reads.
+         */
+        void setTargetChunkTime(double time)
+            {
+            if (!(time > 0.))
+                {
+                throw std::runtime_error("Target chunk time must be positive.");
+                }
+            m_target_time = time;
+            }
+
+        //! Get the chunk size of a thread before any cost is observed.
+        unsigned int getInitialChunkSize() const
+            {
+            return m_initial_chunk;
+            }
+
+        //! Set the chunk size of a thread before any cost is observed.
+        /*!
+         * \param chunk Number of indexes (at least 1).
+         *
+         * The default is 64. The chunk size of every thread is reset to this value, and it adapts
+         * again from there in the next call to ::run.
+         */
+        void setInitialChunkSize(unsigned int chunk)
+            {
+            if (chunk == 0)
+                {
+                throw std::runtime_error("Initial chunk size must be at least 1.");
+                }
+            m_initial_chunk = std::min(chunk, max_chunk);
+            for (auto& d : m_deques)
+                {
+                d->chunk = m_initial_chunk;
+                }
+            }
+
+        //! Get the current chunk size of a thread.
+        unsigned int getChunkSize(unsigned int thread) const
+            {
+            return (thread < m_deques.size()) ? m_deques[thread]->chunk : m_initial_chunk;
+            }
+
+        //! Get the time each thread spent processing chunks in the last run, in seconds.
+        const std::vector<double>& getBusyTimes() const
+            {
+            return m_busy;
+            }
+
+        //! Get the time at which each thread ran out of work in the last run, in seconds.
+        const std::vector<double>& getFinishTimes() const
+            {
+            return m_finish;
+            }
+
+        //! Get the duration of the last run in seconds.
+        double getElapsedTime() const
+            {
+            return m_elapsed;
+            }
+
+        //! Get the fraction of the last run that the threads spent processing chunks.
+        double getUtilization() const;
+
+        //! Get the time between the first and last thread running out of work in the last run, in seconds.
+        double getTailTime() const;
+
+        //! Get the number of chunks processed in the last run.
+        unsigned int getNumChunks() const
+            {
+            return m_num_chunks;
+            }
+
+        //! Get the number of successful steals in the last run.
+        unsigned int getNumSteals() const
+            {
+            return m_num_steals;
+            }
+
+        //! Get the tracer of the chunks.
+        Tracer* getTracer() const
+            {
+            return m_tracer;
+            }
+
+        //! Set the tracer of the chunks.
+        /*!
+         * \param tracer Tracer, or nullptr to not trace.
+         *
+         * Each chunk is recorded as a "chunk" event with the number of indexes it processed, and each successful
+         * steal as a "steal" event with the number of indexes stolen, on the thread that processed or stole them.
+         */
+        void setTracer(Tracer* tracer)
+            {
+            m_tracer = tracer;
+            }
+
+    private:
+        //! Indexes assigned to one thread.
+        struct Deque
+            {
+            std::mutex mutex;       //!< Mutex protecting the range
+            unsigned int begin;     //!< First remaining index
+            unsigned int end;       //!< One past the last remaining index
+            unsigned int chunk;     //!< Number of indexes to take at once
+            unsigned int chunks;    //!< Number of chunks processed
+            unsigned int steals;    //!< Number of successful steals
+            };
+        std::vector<std::unique_ptr<Deque>> m_deques;   //!< Deque of each thread, allocated separately
+
+        double m_target_time;           //!< Target time per chunk
+        unsigned int m_initial_chunk;   //!< Chunk size of a thread before any cost is observed
+
+        std::vector<double> m_busy;     //!< Time each thread spent in chunks
+        std::vector<double> m_finish;   //!< Time each thread ran out of work
+        double m_elapsed;               //!< Duration of the last run
+        unsigned int m_num_chunks;      //!< Number of chunks in the last run
+        unsigned int m_num_steals;      //!< Number of steals in the last run
+        Tracer* m_tracer;               //!< Tracer of the chunks
+
+        static const unsigned int max_chunk = 4096; //!< Largest chunk size
+
+        //! Steal half of the remaining indexes of another thread.
+        bool steal(unsigned int thread, unsigned int num_threads);
+    };
+
+inline WorkStealingScheduler::WorkStealingScheduler()
+    : m_target_time(50.e-6), m_initial_chunk(64), m_elapsed(0.), m_num_chunks(0), m_num_steals(0),
+      m_tracer(nullptr)
+    {}
+
+/*!
+ * \param pool Thread pool.
+ * \param N Number of indexes.
+ * \param f Function to execute, called as f(i) for each index in [0,\a N).
+ *
+ * \tparam Func Type of function.
+ *
+ * Each index is processed exactly once, but the order and the thread that processes it are not specified.
+ * The call returns once all indexes have been processed.
+ */
+template<class Func>
+void WorkStealingScheduler::run(ThreadPool& pool, unsigned int N, const Func& f)
+    {
+    typedef std::chrono::steady_clock clock;
+
+    const unsigned int num_threads = pool.getNumThreads();
+    while (m_deques.size() < num_threads)
+        {
+        m_deques.emplace_back(new Deque);
+        m_deques.back()->chunk = m_initial_chunk;
+        }
+    for (unsigned int t=0; t < num_threads; ++t)
+        {
+        const auto range = pool.getRange(t, 0, N);
+        Deque& d = *m_deques[t];
+        d.begin = range.first;
+        d.end = range.second;
+        d.chunks = 0;
+        d.steals = 0;
+        }
+    m_busy.assign(num_threads, 0.);
+    m_finish.assign(num_threads, 0.);
+
+    const auto start = clock::now();
+    pool.run([&](unsigned int thread)
+        {
+        Deque& own = *m_deques[thread];
+        double busy = 0.;
+        while (true)
+            {
+            // take a chunk from the front of the deque
+            unsigned int first, last;
+                {
+                std::lock_guard<std::mutex> lock(own.mutex);
+                first = own.begin;
+                last = std::min(own.end, first + own.chunk);
+                own.begin = last;
+                }
+
+            if (first < last)
+                {
+                const auto chunk_start = clock::now();
+                for (unsigned int i=first; i < last; ++i)
+                    {
+                    f(i);
+                    }
+                const auto chunk_end = clock::now();
+                const double time = std::chrono::duration<double>(chunk_end - chunk_start).count();
+                if (m_tracer)
+                    {
+                    m_tracer->complete("chunk",
+                                       "scheduler",
+                                       std::chrono::duration_cast<std::chrono::nanoseconds>(chunk_start.time_since_epoch()).count(),
+                                       std::chrono::duration_cast<std::chrono::nanoseconds>(chunk_end.time_since_epoch()).count(),
+                                       last-first,
+                                       0);
+                    }
+                busy += time;
+                ++own.chunks;
+
+                // size the next chunk to take about the target time, growing by at most a factor of 2
+                const double per_index = time/(last-first);
+                double next = 2.*own.chunk;
+                if (per_index > 0.) next = std::min(next, m_target_time/per_index);
+                own.chunk = std::max(1u, static_cast<unsigned int>(std::min(next, static_cast<double>(max_chunk))));
+                }
+            else if (!steal(thread, num_threads))
+                {
+                break;
+                }
+            }
+        m_busy[thread] = busy;
+        m_finish[thread] = std::chrono::duration<double>(clock::now() - start).count();
+        });
+    m_elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+    m_num_chunks = 0;
+    m_num_steals = 0;
+    for (unsigned int t=0; t < num_threads; ++t)
+        {
+        m_num_chunks += m_deques[t]->chunks;
+        m_num_steals += m_deques[t]->steals;
+        }
+    }
+
+/*!
+ * \param thread Index of the stealing thread, whose deque is empty.
+ * \param num_threads Number of threads running.
+ *
+ * \returns True if any indexes were stolen, or false if all other deques are empty.
+ *
+ * The other threads are visited in order starting after \a thread. The back half of the first
+ * nonempty deque is moved to the deque of \a thread. Indexes are only ever moved between deques,
+ * so once every deque has been seen empty, no work remains to be stolen.
+ */
+inline bool WorkStealingScheduler::steal(unsigned int thread, unsigned int num_threads)
+    {
+    for (unsigned int offset=1; offset < num_threads; ++offset)
+        {
+        Deque& victim = *m_deques[(thread + offset) % num_threads];
+        unsigned int first, last;
+            {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            const unsigned int remaining = victim.end - victim.begin;
+            if (remaining == 0) continue;
+            first = victim.end - (remaining+1)/2;
+            last = victim.end;
+            victim.end = first;
+            }
+
+        Deque& own = *m_deques[thread];
+            {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.begin = first;
+            own.end = last;
+            }
+        ++own.steals;
+        if (m_tracer) m_tracer->instant("steal", "scheduler", last-first, 0);
+        return true;
+        }
+    return false;
+    }
+
+/*!
+ * \returns The summed busy time of the threads divided by the number of threads and the elapsed time.
+ *
+ * A utilization of 1 means that no thread was idle or scheduling.
+ */
+inline double WorkStealingScheduler::getUtilization() const
+    {
+    if (m_busy.empty() || m_elapsed <= 0.) return 0.;
+
+    double busy = 0.;
+    for (const double b : m_busy)
+        {
+        busy += b;
+        }
+    return busy/(static_cast<double>(m_busy.size())*m_elapsed);
+    }
+
+/*!
+ * \returns The time from the first thread running out of work to the last.
+ */
+inline double WorkStealingScheduler::getTailTime() const
+    {
+    if (m_finish.empty()) return 0.;
+
+    const auto minmax = std::minmax_element(m_finish.begin(), m_finish.end());
+    return *minmax.second - *minmax.first;
+    }
+
+} // end namespace host
+} // end namespace neighbor
+
+#endif // NEIGHBOR_HOST_WORK_STEALING_SCHEDULER_H_
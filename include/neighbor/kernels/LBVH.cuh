@@ -7,11 +7,15 @@
 #ifndef NEIGHBOR_KERNELS_LBVH_CUH_
 #define NEIGHBOR_KERNELS_LBVH_CUH_
 
+// the kernels are only compiled by a device compiler, so host-only code can include this header
+#if defined(__CUDACC__) || defined(__HIPCC__)
+
 #include <hipper/hipper_runtime.h>
 #include <hipper/hipper_cub.h>
 
 #include "../BoundingVolumes.h"
 #include "../LBVHData.h"
+#include "../MortonCode.h"
 
 namespace neighbor
 {
@@ -19,94 +23,6 @@ namespace gpu
 {
 namespace kernel
 {
-//! Expand a 10-bit integer into 30 bits by inserting 2 zeros after each bit.
-/*!
- * \param v unsigned integer with 10 bits set
- * \returns The integer expanded with two zeros interleaved between bits
- * http://devblogs.nvidia.com/parallelforall/thinking-parallel-part-iii-tree-construction-gpu/
- */
-__device__ __forceinline__ unsigned int expandBits(unsigned int v)
-{
-    v = (v * 0x00010001u) & 0xFF0000FFu;
-    v = (v * 0x00000101u) & 0x0F00F00Fu;
-    v = (v * 0x00000011u) & 0xC30C30C3u;
-    v = (v * 0x00000005u) & 0x49249249u;
-    return v;
-}
-
-//! Compute the 30-bit Morton code for a tuple of binned indexes.
-/*!
- * \param point (x,y,z) tuple of bin indexes.
- * \returns 30-bit Morton code corresponding to \a point.
- *
- * The Morton code is formed by first expanding the bits of each component (see ::expandBits),
- * and then bitshifting to interleave them. The Morton code then has a representation::
- *
- *  x0y0z0x1y1z1...
- *
- * where indices refer to the bitwise representation of each component.
- */
-__device__ __forceinline__ unsigned int calcMortonCode(uint3 point)
-    {
-    return 4 * expandBits(point.x) + 2 * expandBits(point.y) + expandBits(point.z);
-    }
-
-//! Compute the number of bits shared by Morton codes for primitives \a i and \a j.
-/*!
- * \param d_codes List of Morton codes.
- * \param code_i Morton code corresponding to \a i.
- * \param i First primitive.
- * \param j Second primitive.
- * \param N Number of primitives.
- *
- * \returns Number of bits in longest common prefix or -1 if \a j lies outside [0,N).
- *
- * The longest common prefix of the Morton codes for \a i and \j is computed
- * using the __clz intrinsic. When \a i and \a j are the same, they share all 32
- * bits in the int representation of the Morton code. In that case, the common
- * prefix of \a i and \a j is used as a tie breaker.
- *
- * The user is required to supply \a code_i (even though it could also be looked
- * up from \a d_codes) for performance reasons, since code_i can be cached by
- * the caller if making multiple calls to ::delta for different \a j.
- */
-__device__ __forceinline__ int delta(const unsigned int *d_codes,
-                                     const unsigned int code_i,
-                                     const int i,
-                                     const int j,
-                                     const unsigned int N)
-    {
-    if (j < 0 || j >= N)
-        {
-        return -1;
-        }
-
-    const unsigned int code_j = d_codes[j];
-
-    if (code_i == code_j)
-        {
-        return (32 + __clz(i ^ j));
-        }
-    else
-        {
-        return __clz(code_i ^ code_j);
-        }
-    }
-
-//! Convert a fraction to [0,1023]
-/*
- * \param f Fractional coordinate lying in [0,1].
- * \returns Bin integer lying in [0,1023]
- *
- * The range of the binned integer corresponds to the maximum value that can be
- * stored in a 10-bit integer. When \a f lies outside [0,1], the bin is clamped to
- * the ends of the range.
- */
-__device__ __forceinline__ unsigned int fractionToBin(float f)
-    {
-    return static_cast<unsigned int>(fminf(fmaxf(f * 1023.f, 0.f), 1023.f));
-    }
-
 //! Kernel to generate the Morton codes
 /*!
  * \param d_codes Generated Morton codes.
@@ -140,16 +56,8 @@ __global__ void lbvh_gen_codes(unsigned int *d_codes,
     // real space coordinate of aabb center
     const float3 r = insert.get(idx).getCenter();
 
-    // fractional coordinate
-    const float3 f = make_float3((r.x - lo.x) / (hi.x - lo.x),
-                                 (r.y - lo.y) / (hi.y - lo.y),
-                                 (r.z - lo.z) / (hi.z - lo.z));
-
-    // bin fractional coordinate
-    const uint3 q = make_uint3(fractionToBin(f.x), fractionToBin(f.y), fractionToBin(f.z));
-
     // compute morton code
-    const unsigned int code = calcMortonCode(q);
+    const unsigned int code = calcMortonCode(r, lo, hi);
 
     // write out morton code and primitive index
     d_codes[idx] = code;
@@ -330,6 +238,7 @@ __global__ void lbvh_bubble_aabbs(const LBVHData tree,
 /*!
  * \param tree LBVH tree (raw pointers).
  * \param insert The insert operation to obtain the ONE aabb.
+ * \param refit If true, fit the primitive already in the leaf instead of primitive 0.
  *
  * \tparam InsertOpT the kind of insert operation.
  *
@@ -339,14 +248,21 @@ __global__ void lbvh_bubble_aabbs(const LBVHData tree,
  */
 template<class InsertOpT>
 __global__ void lbvh_one_primitive(const LBVHData tree,
-                                   const InsertOpT insert)
+                                   const InsertOpT insert,
+                                   const bool refit)
     {
     // one thread only
     const unsigned int idx = hipper::threadRank<1,1>();
     if (idx >= 1)
         return;
 
-    const BoundingBox b = insert.get(0);
+    // a refit keeps the primitive in the leaf, which need not be 0 after dynamic updates
+    unsigned int primitive = 0;
+    if (refit)
+        primitive = tree.primitive[0];
+    else
+        tree.primitive[0] = 0;
+    const BoundingBox b = insert.get(primitive);
 
     tree.parent[0] = LBVHSentinel;
     tree.lo[0] = b.lo;
@@ -517,6 +433,7 @@ void lbvh_bubble_aabbs(const LBVHData tree,
 /*!
  * \param tree LBVH tree (raw pointers).
  * \param insert The insert operation to obtain the ONE aabb.
+ * \param refit If true, fit the primitive already in the leaf instead of primitive 0.
  * \param stream CUDA stream for kernel execution.
  *
  * \tparam InsertOpT the kind of insert operation
@@ -526,13 +443,16 @@ void lbvh_bubble_aabbs(const LBVHData tree,
 template<class InsertOpT>
 void lbvh_one_primitive(const LBVHData tree,
                         const InsertOpT& insert,
+                        bool refit,
                         hipper::stream_t stream)
     {
     hipper::KernelLauncher launcher(1,1,stream);
-    launcher(kernel::lbvh_one_primitive<InsertOpT>, tree, insert);
+    launcher(kernel::lbvh_one_primitive<InsertOpT>, tree, insert, refit);
     }
 
 } // end namespace gpu
 } // end namespace neighbor
 
+#endif // __CUDACC__ || __HIPCC__
+
 #endif // NEIGHBOR_KERNELS_LBVH_CUH_
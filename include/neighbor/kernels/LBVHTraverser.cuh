@@ -13,9 +13,529 @@
 #include "../LBVHData.h"
 #include "../LBVHTraverserData.h"
 #include "../BoundingVolumes.h"
+#include "../OutputOps.h"
+#include "../TraversalStatistics.h"
+
+#define HOSTDEVICE __host__ __device__ __forceinline__
 
 namespace neighbor
 {
+//! Compute the bin scale factor for compressing an LBVH.
+/*!
+ * \param tree_lo Lower bound of the LBVH root.
+ * \param tree_hi Upper bound of the LBVH root.
+ *
+ * \returns The inverse bin size for each dimension.
+ *
+ * The root is discretized into 1023 bins in each dimension. The bin scale factor
+ * is rounded down so that it always *underestimates* the offset of a bound from the root.
+ */
+HOSTDEVICE float3 lbvh_compression_scale(const float3& tree_lo, const float3& tree_hi)
+    {
+    // compute box size, rounding up to ensure fully covered
+    float3 L = make_float3(approx::fsub_ru(tree_hi.x, tree_lo.x),
+                           approx::fsub_ru(tree_hi.y, tree_lo.y),
+                           approx::fsub_ru(tree_hi.z, tree_lo.z));
+    if (L.x <= 0.f) L.x = 1.0f;
+    if (L.y <= 0.f) L.y = 1.0f;
+    if (L.z <= 0.f) L.z = 1.0f;
+
+    // round down the bin scale factor so that it always *underestimates* the offset
+    return make_float3(approx::fdiv_rd(1023.f,L.x),
+                       approx::fdiv_rd(1023.f,L.y),
+                       approx::fdiv_rd(1023.f,L.z));
+    }
+
+//! Compress one node of an LBVH for rope traversal.
+/*!
+ * \param transform Transformation operation.
+ * \param tree LBVH to compress.
+ * \param N_internal Number of internal nodes in LBVH.
+ * \param idx Node to compress.
+ * \param tree_lo Lower bound of the LBVH root.
+ * \param tree_hi Upper bound of the LBVH root.
+ * \param tree_bininv Inverse bin size (see ::lbvh_compression_scale).
+ *
+ * \returns The compressed node.
+ *
+ * \tparam TransformOpT Type of operation for transforming cached primitive index.
+ *
+ * The rope of the node is found by backtracking, and the bounds are snapped to the bins so
+ * that they always expand. The offsets are clamped at 0 in case rounding makes them slightly negative.
+ * See gpu::kernel::lbvh_compress_ropes for details.
+ */
+template<class TransformOpT>
+HOSTDEVICE int4 lbvh_compress_node(const TransformOpT& transform,
+                                   const ConstLBVHData& tree,
+                                   const unsigned int N_internal,
+                                   const int idx,
+                                   const float3& tree_lo,
+                                   const float3& tree_hi,
+                                   const float3& tree_bininv)
+    {
+    // backtrack tree to find the first right ancestor of this node
+    int rope = LBVHSentinel;
+    int current = idx;
+    while (current != tree.root && rope == LBVHSentinel)
+        {
+        int parent = tree.parent[current];
+        int left = tree.left[parent];
+        if (left == current)
+            {
+            // if this is a left node, then rope is determined to the right
+            rope = tree.right[parent];
+            }
+        else
+            {
+            // otherwise, keep ascending the tree
+            current = parent;
+            }
+        }
+
+    // compress node data into one byte per box dim
+    // low bounds are encoded relative to the low of the box, always rounding down
+    const float3 lo = tree.lo[idx];
+    const uint3 lo_bin = make_uint3((unsigned int)fmaxf(0.f,floorf(approx::fmul_rd(approx::fsub_rd(lo.x,tree_lo.x),tree_bininv.x))),
+                                    (unsigned int)fmaxf(0.f,floorf(approx::fmul_rd(approx::fsub_rd(lo.y,tree_lo.y),tree_bininv.y))),
+                                    (unsigned int)fmaxf(0.f,floorf(approx::fmul_rd(approx::fsub_rd(lo.z,tree_lo.z),tree_bininv.z))));
+    const unsigned int lo_bin3 = (lo_bin.x << 20) +  (lo_bin.y << 10) + lo_bin.z;
+
+    // high bounds are encoded relative to the high of the box, always rounding down
+    const float3 hi = tree.hi[idx];
+    const uint3 hi_bin = make_uint3((unsigned int)fmaxf(0.f,floorf(approx::fmul_rd(approx::fsub_rd(tree_hi.x,hi.x),tree_bininv.x))),
+                                    (unsigned int)fmaxf(0.f,floorf(approx::fmul_rd(approx::fsub_rd(tree_hi.y,hi.y),tree_bininv.y))),
+                                    (unsigned int)fmaxf(0.f,floorf(approx::fmul_rd(approx::fsub_rd(tree_hi.z,hi.z),tree_bininv.z))));
+    const unsigned int hi_bin3 = (hi_bin.x << 20) + (hi_bin.y << 10) + hi_bin.z;
+
+    // node holds left child for internal nodes (>= 0) or primitive for leaf (< 0)
+    int left_flag = (idx < (int)N_internal) ? tree.left[idx] : ~transform(tree.primitive[idx-N_internal]);
+
+    // stash all the data into one int4
+    return make_int4(lo_bin3, hi_bin3, left_flag, rope);
+    }
+
+//! Load a node of a compressed LBVH.
+/*!
+ * \param lbvh Compressed LBVH data.
+ * \param node Node to load.
+ *
+ * \returns The compressed node.
+ */
+HOSTDEVICE int4 lbvh_load_node(const LBVHCompressedData& lbvh, const int node)
+    {
+    #if defined(__CUDA_ARCH__) || defined(__HIP_DEVICE_COMPILE__)
+    return __ldg(lbvh.data + node);
+    #else
+    return lbvh.data[node];
+    #endif
+    }
+
+//! Decompress the bounds of a node of a compressed LBVH.
+/*!
+ * \param node Compressed node.
+ * \param tree_box Bounds of the compressed LBVH.
+ * \param tree_bins Bin size of the compressed LBVH.
+ *
+ * \returns The bounds of the node, which always *expand* the original bounds.
+ */
+HOSTDEVICE BoundingBox lbvh_decompress_bounds(const int4& node, const BoundingBox& tree_box, const float3& tree_bins)
+    {
+    const unsigned int lo = node.x;
+    const float3 lof = make_float3(approx::fadd_rd(tree_box.lo.x, approx::fmul_rd((lo >> 20) & 0x3ffu,tree_bins.x)),
+                                   approx::fadd_rd(tree_box.lo.y, approx::fmul_rd((lo >> 10) & 0x3ffu,tree_bins.y)),
+                                   approx::fadd_rd(tree_box.lo.z, approx::fmul_rd((lo      ) & 0x3ffu,tree_bins.z)));
+
+    const unsigned int hi = node.y;
+    const float3 hif = make_float3(approx::fsub_ru(tree_box.hi.x, approx::fmul_rd((hi >> 20) & 0x3ffu,tree_bins.x)),
+                                   approx::fsub_ru(tree_box.hi.y, approx::fmul_rd((hi >> 10) & 0x3ffu,tree_bins.y)),
+                                   approx::fsub_ru(tree_box.hi.z, approx::fmul_rd((hi      ) & 0x3ffu,tree_bins.z)));
+
+    return BoundingBox(lof,hif);
+    }
+
+//! Traverse a subtree of the LBVH using ropes for one query volume.
+/*!
+ * \param out Output operation for intersected primitives.
+ * \param result Thread data of the output operation.
+ * \param lbvh Compressed LBVH data to traverse.
+ * \param tree_box Bounds of the compressed LBVH.
+ * \param tree_bins Bin size of the compressed LBVH.
+ * \param query Query operation.
+ * \param qdata Thread data of the query operation.
+ * \param q Query volume.
+ * \param node First node of the subtree.
+ * \param escape Rope of the first node, which ends the traversal.
+ * \param counter Traversal statistics policy.
+ * \param stats Thread data of the statistics policy.
+ *
+ * \returns True if the output operation ended the traversal (see ::output_process).
+ *
+ * \tparam OutputOpT The type of output operation.
+ * \tparam QueryOpT The type of query operation.
+ * \tparam CounterT The type of statistics policy.
+ *
+ * The ropes of all nodes in a subtree either stay inside it or point to the rope of its first node,
+ * so the subtree is done when \a escape is reached. The whole LBVH is traversed by starting at the root
+ * with the LBVHSentinel as the escape.
+ */
+template<class OutputOpT, class QueryOpT, class CounterT>
+HOSTDEVICE bool lbvh_traverse_subtree(const OutputOpT& out,
+                                      typename OutputOpT::ThreadData& result,
+                                      const LBVHCompressedData& lbvh,
+                                      const BoundingBox& tree_box,
+                                      const float3& tree_bins,
+                                      const QueryOpT& query,
+                                      const typename QueryOpT::ThreadData& qdata,
+                                      const typename QueryOpT::Volume& q,
+                                      int node,
+                                      const int escape,
+                                      const CounterT& counter,
+                                      typename CounterT::ThreadData& stats)
+    {
+    while (node != escape)
+        {
+        // load node and decompress bounds so that they always *expand*
+        const int4 aabb = lbvh_load_node(lbvh, node);
+        const BoundingBox box = lbvh_decompress_bounds(aabb, tree_box, tree_bins);
+        const int left = aabb.z;
+        counter.visitNode(stats);
+
+        // advance to rope as a preliminary
+        node = aabb.w;
+
+        // if overlap, do work with primitive. otherwise, rope ahead
+        if (query.overlap(q, box))
+            {
+            if(left < 0)
+                {
+                const int primitive = ~left;
+                const bool accepted = query.refine(qdata,primitive);
+                counter.testLeaf(stats, accepted);
+                if (accepted && output_process(out,result,primitive))
+                    return true;
+                // leaf nodes always move to their rope
+                }
+            else
+                {
+                // internal node takes left child
+                node = left;
+                }
+            }
+        } // end stackless search
+
+    return false;
+    }
+
+//! Traverse the siblings of the ancestors of a node using ropes for one query volume.
+/*!
+ * \param out Output operation for intersected primitives.
+ * \param result Thread data of the output operation.
+ * \param lbvh Compressed LBVH data to traverse.
+ * \param tree_box Bounds of the compressed LBVH.
+ * \param tree_bins Bin size of the compressed LBVH.
+ * \param query Query operation.
+ * \param qdata Thread data of the query operation.
+ * \param q Query volume.
+ * \param parents Parent of each node of the LBVH.
+ * \param node Node to ascend from.
+ * \param counter Traversal statistics policy.
+ * \param stats Thread data of the statistics policy.
+ *
+ * \returns True if the output operation ended the traversal.
+ *
+ * \tparam OutputOpT The type of output operation.
+ * \tparam QueryOpT The type of query operation.
+ * \tparam CounterT The type of statistics policy.
+ *
+ * The traversal ascends from \a node to the root. At each ancestor, the sibling subtree that was not
+ * yet visited is traversed using ropes (see ::lbvh_traverse_subtree). The right sibling of a left child is its
+ * rope, while the left sibling of a right child is the left child of the parent. Together with the subtree of
+ * \a node, the siblings cover all nodes except the ancestors of \a node, which are not tested.
+ */
+template<class OutputOpT, class QueryOpT, class CounterT>
+HOSTDEVICE bool lbvh_traverse_siblings(const OutputOpT& out,
+                                       typename OutputOpT::ThreadData& result,
+                                       const LBVHCompressedData& lbvh,
+                                       const BoundingBox& tree_box,
+                                       const float3& tree_bins,
+                                       const QueryOpT& query,
+                                       const typename QueryOpT::ThreadData& qdata,
+                                       const typename QueryOpT::Volume& q,
+                                       const int* parents,
+                                       int node,
+                                       const CounterT& counter,
+                                       typename CounterT::ThreadData& stats)
+    {
+    while (node != lbvh.root)
+        {
+        const int parent = parents[node];
+        const int left = lbvh_load_node(lbvh, parent).z;
+        if (left == node)
+            {
+            const int right = lbvh_load_node(lbvh, node).w;
+            if (lbvh_traverse_subtree(out, result, lbvh, tree_box, tree_bins, query, qdata, q, right, lbvh_load_node(lbvh, right).w, counter, stats))
+                return true;
+            }
+        else if (lbvh_traverse_subtree(out, result, lbvh, tree_box, tree_bins, query, qdata, q, left, node, counter, stats))
+            {
+            return true;
+            }
+        node = parent;
+        }
+
+    return false;
+    }
+
+//! Traverse the LBVH using ropes starting from a leaf for one query volume.
+/*!
+ * \param out Output operation for intersected primitives.
+ * \param result Thread data of the output operation.
+ * \param lbvh Compressed LBVH data to traverse.
+ * \param tree_box Bounds of the compressed LBVH.
+ * \param tree_bins Bin size of the compressed LBVH.
+ * \param query Query operation.
+ * \param qdata Thread data of the query operation.
+ * \param q Query volume.
+ * \param parents Parent of each node of the LBVH.
+ * \param leaf Leaf to start from.
+ * \param counter Traversal statistics policy.
+ * \param stats Thread data of the statistics policy.
+ *
+ * \returns True if the output operation ended the traversal.
+ *
+ * \tparam OutputOpT The type of output operation.
+ * \tparam QueryOpT The type of query operation.
+ * \tparam CounterT The type of statistics policy.
+ *
+ * When the query volume is centered on a primitive in the LBVH, every ancestor of its leaf overlaps
+ * the volume, so testing them while descending from the root is wasted work. Instead, the leaf is tested,
+ * and then the traversal ascends to the root through the siblings of the ancestors (see ::lbvh_traverse_siblings).
+ *
+ * The same primitives are found as when starting from the root, in a different order. This is true even if the
+ * volume does not overlap the leaf, but then the ancestors are not skipped by a traversal from the root. The
+ * traversal cannot stop at an ancestor that encloses the volume, because the bounds of nodes in other subtrees
+ * may still overlap it.
+ */
+template<class OutputOpT, class QueryOpT, class CounterT>
+HOSTDEVICE bool lbvh_traverse_from_leaf(const OutputOpT& out,
+                                        typename OutputOpT::ThreadData& result,
+                                        const LBVHCompressedData& lbvh,
+                                        const BoundingBox& tree_box,
+                                        const float3& tree_bins,
+                                        const QueryOpT& query,
+                                        const typename QueryOpT::ThreadData& qdata,
+                                        const typename QueryOpT::Volume& q,
+                                        const int* parents,
+                                        const int leaf,
+                                        const CounterT& counter,
+                                        typename CounterT::ThreadData& stats)
+    {
+    return lbvh_traverse_subtree(out, result, lbvh, tree_box, tree_bins, query, qdata, q, leaf, lbvh_load_node(lbvh, leaf).w, counter, stats)
+        || lbvh_traverse_siblings(out, result, lbvh, tree_box, tree_bins, query, qdata, q, parents, leaf, counter, stats);
+    }
+
+//! Traverse the LBVH using ropes starting from a cached entry node for one query volume.
+/*!
+ * \param out Output operation for intersected primitives.
+ * \param result Thread data of the output operation.
+ * \param lbvh Compressed LBVH data to traverse.
+ * \param tree_box Bounds of the compressed LBVH.
+ * \param tree_bins Bin size of the compressed LBVH.
+ * \param query Query operation.
+ * \param qdata Thread data of the query operation.
+ * \param q Query volume.
+ * \param parents Parent of each node of the LBVH.
+ * \param entry Entry node, which is replaced by the entry node for the next traversal.
+ * \param counter Traversal statistics policy.
+ * \param stats Thread data of the statistics policy.
+ *
+ * \returns True if the output operation ended the traversal.
+ *
+ * \tparam OutputOpT The type of output operation.
+ * \tparam QueryOpT The type of query operation.
+ * \tparam CounterT The type of statistics policy.
+ *
+ * The \a entry must be a node of the LBVH. The traversal ascends from \a entry until it reaches a node that
+ * overlaps \a q (or the root), and it starts from that node like ::lbvh_traverse_from_leaf. All ancestors of
+ * an overlapped node also overlap \a q, so skipping them never misses a primitive, and the deeper the start node,
+ * the more tests are skipped. The first leaf that overlaps \a q in the subtree of the start node is the next
+ * \a entry, or the start node is kept if there is none.
+ *
+ * Any node is a valid entry, so a stale entry only costs extra work. The entry is most useful when a query moves
+ * little between traversals of an LBVH whose hierarchy does not change (e.g., LBVH::refit).
+ */
+template<class OutputOpT, class QueryOpT, class CounterT>
+HOSTDEVICE bool lbvh_traverse_from_entry(const OutputOpT& out,
+                                         typename OutputOpT::ThreadData& result,
+                                         const LBVHCompressedData& lbvh,
+                                         const BoundingBox& tree_box,
+                                         const float3& tree_bins,
+                                         const QueryOpT& query,
+                                         const typename QueryOpT::ThreadData& qdata,
+                                         const typename QueryOpT::Volume& q,
+                                         const int* parents,
+                                         int& entry,
+                                         const CounterT& counter,
+                                         typename CounterT::ThreadData& stats)
+    {
+    // ascend from the entry until it overlaps the volume
+    int start = entry;
+    while (start != lbvh.root)
+        {
+        counter.visitNode(stats);
+        if (query.overlap(q, lbvh_decompress_bounds(lbvh_load_node(lbvh, start), tree_box, tree_bins)))
+            break;
+        start = parents[start];
+        }
+
+    // traverse the start subtree, keeping the first overlapped leaf as the next entry
+    const int escape = lbvh_load_node(lbvh, start).w;
+    bool found = false;
+    entry = start;
+    int node = start;
+    while (node != escape)
+        {
+        const int current = node;
+        const int4 aabb = lbvh_load_node(lbvh, current);
+        const int left = aabb.z;
+        node = aabb.w;
+        counter.visitNode(stats);
+
+        if (query.overlap(q, lbvh_decompress_bounds(aabb, tree_box, tree_bins)))
+            {
+            if(left < 0)
+                {
+                if (!found)
+                    {
+                    entry = current;
+                    found = true;
+                    }
+
+                const int primitive = ~left;
+                const bool accepted = query.refine(qdata,primitive);
+                counter.testLeaf(stats, accepted);
+                if (accepted && output_process(out,result,primitive))
+                    return true;
+                }
+            else
+                {
+                node = left;
+                }
+            }
+        }
+
+    // traverse the rest of the tree
+    return lbvh_traverse_siblings(out, result, lbvh, tree_box, tree_bins, query, qdata, q, parents, start, counter, stats);
+    }
+
+//! Traverse the LBVH using ropes for one query.
+/*!
+ * \param out Output operation for intersected primitives.
+ * \param lbvh Compressed LBVH data to traverse.
+ * \param tree_box Bounds of the compressed LBVH.
+ * \param tree_bins Bin size of the compressed LBVH.
+ * \param query Query operation.
+ * \param images Translation operation.
+ * \param idx Index of the query.
+ * \param parents Parent of each node of the LBVH.
+ * \param leaf Leaf to start the self image from, or -1 to start all images from the root.
+ * \param entry Cached entry node of the self image, or NULL to not use an entry.
+ * \param counter Traversal statistics policy.
+ *
+ * \tparam OutputOpT The type of output operation.
+ * \tparam QueryOpT The type of query operation.
+ * \tparam TranslateOpT The type of translation operation.
+ * \tparam CounterT The type of statistics policy.
+ *
+ * This is the traversal performed by each thread in gpu::kernel::lbvh_traverse_ropes,
+ * which is also used for traversal on the host. If a \a leaf is given, the image with
+ * zero translation is traversed from it (see ::lbvh_traverse_from_leaf). If an \a entry is
+ * given instead, the image with zero translation is traversed from it, and it is updated
+ * (see ::lbvh_traverse_from_entry). The remaining images are skipped if the output operation
+ * ends the traversal (see ::output_process).
+ *
+ * The work of the query is counted by the \a counter (see TraversalCounter). The default NullTraversalCounter
+ * does not count.
+ */
+template<class OutputOpT, class QueryOpT, class TranslateOpT, class CounterT = NullTraversalCounter>
+HOSTDEVICE void lbvh_traverse_query(const OutputOpT& out,
+                                    const LBVHCompressedData& lbvh,
+                                    const BoundingBox& tree_box,
+                                    const float3& tree_bins,
+                                    const QueryOpT& query,
+                                    const TranslateOpT& images,
+                                    const unsigned int idx,
+                                    const int* parents = NULL,
+                                    const int leaf = -1,
+                                    int* entry = NULL,
+                                    const CounterT& counter = CounterT())
+    {
+    // query thread data
+    const typename QueryOpT::ThreadData qdata = query.setup(idx);
+    typename OutputOpT::ThreadData result = out.setup(idx, qdata);
+    typename CounterT::ThreadData stats = counter.setup(idx);
+
+    // find image flags against root before divergence
+    unsigned int flags = 0;
+    const int nbits = (images.size() <= 32u) ? images.size() : 32;
+    for (unsigned int i=0; i < nbits; ++i)
+        {
+        const typename TranslateOpT::type image = images.get(i);
+        const typename QueryOpT::Volume q = query.get(qdata,image);
+        if (query.overlap(q,tree_box)) flags |= 1u << i;
+        }
+
+    // stackless search
+    do
+        {
+        // look for the next image
+        #if defined(__CUDA_ARCH__) || defined(__HIP_DEVICE_COMPILE__)
+        int image_bit = __ffs(flags);
+        #else
+        int image_bit = __builtin_ffs(flags);
+        #endif
+        if (image_bit)
+            {
+            // shift the lsb by 1 to get the image index
+            --image_bit;
+
+            // unset the bit from this image
+            flags &= ~(1u << image_bit);
+            }
+        else
+            {
+            // no more images, quit
+            break;
+            }
+
+        // move the sphere to the next image
+        const typename TranslateOpT::type image = images.get(image_bit);
+        typename QueryOpT::Volume q = query.get(qdata, image);
+        counter.traverseImage(stats);
+
+        const bool self = (image.x == 0 && image.y == 0 && image.z == 0);
+        bool done;
+        if (self && entry != NULL)
+            {
+            done = lbvh_traverse_from_entry(out, result, lbvh, tree_box, tree_bins, query, qdata, q, parents, *entry, counter, stats);
+            }
+        else if (self && leaf >= 0)
+            {
+            done = lbvh_traverse_from_leaf(out, result, lbvh, tree_box, tree_bins, query, qdata, q, parents, leaf, counter, stats);
+            }
+        else
+            {
+            done = lbvh_traverse_subtree(out, result, lbvh, tree_box, tree_bins, query, qdata, q, lbvh.root, LBVHSentinel, counter, stats);
+            }
+        if (done) break;
+        } while(true);
+
+    out.finalize(result);
+    counter.finalize(stats);
+    }
+
+// the kernels are only compiled by a device compiler, while the traversal above is shared with the host
+#if defined(__CUDACC__) || defined(__HIPCC__)
 namespace gpu
 {
 namespace kernel
@@ -60,60 +580,11 @@ __global__ void lbvh_compress_ropes(const LBVHCompressedData ctree,
         {
         tree_lo = tree.lo[tree.root];
         tree_hi = tree.hi[tree.root];
-        // compute box size, rounding up to ensure fully covered
-        float3 L = make_float3(approx::fsub_ru(tree_hi.x, tree_lo.x),
-                               approx::fsub_ru(tree_hi.y, tree_lo.y),
-                               approx::fsub_ru(tree_hi.z, tree_lo.z));
-        if (L.x <= 0.f) L.x = 1.0f;
-        if (L.y <= 0.f) L.y = 1.0f;
-        if (L.z <= 0.f) L.z = 1.0f;
-
-        // round down the bin scale factor so that it always *underestimates* the offset
-        tree_bininv = make_float3(approx::fdiv_rd(1023.f,L.x),
-                                  approx::fdiv_rd(1023.f,L.y),
-                                  approx::fdiv_rd(1023.f,L.z));
+        tree_bininv = lbvh_compression_scale(tree_lo, tree_hi);
         }
     __syncthreads();
 
-    // backtrack tree to find the first right ancestor of this node
-    int rope = LBVHSentinel;
-    int current = idx;
-    while (current != tree.root && rope == LBVHSentinel)
-        {
-        int parent = tree.parent[current];
-        int left = tree.left[parent];
-        if (left == current)
-            {
-            // if this is a left node, then rope is determined to the right
-            rope = tree.right[parent];
-            }
-        else
-            {
-            // otherwise, keep ascending the tree
-            current = parent;
-            }
-        }
-
-    // compress node data into one byte per box dim
-    // low bounds are encoded relative to the low of the box, always rounding down
-    const float3 lo = tree.lo[idx];
-    const uint3 lo_bin = make_uint3((unsigned int)floorf(approx::fmul_rd(approx::fsub_rd(lo.x,tree_lo.x),tree_bininv.x)),
-                                    (unsigned int)floorf(approx::fmul_rd(approx::fsub_rd(lo.y,tree_lo.y),tree_bininv.y)),
-                                    (unsigned int)floorf(approx::fmul_rd(approx::fsub_rd(lo.z,tree_lo.z),tree_bininv.z)));
-    const unsigned int lo_bin3 = (lo_bin.x << 20) +  (lo_bin.y << 10) + lo_bin.z;
-
-    // high bounds are encoded relative to the high of the box, always rounding down
-    const float3 hi = tree.hi[idx];
-    const uint3 hi_bin = make_uint3((unsigned int)floorf(approx::fmul_rd(approx::fsub_rd(tree_hi.x,hi.x),tree_bininv.x)),
-                                    (unsigned int)floorf(approx::fmul_rd(approx::fsub_rd(tree_hi.y,hi.y),tree_bininv.y)),
-                                    (unsigned int)floorf(approx::fmul_rd(approx::fsub_rd(tree_hi.z,hi.z),tree_bininv.z)));
-    const unsigned int hi_bin3 = (hi_bin.x << 20) + (hi_bin.y << 10) + hi_bin.z;
-
-    // node holds left child for internal nodes (>= 0) or primitive for leaf (< 0)
-    int left_flag = (idx < N_internal) ? tree.left[idx] : ~transform(tree.primitive[idx-N_internal]);
-
-    // stash all the data into one int4
-    ctree.data[idx] = make_int4(lo_bin3, hi_bin3, left_flag, rope);
+    ctree.data[idx] = lbvh_compress_node(transform, tree, N_internal, idx, tree_lo, tree_hi, tree_bininv);
 
     // first thread writes out the compression values, rounding down bin size to ensure box bounds always expand even with floats
     if (idx == 0)
@@ -130,10 +601,12 @@ __global__ void lbvh_compress_ropes(const LBVHCompressedData ctree,
  * \param lbvh Compressed LBVH data to traverse.
  * \param query Query operation.
  * \param images Translation operation.
+ * \param counter Traversal statistics policy.
  *
  * \tparam OutputOpT The type of output operation.
  * \tparam QueryOpT The type of query operation.
  * \tparam TranslateOpT The type of translation operation.
+ * \tparam CounterT The type of statistics policy.
  *
  * The LBVH is traversed using the rope scheme. In this method, the
  * test sphere always descends to the left child of an intersected node,
@@ -152,11 +625,12 @@ __global__ void lbvh_compress_ropes(const LBVHCompressedData ctree,
  * During traversal, an image processes the entire tree, and then advances to the next
  * image once traversal terminates. A maximum of 32 images is supported.
  */
-template<class OutputOpT, class QueryOpT, class TranslateOpT>
+template<class OutputOpT, class QueryOpT, class TranslateOpT, class CounterT>
 __global__ void lbvh_traverse_ropes(const OutputOpT out,
                                     const LBVHCompressedData lbvh,
                                     const QueryOpT query,
-                                    const TranslateOpT images)
+                                    const TranslateOpT images,
+                                    const CounterT counter)
     {
     // one thread per test
     const unsigned int idx = hipper::threadRank<1,1>();
@@ -173,82 +647,130 @@ __global__ void lbvh_traverse_ropes(const OutputOpT out,
         }
     __syncthreads();
 
-    // query thread data
-    const typename QueryOpT::ThreadData qdata = query.setup(idx);
-    typename OutputOpT::ThreadData result = out.setup(idx, qdata);
+    lbvh_traverse_query(out, lbvh, tree_box, tree_bins, query, images, idx, NULL, -1, NULL, counter);
+    }
 
-    // find image flags against root before divergence
-    unsigned int flags = 0;
-    const int nbits = (images.size() <= 32u) ? images.size() : 32;
-    for (unsigned int i=0; i < nbits; ++i)
-        {
-        const typename TranslateOpT::type image = images.get(i);
-        const typename QueryOpT::Volume q = query.get(qdata,image);
-        if (query.overlap(q,tree_box)) flags |= 1u << i;
-        }
+//! Kernel to map primitives to their leaves.
+/*!
+ * \param d_leaves Leaf of each primitive.
+ * \param d_primitives Primitive of each leaf.
+ * \param N_internal Number of internal nodes in LBVH.
+ * \param N Number of primitives.
+ *
+ * One thread is used per leaf. Primitives with an index of \a N or larger are not mapped.
+ */
+__global__ static void lbvh_map_leaves(int* d_leaves,
+                                       const unsigned int* d_primitives,
+                                       const unsigned int N_internal,
+                                       const unsigned int N)
+    {
+    const unsigned int idx = hipper::threadRank<1,1>();
+    if (idx >= N)
+        return;
 
-    // stackless search
-    do
+    const unsigned int primitive = d_primitives[idx];
+    if (primitive < N)
+        d_leaves[primitive] = N_internal + idx;
+    }
+
+//! Kernel to traverse the LBVH using ropes, starting self-queries from their leaves.
+/*!
+ * \param out Output operation for intersected primitives.
+ * \param lbvh Compressed LBVH data to traverse.
+ * \param parents Parent of each node of the LBVH.
+ * \param leaves Leaf of each primitive, or -1 if it is not in the LBVH.
+ * \param N_leaves Number of entries in \a leaves.
+ * \param query Query operation.
+ * \param images Translation operation.
+ * \param counter Traversal statistics policy.
+ *
+ * \tparam OutputOpT The type of output operation.
+ * \tparam QueryOpT The type of query operation.
+ * \tparam TranslateOpT The type of translation operation.
+ * \tparam CounterT The type of statistics policy.
+ *
+ * This is the same as ::lbvh_traverse_ropes, except that query \a idx traverses the self image
+ * starting from the leaf of primitive \a idx (see neighbor::lbvh_traverse_from_leaf).
+ */
+template<class OutputOpT, class QueryOpT, class TranslateOpT, class CounterT>
+__global__ void lbvh_traverse_self_ropes(const OutputOpT out,
+                                         const LBVHCompressedData lbvh,
+                                         const int* parents,
+                                         const int* leaves,
+                                         const unsigned int N_leaves,
+                                         const QueryOpT query,
+                                         const TranslateOpT images,
+                                         const CounterT counter)
+    {
+    // one thread per test
+    const unsigned int idx = hipper::threadRank<1,1>();
+    if (idx >= query.size())
+        return;
+
+    // load tree compression sizes into shared memory
+    __shared__ BoundingBox tree_box;
+    __shared__ float3 tree_bins;
+    if (threadIdx.x == 0)
         {
-        // look for the next image
-        int image_bit = __ffs(flags);
-        if (image_bit)
-            {
-            // shift the lsb by 1 to get the image index
-            --image_bit;
+        tree_box = BoundingBox(*lbvh.lo, *lbvh.hi);
+        tree_bins = *lbvh.bins;
+        }
+    __syncthreads();
 
-            // unset the bit from this image
-            flags &= ~(1u << image_bit);
-            }
-        else
-            {
-            // no more images, quit
-            break;
-            }
+    const int leaf = (idx < N_leaves) ? leaves[idx] : -1;
+    lbvh_traverse_query(out, lbvh, tree_box, tree_bins, query, images, idx, parents, leaf, NULL, counter);
+    }
 
-        // move the sphere to the next image
-        const typename TranslateOpT::type image = images.get(image_bit);
-        typename QueryOpT::Volume q = query.get(qdata, image);
+//! Kernel to traverse the LBVH using ropes, starting from cached entry nodes.
+/*!
+ * \param out Output operation for intersected primitives.
+ * \param lbvh Compressed LBVH data to traverse.
+ * \param parents Parent of each node of the LBVH.
+ * \param entries Entry node of each query, which is updated.
+ * \param N_nodes Number of nodes in the LBVH.
+ * \param query Query operation.
+ * \param images Translation operation.
+ * \param counter Traversal statistics policy.
+ *
+ * \tparam OutputOpT The type of output operation.
+ * \tparam QueryOpT The type of query operation.
+ * \tparam TranslateOpT The type of translation operation.
+ * \tparam CounterT The type of statistics policy.
+ *
+ * This is the same as ::lbvh_traverse_ropes, except that query \a idx traverses the self image
+ * starting from its entry (see neighbor::lbvh_traverse_from_entry). Entries that are not
+ * a node of the LBVH are replaced by the root.
+ */
+template<class OutputOpT, class QueryOpT, class TranslateOpT, class CounterT>
+__global__ void lbvh_traverse_cached_ropes(const OutputOpT out,
+                                           const LBVHCompressedData lbvh,
+                                           const int* parents,
+                                           int* entries,
+                                           const unsigned int N_nodes,
+                                           const QueryOpT query,
+                                           const TranslateOpT images,
+                                           const CounterT counter)
+    {
+    // one thread per test
+    const unsigned int idx = hipper::threadRank<1,1>();
+    if (idx >= query.size())
+        return;
 
-        int node = lbvh.root;
-        while (node != LBVHSentinel)
-            {
-            // load node and decompress bounds so that they always *expand*
-            const int4 aabb = __ldg(lbvh.data + node);
-            const unsigned int lo = aabb.x;
-            const float3 lof = make_float3(approx::fadd_rd(tree_box.lo.x, approx::fmul_rd((lo >> 20) & 0x3ffu,tree_bins.x)),
-                                           approx::fadd_rd(tree_box.lo.y, approx::fmul_rd((lo >> 10) & 0x3ffu,tree_bins.y)),
-                                           approx::fadd_rd(tree_box.lo.z, approx::fmul_rd((lo      ) & 0x3ffu,tree_bins.z)));
-
-            const unsigned int hi = aabb.y;
-            const float3 hif = make_float3(approx::fsub_ru(tree_box.hi.x, approx::fmul_rd((hi >> 20) & 0x3ffu,tree_bins.x)),
-                                           approx::fsub_ru(tree_box.hi.y, approx::fmul_rd((hi >> 10) & 0x3ffu,tree_bins.y)),
-                                           approx::fsub_ru(tree_box.hi.z, approx::fmul_rd((hi      ) & 0x3ffu,tree_bins.z)));
-            const int left = aabb.z;
-
-            // advance to rope as a preliminary
-            node = aabb.w;
-
-            // if overlap, do work with primitive. otherwise, rope ahead
-            if (query.overlap(q, BoundingBox(lof,hif)))
-                {
-                if(left < 0)
-                    {
-                    const int primitive = ~left;
-                    if (query.refine(qdata,primitive))
-                        out.process(result,primitive);
-                    // leaf nodes always move to their rope
-                    }
-                else
-                    {
-                    // internal node takes left child
-                    node = left;
-                    }
-                }
-            } // end stackless search
-        } while(true);
+    // load tree compression sizes into shared memory
+    __shared__ BoundingBox tree_box;
+    __shared__ float3 tree_bins;
+    if (threadIdx.x == 0)
+        {
+        tree_box = BoundingBox(*lbvh.lo, *lbvh.hi);
+        tree_bins = *lbvh.bins;
+        }
+    __syncthreads();
 
-    out.finalize(result);
+    int entry = entries[idx];
+    if (entry < 0 || entry >= (int)N_nodes)
+        entry = lbvh.root;
+    lbvh_traverse_query(out, lbvh, tree_box, tree_bins, query, images, idx, parents, -1, &entry, counter);
+    entries[idx] = entry;
     }
 } // end namespace kernel
 
@@ -298,20 +820,164 @@ void lbvh_compress_ropes(const LBVHCompressedData& ctree,
  * \param images Translation operation.
  * \param block_size Number of CUDA threads per block.
  * \param stream CUDA stream for kernel execution.
+ * \param counter Traversal statistics policy.
  *
  * \tparam OutputOpT The type of output operation.
  * \tparam QueryOpT The type of query operation.
  * \tparam TranslateOpT The type of translation operation.
+ * \tparam CounterT The type of statistics policy.
  *
  * \sa kernel::lbvh_traverse_ropes
  */
-template<class OutputOpT, class QueryOpT, class TranslateOpT>
+template<class OutputOpT, class QueryOpT, class TranslateOpT, class CounterT = NullTraversalCounter>
 void lbvh_traverse_ropes(const OutputOpT& out,
                          const LBVHCompressedData& lbvh,
                          const QueryOpT& query,
                          const TranslateOpT& images,
                          unsigned int block_size,
-                         hipper::stream_t stream)
+                         hipper::stream_t stream,
+                         const CounterT& counter = CounterT())
+    {
+    // quit if there are no images
+    if (query.size() == 0 || images.size() == 0)
+        return;
+
+    // clamp block size
+    static unsigned int max_block_size = UINT_MAX;
+    if (max_block_size == UINT_MAX)
+        {
+        hipper::funcAttributes_t attr;
+        hipper::funcGetAttributes(&attr, reinterpret_cast<const void*>(kernel::lbvh_traverse_ropes<OutputOpT,QueryOpT,TranslateOpT,CounterT>));
+        max_block_size = attr.maxThreadsPerBlock;
+        }
+    const unsigned int run_block_size = (block_size < max_block_size) ? block_size : max_block_size;
+    const unsigned int num_blocks = (query.size() + run_block_size - 1)/run_block_size;
+
+    hipper::KernelLauncher launcher(num_blocks, run_block_size, stream);
+    launcher(kernel::lbvh_traverse_ropes<OutputOpT,QueryOpT,TranslateOpT,CounterT>, out, lbvh, query, images, counter);
+    }
+
+//! Map primitives to their leaves.
+/*!
+ * \param d_leaves Leaf of each primitive.
+ * \param d_primitives Primitive of each leaf.
+ * \param N_internal Number of internal nodes in LBVH.
+ * \param N Number of primitives.
+ * \param block_size Number of CUDA threads per block.
+ * \param stream CUDA stream for kernel execution.
+ *
+ * The leaves are first set to -1, so primitives that are not mapped have no leaf.
+ *
+ * \sa kernel::lbvh_map_leaves
+ */
+inline void lbvh_map_leaves(int* d_leaves,
+                            const unsigned int* d_primitives,
+                            unsigned int N_internal,
+                            unsigned int N,
+                            unsigned int block_size,
+                            hipper::stream_t stream)
+    {
+    if (N == 0) return;
+    hipper::memsetAsync(d_leaves, 0xff, N*sizeof(int), stream);
+
+    // clamp block size
+    static unsigned int max_block_size = UINT_MAX;
+    if (max_block_size == UINT_MAX)
+        {
+        hipper::funcAttributes_t attr;
+        hipper::funcGetAttributes(&attr, reinterpret_cast<const void*>(kernel::lbvh_map_leaves));
+        max_block_size = attr.maxThreadsPerBlock;
+        }
+    const unsigned int run_block_size = (block_size < max_block_size) ? block_size : max_block_size;
+    const unsigned int num_blocks = (N + run_block_size - 1)/run_block_size;
+
+    hipper::KernelLauncher launcher(num_blocks, run_block_size, stream);
+    launcher(kernel::lbvh_map_leaves, d_leaves, d_primitives, N_internal, N);
+    }
+
+//! Traverse the LBVH using ropes, starting self-queries from their leaves.
+/*!
+ * \param out Output operation for intersected primitives.
+ * \param lbvh Compressed LBVH data to traverse.
+ * \param parents Parent of each node of the LBVH.
+ * \param leaves Leaf of each primitive, or -1 if it is not in the LBVH.
+ * \param N_leaves Number of entries in \a leaves.
+ * \param query Query operation.
+ * \param images Translation operation.
+ * \param block_size Number of CUDA threads per block.
+ * \param stream CUDA stream for kernel execution.
+ * \param counter Traversal statistics policy.
+ *
+ * \tparam OutputOpT The type of output operation.
+ * \tparam QueryOpT The type of query operation.
+ * \tparam TranslateOpT The type of translation operation.
+ * \tparam CounterT The type of statistics policy.
+ *
+ * \sa kernel::lbvh_traverse_self_ropes
+ */
+template<class OutputOpT, class QueryOpT, class TranslateOpT, class CounterT = NullTraversalCounter>
+void lbvh_traverse_self_ropes(const OutputOpT& out,
+                              const LBVHCompressedData& lbvh,
+                              const int* parents,
+                              const int* leaves,
+                              unsigned int N_leaves,
+                              const QueryOpT& query,
+                              const TranslateOpT& images,
+                              unsigned int block_size,
+                              hipper::stream_t stream,
+                              const CounterT& counter = CounterT())
+    {
+    // quit if there are no images
+    if (query.size() == 0 || images.size() == 0)
+        return;
+
+    // clamp block size
+    static unsigned int max_block_size = UINT_MAX;
+    if (max_block_size == UINT_MAX)
+        {
+        hipper::funcAttributes_t attr;
+        hipper::funcGetAttributes(&attr, reinterpret_cast<const void*>(kernel::lbvh_traverse_self_ropes<OutputOpT,QueryOpT,TranslateOpT,CounterT>));
+        max_block_size = attr.maxThreadsPerBlock;
+        }
+    const unsigned int run_block_size = (block_size < max_block_size) ? block_size : max_block_size;
+    const unsigned int num_blocks = (query.size() + run_block_size - 1)/run_block_size;
+
+    hipper::KernelLauncher launcher(num_blocks, run_block_size, stream);
+    launcher(kernel::lbvh_traverse_self_ropes<OutputOpT,QueryOpT,TranslateOpT,CounterT>,
+             out, lbvh, parents, leaves, N_leaves, query, images, counter);
+    }
+
+//! Traverse the LBVH using ropes, starting from cached entry nodes.
+/*!
+ * \param out Output operation for intersected primitives.
+ * \param lbvh Compressed LBVH data to traverse.
+ * \param parents Parent of each node of the LBVH.
+ * \param entries Entry node of each query, which is updated.
+ * \param N_nodes Number of nodes in the LBVH.
+ * \param query Query operation.
+ * \param images Translation operation.
+ * \param block_size Number of CUDA threads per block.
+ * \param stream CUDA stream for kernel execution.
+ * \param counter Traversal statistics policy.
+ *
+ * \tparam OutputOpT The type of output operation.
+ * \tparam QueryOpT The type of query operation.
+ * \tparam TranslateOpT The type of translation operation.
+ * \tparam CounterT The type of statistics policy.
+ *
+ * \sa kernel::lbvh_traverse_cached_ropes
+ */
+template<class OutputOpT, class QueryOpT, class TranslateOpT, class CounterT = NullTraversalCounter>
+void lbvh_traverse_cached_ropes(const OutputOpT& out,
+                                const LBVHCompressedData& lbvh,
+                                const int* parents,
+                                int* entries,
+                                unsigned int N_nodes,
+                                const QueryOpT& query,
+                                const TranslateOpT& images,
+                                unsigned int block_size,
+                                hipper::stream_t stream,
+                                const CounterT& counter = CounterT())
     {
     // quit if there are no images
     if (query.size() == 0 || images.size() == 0)
@@ -322,17 +988,21 @@ void lbvh_traverse_ropes(const OutputOpT& out,
     if (max_block_size == UINT_MAX)
         {
         hipper::funcAttributes_t attr;
-        hipper::funcGetAttributes(&attr, reinterpret_cast<const void*>(kernel::lbvh_traverse_ropes<OutputOpT,QueryOpT,TranslateOpT>));
+        hipper::funcGetAttributes(&attr, reinterpret_cast<const void*>(kernel::lbvh_traverse_cached_ropes<OutputOpT,QueryOpT,TranslateOpT,CounterT>));
         max_block_size = attr.maxThreadsPerBlock;
         }
     const unsigned int run_block_size = (block_size < max_block_size) ? block_size : max_block_size;
     const unsigned int num_blocks = (query.size() + run_block_size - 1)/run_block_size;
 
     hipper::KernelLauncher launcher(num_blocks, run_block_size, stream);
-    launcher(kernel::lbvh_traverse_ropes<OutputOpT,QueryOpT,TranslateOpT>, out, lbvh, query, images);
+    launcher(kernel::lbvh_traverse_cached_ropes<OutputOpT,QueryOpT,TranslateOpT,CounterT>,
+             out, lbvh, parents, entries, N_nodes, query, images, counter);
     }
 
 } // end namespace gpu
+#endif // __CUDACC__ || __HIPCC__
 } // end namespace neighbor
 
+#undef HOSTDEVICE
+
 #endif // NEIGHBOR_LBVH_TRAVERSER_CUH_
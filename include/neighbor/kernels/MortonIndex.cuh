@@ -0,0 +1,252 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+#ifndef NEIGHBOR_KERNELS_MORTON_INDEX_CUH_
+#define NEIGHBOR_KERNELS_MORTON_INDEX_CUH_
+
+// the kernels are only compiled by a device compiler, so host-only code can include this header
+#if defined(__CUDACC__) || defined(__HIPCC__)
+
+#include <hipper/hipper_runtime.h>
+
+#include "../BoundingVolumes.h"
+#include "../MortonCode.h"
+#include "../OutputOps.h"
+
+namespace neighbor
+{
+namespace gpu
+{
+namespace kernel
+{
+//! Kernel to fit the primitives in sorted order
+/*!
+ * \param d_lo Lower bound of each sorted primitive.
+ * \param d_hi Upper bound of each sorted primitive.
+ * \param d_indexes Sorted primitive indexes.
+ * \param insert Insert operation.
+ * \param N Number of primitives.
+ *
+ * \tparam InsertOpT the kind of insert operation
+ *
+ * One thread is used per primitive. The bounds are stored in sorted order so that
+ * they can be read contiguously during a query.
+ */
+template<class InsertOpT>
+__global__ void morton_index_fit(float3 *d_lo,
+                                 float3 *d_hi,
+                                 const unsigned int *d_indexes,
+                                 const InsertOpT insert,
+                                 const unsigned int N)
+    {
+    const unsigned int idx = hipper::threadRank<1,1>();
+    if (idx >= N)
+        return;
+
+    const BoundingBox b = insert.get(d_indexes[idx]);
+    d_lo[idx] = b.lo;
+    d_hi[idx] = b.hi;
+    }
+
+//! Find the first sorted Morton code that is not less than a value.
+/*!
+ * \param d_codes Sorted Morton codes.
+ * \param first First code to search.
+ * \param last One past the last code to search.
+ * \param code Code to find.
+ *
+ * \returns The index of the first code in [first,last) that is not less than \a code, or \a last.
+ */
+__device__ __forceinline__ unsigned int morton_index_lower_bound(const unsigned int *d_codes,
+                                                                 unsigned int first,
+                                                                 unsigned int last,
+                                                                 const unsigned int code)
+    {
+    while (first < last)
+        {
+        const unsigned int mid = first + ((last-first) >> 1);
+        if (d_codes[mid] < code)
+            first = mid + 1;
+        else
+            last = mid;
+        }
+    return first;
+    }
+
+//! Kernel to answer box queries with sorted Morton codes
+/*!
+ * \param out Output operation for intersected primitives.
+ * \param d_codes Sorted Morton codes.
+ * \param d_primitives Sorted primitive indexes.
+ * \param d_lo Lower bound of each sorted primitive.
+ * \param d_hi Upper bound of each sorted primitive.
+ * \param lo Lower bound of scene.
+ * \param hi Upper bound of scene.
+ * \param N Number of primitives.
+ * \param query Query operation, whose volume must be a BoundingBox.
+ * \param images Translation operation.
+ *
+ * \tparam OutputOpT The type of output operation.
+ * \tparam QueryOpT The type of query operation.
+ * \tparam TranslateOpT The type of translation operation.
+ *
+ * One thread is used per query. For each image, the box is binned in the same way as the primitives,
+ * which gives the Morton codes of its lower and upper corners. Since points outside the scene are
+ * clamped into it, the box is clamped in the same way. The sorted codes are then scanned from the
+ * first code not less than the lower corner to the upper corner. Codes inside the box are tested
+ * against the query, while the first code outside the box ends the run of codes inside it, and the
+ * search jumps ahead to the next code inside the box (see ::mortonBigMin) by binary search.
+ */
+template<class OutputOpT, class QueryOpT, class TranslateOpT>
+__global__ void morton_index_query(const OutputOpT out,
+                                   const unsigned int *d_codes,
+                                   const unsigned int *d_primitives,
+                                   const float3 *d_lo,
+                                   const float3 *d_hi,
+                                   const float3 lo,
+                                   const float3 hi,
+                                   const unsigned int N,
+                                   const QueryOpT query,
+                                   const TranslateOpT images)
+    {
+    // one thread per query
+    const unsigned int idx = hipper::threadRank<1,1>();
+    if (idx >= query.size())
+        return;
+
+    const typename QueryOpT::ThreadData qdata = query.setup(idx);
+    typename OutputOpT::ThreadData result = out.setup(idx, qdata);
+
+    bool done = false;
+    for (unsigned int i=0; !done && i < images.size(); ++i)
+        {
+        const BoundingBox q = query.get(qdata, images.get(i));
+
+        // skip boxes that are empty after translation
+        if (q.lo.x > q.hi.x || q.lo.y > q.hi.y || q.lo.z > q.hi.z)
+            continue;
+
+        const unsigned int zmin = calcMortonCode(q.lo, lo, hi);
+        const unsigned int zmax = calcMortonCode(q.hi, lo, hi);
+
+        unsigned int j = morton_index_lower_bound(d_codes, 0, N, zmin);
+        while (!done && j < N)
+            {
+            const unsigned int code = d_codes[j];
+            if (code > zmax)
+                break;
+
+            if (mortonInBox(code, zmin, zmax))
+                {
+                const int primitive = d_primitives[j];
+                if (query.overlap(q, BoundingBox(d_lo[j], d_hi[j])) && query.refine(qdata, primitive))
+                    done = output_process(out, result, primitive);
+                ++j;
+                }
+            else
+                {
+                j = morton_index_lower_bound(d_codes, j+1, N, mortonBigMin(code, zmin, zmax));
+                }
+            }
+        }
+
+    out.finalize(result);
+    }
+} // end namespace kernel
+
+//! Fit the primitives in sorted order.
+/*!
+ * \param d_lo Lower bound of each sorted primitive.
+ * \param d_hi Upper bound of each sorted primitive.
+ * \param d_indexes Sorted primitive indexes.
+ * \param insert Insert operation.
+ * \param N Number of primitives.
+ * \param block_size Number of CUDA threads per block.
+ * \param stream CUDA stream for kernel execution.
+ *
+ * \tparam InsertOpT the kind of insert operation
+ *
+ * \sa kernel::morton_index_fit
+ */
+template<class InsertOpT>
+void morton_index_fit(float3 *d_lo,
+                      float3 *d_hi,
+                      const unsigned int *d_indexes,
+                      const InsertOpT& insert,
+                      const unsigned int N,
+                      const unsigned int block_size,
+                      hipper::stream_t stream)
+    {
+    // clamp block size
+    static unsigned int max_block_size = UINT_MAX;
+    if (max_block_size == UINT_MAX)
+        {
+        hipper::funcAttributes_t attr;
+        hipper::funcGetAttributes(&attr, reinterpret_cast<const void*>(kernel::morton_index_fit<InsertOpT>));
+        max_block_size = attr.maxThreadsPerBlock;
+        }
+    const unsigned int run_block_size = (block_size < max_block_size) ? block_size : max_block_size;
+    const unsigned int num_blocks = (N + run_block_size - 1)/run_block_size;
+
+    hipper::KernelLauncher launcher(num_blocks, run_block_size, stream);
+    launcher(kernel::morton_index_fit<InsertOpT>, d_lo, d_hi, d_indexes, insert, N);
+    }
+
+//! Answer box queries with sorted Morton codes.
+/*!
+ * \param out Output operation for intersected primitives.
+ * \param d_codes Sorted Morton codes.
+ * \param d_primitives Sorted primitive indexes.
+ * \param d_lo Lower bound of each sorted primitive.
+ * \param d_hi Upper bound of each sorted primitive.
+ * \param lo Lower bound of scene.
+ * \param hi Upper bound of scene.
+ * \param N Number of primitives.
+ * \param query Query operation, whose volume must be a BoundingBox.
+ * \param images Translation operation.
+ * \param block_size Number of CUDA threads per block.
+ * \param stream CUDA stream for kernel execution.
+ *
+ * \tparam OutputOpT The type of output operation.
+ * \tparam QueryOpT The type of query operation.
+ * \tparam TranslateOpT The type of translation operation.
+ *
+ * \sa kernel::morton_index_query
+ */
+template<class OutputOpT, class QueryOpT, class TranslateOpT>
+void morton_index_query(const OutputOpT& out,
+                        const unsigned int *d_codes,
+                        const unsigned int *d_primitives,
+                        const float3 *d_lo,
+                        const float3 *d_hi,
+                        const float3& lo,
+                        const float3& hi,
+                        const unsigned int N,
+                        const QueryOpT& query,
+                        const TranslateOpT& images,
+                        const unsigned int block_size,
+                        hipper::stream_t stream)
+    {
+    // clamp block size
+    static unsigned int max_block_size = UINT_MAX;
+    if (max_block_size == UINT_MAX)
+        {
+        hipper::funcAttributes_t attr;
+        hipper::funcGetAttributes(&attr, reinterpret_cast<const void*>(kernel::morton_index_query<OutputOpT,QueryOpT,TranslateOpT>));
+        max_block_size = attr.maxThreadsPerBlock;
+        }
+    const unsigned int run_block_size = (block_size < max_block_size) ? block_size : max_block_size;
+    const unsigned int num_blocks = (query.size() + run_block_size - 1)/run_block_size;
+
+    hipper::KernelLauncher launcher(num_blocks, run_block_size, stream);
+    launcher(kernel::morton_index_query<OutputOpT,QueryOpT,TranslateOpT>,
+             out, d_codes, d_primitives, d_lo, d_hi, lo, hi, N, query, images);
+    }
+
+} // end namespace gpu
+} // end namespace neighbor
+
+#endif // __CUDACC__ || __HIPCC__
+
+#endif // NEIGHBOR_KERNELS_MORTON_INDEX_CUH_
@@ -15,6 +15,36 @@
 
 // LBVH API
 #include "LBVH.h"
+#include "LBVHForest.h"
+#include "LBVHQuality.h"
 #include "LBVHTraverser.h"
+#include "LazyLBVH.h"
+#include "TraversalStatistics.h"
+
+// Cell list API
+#include "AdaptiveSearch.h"
+#include "CellList.h"
+
+// Tuning API
+#include "Autotuner.h"
+#include "PhaseTimer.h"
+#include "Tracer.h"
+#include "TuningCache.h"
+#include "TuningSpace.h"
+#include "host/HardwareCounters.h"
+
+// Memory API
+#include "Allocator.h"
+#include "Memory.h"
+#include "host/HostAllocator.h"
+
+// Trajectory API
+#include "host/TrajectoryReader.h"
+
+// Morton code API (the MortonIndex only runs on the GPU, so it needs a device compiler)
+#include "MortonCode.h"
+#if defined(__CUDACC__) || defined(__HIPCC__)
+#include "MortonIndex.h"
+#endif
 
 #endif // NEIGHBOR_NEIGHBOR_H_
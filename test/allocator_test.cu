@@ -0,0 +1,262 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#include <hipper/hipper_runtime.h>
+
+#include "neighbor/neighbor.h"
+
+#include <cstdint>
+#include <random>
+
+#include "upp11_config.h"
+UP_MAIN();
+
+//! Allocator that counts its allocations and can fail.
+class CountingAllocator : public neighbor::Allocator
+    {
+    public:
+        CountingAllocator() : allocations(0), frees(0), bytes(0), fail(false) {}
+
+        void* allocate(size_t size) override
+            {
+            if (fail) throw std::runtime_error("Out of memory.");
+            ++allocations;
+            bytes += size;
+            return new char[size];
+            }
+
+        void deallocate(void* ptr, size_t size) override
+            {
+            ++frees;
+            bytes -= size;
+            delete[] static_cast<char*>(ptr);
+            }
+
+        unsigned int allocations;
+        unsigned int frees;
+        size_t bytes;
+        bool fail;
+    };
+
+// Test the size classes of the caching allocator
+UP_TEST( caching_allocator_size_class_test )
+    {
+    UP_ASSERT_EQUAL(neighbor::CachingAllocator::getSizeClass(1), 256);
+    UP_ASSERT_EQUAL(neighbor::CachingAllocator::getSizeClass(256), 256);
+    UP_ASSERT_EQUAL(neighbor::CachingAllocator::getSizeClass(257), 320);
+    UP_ASSERT_EQUAL(neighbor::CachingAllocator::getSizeClass(1024), 1024);
+    UP_ASSERT_EQUAL(neighbor::CachingAllocator::getSizeClass(1025), 1280);
+    UP_ASSERT_EQUAL(neighbor::CachingAllocator::getSizeClass(1500), 1536);
+    UP_ASSERT_EQUAL(neighbor::CachingAllocator::getSizeClass(2000), 2048);
+
+    // classes are never more than 25% larger than the request
+    std::mt19937 mt(42);
+    std::uniform_int_distribution<size_t> U(257, 100000000);
+    for (unsigned int i=0; i < 1000; ++i)
+        {
+        const size_t bytes = U(mt);
+        const size_t size = neighbor::CachingAllocator::getSizeClass(bytes);
+        UP_ASSERT(size >= bytes);
+        UP_ASSERT(4*size <= 5*bytes + 4);
+        UP_ASSERT_EQUAL(neighbor::CachingAllocator::getSizeClass(size), size);
+        }
+    }
+
+// Test that the caching allocator recycles blocks
+UP_TEST( caching_allocator_test )
+    {
+    auto upstream = std::make_shared<CountingAllocator>();
+    auto cache = std::make_shared<neighbor::CachingAllocator>(upstream);
+    UP_ASSERT(cache->getUpstream() == upstream);
+    UP_ASSERT(cache->getSynchronize());
+    UP_ASSERT(!neighbor::CachingAllocator(upstream, 0, false).getSynchronize());
+
+    void* a = cache->allocate(1000);
+    UP_ASSERT_EQUAL(upstream->allocations, 1);
+    UP_ASSERT_EQUAL(cache->getAllocatedBytes(), 1024);
+    cache->deallocate(a, 1000);
+    UP_ASSERT_EQUAL(upstream->frees, 0);
+    UP_ASSERT_EQUAL(cache->getCachedBytes(), 1024);
+    UP_ASSERT_EQUAL(cache->getAllocatedBytes(), 0);
+
+    // same class is reused, other class is not
+    void* b = cache->allocate(900);
+    UP_ASSERT(b == a);
+    UP_ASSERT_EQUAL(cache->getHits(), 1);
+    void* c = cache->allocate(2000);
+    UP_ASSERT(c != a);
+    UP_ASSERT_EQUAL(cache->getMisses(), 2);
+    UP_ASSERT_EQUAL(upstream->allocations, 2);
+    cache->deallocate(b, 900);
+    cache->deallocate(c, 2000);
+    UP_ASSERT_EQUAL(cache->getCachedBytes(), 1024+2048);
+
+    // upstream failure releases the cache and retries
+    upstream->fail = true;
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ cache->allocate(5000); });
+    UP_ASSERT_EQUAL(cache->getCachedBytes(), 0);
+    UP_ASSERT_EQUAL(upstream->frees, 2);
+    UP_ASSERT_EQUAL(upstream->bytes, 0);
+    upstream->fail = false;
+
+    // release returns cached blocks upstream
+    void* f = cache->allocate(300);
+    cache->deallocate(f, 300);
+    UP_ASSERT_EQUAL(cache->getCachedBytes(), 320);
+    cache->release();
+    UP_ASSERT_EQUAL(cache->getCachedBytes(), 0);
+    UP_ASSERT_EQUAL(upstream->frees, 3);
+    UP_ASSERT_EQUAL(upstream->bytes, 0);
+
+    // blocks that do not fit in the cache are returned upstream
+    auto small = std::make_shared<neighbor::CachingAllocator>(upstream, 1500);
+    void* d = small->allocate(1000);
+    void* e = small->allocate(1000);
+    small->deallocate(d, 1000);
+    small->deallocate(e, 1000);
+    UP_ASSERT_EQUAL(small->getCachedBytes(), 1024);
+    UP_ASSERT_EQUAL(upstream->frees, 4);
+    small.reset();
+    UP_ASSERT_EQUAL(upstream->bytes, 0);
+    }
+
+// Test the host allocator
+UP_TEST( host_allocator_test )
+    {
+    UP_ASSERT_EXCEPTION(std::runtime_error, []{ neighbor::host::HostAllocator(48); });
+    UP_ASSERT_EXCEPTION(std::runtime_error, []{ neighbor::host::HostAllocator(2); });
+
+    neighbor::host::HostAllocator alloc(128, 65536);
+    UP_ASSERT_EQUAL(alloc.getAlignment(), 128);
+    UP_ASSERT_EQUAL(alloc.getMapThreshold(), 65536);
+
+    // aligned and mapped blocks can be written
+    const size_t sizes[] = {1, 100, 4096, 65536, 1000000};
+    for (size_t bytes : sizes)
+        {
+        void* ptr = alloc.allocate(bytes);
+        UP_ASSERT(ptr != nullptr);
+        UP_ASSERT_EQUAL(reinterpret_cast<uintptr_t>(ptr) % 128, 0);
+        unsigned char* data = static_cast<unsigned char*>(ptr);
+        for (size_t i=0; i < bytes; ++i) data[i] = static_cast<unsigned char>(i);
+        UP_ASSERT_EQUAL(data[bytes-1], static_cast<unsigned char>(bytes-1));
+        alloc.deallocate(ptr, bytes);
+        }
+
+    // mapped blocks are also aligned to more than a page
+    const size_t big_alignment = 1 << 21;
+    neighbor::host::HostAllocator big(big_alignment, 65536);
+    for (size_t bytes : {size_t(65536), size_t(1000000), size_t(3000000)})
+        {
+        for (unsigned int i=0; i < 4; ++i)
+            {
+            void* ptr = big.allocate(bytes);
+            UP_ASSERT_EQUAL(reinterpret_cast<uintptr_t>(ptr) % big_alignment, 0);
+            unsigned char* data = static_cast<unsigned char*>(ptr);
+            data[0] = 1;
+            data[bytes-1] = 2;
+            UP_ASSERT_EQUAL(data[0] + data[bytes-1], 3);
+            big.deallocate(ptr, bytes);
+            }
+        }
+    }
+
+// Test shared_array with allocators
+UP_TEST( shared_array_allocator_test )
+    {
+    auto upstream = std::make_shared<CountingAllocator>();
+        {
+        neighbor::shared_array<float> a(100, upstream);
+        UP_ASSERT_EQUAL(a.size(), 100);
+        UP_ASSERT(a.getAllocator() == upstream);
+        UP_ASSERT_EQUAL(upstream->allocations, 1);
+        UP_ASSERT_EQUAL(upstream->bytes, 100*sizeof(float));
+
+        // copies share the memory
+        neighbor::shared_array<float> b = a;
+        a = neighbor::shared_array<float>();
+        UP_ASSERT(!a.getAllocator());
+        UP_ASSERT_EQUAL(upstream->frees, 0);
+        }
+    UP_ASSERT_EQUAL(upstream->frees, 1);
+    UP_ASSERT_EQUAL(upstream->bytes, 0);
+
+    // failed allocation leaves an empty array
+    upstream->fail = true;
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ neighbor::shared_array<int> c(10, upstream); });
+    upstream->fail = false;
+
+    // the default allocator is used for new arrays
+    auto managed = neighbor::Allocator::getDefault();
+    UP_ASSERT(managed != nullptr);
+    UP_ASSERT(neighbor::shared_array<int>(1).getAllocator() == managed);
+    neighbor::Allocator::setDefault(upstream);
+    neighbor::shared_array<int> d(10);
+    UP_ASSERT(d.getAllocator() == upstream);
+    UP_ASSERT_EQUAL(upstream->allocations, 2);
+    neighbor::Allocator::setDefault(nullptr);
+    UP_ASSERT(neighbor::shared_array<int>(1).getAllocator() != upstream);
+    UP_ASSERT(d.getAllocator() == upstream);
+    }
+
+// Test that LBVHs and traversers of different sizes recycle memory through the default allocator
+UP_TEST( lbvh_caching_allocator_test )
+    {
+    auto upstream = std::make_shared<CountingAllocator>();
+    auto cache = std::make_shared<neighbor::CachingAllocator>(upstream);
+    neighbor::Allocator::setDefault(cache);
+
+    const float L = 10.f;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(L, L, L);
+    std::mt19937 mt(7);
+    std::uniform_real_distribution<float> U(0.f, L);
+    neighbor::host::ThreadPool pool(2);
+    neighbor::shared_array<float3> images(1);
+    images[0] = make_float3(0.f, 0.f, 0.f);
+    const neighbor::ImageListOp<float3> translate(images.get(), images.size());
+
+    const unsigned int Ns[] = {400, 500, 400, 500, 400};
+    unsigned long long misses = 0;
+    for (unsigned int n=0; n < 5; ++n)
+        {
+        const unsigned int N = Ns[n];
+        neighbor::shared_array<float3> points(N);
+        neighbor::shared_array<float4> spheres(N);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            points[i] = make_float3(U(mt), U(mt), U(mt));
+            spheres[i] = make_float4(points[i].x, points[i].y, points[i].z, 1.f);
+            }
+        neighbor::shared_array<unsigned int> hits(N);
+
+        neighbor::LBVH lbvh;
+        neighbor::LBVHTraverser traverser;
+        lbvh.build(pool, neighbor::PointInsertOp(points.get(), N), lo, hi);
+        traverser.traverse(pool,
+                           lbvh,
+                           neighbor::SphereQueryOp(spheres.get(), N),
+                           neighbor::CountNeighborsOp(hits.get()),
+                           translate);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            UP_ASSERT(hits[i] >= 1);
+            }
+
+        // after both sizes have been seen, the instances reuse the cached blocks
+        if (n == 1)
+            misses = cache->getMisses();
+        else if (n > 1)
+            UP_ASSERT_EQUAL(cache->getMisses(), misses);
+        }
+    UP_ASSERT(cache->getHits() > 0);
+    UP_ASSERT_EQUAL(cache->getAllocatedBytes(), 256);
+
+    neighbor::Allocator::setDefault(nullptr);
+    images = neighbor::shared_array<float3>();
+    cache.reset();
+    UP_ASSERT_EQUAL(upstream->bytes, 0);
+    }
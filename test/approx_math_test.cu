@@ -8,6 +8,8 @@
 
 #include "neighbor/neighbor.h"
 
+#include <cmath>
+
 #include "upp11_config.h"
 UP_MAIN();
 
@@ -83,12 +85,22 @@ __global__ void approx_math_kernel(float* result)
         result[26] = approx::fmaf_rd(-a,b,-c); // < -2.0f
         result[27] = approx::fmaf_ru(-a,b,-c); // = -2.0f
         }
+
+    // square root
+        {
+        const float a = 2.0f;
+        const float b = 4.0f;
+        result[28] = approx::fsqrt_rd(a); // < sqrt(2)
+        result[29] = approx::fsqrt_ru(a); // > sqrt(2)
+        result[30] = approx::fsqrt_rd(b); // <= 2.0f
+        result[31] = approx::fsqrt_ru(b); // >= 2.0f
+        }
     }
 
 UP_TEST( approx_math_test )
     {
-    // test the 7 functions in ApproximateMath.h in round down and round up modes, 2 tests each
-    neighbor::shared_array<float> result(7*2*2);
+    // test the 8 functions in ApproximateMath.h in round down and round up modes, 2 tests each
+    neighbor::shared_array<float> result(8*2*2);
 
     hipper::KernelLauncher launcher(1,1);
     launcher(approx_math_kernel, result.get());
@@ -129,4 +141,9 @@ UP_TEST( approx_math_test )
     UP_ASSERT_GREATER(result[25], 2.0f);
     UP_ASSERT_LESS(result[26], -2.0f);
     UP_ASSERT_GREATER_EQUAL(result[27], -2.0f);
+    // square root (loose test)
+    UP_ASSERT_LESS(result[28], std::sqrt(2.0));
+    UP_ASSERT_GREATER(result[29], std::sqrt(2.0));
+    UP_ASSERT_LESS_EQUAL(result[30], 2.0f);
+    UP_ASSERT_GREATER_EQUAL(result[31], 2.0f);
     }
@@ -0,0 +1,172 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#include <hipper/hipper_runtime.h>
+
+#include "neighbor/neighbor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "upp11_config.h"
+UP_MAIN();
+
+// Test that the autotuner scans the parameters and picks the fastest
+UP_TEST( autotuner_test )
+    {
+    const std::vector<unsigned int> empty;
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ neighbor::Autotuner<unsigned int> tuner(empty); });
+    UP_ASSERT_EXCEPTION(std::runtime_error, []{ neighbor::Autotuner<unsigned int> tuner({1, 2}, 0); });
+
+    // the call is fastest for the parameter 3
+    auto call = [](neighbor::Autotuner<unsigned int>& tuner)
+        {
+        const unsigned int p = tuner.getParameter();
+        tuner.begin();
+        std::this_thread::sleep_for(std::chrono::microseconds(500*((p > 3) ? p-3 : 3-p) + 200));
+        tuner.end();
+        };
+
+    for (auto statistic : {neighbor::Autotuner<unsigned int>::Statistic::Median,
+                           neighbor::Autotuner<unsigned int>::Statistic::TrimmedMean})
+        {
+        neighbor::Autotuner<unsigned int> tuner({1, 2, 3, 4, 5}, 4, 10);
+        tuner.setStatistic(statistic);
+        UP_ASSERT(tuner.getStatistic() == statistic);
+        UP_ASSERT_EQUAL(tuner.getNumSamples(), 4);
+        UP_ASSERT_EQUAL(tuner.getPeriod(), 10);
+        UP_ASSERT(tuner.isTuning());
+        UP_ASSERT_EQUAL(tuner.getBestTime(), 0.);
+
+        // each parameter is sampled in turn
+        for (unsigned int i=0; i < 20; ++i)
+            {
+            UP_ASSERT(tuner.isTuning());
+            UP_ASSERT_EQUAL(tuner.getParameter(), 1+i/4);
+            call(tuner);
+            }
+        UP_ASSERT(!tuner.isTuning());
+        UP_ASSERT_EQUAL(tuner.getParameter(), 3);
+        UP_ASSERT(tuner.getBestTime() > 0.);
+
+        // the next scan starts after the period
+        for (unsigned int i=0; i < 9; ++i)
+            {
+            call(tuner);
+            UP_ASSERT(!tuner.isTuning());
+            }
+        call(tuner);
+        UP_ASSERT(tuner.isTuning());
+        UP_ASSERT_EQUAL(tuner.getParameter(), 1);
+        }
+
+    // the problem size only triggers a scan when it moves to a different power of 2
+    neighbor::Autotuner<unsigned int> tuner({1, 2, 3, 4, 5}, 1, 0);
+    tuner.setProblemSize(1000);
+    for (unsigned int i=0; i < 5; ++i)
+        {
+        call(tuner);
+        }
+    UP_ASSERT(!tuner.isTuning());
+    tuner.setProblemSize(1000);
+    tuner.setProblemSize(600);
+    UP_ASSERT(!tuner.isTuning());
+    for (unsigned int i=0; i < 100; ++i)
+        {
+        call(tuner);
+        }
+    UP_ASSERT(!tuner.isTuning());
+    tuner.setProblemSize(2000);
+    UP_ASSERT(tuner.isTuning());
+
+    // disabling ends the scan with the best parameter of the samples taken
+    call(tuner);
+    call(tuner);
+    tuner.setEnabled(false);
+    UP_ASSERT(!tuner.getEnabled());
+    UP_ASSERT(!tuner.isTuning());
+    UP_ASSERT_EQUAL(tuner.getParameter(), 2);
+    tuner.scan();
+    tuner.setProblemSize(5000);
+    UP_ASSERT(!tuner.isTuning());
+
+    // timing in a stream
+    tuner.setEnabled(true);
+    tuner.scan();
+    for (unsigned int i=0; i < 5; ++i)
+        {
+        tuner.begin(0);
+        tuner.end(0);
+        }
+    UP_ASSERT(!tuner.isTuning());
+    }
+
+// Test that the stream methods of the LBVH and traverser are autotuned
+UP_TEST( tunable_autotuning_test )
+    {
+    const float L = 10.f;
+    const unsigned int N = 200;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(L, L, L);
+    neighbor::shared_array<float3> points(N);
+    neighbor::shared_array<float4> spheres(N);
+        {
+        std::mt19937 mt(42);
+        std::uniform_real_distribution<float> U(0.f, L);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            points[i] = make_float3(U(mt), U(mt), U(mt));
+            spheres[i] = make_float4(points[i].x, points[i].y, points[i].z, 1.f);
+            }
+        }
+    const neighbor::PointInsertOp insert(points.get(), N);
+    const neighbor::SphereQueryOp query(spheres.get(), N);
+
+    neighbor::LBVH lbvh;
+    UP_ASSERT(!lbvh.getAutotuning());
+    lbvh.build(insert, lo, hi);
+    hipper::deviceSynchronize();
+    neighbor::LBVHTraverser traverser;
+    neighbor::shared_array<unsigned int> ref(N), count(N);
+    traverser.traverse(lbvh, query, neighbor::CountNeighborsOp(ref.get()));
+    hipper::deviceSynchronize();
+
+    // one scan is the number of block sizes times the number of samples
+    lbvh.setAutotuning(true);
+    traverser.setAutotuning(true);
+    neighbor::Autotuner<unsigned int>& build_tuner = lbvh.getAutotuner("build");
+    neighbor::Autotuner<unsigned int>& traverse_tuner = traverser.getAutotuner("traverse");
+    UP_ASSERT(build_tuner.getParameters() == lbvh.getTunableParameters());
+    const unsigned int calls = build_tuner.getParameters().size()*build_tuner.getNumSamples();
+    for (unsigned int i=0; i < calls; ++i)
+        {
+        UP_ASSERT(build_tuner.isTuning());
+        UP_ASSERT(traverse_tuner.isTuning());
+        lbvh.build(insert, lo, hi);
+        traverser.traverse(lbvh, query, neighbor::CountNeighborsOp(count.get()));
+        hipper::deviceSynchronize();
+        for (unsigned int j=0; j < N; ++j)
+            {
+            UP_ASSERT_EQUAL(count[j], ref[j]);
+            }
+        }
+    UP_ASSERT(!build_tuner.isTuning());
+    UP_ASSERT(!traverse_tuner.isTuning());
+    const std::vector<unsigned int> params = lbvh.getTunableParameters();
+    UP_ASSERT(std::find(params.begin(), params.end(), build_tuner.getParameter()) != params.end());
+
+    // the operations have their own autotuners
+    UP_ASSERT(&lbvh.getAutotuner("refit") != &build_tuner);
+    UP_ASSERT(lbvh.getAutotuner("refit").isTuning());
+
+    // new parameters reset the autotuners
+    lbvh.setTunableParameters({64, 128});
+    UP_ASSERT(lbvh.getAutotuner("build").getParameters() == lbvh.getTunableParameters());
+    UP_ASSERT(lbvh.getAutotuner("build").isTuning());
+    }
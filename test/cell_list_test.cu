@@ -0,0 +1,307 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#include <hipper/hipper_runtime.h>
+
+#include "neighbor/neighbor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "test_systems.h"
+#include "upp11_config.h"
+UP_MAIN();
+
+// Test that a CellList finds the same primitives as brute force
+UP_TEST( cell_list_test )
+    {
+    const float L = 12.f;
+    const unsigned int N = 3000;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(L, L, L);
+    neighbor::shared_array<float3> points(N);
+    makeUniformPoints(points, L, 42);
+    // some points lie outside the scene and are clamped into it
+    points[0] = make_float3(-0.5f, 5.f, 5.f);
+    points[1] = make_float3(5.f, L+0.5f, 5.f);
+
+    // query spheres, some hanging out of the scene
+    const unsigned int Nq = 300;
+    const float rcut = 1.f;
+    neighbor::shared_array<float4> spheres(Nq);
+        {
+        std::mt19937 mt(7);
+        std::uniform_real_distribution<float> U(-1.f, L+1.f);
+        for (unsigned int i=0; i < Nq; ++i)
+            {
+            spheres[i] = make_float4(U(mt), U(mt), U(mt), rcut);
+            }
+        spheres[0] = make_float4(points[0].x, points[0].y, points[0].z, rcut);
+        }
+    const neighbor::SphereQueryOp query(spheres.get(), Nq);
+
+    // periodic images
+    const neighbor::shared_array<float3> images = makeCubicImages(L);
+
+    for (unsigned int num_threads : {1, 3})
+        {
+        neighbor::host::ThreadPool pool(num_threads);
+        for (float radius : {0.f, 0.6f})
+            {
+            const neighbor::SphereInsertOp insert(points.get(), radius, N);
+            neighbor::CellList cells;
+            cells.build(pool, insert, lo, hi, rcut);
+            UP_ASSERT_EQUAL(cells.getN(), N);
+            UP_ASSERT_EQUAL(cells.getDimensions().x, 12);
+            UP_ASSERT_EQUAL(cells.getCellStarts().back(), N);
+
+            for (unsigned int num_images : {1, 27})
+                {
+                const neighbor::ImageListOp<float3> translate(images.get() + (num_images == 1 ? 13 : 0), num_images);
+                const unsigned int max_neigh = 200;
+                neighbor::shared_array<unsigned int> nlist(Nq*max_neigh), nneigh(Nq);
+                cells.traverse(pool, query, neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh), translate);
+
+                for (unsigned int i=0; i < Nq; ++i)
+                    {
+                    std::vector<unsigned int> ref;
+                    for (unsigned int j=0; j < N; ++j)
+                        {
+                        for (unsigned int k=0; k < num_images; ++k)
+                            {
+                            const neighbor::BoundingSphere q = query.get(query.setup(i), translate.get(k));
+                            if (q.overlap(insert.get(j)))
+                                ref.push_back(j);
+                            }
+                        }
+                    UP_ASSERT_EQUAL(nneigh[i], ref.size());
+                    std::vector<unsigned int> neigh(nlist.get() + i*max_neigh, nlist.get() + i*max_neigh + nneigh[i]);
+                    std::sort(neigh.begin(), neigh.end());
+                    UP_ASSERT(neigh == ref);
+                    }
+                UP_ASSERT(nneigh[0] >= 1);
+                }
+            }
+        }
+
+    // empty cell list still finalizes the queries
+    neighbor::host::ThreadPool pool(2);
+    neighbor::CellList cells;
+    cells.build(pool, neighbor::PointInsertOp(points.get(), 0), lo, hi, rcut);
+    neighbor::shared_array<unsigned int> hits(Nq);
+    std::fill(hits.get(), hits.get() + Nq, 1);
+    cells.traverse(pool, query, neighbor::CountNeighborsOp(hits.get()));
+    for (unsigned int i=0; i < Nq; ++i)
+        {
+        UP_ASSERT_EQUAL(hits[i], 0);
+        }
+
+    // the number of cells is capped for dilute scenes
+    cells.build(pool, neighbor::PointInsertOp(points.get(), 10), lo, hi, 0.01f);
+    const uint3 dim = cells.getDimensions();
+    UP_ASSERT(dim.x*dim.y*dim.z <= 80);
+    UP_ASSERT(cells.getWidth().x >= 0.01f);
+
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ cells.build(pool, neighbor::PointInsertOp(points.get(), 10), lo, hi, 0.f); });
+    }
+
+// Test that an AdaptiveSearch picks a CellList for uniform points and an LBVH for a small cluster
+UP_TEST( adaptive_search_test )
+    {
+    // the same points at unit density either fill the scene or a small corner of a larger scene
+    const unsigned int N = 40000;
+    const float L = std::cbrt(static_cast<float>(N));
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    neighbor::shared_array<float3> points(N);
+    makeUniformPoints(points, L, 42);
+
+    const float rcut = 1.f;
+    const unsigned int Nq = 500;
+    neighbor::host::ThreadPool pool(2);
+    neighbor::AdaptiveSearch search;
+    UP_ASSERT_EQUAL(search.getThreshold(), 0.002f);
+    const neighbor::PointInsertOp insert(points.get(), N);
+    for (float scale : {1.f, 20.f})
+        {
+        const float3 hi = make_float3(scale*L, scale*L, scale*L);
+        search.build(pool, insert, lo, hi, rcut);
+        if (scale == 1.f)
+            {
+            UP_ASSERT(search.getMethod() == neighbor::AdaptiveSearch::Method::CellList);
+            UP_ASSERT(search.getOccupiedFraction() > 0.9f);
+            }
+        else
+            {
+            UP_ASSERT(search.getMethod() == neighbor::AdaptiveSearch::Method::LBVH);
+            UP_ASSERT(search.getOccupiedFraction() < 0.001f);
+            }
+
+        neighbor::shared_array<float4> spheres(Nq);
+        for (unsigned int i=0; i < Nq; ++i)
+            {
+            const float3 r = points[i];
+            spheres[i] = make_float4(r.x, r.y, r.z, rcut);
+            }
+        const unsigned int max_neigh = 64;
+        neighbor::shared_array<unsigned int> nlist(Nq*max_neigh), nneigh(Nq);
+        search.traverse(pool, neighbor::SphereQueryOp(spheres.get(), Nq), neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh));
+
+        // the LBVH may find a few extra primitives because its bounds are compressed
+        for (unsigned int i=0; i < Nq; ++i)
+            {
+            const float3 ri = points[i];
+            std::vector<unsigned int> ref;
+            for (unsigned int j=0; j < N; ++j)
+                {
+                const float3 rj = points[j];
+                const float3 dr = make_float3(rj.x-ri.x, rj.y-ri.y, rj.z-ri.z);
+                if (dr.x*dr.x + dr.y*dr.y + dr.z*dr.z <= rcut*rcut)
+                    ref.push_back(j);
+                }
+            UP_ASSERT(nneigh[i] <= max_neigh);
+            std::vector<unsigned int> neigh(nlist.get() + i*max_neigh, nlist.get() + i*max_neigh + nneigh[i]);
+            std::sort(neigh.begin(), neigh.end());
+            if (search.getMethod() == neighbor::AdaptiveSearch::Method::CellList)
+                {
+                UP_ASSERT(neigh == ref);
+                }
+            else
+                {
+                UP_ASSERT(std::includes(neigh.begin(), neigh.end(), ref.begin(), ref.end()));
+                }
+            }
+        }
+
+    // the occupied fraction does not depend on the number of primitives, so a small cluster also picks the LBVH
+    const float3 hi = make_float3(20.f*L, 20.f*L, 20.f*L);
+    search.build(pool, neighbor::PointInsertOp(points.get(), 1000), lo, hi, rcut);
+    UP_ASSERT(search.getMethod() == neighbor::AdaptiveSearch::Method::LBVH);
+    UP_ASSERT(search.getOccupiedFraction() < 0.002f);
+
+    // a zero threshold always picks the CellList, and a threshold above 1 always picks the LBVH
+    search.setThreshold(0.f);
+    search.build(pool, insert, lo, hi, rcut);
+    UP_ASSERT(search.getMethod() == neighbor::AdaptiveSearch::Method::CellList);
+    search.setThreshold(1.5f);
+    search.build(pool, insert, lo, make_float3(L, L, L), rcut);
+    UP_ASSERT(search.getMethod() == neighbor::AdaptiveSearch::Method::LBVH);
+
+    // the CellList is used when there are no primitives
+    search.build(pool, neighbor::PointInsertOp(points.get(), 0), lo, hi, rcut);
+    UP_ASSERT(search.getMethod() == neighbor::AdaptiveSearch::Method::CellList);
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ search.setThreshold(-1.f); });
+    }
+
+// Test that the CellList, AdaptiveSearch, and LBVH refine and output the same transformed indexes
+UP_TEST( transform_test )
+    {
+    const unsigned int N = 8000;
+    const float L = std::cbrt(static_cast<float>(N));
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    neighbor::shared_array<float3> points(N);
+    makeUniformPoints(points, L, 7);
+    neighbor::shared_array<unsigned int> map(N);
+    for (unsigned int i=0; i < N; ++i)
+        {
+        map[i] = N - 1 - i;
+        }
+
+    const float rcut = 1.f;
+    const unsigned int Nq = 500;
+    neighbor::shared_array<float4> spheres(Nq);
+    for (unsigned int i=0; i < Nq; ++i)
+        {
+        const float3 r = points[i];
+        spheres[i] = make_float4(r.x, r.y, r.z, rcut);
+        }
+    const EvenSphereQueryOp query(spheres.get(), Nq);
+    const neighbor::MapTransformOp transform(map.get());
+    const neighbor::PointInsertOp insert(points.get(), N);
+    const unsigned int max_neigh = 64;
+    neighbor::host::ThreadPool pool(2);
+
+    // expected neighbors are the even transformed indexes
+    std::vector<std::vector<unsigned int>> ref(Nq);
+    for (unsigned int i=0; i < Nq; ++i)
+        {
+        const float3 ri = points[i];
+        for (unsigned int j=0; j < N; ++j)
+            {
+            const float3 rj = points[j];
+            const float3 dr = make_float3(rj.x-ri.x, rj.y-ri.y, rj.z-ri.z);
+            if (dr.x*dr.x + dr.y*dr.y + dr.z*dr.z <= rcut*rcut && map[j] % 2 == 0)
+                ref[i].push_back(map[j]);
+            }
+        std::sort(ref[i].begin(), ref[i].end());
+        }
+
+    // the LBVH may find a few extra primitives because its bounds are compressed, but all must be even
+    auto check = [&](const neighbor::shared_array<unsigned int>& nlist,
+                     const neighbor::shared_array<unsigned int>& nneigh,
+                     bool exact)
+        {
+        for (unsigned int i=0; i < Nq; ++i)
+            {
+            UP_ASSERT(nneigh[i] <= max_neigh);
+            std::vector<unsigned int> neigh(nlist.get() + i*max_neigh, nlist.get() + i*max_neigh + nneigh[i]);
+            std::sort(neigh.begin(), neigh.end());
+            if (exact)
+                {
+                UP_ASSERT(neigh == ref[i]);
+                }
+            else
+                {
+                UP_ASSERT(std::includes(neigh.begin(), neigh.end(), ref[i].begin(), ref[i].end()));
+                }
+            for (const unsigned int j : neigh)
+                {
+                UP_ASSERT(j % 2 == 0);
+                }
+            }
+        };
+
+    neighbor::shared_array<unsigned int> nlist(Nq*max_neigh), nneigh(Nq);
+        {
+        neighbor::LBVH lbvh;
+        lbvh.build(pool, insert, lo, make_float3(L, L, L));
+        neighbor::LBVHTraverser traverser;
+        traverser.traverse(pool,
+                           lbvh,
+                           query,
+                           neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh),
+                           neighbor::SelfOp(),
+                           transform);
+        check(nlist, nneigh, false);
+        }
+
+        {
+        neighbor::CellList cells;
+        cells.build(pool, insert, lo, make_float3(L, L, L), rcut);
+        cells.traverse(pool,
+                       query,
+                       neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh),
+                       neighbor::SelfOp(),
+                       transform);
+        check(nlist, nneigh, true);
+        }
+
+    // the adaptive search gives the same result with either backend
+    neighbor::AdaptiveSearch search;
+    for (float scale : {1.f, 20.f})
+        {
+        search.build(pool, insert, lo, make_float3(scale*L, scale*L, scale*L), rcut);
+        UP_ASSERT(search.getMethod() == ((scale == 1.f) ? neighbor::AdaptiveSearch::Method::CellList
+                                                        : neighbor::AdaptiveSearch::Method::LBVH));
+        search.traverse(pool,
+                        query,
+                        neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh),
+                        neighbor::SelfOp(),
+                        transform);
+        check(nlist, nneigh, search.getMethod() == neighbor::AdaptiveSearch::Method::CellList);
+        }
+    }
@@ -0,0 +1,100 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#include <hipper/hipper_runtime.h>
+
+#include "neighbor/neighbor.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "upp11_config.h"
+UP_MAIN();
+
+// Test that the phases of the host LBVH build and traversal are counted, or only timed without counters
+UP_TEST( hardware_counters_test )
+    {
+    const float L = 10.f;
+    const unsigned int N = 2000;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(L, L, L);
+    neighbor::shared_array<float3> points(N);
+    neighbor::shared_array<float4> spheres(N);
+        {
+        std::mt19937 mt(42);
+        std::uniform_real_distribution<float> U(0.f, L);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            points[i] = make_float3(U(mt), U(mt), U(mt));
+            spheres[i] = make_float4(points[i].x, points[i].y, points[i].z, 1.f);
+            }
+        }
+    const neighbor::PointInsertOp insert(points.get(), N);
+    const neighbor::SphereQueryOp query(spheres.get(), N);
+    neighbor::shared_array<unsigned int> hits(N), ref_hits(N);
+    neighbor::shared_array<float3> images(1);
+    images[0] = make_float3(0.f, 0.f, 0.f);
+    const neighbor::ImageListOp<float3> translate(images.get(), images.size());
+
+    neighbor::host::ThreadPool pool(2);
+    neighbor::host::HardwareCounters counters(pool);
+    UP_ASSERT(counters.getPhases().empty());
+    UP_ASSERT_EQUAL(counters.isAvailable(), counters.getError().empty());
+    UP_ASSERT_EQUAL(counters.isAvailable(), counters.isSupported(neighbor::host::HardwareCounters::Event::Cycles));
+
+    neighbor::LBVH lbvh;
+    lbvh.build(pool, insert, lo, hi, counters);
+    UP_ASSERT_EQUAL(counters.getPhases().size(), 3);
+    UP_ASSERT_EQUAL(counters.getPhases()[0].name, std::string("partition"));
+    UP_ASSERT_EQUAL(counters.getPhases()[0].count, N);
+
+    neighbor::LBVHTraverser traverser;
+    traverser.traverse(pool, lbvh, query, neighbor::CountNeighborsOp(hits.get()), translate, neighbor::NullTransformOp(), counters);
+    UP_ASSERT_EQUAL(counters.getPhases().size(), 2);
+    UP_ASSERT_EQUAL(counters.getPhases()[1].name, std::string("traverse"));
+    UP_ASSERT_EQUAL(counters.getPhases()[1].count, N);
+    for (const auto& p : counters.getPhases())
+        {
+        UP_ASSERT(p.time >= 0.);
+        }
+
+    // counts are only nonzero when counted
+    const neighbor::host::PhaseCounters traverse = counters.getTotal("traverse");
+    UP_ASSERT_EQUAL(traverse.count, N);
+    if (counters.isAvailable())
+        {
+        UP_ASSERT(traverse.cycles > 0);
+        if (counters.isSupported(neighbor::host::HardwareCounters::Event::Instructions))
+            {
+            UP_ASSERT(traverse.instructions > 0);
+            UP_ASSERT(traverse.getIPC() > 0.);
+            }
+        }
+    else
+        {
+        UP_ASSERT_EQUAL(traverse.cycles, 0);
+        UP_ASSERT_EQUAL(traverse.instructions, 0);
+        UP_ASSERT_EQUAL(traverse.cache_misses, 0);
+        UP_ASSERT_EQUAL(traverse.tlb_misses, 0);
+        UP_ASSERT_EQUAL(traverse.getIPC(), 0.);
+        }
+    const neighbor::host::PhaseCounters total = counters.getTotal();
+    UP_ASSERT(total.cycles >= traverse.cycles);
+    UP_ASSERT(total.count >= traverse.count);
+
+    // counting does not change the traversal
+    neighbor::LBVHTraverser ref_traverser;
+    ref_traverser.traverse(pool, lbvh, query, neighbor::CountNeighborsOp(ref_hits.get()), translate);
+    for (unsigned int i=0; i < N; ++i)
+        {
+        UP_ASSERT_EQUAL(hits[i], ref_hits[i]);
+        }
+
+    // counters on the calling thread only
+    neighbor::host::HardwareCounters serial_counters;
+    UP_ASSERT_EQUAL(serial_counters.isAvailable(), counters.isAvailable());
+    }
@@ -0,0 +1,184 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#include <hipper/hipper_runtime.h>
+
+#include "neighbor/neighbor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "test_systems.h"
+#include "upp11_config.h"
+UP_MAIN();
+
+// Test that a LazyLBVH finds the same neighbors as a full LBVH, while only refining touched regions
+UP_TEST( lazy_lbvh_test )
+    {
+    const float L = 40.f;
+    const unsigned int N = 20000;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(L, L, L);
+    neighbor::shared_array<float3> points(N);
+    makeUniformPoints(points, L, 42);
+    // duplicate a point to test splitting identical codes
+    points[N-1] = points[N-2];
+    const neighbor::PointInsertOp insert(points.get(), N);
+
+    // reference traversal with periodic images
+    const neighbor::shared_array<float3> images = makeCubicImages(L);
+    const float rcut = 1.5f;
+    neighbor::shared_array<float4> spheres(N);
+    for (unsigned int i=0; i < N; ++i)
+        {
+        spheres[i] = make_float4(points[i].x, points[i].y, points[i].z, rcut);
+        }
+    const unsigned int max_neigh = 64;
+    neighbor::shared_array<unsigned int> ref_nlist(N*max_neigh), ref_nneigh(N);
+        {
+        neighbor::LBVH lbvh;
+        lbvh.build(insert, lo, hi);
+        neighbor::LBVHTraverser traverser;
+        traverser.traverse(lbvh,
+                           neighbor::SphereQueryOp(spheres.get(), N),
+                           neighbor::NeighborListOp(ref_nlist.get(), ref_nneigh.get(), max_neigh),
+                           neighbor::ImageListOp<float3>(images.get(), images.size()));
+        hipper::deviceSynchronize();
+        }
+
+    for (unsigned int num_threads : {1, 3})
+        {
+        std::cout << "Testing LazyLBVH with " << num_threads << " threads..." << std::endl;
+        neighbor::host::ThreadPool pool(num_threads);
+        neighbor::LazyLBVH lazy;
+        lazy.setLeafSize(1);
+        lazy.build(pool, insert, lo, hi);
+        UP_ASSERT_EQUAL(lazy.getN(), N);
+        const unsigned int num_top = lazy.getNumNodes();
+        UP_ASSERT(num_top < N/100);
+
+        // a few small queries only refine a small part of the hierarchy
+        neighbor::shared_array<unsigned int> hits(4);
+        lazy.traverse(pool, neighbor::SphereQueryOp(spheres.get(), 4), neighbor::CountNeighborsOp(hits.get()));
+        UP_ASSERT(lazy.getNumNodes() > num_top);
+        UP_ASSERT(lazy.getNumNodes() < N/4);
+        for (unsigned int i=0; i < 4; ++i)
+            {
+            unsigned int count = 0;
+            for (unsigned int j=0; j < N; ++j)
+                {
+                const float3 dr = make_float3(points[j].x-points[i].x, points[j].y-points[i].y, points[j].z-points[i].z);
+                if (dr.x*dr.x + dr.y*dr.y + dr.z*dr.z <= rcut*rcut) ++count;
+                }
+            UP_ASSERT_EQUAL(hits[i], count);
+            }
+
+        // all queries with images refine the whole hierarchy and match the full LBVH, which may also find
+        // some false positives because its bounds are compressed
+        neighbor::shared_array<unsigned int> nlist(N*max_neigh), nneigh(N);
+        lazy.traverse(pool,
+                      neighbor::SphereQueryOp(spheres.get(), N),
+                      neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh),
+                      neighbor::ImageListOp<float3>(images.get(), images.size()));
+        UP_ASSERT_EQUAL(lazy.getNumNodes(), 2*N-1);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            UP_ASSERT(nneigh[i] <= ref_nneigh[i]);
+            const unsigned int* first = nlist.get() + i*max_neigh;
+            const unsigned int* last = first + nneigh[i];
+            for (unsigned int k=0; k < ref_nneigh[i]; ++k)
+                {
+                const unsigned int j = ref_nlist[i*max_neigh+k];
+                float3 dr = make_float3(points[j].x-points[i].x, points[j].y-points[i].y, points[j].z-points[i].z);
+                dr.x -= L*std::round(dr.x/L);
+                dr.y -= L*std::round(dr.y/L);
+                dr.z -= L*std::round(dr.z/L);
+                const float dr2 = dr.x*dr.x + dr.y*dr.y + dr.z*dr.z;
+                const bool found = (std::find(first, last, j) != last);
+                if (dr2 < 0.999f*rcut*rcut)
+                    {
+                    UP_ASSERT(found);
+                    }
+                else if (dr2 > 1.001f*rcut*rcut)
+                    {
+                    UP_ASSERT(!found);
+                    }
+                }
+            }
+        }
+
+    // refine and output see the same transformed index as in the LBVH
+        {
+        std::cout << "Testing LazyLBVH with a transform..." << std::endl;
+        const unsigned int Nt = 2000;
+        neighbor::shared_array<unsigned int> map(Nt);
+        for (unsigned int i=0; i < Nt; ++i)
+            {
+            map[i] = Nt - 1 - i;
+            }
+        const neighbor::PointInsertOp tinsert(points.get(), Nt);
+        const EvenSphereQueryOp tquery(spheres.get(), Nt);
+
+        neighbor::host::ThreadPool pool(2);
+        neighbor::LBVH lbvh;
+        lbvh.build(pool, tinsert, lo, hi);
+        neighbor::LBVHTraverser traverser;
+        neighbor::shared_array<unsigned int> ref_list(Nt*max_neigh), ref_num(Nt);
+        traverser.traverse(pool,
+                           lbvh,
+                           tquery,
+                           neighbor::NeighborListOp(ref_list.get(), ref_num.get(), max_neigh),
+                           neighbor::SelfOp(),
+                           neighbor::MapTransformOp(map.get()));
+
+        neighbor::LazyLBVH lazy;
+        lazy.build(pool, tinsert, lo, hi);
+        neighbor::shared_array<unsigned int> list(Nt*max_neigh), num(Nt);
+        lazy.traverse(pool,
+                      tquery,
+                      neighbor::NeighborListOp(list.get(), num.get(), max_neigh),
+                      neighbor::SelfOp(),
+                      neighbor::MapTransformOp(map.get()));
+
+        unsigned int total = 0;
+        for (unsigned int i=0; i < Nt; ++i)
+            {
+            // the lazy LBVH is exact, and the LBVH only adds false positives near the cutoff
+            std::vector<unsigned int> expected, found(list.get() + i*max_neigh, list.get() + i*max_neigh + num[i]);
+            std::vector<unsigned int> ref(ref_list.get() + i*max_neigh, ref_list.get() + i*max_neigh + ref_num[i]);
+            for (unsigned int j=0; j < Nt; ++j)
+                {
+                const float3 dr = make_float3(points[j].x-points[i].x, points[j].y-points[i].y, points[j].z-points[i].z);
+                if (dr.x*dr.x + dr.y*dr.y + dr.z*dr.z <= rcut*rcut && map[j] % 2 == 0) expected.push_back(map[j]);
+                }
+            std::sort(expected.begin(), expected.end());
+            std::sort(found.begin(), found.end());
+            std::sort(ref.begin(), ref.end());
+            total += expected.size();
+            UP_ASSERT(found == expected);
+            UP_ASSERT(std::includes(ref.begin(), ref.end(), expected.begin(), expected.end()));
+            for (const unsigned int j : ref)
+                {
+                UP_ASSERT(j % 2 == 0);
+                }
+            }
+        UP_ASSERT(total > Nt/4);
+        }
+
+    // small and empty builds
+    neighbor::host::ThreadPool pool(2);
+    neighbor::LazyLBVH lazy;
+    for (unsigned int n : {0, 1, 2, 3})
+        {
+        lazy.build(pool, neighbor::PointInsertOp(points.get(), n), lo, hi);
+        UP_ASSERT_EQUAL(lazy.getN(), n);
+        neighbor::shared_array<unsigned int> hits(1);
+        lazy.traverse(pool, neighbor::SphereQueryOp(spheres.get(), 1), neighbor::CountNeighborsOp(hits.get()));
+        UP_ASSERT_EQUAL(hits[0], (n > 0) ? 1 : 0);
+        }
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ lazy.setLeafSize(0); });
+    }
@@ -0,0 +1,193 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#include <hipper/hipper_runtime.h>
+
+#include "neighbor/neighbor.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "upp11_config.h"
+UP_MAIN();
+
+// Test that a forest matches independent LBVHs for each system
+UP_TEST( lbvh_forest_test )
+    {
+    // systems of different sizes, including empty and single-primitive systems
+    const std::vector<unsigned int> sizes = {300, 0, 1, 2, 1000, 0, 57};
+    const unsigned int num_systems = static_cast<unsigned int>(sizes.size());
+    std::vector<unsigned int> offsets(num_systems+1, 0);
+    for (unsigned int s=0; s < num_systems; ++s)
+        {
+        offsets[s+1] = offsets[s] + sizes[s];
+        }
+    const unsigned int N = offsets.back();
+
+    // each system has its own box
+    std::vector<float3> lo(num_systems), hi(num_systems);
+    neighbor::shared_array<float3> points(N);
+        {
+        std::mt19937 mt(42);
+        std::uniform_real_distribution<float> U(0.f, 1.f);
+        for (unsigned int s=0; s < num_systems; ++s)
+            {
+            const float L = 5.f + 2.f*s;
+            lo[s] = make_float3(-1.f*s, 2.f*s, 0.f);
+            hi[s] = make_float3(lo[s].x + L, lo[s].y + L, lo[s].z + L);
+            for (unsigned int i=offsets[s]; i < offsets[s+1]; ++i)
+                {
+                points[i] = make_float3(lo[s].x + L*U(mt), lo[s].y + L*U(mt), lo[s].z + L*U(mt));
+                }
+            }
+        }
+
+    // queries are tagged with their system, and are interleaved between systems
+    neighbor::shared_array<float4> spheres(N+num_systems);
+    neighbor::shared_array<unsigned int> systems(N+num_systems);
+        {
+        unsigned int idx = 0;
+        for (unsigned int s=0; s < num_systems; ++s)
+            {
+            // one query per system so that empty systems are also queried
+            spheres[idx] = make_float4(lo[s].x, lo[s].y, lo[s].z, 1.5f);
+            systems[idx] = s;
+            ++idx;
+            }
+        for (unsigned int s=0; s < num_systems; ++s)
+            {
+            for (unsigned int i=offsets[s]; i < offsets[s+1]; ++i)
+                {
+                spheres[idx] = make_float4(points[i].x, points[i].y, points[i].z, 1.f);
+                systems[idx] = s;
+                ++idx;
+                }
+            }
+        std::mt19937 mt(7);
+        std::vector<unsigned int> order(idx);
+        for (unsigned int i=0; i < idx; ++i) order[i] = i;
+        std::shuffle(order.begin(), order.end(), mt);
+        neighbor::shared_array<float4> tmp_spheres(idx);
+        neighbor::shared_array<unsigned int> tmp_systems(idx);
+        for (unsigned int i=0; i < idx; ++i)
+            {
+            tmp_spheres[i] = spheres[order[i]];
+            tmp_systems[i] = systems[order[i]];
+            }
+        spheres.swap(tmp_spheres);
+        systems.swap(tmp_systems);
+        }
+    const unsigned int Nq = static_cast<unsigned int>(spheres.size());
+
+    for (unsigned int num_threads : {1, 3})
+        {
+        std::cout << "Testing LBVH forest with " << num_threads << " threads..." << std::endl;
+        neighbor::host::ThreadPool pool(num_threads);
+        neighbor::LBVHForest forest;
+        forest.build(pool, neighbor::PointInsertOp(points.get(), N), offsets.data(), lo.data(), hi.data(), num_systems);
+        UP_ASSERT_EQUAL(forest.getNumSystems(), num_systems);
+        UP_ASSERT_EQUAL(forest.getN(), N);
+
+        // each tree has the same primitive order as an independent build, but holds global indexes
+        for (unsigned int s=0; s < num_systems; ++s)
+            {
+            UP_ASSERT_EQUAL(forest.getN(s), sizes[s]);
+            if (sizes[s] == 0) continue;
+
+            neighbor::LBVH ref;
+            ref.build(neighbor::PointInsertOp(points.get() + offsets[s], sizes[s]), lo[s], hi[s]);
+            hipper::deviceSynchronize();
+
+            const neighbor::ConstLBVHData tree = forest.data(s);
+            for (unsigned int i=0; i < sizes[s]; ++i)
+                {
+                UP_ASSERT_EQUAL(tree.primitive[i], ref.getPrimitives()[i] + offsets[s]);
+                }
+            for (unsigned int i=0; i < 2*sizes[s]-1; ++i)
+                {
+                UP_ASSERT_EQUAL(tree.lo[i].x, ref.getLowerBounds()[i].x);
+                UP_ASSERT_EQUAL(tree.hi[i].y, ref.getUpperBounds()[i].y);
+                }
+            UP_ASSERT_EQUAL(tree.parent[0], neighbor::LBVHSentinel);
+            }
+
+        // traverse all systems at once, and repeat with a replayed setup
+        const unsigned int max_neigh = 64;
+        neighbor::shared_array<unsigned int> nlist(Nq*max_neigh), nneigh(Nq), hits(Nq);
+        forest.traverse(pool, systems.get(), neighbor::SphereQueryOp(spheres.get(), Nq), neighbor::CountNeighborsOp(hits.get()));
+        forest.setup(pool);
+        forest.traverse(pool,
+                        systems.get(),
+                        neighbor::SphereQueryOp(spheres.get(), Nq),
+                        neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh));
+
+        // each query matches a traversal of its own system with an independent LBVH
+        for (unsigned int s=0; s < num_systems; ++s)
+            {
+            std::vector<unsigned int> queries;
+            for (unsigned int i=0; i < Nq; ++i)
+                {
+                if (systems[i] == s) queries.push_back(i);
+                }
+            neighbor::shared_array<float4> ref_spheres(queries.size());
+            for (size_t i=0; i < queries.size(); ++i)
+                {
+                ref_spheres[i] = spheres[queries[i]];
+                }
+
+            if (sizes[s] == 0)
+                {
+                for (const auto i : queries)
+                    {
+                    UP_ASSERT_EQUAL(hits[i], 0);
+                    UP_ASSERT_EQUAL(nneigh[i], 0);
+                    }
+                continue;
+                }
+
+            neighbor::LBVH ref;
+            ref.build(neighbor::PointInsertOp(points.get() + offsets[s], sizes[s]), lo[s], hi[s]);
+            neighbor::shared_array<unsigned int> ref_nlist(queries.size()*max_neigh), ref_nneigh(queries.size());
+            neighbor::LBVHTraverser traverser;
+            traverser.traverse(ref,
+                               neighbor::SphereQueryOp(ref_spheres.get(), (unsigned int)queries.size()),
+                               neighbor::NeighborListOp(ref_nlist.get(), ref_nneigh.get(), max_neigh));
+            hipper::deviceSynchronize();
+
+            for (size_t q=0; q < queries.size(); ++q)
+                {
+                const unsigned int i = queries[q];
+                UP_ASSERT_EQUAL(hits[i], ref_nneigh[q]);
+                UP_ASSERT_EQUAL(nneigh[i], ref_nneigh[q]);
+                UP_ASSERT(nneigh[i] <= max_neigh);
+
+                std::vector<unsigned int> neigh(nlist.get() + i*max_neigh, nlist.get() + i*max_neigh + nneigh[i]);
+                std::vector<unsigned int> ref_neigh(ref_nlist.get() + q*max_neigh, ref_nlist.get() + q*max_neigh + ref_nneigh[q]);
+                for (auto& j : ref_neigh) j += offsets[s];
+                std::sort(neigh.begin(), neigh.end());
+                std::sort(ref_neigh.begin(), ref_neigh.end());
+                UP_ASSERT(neigh == ref_neigh);
+                }
+            }
+
+        // queries must belong to a system in the forest
+            {
+            const unsigned int last_system = systems[Nq-1];
+            systems[Nq-1] = num_systems;
+            UP_ASSERT_EXCEPTION(std::runtime_error, [&]{
+                forest.traverse(pool, systems.get(), neighbor::SphereQueryOp(spheres.get(), Nq), neighbor::CountNeighborsOp(hits.get()));
+                });
+            systems[Nq-1] = last_system;
+            }
+
+        // rebuilding a smaller forest reuses the arena
+        forest.build(pool, neighbor::PointInsertOp(points.get(), offsets[3]), offsets.data(), lo.data(), hi.data(), 3);
+        UP_ASSERT_EQUAL(forest.getNumSystems(), 3);
+        UP_ASSERT_EQUAL(forest.getN(), offsets[3]);
+        UP_ASSERT_EQUAL(forest.data(2).primitive[0], offsets[2]);
+        }
+    }
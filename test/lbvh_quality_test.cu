@@ -0,0 +1,171 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#include <hipper/hipper_runtime.h>
+
+#include "neighbor/neighbor.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "upp11_config.h"
+UP_MAIN();
+
+//! Test if a node is an ancestor of another.
+bool is_ancestor(const neighbor::LBVH& lbvh, int ancestor, int node)
+    {
+    while (node != lbvh.getRoot())
+        {
+        node = lbvh.getParents()[node];
+        if (node == ancestor) return true;
+        }
+    return false;
+    }
+
+// Test the quality metrics against a direct calculation
+UP_TEST( lbvh_quality_test )
+    {
+    const float L = 10.f;
+    const unsigned int N = 150;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(L, L, L);
+    neighbor::shared_array<float3> points(N);
+        {
+        std::mt19937 mt(42);
+        std::uniform_real_distribution<float> U(0.f, L);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            points[i] = make_float3(U(mt), U(mt), U(mt));
+            }
+        }
+    const float r = 0.5f;
+    const neighbor::SphereInsertOp insert(points.get(), r, N);
+    neighbor::LBVH lbvh;
+    lbvh.build(insert, lo, hi);
+    hipper::deviceSynchronize();
+
+    // direct calculation
+    const unsigned int N_internal = lbvh.getNInternal();
+    const unsigned int N_nodes = lbvh.getNNodes();
+    auto node_lo = [&](int i) { return lbvh.getLowerBounds()[i]; };
+    auto node_hi = [&](int i) { return lbvh.getUpperBounds()[i]; };
+    const double root_area = neighbor::host::lbvh_surface_area(node_lo(0), node_hi(0));
+    const double root_volume = neighbor::host::lbvh_overlap_volume(node_lo(0), node_hi(0), node_lo(0), node_hi(0));
+    double internal_area = 0., leaf_area = 0., sibling = 0., total = 0., epo = 0.;
+    std::vector<unsigned int> depths(N_nodes, 0);
+    for (unsigned int i=0; i < N_nodes; ++i)
+        {
+        const double area = neighbor::host::lbvh_surface_area(node_lo(i), node_hi(i));
+        if (i < N_internal)
+            {
+            internal_area += area;
+            const int left = lbvh.getLeftChildren()[i];
+            const int right = lbvh.getRightChildren()[i];
+            sibling += neighbor::host::lbvh_overlap_volume(node_lo(left), node_hi(left), node_lo(right), node_hi(right));
+            }
+        else
+            {
+            leaf_area += area;
+            }
+
+        unsigned int foreign = 0;
+        for (unsigned int j=0; j < N_nodes; ++j)
+            {
+            if (i == j || is_ancestor(lbvh, i, j) || is_ancestor(lbvh, j, i)) continue;
+            const neighbor::BoundingBox a(node_lo(i), node_hi(i));
+            const neighbor::BoundingBox b(node_lo(j), node_hi(j));
+            if (!a.overlap(b)) continue;
+            if (j > i) total += neighbor::host::lbvh_overlap_volume(a.lo, a.hi, b.lo, b.hi);
+            if (j >= N_internal) ++foreign;
+            }
+        epo += area*foreign;
+
+        for (int node = i; node != lbvh.getRoot(); node = lbvh.getParents()[node])
+            {
+            ++depths[i];
+            }
+        }
+
+    for (unsigned int threads : {1u, 3u})
+        {
+        neighbor::host::ThreadPool pool(threads);
+        const neighbor::LBVHQuality quality = neighbor::host::lbvh_quality(pool, lbvh, insert, 1.f, 2.f);
+        UP_ASSERT_CLOSE(quality.sah_cost, ((internal_area + 2.*leaf_area)/root_area), 1.e-8);
+        UP_ASSERT(quality.compressed_sah_cost >= quality.sah_cost);
+        UP_ASSERT_CLOSE(quality.quantization_inflation, (quality.compressed_sah_cost/quality.sah_cost), 1.e-12);
+        UP_ASSERT(quality.quantization_inflation < 1.1);
+        UP_ASSERT_CLOSE(quality.sibling_overlap, (sibling/root_volume), 1.e-8);
+        UP_ASSERT_CLOSE(quality.total_overlap, (total/root_volume), 1.e-8);
+        UP_ASSERT(quality.total_overlap >= quality.sibling_overlap);
+        UP_ASSERT_CLOSE(quality.epo, (epo/(root_area*N)), 1.e-8);
+
+        unsigned int max_depth = 0, total_depth = 0;
+        for (unsigned int i=N_internal; i < N_nodes; ++i)
+            {
+            max_depth = std::max(max_depth, depths[i]);
+            total_depth += depths[i];
+            }
+        UP_ASSERT_EQUAL(quality.max_depth, max_depth);
+        UP_ASSERT_EQUAL(quality.depth_histogram.size(), max_depth+1);
+        UP_ASSERT_EQUAL(quality.depth_histogram[0], 0);
+        unsigned int sum = 0;
+        for (auto h : quality.depth_histogram) sum += h;
+        UP_ASSERT_EQUAL(sum, N);
+        UP_ASSERT_CLOSE(quality.mean_depth, (static_cast<double>(total_depth)/N), 1.e-12);
+
+        // the leaves are the boxes of the spheres
+        UP_ASSERT_CLOSE(quality.leaf_volume_ratio, 1.0, 1.e-5);
+        }
+
+    // leaves are 8 times larger than spheres of half the radius
+    neighbor::host::ThreadPool pool(2);
+    const neighbor::LBVHQuality small = neighbor::host::lbvh_quality(pool, lbvh, neighbor::SphereInsertOp(points.get(), 0.5f*r, N));
+    UP_ASSERT_CLOSE(small.leaf_volume_ratio, 8.0, 1.e-4);
+
+    // points have no volume, so their leaves are not compared
+    neighbor::LBVH point_lbvh;
+    point_lbvh.build(pool, neighbor::PointInsertOp(points.get(), N), lo, hi);
+    const neighbor::LBVHQuality points_quality = neighbor::host::lbvh_quality(pool, point_lbvh, neighbor::PointInsertOp(points.get(), N));
+    UP_ASSERT_EQUAL(points_quality.leaf_volume_ratio, 0.);
+    UP_ASSERT(points_quality.compressed_sah_cost > points_quality.sah_cost);
+    UP_ASSERT(points_quality.sah_cost < small.sah_cost);
+    }
+
+// Test the quality metrics of small trees
+UP_TEST( lbvh_quality_small_test )
+    {
+    neighbor::host::ThreadPool pool(2);
+    neighbor::shared_array<float3> points(2);
+    points[0] = make_float3(1.f, 1.f, 1.f);
+    points[1] = make_float3(2.f, 1.f, 1.f);
+
+    // empty tree
+    neighbor::LBVH lbvh;
+    neighbor::LBVHQuality quality = neighbor::host::lbvh_quality(pool, lbvh, neighbor::PointInsertOp(points.get(), 0));
+    UP_ASSERT_EQUAL(quality.sah_cost, 0.);
+    UP_ASSERT(quality.depth_histogram.empty());
+
+    // one primitive is a root leaf
+    lbvh.build(pool, neighbor::SphereInsertOp(points.get(), 1.f, 1), make_float3(0.f, 0.f, 0.f), make_float3(4.f, 4.f, 4.f));
+    quality = neighbor::host::lbvh_quality(pool, lbvh, neighbor::SphereInsertOp(points.get(), 1.f, 1));
+    UP_ASSERT_CLOSE(quality.sah_cost, 1.0, 1.e-12);
+    UP_ASSERT_EQUAL(quality.sibling_overlap, 0.);
+    UP_ASSERT_EQUAL(quality.total_overlap, 0.);
+    UP_ASSERT_EQUAL(quality.epo, 0.);
+    UP_ASSERT_EQUAL(quality.max_depth, 0);
+    UP_ASSERT(quality.depth_histogram == std::vector<unsigned int>({1}));
+
+    // boxes of two spheres of radius 1 with centers 1 apart overlap in half their volume, and each leaf overlaps the other
+    lbvh.build(pool, neighbor::SphereInsertOp(points.get(), 1.f, 2), make_float3(0.f, 0.f, 0.f), make_float3(4.f, 4.f, 4.f));
+    quality = neighbor::host::lbvh_quality(pool, lbvh, neighbor::SphereInsertOp(points.get(), 1.f, 2));
+    UP_ASSERT_CLOSE(quality.sibling_overlap, (4./12.), 1.e-6);
+    UP_ASSERT_CLOSE(quality.total_overlap, (4./12.), 1.e-6);
+    UP_ASSERT_CLOSE(quality.sah_cost, 2.5, 1.e-6);
+    UP_ASSERT_CLOSE(quality.epo, 0.75, 1.e-6);
+    UP_ASSERT(quality.depth_histogram == std::vector<unsigned int>({0, 2}));
+    UP_ASSERT_CLOSE(quality.mean_depth, 1.0, 1.e-12);
+    }
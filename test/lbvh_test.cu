@@ -8,7 +8,9 @@
 
 #include "neighbor/neighbor.h"
 
+#include <algorithm>
 #include <random>
+#include <vector>
 
 #include "upp11_config.h"
 UP_MAIN();
@@ -580,3 +582,601 @@ UP_TEST( lbvh_small_test )
         UP_ASSERT_EQUAL(hits[1], 0);
         }
     }
+
+// Check that an LBVH has a consistent layout and nested bounding boxes
+void check_lbvh_structure(const neighbor::LBVH& lbvh)
+    {
+    const neighbor::ConstLBVHData tree = lbvh.data();
+    const int N_internal = lbvh.getNInternal();
+    const int N_nodes = lbvh.getNNodes();
+    UP_ASSERT_EQUAL(tree.root, 0);
+    UP_ASSERT_EQUAL(tree.parent[0], neighbor::LBVHSentinel);
+
+    std::vector<int> visits(N_nodes, 0);
+    for (int i=0; i < N_internal; ++i)
+        {
+        const int children[2] = {tree.left[i], tree.right[i]};
+        for (int child : children)
+            {
+            UP_ASSERT(child > 0 && child < N_nodes);
+            UP_ASSERT_EQUAL(tree.parent[child], i);
+            ++visits[child];
+            UP_ASSERT(tree.lo[child].x >= tree.lo[i].x && tree.hi[child].x <= tree.hi[i].x);
+            UP_ASSERT(tree.lo[child].y >= tree.lo[i].y && tree.hi[child].y <= tree.hi[i].y);
+            UP_ASSERT(tree.lo[child].z >= tree.lo[i].z && tree.hi[child].z <= tree.hi[i].z);
+            }
+        }
+    for (int i=1; i < N_nodes; ++i)
+        {
+        UP_ASSERT_EQUAL(visits[i], 1);
+        }
+    }
+
+// Sphere query that only accepts points inside the sphere
+struct PointSphereQueryOp : public neighbor::SphereQueryOp
+    {
+    PointSphereQueryOp(float4 *spheres_, unsigned int N_, const float3* points_)
+        : neighbor::SphereQueryOp(spheres_, N_), points(points_)
+        {}
+
+    __host__ __device__ __forceinline__ bool refine(const ThreadData& q, const int primitive) const
+        {
+        const float3 p = points[primitive];
+        const float3 dr = make_float3(p.x-q.x, p.y-q.y, p.z-q.z);
+        return (dr.x*dr.x + dr.y*dr.y + dr.z*dr.z <= q.w*q.w);
+        }
+
+    const float3* points;
+    };
+
+// Test of LBVH dynamic insertion and removal
+UP_TEST( lbvh_dynamic_test )
+    {
+    auto lbvh = std::make_shared<neighbor::LBVH>();
+
+    // random points in a box
+    const unsigned int N = 200;
+    const float3 lo = make_float3(-2.f, -3.f, -4.f);
+    const float3 hi = make_float3(6.f, 5.f, 4.f);
+    neighbor::shared_array<float3> points(N);
+        {
+        std::mt19937 mt(7);
+        std::uniform_real_distribution<float> U(0.f, 1.f);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            points[i] = make_float3(lo.x + (hi.x-lo.x)*U(mt),
+                                    lo.y + (hi.y-lo.y)*U(mt),
+                                    lo.z + (hi.z-lo.z)*U(mt));
+            }
+        }
+    neighbor::PointInsertOp insert(points.get(), N);
+
+    // check that the tree has a consistent layout and holds the expected primitives
+    auto check_tree = [&](const std::vector<unsigned int>& expected)
+        {
+        hipper::deviceSynchronize();
+        UP_ASSERT_EQUAL(lbvh->getN(), expected.size());
+        UP_ASSERT_EQUAL(lbvh->getNInternal(), (expected.size() > 0) ? expected.size()-1 : 0);
+        if (expected.size() == 0) return;
+
+        check_lbvh_structure(*lbvh);
+
+        const int N_internal = lbvh->getNInternal();
+        std::vector<unsigned int> primitives(lbvh->getPrimitives().get(), lbvh->getPrimitives().get() + expected.size());
+        for (unsigned int i=0; i < primitives.size(); ++i)
+            {
+            const float3 p = points[primitives[i]];
+            const float3 leaf_lo = lbvh->getLowerBounds()[N_internal + i];
+            const float3 leaf_hi = lbvh->getUpperBounds()[N_internal + i];
+            UP_ASSERT(leaf_lo.x == p.x && leaf_lo.y == p.y && leaf_lo.z == p.z);
+            UP_ASSERT(leaf_hi.x == p.x && leaf_hi.y == p.y && leaf_hi.z == p.z);
+            }
+        std::sort(primitives.begin(), primitives.end());
+        std::vector<unsigned int> sorted_expected(expected);
+        std::sort(sorted_expected.begin(), sorted_expected.end());
+        UP_ASSERT(primitives == sorted_expected);
+        };
+
+    // check that traversal finds every neighbor of the primitives in the tree
+    auto check_hits = [&](const std::vector<unsigned int>& expected)
+        {
+        const float rcut = 1.5f;
+        neighbor::shared_array<float4> spheres(N);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            spheres[i] = make_float4(points[i].x, points[i].y, points[i].z, rcut);
+            }
+
+        neighbor::LBVHTraverser traverser;
+        neighbor::shared_array<unsigned int> hits(N);
+            {
+            neighbor::CountNeighborsOp count(hits.get());
+            PointSphereQueryOp query(spheres.get(), N, points.get());
+            traverser.traverse(*lbvh, query, count);
+            hipper::deviceSynchronize();
+            }
+
+        for (unsigned int i=0; i < N; ++i)
+            {
+            unsigned int ref_hits = 0;
+            for (const unsigned int j : expected)
+                {
+                const float3 dr = make_float3(points[j].x-points[i].x,
+                                              points[j].y-points[i].y,
+                                              points[j].z-points[i].z);
+                if (dr.x*dr.x + dr.y*dr.y + dr.z*dr.z <= rcut*rcut)
+                    ++ref_hits;
+                }
+            UP_ASSERT_EQUAL(hits[i], ref_hits);
+            }
+        };
+
+    std::cout << "Testing LBVH insertion..." << std::endl;
+    std::vector<unsigned int> expected;
+        {
+        lbvh->build(neighbor::PointInsertOp(points.get(), N/2), lo, hi);
+        for (unsigned int i=0; i < N/2; ++i)
+            expected.push_back(i);
+        hipper::deviceSynchronize();
+        UP_ASSERT_CLOSE(lbvh->getQuality(), 1.f, 1.e-6f);
+
+        std::vector<unsigned int> inserted;
+        for (unsigned int i=N/2; i < N; ++i)
+            inserted.push_back(i);
+        lbvh->insertPrimitives(insert, inserted.data(), inserted.size());
+        expected.insert(expected.end(), inserted.begin(), inserted.end());
+        check_tree(expected);
+        check_hits(expected);
+        UP_ASSERT(lbvh->getQuality() > 0.f);
+
+        // cannot insert a primitive twice
+        UP_ASSERT_EXCEPTION(std::runtime_error, [&]{lbvh->insertPrimitives(insert, inserted.data(), 1);});
+        }
+
+    std::cout << "Testing LBVH removal..." << std::endl;
+        {
+        std::vector<unsigned int> removed;
+        for (unsigned int i=0; i < N; i += 3)
+            removed.push_back(i);
+        lbvh->removePrimitives(removed.data(), removed.size());
+        expected.erase(std::remove_if(expected.begin(), expected.end(), [](unsigned int i){ return i % 3 == 0; }),
+                       expected.end());
+        check_tree(expected);
+        check_hits(expected);
+
+        // cannot remove a primitive that is not in the tree
+        UP_ASSERT_EXCEPTION(std::runtime_error, [&]{lbvh->removePrimitives(removed.data(), 1);});
+
+        // remove all but two primitives, then grow again
+        while (expected.size() > 2)
+            {
+            lbvh->removePrimitives(&expected.back(), 1);
+            expected.pop_back();
+            }
+        check_tree(expected);
+
+        // refit a single leaf that is not primitive 0
+            {
+            const unsigned int last = expected.back();
+            lbvh->removePrimitives(&last, 1);
+            expected.pop_back();
+            UP_ASSERT(expected[0] != 0);
+            const float3 saved = points[expected[0]];
+            points[expected[0]] = make_float3(saved.x+0.5f, saved.y-0.25f, saved.z);
+            lbvh->refit(insert);
+            check_tree(expected);
+
+            points[expected[0]] = saved;
+            neighbor::host::ThreadPool pool(2);
+            lbvh->refit(pool, insert);
+            check_tree(expected);
+
+            lbvh->insertPrimitives(insert, &last, 1);
+            expected.push_back(last);
+            check_tree(expected);
+            }
+        lbvh->removePrimitives(expected.data(), 2);
+        expected.clear();
+        check_tree(expected);
+        for (unsigned int i=0; i < 5; ++i)
+            {
+            lbvh->insertPrimitives(insert, &i, 1);
+            expected.push_back(i);
+            check_tree(expected);
+            }
+        check_hits(expected);
+        }
+
+    std::cout << "Testing LBVH update..." << std::endl;
+        {
+        lbvh->build(neighbor::PointInsertOp(points.get(), N-1), lo, hi);
+        hipper::deviceSynchronize();
+        UP_ASSERT_CLOSE(lbvh->getQuality(), 1.f, 1.e-6f);
+
+        // update without rebuilding. the inserted point is inside the root, so it only adds cost
+        const unsigned int last = N-1;
+        points[last] = make_float3(0.5f*(points[0].x+points[1].x),
+                                   0.5f*(points[0].y+points[1].y),
+                                   0.5f*(points[0].z+points[1].z));
+        lbvh->setRebuildThreshold(100.f);
+        bool rebuilt = lbvh->update(insert, lo, hi, NULL, 0, &last, 1);
+        UP_ASSERT(!rebuilt);
+        UP_ASSERT(lbvh->getQuality() > 1.f);
+        expected.clear();
+        for (unsigned int i=0; i < N; ++i)
+            expected.push_back(i);
+        check_tree(expected);
+
+        // force a rebuild, which restores the quality. reinserting the point gives the same cost as before
+        UP_ASSERT_EXCEPTION(std::runtime_error, [&]{lbvh->setRebuildThreshold(0.5f);});
+        lbvh->setRebuildThreshold(1.f);
+        rebuilt = lbvh->update(insert, lo, hi, &last, 1, &last, 1);
+        UP_ASSERT(rebuilt);
+        hipper::deviceSynchronize();
+        UP_ASSERT_CLOSE(lbvh->getQuality(), 1.f, 1.e-6f);
+        check_tree(expected);
+        check_hits(expected);
+
+        // remove half of the primitives without rebuilding
+        std::vector<unsigned int> removed;
+        for (unsigned int i=1; i < N; i += 2)
+            removed.push_back(i);
+        lbvh->setRebuildThreshold(100.f);
+        rebuilt = lbvh->update(insert, lo, hi, removed.data(), removed.size(), NULL, 0);
+        UP_ASSERT(!rebuilt);
+        expected.clear();
+        for (unsigned int i=0; i < N; i += 2)
+            expected.push_back(i);
+        check_tree(expected);
+        check_hits(expected);
+
+        // scramble the primitives in the tree so that a refit degrades the quality
+        for (unsigned int i=0; i < N/2; i += 2)
+            {
+            std::swap(points[i], points[N-2-i]);
+            }
+        lbvh->refit(insert);
+        hipper::deviceSynchronize();
+        UP_ASSERT(lbvh->getQuality() > 1.f);
+        check_hits(expected);
+
+        // removed primitives stay in the insert operation, so a rebuild only includes the primitives in the tree
+        lbvh->setRebuildThreshold(1.f);
+        rebuilt = lbvh->update(insert, lo, hi, NULL, 0, NULL, 0);
+        UP_ASSERT(rebuilt);
+        hipper::deviceSynchronize();
+        UP_ASSERT_CLOSE(lbvh->getQuality(), 1.f, 1.e-6f);
+        check_tree(expected);
+        check_hits(expected);
+
+        // the rebuilt tree can be updated again with the original indexes
+        lbvh->setRebuildThreshold(100.f);
+        rebuilt = lbvh->update(insert, lo, hi, &expected.front(), 1, &removed.front(), 1);
+        UP_ASSERT(!rebuilt);
+        expected.front() = removed.front();
+        check_tree(expected);
+        check_hits(expected);
+        }
+    }
+
+// Test of the partitioned LBVH build on the host
+UP_TEST( lbvh_host_build_test )
+    {
+    // clustered points so that some partitions are empty
+    const unsigned int N = 5000;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(20.f, 20.f, 20.f);
+    neighbor::shared_array<float3> points(N);
+        {
+        std::mt19937 mt(42);
+        std::uniform_real_distribution<float> U(0.f, 1.f);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            const float3 c = (i % 2) ? make_float3(2.f, 3.f, 4.f) : make_float3(15.f, 12.f, 16.f);
+            points[i] = make_float3(c.x + 3.f*U(mt), c.y + 3.f*U(mt), c.z + 3.f*U(mt));
+            }
+        // duplicate a point to test tie breaking
+        points[N-1] = points[N-3];
+        }
+
+    neighbor::LBVH ref;
+    ref.build(neighbor::PointInsertOp(points.get(), N), lo, hi);
+    hipper::deviceSynchronize();
+
+    for (unsigned int num_threads : {1, 3})
+        {
+        std::cout << "Testing host LBVH build with " << num_threads << " threads..." << std::endl;
+        neighbor::host::ThreadPool pool(num_threads);
+        neighbor::LBVH lbvh;
+        lbvh.build(pool, neighbor::PointInsertOp(points.get(), N), lo, hi);
+        check_lbvh_structure(lbvh);
+
+        // primitives are in the same order as the GPU build, and the root encloses the same points
+        for (unsigned int i=0; i < N; ++i)
+            {
+            UP_ASSERT_EQUAL(lbvh.getPrimitives()[i], ref.getPrimitives()[i]);
+            }
+        UP_ASSERT_EQUAL(lbvh.getLowerBounds()[0].x, ref.getLowerBounds()[0].x);
+        UP_ASSERT_EQUAL(lbvh.getUpperBounds()[0].z, ref.getUpperBounds()[0].z);
+
+        // traversal finds the same neighbors
+        neighbor::shared_array<float4> spheres(N);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            spheres[i] = make_float4(points[i].x, points[i].y, points[i].z, 0.5f);
+            }
+        neighbor::shared_array<unsigned int> hits(N), ref_hits(N), host_hits(N);
+        neighbor::LBVHTraverser traverser;
+        traverser.traverse(lbvh, neighbor::SphereQueryOp(spheres.get(), N), neighbor::CountNeighborsOp(hits.get()));
+        traverser.traverse(ref, neighbor::SphereQueryOp(spheres.get(), N), neighbor::CountNeighborsOp(ref_hits.get()));
+        hipper::deviceSynchronize();
+
+        // host traversal compresses the same way as the GPU
+        traverser.traverse(pool, lbvh, neighbor::SphereQueryOp(spheres.get(), N), neighbor::CountNeighborsOp(host_hits.get()));
+        for (unsigned int i=0; i < N; ++i)
+            {
+            UP_ASSERT_EQUAL(hits[i], ref_hits[i]);
+            UP_ASSERT_EQUAL(host_hits[i], ref_hits[i]);
+            }
+        }
+
+    // small builds
+    neighbor::host::ThreadPool pool(2);
+    for (unsigned int n : {1, 2, 3})
+        {
+        neighbor::LBVH lbvh;
+        lbvh.build(pool, neighbor::PointInsertOp(points.get(), n), lo, hi);
+        UP_ASSERT_EQUAL(lbvh.getN(), n);
+        check_lbvh_structure(lbvh);
+        }
+    }
+
+// Test that self-queries starting from their leaves find the same neighbors as from the root
+UP_TEST( lbvh_self_traverse_test )
+    {
+    const float L = 10.f;
+    const unsigned int N = 2000;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(L, L, L);
+    neighbor::shared_array<float3> points(N);
+        {
+        std::mt19937 mt(5);
+        std::uniform_real_distribution<float> U(0.f, L);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            points[i] = make_float3(U(mt), U(mt), U(mt));
+            }
+        }
+
+    // a few extra queries are not primitives in the LBVH
+    const unsigned int Nq = N + 10;
+    neighbor::shared_array<float4> spheres(Nq);
+    for (unsigned int i=0; i < Nq; ++i)
+        {
+        const float3 r = points[i % N];
+        spheres[i] = make_float4(r.x + ((i < N) ? 0.f : 0.3f), r.y, r.z, 1.2f);
+        }
+    const neighbor::SphereQueryOp query(spheres.get(), Nq);
+
+    neighbor::shared_array<float3> images(27);
+        {
+        unsigned int idx=0;
+        for (int ix=-1; ix <= 1; ++ix)
+            for (int iy=-1; iy <= 1; ++iy)
+                for (int iz=-1; iz <= 1; ++iz)
+                    images[idx++] = make_float3(L*ix, L*iy, L*iz);
+        }
+    const neighbor::ImageListOp<float3> translate(images.get(), images.size());
+
+    // neighbors sorted by primitive for comparison
+    const unsigned int max_neigh = 64;
+    auto neighbors = [&](const neighbor::shared_array<unsigned int>& nlist, const neighbor::shared_array<unsigned int>& nneigh)
+        {
+        std::vector<std::vector<unsigned int>> result(Nq);
+        for (unsigned int i=0; i < Nq; ++i)
+            {
+            UP_ASSERT(nneigh[i] <= max_neigh);
+            result[i].assign(nlist.get() + i*max_neigh, nlist.get() + i*max_neigh + nneigh[i]);
+            std::sort(result[i].begin(), result[i].end());
+            }
+        return result;
+        };
+
+    neighbor::LBVH lbvh;
+    lbvh.build(neighbor::PointInsertOp(points.get(), N), lo, hi);
+    hipper::deviceSynchronize();
+
+    // remove a primitive so that the primitive indexes do not match the order of the build
+    const unsigned int removed = 17;
+    lbvh.removePrimitives(&removed, 1);
+
+    neighbor::LBVHTraverser traverser;
+    neighbor::shared_array<unsigned int> nlist(Nq*max_neigh), nneigh(Nq);
+    traverser.traverse(lbvh, query, neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh), translate);
+    hipper::deviceSynchronize();
+    const auto ref = neighbors(nlist, nneigh);
+    UP_ASSERT(ref[0].size() >= 1);
+
+    // gpu
+    traverser.traverseSelf(lbvh, query, neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh), translate);
+    hipper::deviceSynchronize();
+    UP_ASSERT(neighbors(nlist, nneigh) == ref);
+
+    // host, with a setup to replay
+    neighbor::host::ThreadPool pool(3);
+    traverser.setup(pool, lbvh);
+    traverser.traverseSelf(pool, lbvh, query, neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh), translate);
+    UP_ASSERT(neighbors(nlist, nneigh) == ref);
+    traverser.traverseSelf(pool, lbvh, query, neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh), translate);
+    UP_ASSERT(neighbors(nlist, nneigh) == ref);
+    traverser.reset();
+
+    // a single primitive is its own root
+    lbvh.build(neighbor::PointInsertOp(points.get(), 1), lo, hi);
+    hipper::deviceSynchronize();
+    neighbor::shared_array<unsigned int> hits(1);
+    traverser.traverseSelf(lbvh, neighbor::SphereQueryOp(spheres.get(), 1), neighbor::CountNeighborsOp(hits.get()));
+    hipper::deviceSynchronize();
+    UP_ASSERT_EQUAL(hits[0], 1);
+    }
+
+// Sphere query that counts the nodes tested for overlap (on one host thread only)
+struct CountingSphereQueryOp : public neighbor::SphereQueryOp
+    {
+    CountingSphereQueryOp(float4 *spheres_, unsigned int N_, unsigned long long* count_)
+        : neighbor::SphereQueryOp(spheres_, N_), count(count_)
+        {}
+
+    __host__ __device__ __forceinline__ bool overlap(const Volume& v, const neighbor::BoundingBox& box) const
+        {
+        ++(*count);
+        return v.overlap(box);
+        }
+
+    unsigned long long* count;
+    };
+
+// Test that traversing from cached entry nodes finds the same neighbors as a traversal from the root
+UP_TEST( lbvh_cached_traverse_test )
+    {
+    const float L = 10.f;
+    const unsigned int N = 2000;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(L, L, L);
+    neighbor::shared_array<float3> points(N);
+    neighbor::shared_array<float4> spheres(N);
+    std::mt19937 mt(11);
+        {
+        std::uniform_real_distribution<float> U(0.f, L);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            points[i] = make_float3(U(mt), U(mt), U(mt));
+            }
+        }
+
+    neighbor::shared_array<float3> images(27);
+        {
+        unsigned int idx=0;
+        for (int ix=-1; ix <= 1; ++ix)
+            for (int iy=-1; iy <= 1; ++iy)
+                for (int iz=-1; iz <= 1; ++iz)
+                    images[idx++] = make_float3(L*ix, L*iy, L*iz);
+        }
+    const neighbor::ImageListOp<float3> translate(images.get(), images.size());
+
+    // neighbors sorted by primitive for comparison
+    const unsigned int max_neigh = 64;
+    neighbor::shared_array<unsigned int> nlist(N*max_neigh), nneigh(N);
+    auto neighbors = [&]()
+        {
+        std::vector<std::vector<unsigned int>> result(N);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            UP_ASSERT(nneigh[i] <= max_neigh);
+            result[i].assign(nlist.get() + i*max_neigh, nlist.get() + i*max_neigh + nneigh[i]);
+            std::sort(result[i].begin(), result[i].end());
+            }
+        return result;
+        };
+
+    const neighbor::PointInsertOp insert(points.get(), N);
+    neighbor::LBVH lbvh;
+    lbvh.build(insert, lo, hi);
+    hipper::deviceSynchronize();
+
+    neighbor::LBVHTraverser traverser;
+    neighbor::host::ThreadPool pool(1);
+    neighbor::shared_array<unsigned long long> count(1);
+    std::normal_distribution<float> dx(0.f, 0.02f);
+    for (unsigned int step=0; step < 6; ++step)
+        {
+        // move the points a little, and refit
+        if (step > 0)
+            {
+            for (unsigned int i=0; i < N; ++i)
+                {
+                float3 r = points[i];
+                r.x += dx(mt); r.y += dx(mt); r.z += dx(mt);
+                r.x -= L*std::floor(r.x/L); r.y -= L*std::floor(r.y/L); r.z -= L*std::floor(r.z/L);
+                points[i] = r;
+                }
+            if (step % 2)
+                {
+                lbvh.refit(insert);
+                hipper::deviceSynchronize();
+                }
+            else
+                {
+                lbvh.refit(pool, insert);
+                }
+            }
+        for (unsigned int i=0; i < N; ++i)
+            {
+            const float3 r = points[i];
+            spheres[i] = make_float4(r.x, r.y, r.z, 1.2f);
+            }
+
+        // reference from the root
+        count[0] = 0;
+        traverser.traverse(pool, lbvh, CountingSphereQueryOp(spheres.get(), N, count.get()), neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh), translate);
+        const unsigned long long ref_count = count[0];
+        const auto ref = neighbors();
+
+        // gpu
+        traverser.traverseCached(lbvh, neighbor::SphereQueryOp(spheres.get(), N), neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh), translate);
+        hipper::deviceSynchronize();
+        UP_ASSERT(neighbors() == ref);
+
+        // host, which visits fewer nodes once the entries are cached
+        count[0] = 0;
+        traverser.traverseCached(pool, lbvh, CountingSphereQueryOp(spheres.get(), N, count.get()), neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh), translate);
+        UP_ASSERT(neighbors() == ref);
+        UP_ASSERT(count[0] < ref_count);
+        }
+
+    // the refit bounds match a new build
+    float3 rlo = points[0], rhi = points[0];
+    for (unsigned int i=1; i < N; ++i)
+        {
+        const float3 r = points[i];
+        rlo = make_float3(std::min(rlo.x, r.x), std::min(rlo.y, r.y), std::min(rlo.z, r.z));
+        rhi = make_float3(std::max(rhi.x, r.x), std::max(rhi.y, r.y), std::max(rhi.z, r.z));
+        }
+    const float3 root_lo = lbvh.getLowerBounds()[lbvh.getRoot()];
+    const float3 root_hi = lbvh.getUpperBounds()[lbvh.getRoot()];
+    UP_ASSERT(root_lo.x == rlo.x && root_lo.y == rlo.y && root_lo.z == rlo.z);
+    UP_ASSERT(root_hi.x == rhi.x && root_hi.y == rhi.y && root_hi.z == rhi.z);
+
+    // almost every entry is a leaf
+    unsigned int num_leaves = 0;
+    for (unsigned int i=0; i < N; ++i)
+        {
+        const int entry = traverser.getEntries()[i];
+        UP_ASSERT(entry >= 0 && entry < (int)lbvh.getNNodes());
+        if (entry >= (int)lbvh.getNInternal()) ++num_leaves;
+        }
+    UP_ASSERT(num_leaves > 9*N/10);
+
+    // stale entries after a rebuild with fewer primitives still find the right neighbors
+    lbvh.build(neighbor::PointInsertOp(points.get(), N/2), lo, hi);
+    hipper::deviceSynchronize();
+    traverser.traverse(pool, lbvh, neighbor::SphereQueryOp(spheres.get(), N), neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh), translate);
+    const auto ref = neighbors();
+    traverser.traverseCached(pool, lbvh, neighbor::SphereQueryOp(spheres.get(), N), neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh), translate);
+    UP_ASSERT(neighbors() == ref);
+
+    // forgetting the entries starts from the root
+    traverser.resetEntries();
+    UP_ASSERT_EQUAL(traverser.getEntries().size(), 0);
+    traverser.traverseCached(lbvh, neighbor::SphereQueryOp(spheres.get(), N), neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh), translate);
+    hipper::deviceSynchronize();
+    UP_ASSERT(neighbors() == ref);
+    UP_ASSERT_EQUAL(traverser.getEntries().size(), N);
+
+    // a single primitive is its own root
+    lbvh.build(neighbor::PointInsertOp(points.get(), 1), lo, hi);
+    lbvh.refit(pool, neighbor::PointInsertOp(points.get(), 1));
+    neighbor::shared_array<unsigned int> hits(1);
+    traverser.traverseCached(pool, lbvh, neighbor::SphereQueryOp(spheres.get(), 1), neighbor::CountNeighborsOp(hits.get()));
+    UP_ASSERT_EQUAL(hits[0], 1);
+    }
@@ -0,0 +1,154 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#include <hipper/hipper_runtime.h>
+
+#include "neighbor/neighbor.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "upp11_config.h"
+UP_MAIN();
+
+// Test that BIGMIN finds the next code inside a box
+UP_TEST( morton_bigmin_test )
+    {
+    std::mt19937 mt(3);
+    std::uniform_int_distribution<unsigned int> B(0,1023);
+    std::uniform_int_distribution<unsigned int> W(0,12);
+    for (unsigned int t=0; t < 500; ++t)
+        {
+        uint3 a, b;
+        a.x = B(mt); b.x = std::min(1023u, a.x + W(mt));
+        a.y = B(mt); b.y = std::min(1023u, a.y + W(mt));
+        a.z = B(mt); b.z = std::min(1023u, a.z + W(mt));
+        const unsigned int zmin = neighbor::calcMortonCode(a);
+        const unsigned int zmax = neighbor::calcMortonCode(b);
+
+        // all cells of the box are inside it
+        std::vector<unsigned int> cells;
+        for (unsigned int x=a.x; x <= b.x; ++x)
+            for (unsigned int y=a.y; y <= b.y; ++y)
+                for (unsigned int z=a.z; z <= b.z; ++z)
+                    {
+                    const unsigned int code = neighbor::calcMortonCode(make_uint3(x,y,z));
+                    UP_ASSERT(neighbor::mortonInBox(code, zmin, zmax));
+                    cells.push_back(code);
+                    }
+        std::sort(cells.begin(), cells.end());
+
+        // BIGMIN of codes outside the box is the next cell
+        std::uniform_int_distribution<unsigned int> C(zmin, zmax);
+        for (unsigned int i=0; i < 20; ++i)
+            {
+            const unsigned int code = C(mt);
+            if (std::binary_search(cells.begin(), cells.end(), code))
+                continue;
+            UP_ASSERT(!neighbor::mortonInBox(code, zmin, zmax));
+            const unsigned int next = *std::upper_bound(cells.begin(), cells.end(), code);
+            UP_ASSERT_EQUAL(neighbor::mortonBigMin(code, zmin, zmax), next);
+            }
+        }
+    }
+
+// Test box queries with a MortonIndex against brute force
+UP_TEST( morton_index_test )
+    {
+    const float L = 20.f;
+    const unsigned int N = 4000;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(L, L, L);
+    neighbor::shared_array<float3> points(N);
+        {
+        std::mt19937 mt(42);
+        std::uniform_real_distribution<float> U(0.f, L);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            points[i] = make_float3(U(mt), U(mt), U(mt));
+            }
+        // some points lie outside the scene and are clamped into it
+        points[0] = make_float3(-1.f, 5.f, 5.f);
+        points[1] = make_float3(5.f, L+2.f, 5.f);
+        points[2] = points[3];
+        }
+
+    // query boxes of different sizes, some hanging out of the scene
+    const unsigned int Nq = 200;
+    neighbor::shared_array<float3> qlo(Nq), qhi(Nq);
+        {
+        std::mt19937 mt(7);
+        std::uniform_real_distribution<float> U(-2.f, L+2.f);
+        std::uniform_real_distribution<float> W(0.f, 4.f);
+        for (unsigned int i=0; i < Nq; ++i)
+            {
+            qlo[i] = make_float3(U(mt), U(mt), U(mt));
+            qhi[i] = make_float3(qlo[i].x + W(mt), qlo[i].y + W(mt), qlo[i].z + W(mt));
+            }
+        qlo[0] = points[0];
+        qhi[0] = points[0];
+        qlo[1] = make_float3(-5.f, -5.f, -5.f);
+        qhi[1] = make_float3(L+5.f, L+5.f, L+5.f);
+        }
+    const neighbor::BoxQueryOp query(qlo.get(), qhi.get(), Nq);
+
+    // periodic images
+    neighbor::shared_array<float3> images(27);
+        {
+        unsigned int idx=0;
+        for (int ix=-1; ix <= 1; ++ix)
+            for (int iy=-1; iy <= 1; ++iy)
+                for (int iz=-1; iz <= 1; ++iz)
+                    images[idx++] = make_float3(L*ix, L*iy, L*iz);
+        }
+
+    neighbor::MortonIndex index;
+    for (unsigned int num_images : {1, 27})
+        {
+        const unsigned int max_neigh = N;
+        const neighbor::ImageListOp<float3> translate(images.get() + (num_images == 1 ? 13 : 0), num_images);
+
+        index.build(neighbor::PointInsertOp(points.get(), N), lo, hi);
+        neighbor::shared_array<unsigned int> nlist(Nq*max_neigh), nneigh(Nq);
+        index.query(query, neighbor::NeighborListOp(nlist.get(), nneigh.get(), max_neigh), translate);
+        hipper::deviceSynchronize();
+        UP_ASSERT_EQUAL(index.getN(), N);
+
+        for (unsigned int i=0; i < Nq; ++i)
+            {
+            std::vector<unsigned int> ref;
+            for (unsigned int j=0; j < N; ++j)
+                {
+                for (unsigned int k=0; k < num_images; ++k)
+                    {
+                    const neighbor::BoundingBox q = query.get(query.setup(i), translate.get(k));
+                    if (q.overlap(neighbor::BoundingBox(points[j], points[j])))
+                        ref.push_back(j);
+                    }
+                }
+            UP_ASSERT_EQUAL(nneigh[i], ref.size());
+            if (nneigh[i] <= max_neigh)
+                {
+                std::vector<unsigned int> neigh(nlist.get() + i*max_neigh, nlist.get() + i*max_neigh + nneigh[i]);
+                std::sort(neigh.begin(), neigh.end());
+                UP_ASSERT(neigh == ref);
+                }
+            }
+        if (num_images == 1) UP_ASSERT_EQUAL(nneigh[1], N);
+        UP_ASSERT(nneigh[0] >= 1);
+        }
+
+    // empty index
+    index.build(neighbor::PointInsertOp(points.get(), 0), lo, hi);
+    neighbor::shared_array<unsigned int> hits(Nq);
+    index.query(query, neighbor::CountNeighborsOp(hits.get()));
+    hipper::deviceSynchronize();
+    for (unsigned int i=0; i < Nq; ++i)
+        {
+        UP_ASSERT_EQUAL(hits[i], 0);
+        }
+    }
@@ -0,0 +1,267 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#include <hipper/hipper_runtime.h>
+
+#include "neighbor/neighbor.h"
+
+#include <algorithm>
+#include <random>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "upp11_config.h"
+UP_MAIN();
+
+// Output operation that counts the processed primitives and ends the traversal at the first one
+struct FirstHitOp : public neighbor::CountNeighborsOp
+    {
+    FirstHitOp(unsigned int* nneigh_)
+        : neighbor::CountNeighborsOp(nneigh_)
+        {}
+
+    __host__ __device__ __forceinline__ bool process(ThreadData& t, const int primitive) const
+        {
+        ++t.num_neigh;
+        return true;
+        }
+    };
+
+// Test that AnyOverlapOp flags queries with a neighbor and ends each traversal at the first overlap
+UP_TEST( any_overlap_test )
+    {
+    const float L = 10.f;
+    const unsigned int N = 1000;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(L, L, L);
+    neighbor::shared_array<float3> points(N);
+        {
+        std::mt19937 mt(42);
+        std::uniform_real_distribution<float> U(0.f, L);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            points[i] = make_float3(U(mt), U(mt), U(mt));
+            }
+        }
+    const neighbor::PointInsertOp insert(points.get(), N);
+
+    // small random spheres, so that most miss, and boxes around them
+    const unsigned int Nq = 500;
+    const float rcut = 0.4f;
+    neighbor::shared_array<float4> spheres(Nq);
+    neighbor::shared_array<float3> qlo(Nq), qhi(Nq);
+        {
+        std::mt19937 mt(7);
+        std::uniform_real_distribution<float> U(0.f, L);
+        for (unsigned int i=0; i < Nq; ++i)
+            {
+            spheres[i] = make_float4(U(mt), U(mt), U(mt), rcut);
+            qlo[i] = make_float3(spheres[i].x-rcut, spheres[i].y-rcut, spheres[i].z-rcut);
+            qhi[i] = make_float3(spheres[i].x+rcut, spheres[i].y+rcut, spheres[i].z+rcut);
+            }
+        }
+    const neighbor::SphereQueryOp query(spheres.get(), Nq);
+    const neighbor::BoxQueryOp box_query(qlo.get(), qhi.get(), Nq);
+
+    // spheres centered on the points always overlap their own point
+    neighbor::shared_array<float4> self_spheres(N);
+    for (unsigned int i=0; i < N; ++i)
+        {
+        self_spheres[i] = make_float4(points[i].x, points[i].y, points[i].z, rcut);
+        }
+    const neighbor::SphereQueryOp self_query(self_spheres.get(), N);
+
+    neighbor::shared_array<float3> images(27);
+        {
+        unsigned int idx=0;
+        for (int ix=-1; ix <= 1; ++ix)
+            for (int iy=-1; iy <= 1; ++iy)
+                for (int iz=-1; iz <= 1; ++iz)
+                    images[idx++] = make_float3(L*ix, L*iy, L*iz);
+        }
+    const neighbor::ImageListOp<float3> translate(images.get(), images.size());
+
+    // each query is flagged if it has a neighbor, and at most one primitive is processed
+    neighbor::shared_array<unsigned int> count(N), flags(N), hits(N);
+    auto check = [&](unsigned int num_queries)
+        {
+        unsigned int num_overlap = 0;
+        for (unsigned int i=0; i < num_queries; ++i)
+            {
+            UP_ASSERT_EQUAL(flags[i], (count[i] > 0) ? 1u : 0u);
+            UP_ASSERT_EQUAL(hits[i], flags[i]);
+            num_overlap += flags[i];
+            }
+        return num_overlap;
+        };
+
+    // lbvh
+    neighbor::LBVH lbvh;
+    lbvh.build(insert, lo, hi);
+    hipper::deviceSynchronize();
+    neighbor::LBVHTraverser traverser;
+    traverser.traverse(lbvh, query, neighbor::CountNeighborsOp(count.get()), translate);
+    traverser.traverse(lbvh, query, neighbor::AnyOverlapOp(flags.get()), translate);
+    traverser.traverse(lbvh, query, FirstHitOp(hits.get()), translate);
+    hipper::deviceSynchronize();
+    const unsigned int num_overlap = check(Nq);
+    UP_ASSERT(num_overlap > 0 && num_overlap < Nq);
+
+    neighbor::host::ThreadPool pool(3);
+    traverser.traverse(pool, lbvh, query, neighbor::CountNeighborsOp(count.get()), translate);
+    traverser.traverse(pool, lbvh, query, neighbor::AnyOverlapOp(flags.get()), translate);
+    traverser.traverse(pool, lbvh, query, FirstHitOp(hits.get()), translate);
+    UP_ASSERT_EQUAL(check(Nq), num_overlap);
+
+    // self and cached traversals
+    traverser.traverseSelf(lbvh, self_query, neighbor::CountNeighborsOp(count.get()), translate);
+    traverser.traverseSelf(lbvh, self_query, neighbor::AnyOverlapOp(flags.get()), translate);
+    traverser.traverseSelf(lbvh, self_query, FirstHitOp(hits.get()), translate);
+    hipper::deviceSynchronize();
+    UP_ASSERT_EQUAL(check(N), N);
+    traverser.traverseCached(pool, lbvh, self_query, neighbor::CountNeighborsOp(count.get()), translate);
+    traverser.traverseCached(pool, lbvh, self_query, neighbor::AnyOverlapOp(flags.get()), translate);
+    traverser.traverseCached(pool, lbvh, self_query, FirstHitOp(hits.get()), translate);
+    UP_ASSERT_EQUAL(check(N), N);
+
+    // cell list
+    neighbor::CellList cells;
+    cells.build(pool, insert, lo, hi, rcut);
+    cells.traverse(pool, query, neighbor::CountNeighborsOp(count.get()), translate);
+    cells.traverse(pool, query, neighbor::AnyOverlapOp(flags.get()), translate);
+    cells.traverse(pool, query, FirstHitOp(hits.get()), translate);
+    check(Nq);
+
+    // lazy lbvh
+    neighbor::LazyLBVH lazy;
+    lazy.build(pool, insert, lo, hi);
+    lazy.traverse(pool, query, neighbor::CountNeighborsOp(count.get()), translate);
+    lazy.traverse(pool, query, neighbor::AnyOverlapOp(flags.get()), translate);
+    lazy.traverse(pool, query, FirstHitOp(hits.get()), translate);
+    check(Nq);
+
+    // morton index
+    neighbor::MortonIndex index;
+    index.build(insert, lo, hi);
+    index.query(box_query, neighbor::CountNeighborsOp(count.get()), translate);
+    index.query(box_query, neighbor::AnyOverlapOp(flags.get()), translate);
+    index.query(box_query, FirstHitOp(hits.get()), translate);
+    hipper::deviceSynchronize();
+    check(Nq);
+    }
+
+// Test that capped neighbor lists and saturating counts stop at their maximum
+UP_TEST( capped_output_test )
+    {
+    const float L = 10.f;
+    const unsigned int N = 3000;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(L, L, L);
+    neighbor::shared_array<float3> points(N);
+        {
+        std::mt19937 mt(42);
+        std::uniform_real_distribution<float> U(0.f, L);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            points[i] = make_float3(U(mt), U(mt), U(mt));
+            }
+        }
+    const neighbor::PointInsertOp insert(points.get(), N);
+
+    // about 12 neighbors per sphere, so many have more than the cap and some have fewer
+    const float rcut = 1.f;
+    neighbor::shared_array<float4> spheres(N);
+    for (unsigned int i=0; i < N; ++i)
+        {
+        spheres[i] = make_float4(points[i].x, points[i].y, points[i].z, rcut);
+        }
+    const neighbor::SphereQueryOp query(spheres.get(), N);
+
+    neighbor::shared_array<float3> images(27);
+        {
+        unsigned int idx=0;
+        for (int ix=-1; ix <= 1; ++ix)
+            for (int iy=-1; iy <= 1; ++iy)
+                for (int iz=-1; iz <= 1; ++iz)
+                    images[idx++] = make_float3(L*ix, L*iy, L*iz);
+        }
+    const neighbor::ImageListOp<float3> translate(images.get(), images.size());
+
+    const unsigned int max_neigh = 64;
+    const unsigned int cap = 12;
+    neighbor::shared_array<unsigned int> ref_nlist(N*max_neigh), ref_nneigh(N);
+    neighbor::shared_array<unsigned int> nlist(N*max_neigh), nneigh(N), count(N);
+
+    // the capped list (with the cap as its stride) holds distinct neighbors from the full list, and the count
+    // saturates at the cap
+    auto check = [&]
+        {
+        unsigned int num_saturated = 0;
+        for (unsigned int i=0; i < N; ++i)
+            {
+            UP_ASSERT(ref_nneigh[i] <= max_neigh);
+            const unsigned int expected = std::min(ref_nneigh[i], cap);
+            UP_ASSERT_EQUAL(nneigh[i], expected);
+            UP_ASSERT_EQUAL(count[i], expected);
+
+            std::vector<unsigned int> ref(ref_nlist.get() + i*max_neigh, ref_nlist.get() + i*max_neigh + ref_nneigh[i]);
+            std::vector<unsigned int> neigh(nlist.get() + i*cap, nlist.get() + i*cap + nneigh[i]);
+            std::sort(ref.begin(), ref.end());
+            std::sort(neigh.begin(), neigh.end());
+            UP_ASSERT(std::adjacent_find(neigh.begin(), neigh.end()) == neigh.end());
+            UP_ASSERT(std::includes(ref.begin(), ref.end(), neigh.begin(), neigh.end()));
+            if (ref_nneigh[i] > cap) ++num_saturated;
+            }
+        return num_saturated;
+        };
+
+    // lbvh
+    neighbor::LBVH lbvh;
+    lbvh.build(insert, lo, hi);
+    hipper::deviceSynchronize();
+    neighbor::LBVHTraverser traverser;
+    traverser.traverse(lbvh, query, neighbor::NeighborListOp(ref_nlist.get(), ref_nneigh.get(), max_neigh), translate);
+    traverser.traverse(lbvh, query, neighbor::CappedNeighborListOp(nlist.get(), nneigh.get(), cap), translate);
+    traverser.traverse(lbvh, query, neighbor::SaturatingCountNeighborsOp(count.get(), cap), translate);
+    hipper::deviceSynchronize();
+    const unsigned int num_saturated = check();
+    UP_ASSERT(num_saturated > 0 && num_saturated < N);
+
+    neighbor::host::ThreadPool pool(3);
+    traverser.traverseSelf(pool, lbvh, query, neighbor::CappedNeighborListOp(nlist.get(), nneigh.get(), cap), translate);
+    traverser.traverseSelf(pool, lbvh, query, neighbor::SaturatingCountNeighborsOp(count.get(), cap), translate);
+    UP_ASSERT_EQUAL(check(), num_saturated);
+
+    // an uncapped list does not check if it is full, and still counts past its maximum
+    static_assert(std::is_same<decltype(std::declval<neighbor::NeighborListOp>().process(std::declval<neighbor::NeighborListOp::ThreadData&>(), 0)), void>::value,
+                  "NeighborListOp should not end the traversal");
+    static_assert(std::is_same<decltype(std::declval<neighbor::CappedNeighborListOp>().process(std::declval<neighbor::NeighborListOp::ThreadData&>(), 0)), bool>::value,
+                  "CappedNeighborListOp should end the traversal");
+    traverser.traverse(lbvh, query, neighbor::NeighborListOp(nlist.get(), nneigh.get(), cap), translate);
+    hipper::deviceSynchronize();
+    for (unsigned int i=0; i < N; ++i)
+        {
+        UP_ASSERT_EQUAL(nneigh[i], ref_nneigh[i]);
+        }
+
+    // a cap of zero finds nothing
+    traverser.traverse(pool, lbvh, query, neighbor::CappedNeighborListOp(nlist.get(), nneigh.get(), 0), translate);
+    traverser.traverse(pool, lbvh, query, neighbor::SaturatingCountNeighborsOp(count.get(), 0), translate);
+    for (unsigned int i=0; i < N; ++i)
+        {
+        UP_ASSERT_EQUAL(nneigh[i], 0);
+        UP_ASSERT_EQUAL(count[i], 0);
+        }
+
+    // cell list
+    neighbor::CellList cells;
+    cells.build(pool, insert, lo, hi, rcut);
+    cells.traverse(pool, query, neighbor::NeighborListOp(ref_nlist.get(), ref_nneigh.get(), max_neigh), translate);
+    cells.traverse(pool, query, neighbor::CappedNeighborListOp(nlist.get(), nneigh.get(), cap), translate);
+    cells.traverse(pool, query, neighbor::SaturatingCountNeighborsOp(count.get(), cap), translate);
+    UP_ASSERT(check() > 0);
+    }
@@ -0,0 +1,142 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#include <hipper/hipper_runtime.h>
+
+#include "neighbor/neighbor.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "upp11_config.h"
+UP_MAIN();
+
+//! Get the names of the phases of a timer.
+std::vector<std::string> get_names(const neighbor::PhaseTimer& timer)
+    {
+    std::vector<std::string> names;
+    for (const auto& p : timer.getPhases())
+        {
+        names.push_back(p.name);
+        }
+    return names;
+    }
+
+// Test that the phases of the LBVH build and traversal are timed
+UP_TEST( phase_timer_test )
+    {
+    const float L = 10.f;
+    const unsigned int N = 200;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(L, L, L);
+    neighbor::shared_array<float3> points(N);
+    neighbor::shared_array<float4> spheres(N);
+        {
+        std::mt19937 mt(42);
+        std::uniform_real_distribution<float> U(0.f, L);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            points[i] = make_float3(U(mt), U(mt), U(mt));
+            spheres[i] = make_float4(points[i].x, points[i].y, points[i].z, 1.f);
+            }
+        }
+    const neighbor::PointInsertOp insert(points.get(), N);
+    const neighbor::SphereQueryOp query(spheres.get(), N);
+    neighbor::shared_array<unsigned int> hits(N), ref_hits(N);
+    neighbor::shared_array<float3> images(1);
+    images[0] = make_float3(0.f, 0.f, 0.f);
+    const neighbor::ImageListOp<float3> translate(images.get(), images.size());
+
+    neighbor::PhaseTimer timer;
+    UP_ASSERT(timer.getPhases().empty());
+    UP_ASSERT_EQUAL(timer.getTotalTime(), 0.);
+
+    // device build
+    neighbor::LBVH lbvh;
+    lbvh.build(neighbor::LBVH::LaunchParameters(128, 0), insert, lo, hi, timer);
+    UP_ASSERT(get_names(timer) == std::vector<std::string>({"codes", "sort", "tree", "bubble"}));
+    for (const auto& p : timer.getPhases())
+        {
+        UP_ASSERT(p.time >= 0.);
+        UP_ASSERT(p.bytes > 0);
+        }
+    UP_ASSERT_EQUAL(timer.getPhases()[0].count, N);
+    UP_ASSERT_EQUAL(timer.getPhases()[2].count, N-1);
+    UP_ASSERT(timer.getTotalTime() >= timer.getTime("sort"));
+    UP_ASSERT_EQUAL(timer.getTime("compress"), 0.);
+
+    // the timed build is the same as the untimed one
+    neighbor::LBVH ref_lbvh;
+    ref_lbvh.build(insert, lo, hi);
+    hipper::deviceSynchronize();
+    for (unsigned int i=0; i < N; ++i)
+        {
+        UP_ASSERT_EQUAL(lbvh.getPrimitives()[i], ref_lbvh.getPrimitives()[i]);
+        }
+
+    // device traversal without setup compresses first
+    neighbor::LBVHTraverser traverser;
+    traverser.traverse(neighbor::LBVHTraverser::LaunchParameters(128, 0),
+                       lbvh,
+                       query,
+                       neighbor::CountNeighborsOp(hits.get()),
+                       translate,
+                       neighbor::NullTransformOp(),
+                       timer);
+    UP_ASSERT(get_names(timer) == std::vector<std::string>({"compress", "traverse"}));
+    UP_ASSERT_EQUAL(timer.getPhases()[0].count, lbvh.getNNodes());
+    UP_ASSERT_EQUAL(timer.getPhases()[1].count, N);
+
+    neighbor::LBVHTraverser ref_traverser;
+    ref_traverser.traverse(ref_lbvh, query, neighbor::CountNeighborsOp(ref_hits.get()), translate);
+    hipper::deviceSynchronize();
+    for (unsigned int i=0; i < N; ++i)
+        {
+        UP_ASSERT_EQUAL(hits[i], ref_hits[i]);
+        }
+
+    // setup times the compression, so the traversal only times itself
+    traverser.setup(neighbor::LBVHTraverser::LaunchParameters(128, 0), lbvh, neighbor::NullTransformOp(), timer);
+    UP_ASSERT(get_names(timer) == std::vector<std::string>({"compress"}));
+    traverser.traverse(neighbor::LBVHTraverser::LaunchParameters(128, 0),
+                       lbvh,
+                       query,
+                       neighbor::CountNeighborsOp(hits.get()),
+                       translate,
+                       neighbor::NullTransformOp(),
+                       timer);
+    UP_ASSERT(get_names(timer) == std::vector<std::string>({"traverse"}));
+    traverser.reset();
+
+    // host build and traversal
+    neighbor::host::ThreadPool pool(2);
+    lbvh.build(pool, insert, lo, hi, timer);
+    UP_ASSERT(get_names(timer) == std::vector<std::string>({"partition", "buckets", "top"}));
+    UP_ASSERT_EQUAL(timer.getPhases()[0].count, N);
+    for (const auto& p : timer.getPhases())
+        {
+        UP_ASSERT(p.time >= 0.);
+        }
+
+    traverser.traverse(pool, lbvh, query, neighbor::CountNeighborsOp(hits.get()), translate, neighbor::NullTransformOp(), timer);
+    UP_ASSERT(get_names(timer) == std::vector<std::string>({"compress", "traverse"}));
+    UP_ASSERT_EQUAL(timer.getPhases()[1].count, N);
+    for (unsigned int i=0; i < N; ++i)
+        {
+        UP_ASSERT_EQUAL(hits[i], ref_hits[i]);
+        }
+
+    // an empty traversal has no phases
+    traverser.traverse(pool,
+                       lbvh,
+                       neighbor::SphereQueryOp(spheres.get(), 0),
+                       neighbor::CountNeighborsOp(hits.get()),
+                       translate,
+                       neighbor::NullTransformOp(),
+                       timer);
+    UP_ASSERT(timer.getPhases().empty());
+    }
@@ -0,0 +1,67 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+/*!
+ * \file test_systems.h
+ * \brief Defines systems and operations shared by the unit tests.
+ */
+
+#ifndef NEIGHBOR_TEST_TEST_SYSTEMS_H_
+#define NEIGHBOR_TEST_TEST_SYSTEMS_H_
+
+#include <hipper/hipper_runtime.h>
+
+#include "neighbor/neighbor.h"
+
+#include <random>
+
+//! Sphere query that only accepts even (transformed) primitive indexes.
+struct EvenSphereQueryOp : public neighbor::SphereQueryOp
+    {
+    EvenSphereQueryOp(float4* spheres_, unsigned int N_)
+        : neighbor::SphereQueryOp(spheres_, N_)
+        {}
+
+    __host__ __device__ __forceinline__ bool refine(const ThreadData& q, const int primitive) const
+        {
+        return (primitive % 2 == 0);
+        }
+    };
+
+//! Place points uniformly at random in a cubic box.
+/*!
+ * \param points Points to place.
+ * \param L Edge length of the box, which has its lower corner at the origin.
+ * \param seed Seed for the random number generator.
+ */
+inline void makeUniformPoints(neighbor::shared_array<float3>& points, float L, unsigned int seed)
+    {
+    std::mt19937 mt(seed);
+    std::uniform_real_distribution<float> U(0.f, L);
+    for (unsigned int i=0; i < points.size(); ++i)
+        {
+        points[i] = make_float3(U(mt), U(mt), U(mt));
+        }
+    }
+
+//! Make the 27 periodic images of a cubic box.
+/*!
+ * \param L Edge length of the box.
+ *
+ * \returns The image vectors, with the self image at index 13.
+ */
+inline neighbor::shared_array<float3> makeCubicImages(float L)
+    {
+    neighbor::shared_array<float3> images(27);
+    unsigned int idx=0;
+    for (int ix=-1; ix <= 1; ++ix)
+        for (int iy=-1; iy <= 1; ++iy)
+            for (int iz=-1; iz <= 1; ++iz)
+                images[idx++] = make_float3(L*ix, L*iy, L*iz);
+    return images;
+    }
+
+#endif // NEIGHBOR_TEST_TEST_SYSTEMS_H_
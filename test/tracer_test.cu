@@ -0,0 +1,179 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#include <hipper/hipper_runtime.h>
+
+#include "neighbor/neighbor.h"
+
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "upp11_config.h"
+UP_MAIN();
+
+//! Count the occurrences of a string in a trace.
+unsigned int count_matches(const std::string& trace, const std::string& s)
+    {
+    unsigned int count = 0;
+    for (size_t pos = trace.find(s); pos != std::string::npos; pos = trace.find(s, pos+s.size()))
+        {
+        ++count;
+        }
+    return count;
+    }
+
+// Test that phases, chunks, and allocations are traced
+UP_TEST( tracer_test )
+    {
+    const float L = 10.f;
+    const unsigned int N = 500;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(L, L, L);
+    neighbor::shared_array<float3> points(N);
+    neighbor::shared_array<float4> spheres(N);
+        {
+        std::mt19937 mt(42);
+        std::uniform_real_distribution<float> U(0.f, L);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            points[i] = make_float3(U(mt), U(mt), U(mt));
+            spheres[i] = make_float4(points[i].x, points[i].y, points[i].z, 1.f);
+            }
+        }
+    const neighbor::PointInsertOp insert(points.get(), N);
+    const neighbor::SphereQueryOp query(spheres.get(), N);
+    neighbor::shared_array<unsigned int> hits(N);
+    neighbor::shared_array<float3> images(1);
+    images[0] = make_float3(0.f, 0.f, 0.f);
+    const neighbor::ImageListOp<float3> translate(images.get(), images.size());
+
+    neighbor::Tracer tracer;
+    UP_ASSERT_EQUAL(tracer.getNumEvents(), 0);
+    UP_ASSERT_EQUAL(tracer.getNumDropped(), 0);
+
+    // host build and traversal with traced phases and chunks
+    neighbor::host::ThreadPool pool(2);
+    neighbor::LBVH lbvh;
+    lbvh.build(pool, insert, lo, hi, tracer);
+    UP_ASSERT_EQUAL(tracer.getNumEvents(), 3);
+
+    neighbor::LBVHTraverser traverser;
+    traverser.getScheduler().setTracer(&tracer);
+    UP_ASSERT(traverser.getScheduler().getTracer() == &tracer);
+    traverser.traverse(pool, lbvh, query, neighbor::CountNeighborsOp(hits.get()), translate, neighbor::NullTransformOp(), tracer);
+    const unsigned int num_chunks = traverser.getScheduler().getNumChunks();
+    const unsigned int num_steals = traverser.getScheduler().getNumSteals();
+    UP_ASSERT(num_chunks > 0);
+    UP_ASSERT_EQUAL(tracer.getNumEvents(), 3 + 2 + num_chunks + num_steals);
+    traverser.getScheduler().setTracer(nullptr);
+
+    std::ostringstream s;
+    tracer.write(s);
+    const std::string trace = s.str();
+    UP_ASSERT_EQUAL(trace.find("{\"traceEvents\":["), 0);
+    UP_ASSERT(trace.find("\"dropped\":0") != std::string::npos);
+    UP_ASSERT_EQUAL(count_matches(trace, "\"name\":\"partition\",\"cat\":\"phase\",\"ph\":\"X\""), 1);
+    UP_ASSERT_EQUAL(count_matches(trace, "\"name\":\"top\""), 1);
+    UP_ASSERT_EQUAL(count_matches(trace, "\"name\":\"compress\""), 1);
+    UP_ASSERT_EQUAL(count_matches(trace, "\"name\":\"traverse\""), 1);
+    UP_ASSERT_EQUAL(count_matches(trace, "\"name\":\"chunk\",\"cat\":\"scheduler\""), num_chunks);
+    UP_ASSERT_EQUAL(count_matches(trace, "\"name\":\"steal\""), num_steals);
+    UP_ASSERT(trace.find("\"args\":{\"count\":" + std::to_string(N)) != std::string::npos);
+
+    // chunks are recorded on the thread that processed them
+    std::set<std::string> tids;
+    for (size_t pos = trace.find("\"name\":\"chunk\""); pos != std::string::npos; pos = trace.find("\"name\":\"chunk\"", pos+1))
+        {
+        const size_t tid = trace.find("\"tid\":", pos);
+        tids.insert(trace.substr(tid, trace.find(',', tid)-tid));
+        }
+    UP_ASSERT(tids.size() >= 1 && tids.size() <= 2);
+
+    // allocations and frees are traced with their size
+    tracer.clear();
+    UP_ASSERT_EQUAL(tracer.getNumEvents(), 0);
+    neighbor::Tracer::setAllocationTracer(&tracer);
+        {
+        neighbor::shared_array<double> a(10);
+        }
+    neighbor::Tracer::setAllocationTracer(nullptr);
+    neighbor::shared_array<double> b(10);
+    UP_ASSERT_EQUAL(tracer.getNumEvents(), 2);
+    s.str("");
+    tracer.write(s);
+    UP_ASSERT_EQUAL(count_matches(s.str(), "\"name\":\"allocate\",\"cat\":\"memory\",\"ph\":\"i\""), 1);
+    UP_ASSERT_EQUAL(count_matches(s.str(), "\"name\":\"free\""), 1);
+    UP_ASSERT_EQUAL(count_matches(s.str(), "\"bytes\":80}"), 2);
+    }
+
+// Test that the ring buffer keeps the newest events
+UP_TEST( tracer_ring_test )
+    {
+    UP_ASSERT_EXCEPTION(std::runtime_error, []{ neighbor::Tracer tracer(0); });
+
+    neighbor::Tracer tracer(4);
+    UP_ASSERT_EQUAL(tracer.getCapacity(), 4);
+    const char* names[] = {"a", "b", "c", "d", "e", "f"};
+    for (unsigned int i=0; i < 6; ++i)
+        {
+        tracer.complete(names[i], "test", 1000*i, 1000*i+500, i, 0);
+        }
+    UP_ASSERT_EQUAL(tracer.getNumEvents(), 4);
+    UP_ASSERT_EQUAL(tracer.getNumDropped(), 2);
+
+    std::ostringstream s;
+    tracer.write(s);
+    const std::string trace = s.str();
+    UP_ASSERT(trace.find("\"name\":\"a\"") == std::string::npos);
+    UP_ASSERT(trace.find("\"name\":\"b\"") == std::string::npos);
+    const size_t c = trace.find("\"name\":\"c\"");
+    const size_t f = trace.find("\"name\":\"f\"");
+    UP_ASSERT(c != std::string::npos && f != std::string::npos && c < f);
+    UP_ASSERT(trace.find("\"ts\":2.000,\"dur\":0.500") != std::string::npos);
+    UP_ASSERT(trace.find("\"dropped\":2") != std::string::npos);
+
+    // names are escaped
+    tracer.clear();
+    tracer.instant("say \"hi\"\n", "test", 0, 0);
+    s.str("");
+    tracer.write(s);
+    UP_ASSERT(s.str().find("\"name\":\"say \\\"hi\\\"\\u000a\"") != std::string::npos);
+    UP_ASSERT(s.str().find("\"ph\":\"i\",\"ts\":") != std::string::npos);
+
+    // threads wrapping around the buffer never tear an event, whose count and bytes are equal
+    tracer.clear();
+    const unsigned int num_threads = 4;
+    const unsigned int num_per_thread = 10000;
+    std::vector<std::thread> threads;
+    for (unsigned int t=0; t < num_threads; ++t)
+        {
+        threads.emplace_back([&tracer, t]
+            {
+            for (unsigned long long i=0; i < num_per_thread; ++i)
+                {
+                const unsigned long long value = t*num_per_thread + i;
+                tracer.complete("race", "test", 0, 0, value, value);
+                }
+            });
+        }
+    for (auto& thread : threads) thread.join();
+    UP_ASSERT(tracer.getNumEvents() >= 1 && tracer.getNumEvents() <= 4);
+    UP_ASSERT_EQUAL(tracer.getNumEvents() + tracer.getNumDropped(), num_threads*num_per_thread);
+    s.str("");
+    tracer.write(s);
+    const std::string race = s.str();
+    UP_ASSERT_EQUAL(count_matches(race, "\"name\":\"race\""), tracer.getNumEvents());
+    for (size_t pos = race.find("\"count\":"); pos != std::string::npos; pos = race.find("\"count\":", pos+1))
+        {
+        const size_t bytes = race.find("\"bytes\":", pos);
+        const std::string count = race.substr(pos+8, race.find(',', pos)-pos-8);
+        UP_ASSERT_EQUAL(count, race.substr(bytes+8, race.find('}', bytes)-bytes-8));
+        }
+    }
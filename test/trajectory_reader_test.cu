@@ -0,0 +1,309 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#include <hipper/hipper_runtime.h>
+
+#include "neighbor/neighbor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "upp11_config.h"
+UP_MAIN();
+
+//! Chunk of a GSD file.
+struct Chunk
+    {
+    std::uint64_t frame;
+    std::string name;
+    std::uint8_t type;
+    std::uint64_t N;
+    std::uint32_t M;
+    std::vector<char> data;
+    };
+
+//! Make a chunk of floats.
+Chunk float_chunk(std::uint64_t frame, const std::string& name, std::uint64_t N, std::uint32_t M, const std::vector<float>& values)
+    {
+    Chunk c = {frame, name, 9, N, M, std::vector<char>(values.size()*sizeof(float))};
+    std::memcpy(c.data.data(), values.data(), c.data.size());
+    return c;
+    }
+
+//! Write a minimal GSD file.
+/*!
+ * \param filename Name of the file.
+ * \param version GSD version (1 or 2), which sets the layout of the names.
+ * \param chunks Chunks of the file.
+ * \param offset Extra bytes before the data of each chunk, to misalign it.
+ */
+void write_gsd(const std::string& filename, unsigned int version, const std::vector<Chunk>& chunks, unsigned int offset = 0)
+    {
+    std::vector<std::string> names;
+    for (const auto& c : chunks)
+        {
+        if (std::find(names.begin(), names.end(), c.name) == names.end()) names.push_back(c.name);
+        }
+
+    std::vector<char> file(256, 0);
+    std::vector<std::uint64_t> locations;
+    for (const auto& c : chunks)
+        {
+        file.resize(file.size() + offset, 0);
+        locations.push_back(file.size());
+        file.insert(file.end(), c.data.begin(), c.data.end());
+        }
+
+    // namelist
+    const std::uint64_t namelist_location = file.size();
+    const std::uint64_t namelist_entries = names.size() + 1;
+    std::vector<char> namelist(64*namelist_entries, 0);
+    size_t pos = 0;
+    for (const auto& n : names)
+        {
+        std::memcpy(namelist.data() + pos, n.c_str(), n.size());
+        pos += (version == 1) ? 64 : n.size()+1;
+        }
+    file.insert(file.end(), namelist.begin(), namelist.end());
+
+    // index, with one unused entry
+    const std::uint64_t index_location = file.size();
+    const std::uint64_t index_entries = chunks.size() + 1;
+    file.resize(file.size() + 32*index_entries, 0);
+    for (size_t i=0; i < chunks.size(); ++i)
+        {
+        char* e = file.data() + index_location + 32*i;
+        const std::uint16_t id = std::find(names.begin(), names.end(), chunks[i].name) - names.begin();
+        std::memcpy(e, &chunks[i].frame, 8);
+        std::memcpy(e + 8, &chunks[i].N, 8);
+        std::memcpy(e + 16, &locations[i], 8);
+        std::memcpy(e + 24, &chunks[i].M, 4);
+        std::memcpy(e + 28, &id, 2);
+        std::memcpy(e + 30, &chunks[i].type, 1);
+        }
+
+    // header
+    const std::uint64_t magic = 0x65DF65DF65DF65DFull;
+    const std::uint32_t gsd_version = version << 16;
+    std::memcpy(file.data(), &magic, 8);
+    std::memcpy(file.data() + 8, &index_location, 8);
+    std::memcpy(file.data() + 16, &index_entries, 8);
+    std::memcpy(file.data() + 24, &namelist_location, 8);
+    std::memcpy(file.data() + 32, &namelist_entries, 8);
+    std::memcpy(file.data() + 44, &gsd_version, 4);
+
+    std::ofstream f(filename.c_str(), std::ios::binary);
+    f.write(file.data(), file.size());
+    }
+
+//! Count neighbors of each frame point by brute force in a periodic orthorhombic box.
+std::vector<unsigned int> brute_force(const neighbor::host::TrajectoryFrame& frame, float rcut)
+    {
+    std::vector<unsigned int> counts(frame.N, 0);
+    for (unsigned int i=0; i < frame.N; ++i)
+        for (unsigned int j=0; j < frame.N; ++j)
+            {
+            float d[3] = {frame.positions[i].x - frame.positions[j].x,
+                          frame.positions[i].y - frame.positions[j].y,
+                          frame.positions[i].z - frame.positions[j].z};
+            const float L[3] = {frame.L.x, frame.L.y, frame.L.z};
+            float dr2 = 0.f;
+            for (unsigned int k=0; k < 3; ++k)
+                {
+                if (frame.periodic[k]) d[k] -= L[k]*std::round(d[k]/L[k]);
+                dr2 += d[k]*d[k];
+                }
+            if (dr2 <= rcut*rcut) ++counts[i];
+            }
+    return counts;
+    }
+
+// Test that GSD files are read in place and can be traversed
+UP_TEST( trajectory_reader_gsd_test )
+    {
+    const std::string filename = "trajectory_reader_test.gsd";
+    const unsigned int N = 50;
+    std::vector<float> frame0(3*N), frame1(3*N), diameters(N);
+    for (unsigned int i=0; i < N; ++i)
+        {
+        for (unsigned int k=0; k < 3; ++k)
+            {
+            frame0[3*i+k] = -2.5f + 5.f*((7*i + 3*k) % N)/N;
+            frame1[3*i+k] = -2.5f + 5.f*((11*i + 5*k) % N)/N;
+            }
+        diameters[i] = 1.f + 0.01f*i;
+        }
+    std::vector<Chunk> chunks = {float_chunk(0, "configuration/box", 6, 1, {5.f, 5.f, 5.f, 0.f, 0.f, 0.f}),
+                                 {0, "particles/N", 3, 1, 1, std::vector<char>(4)},
+                                 float_chunk(0, "particles/position", N, 3, frame0),
+                                 float_chunk(0, "particles/diameter", N, 1, diameters),
+                                 float_chunk(1, "particles/position", N, 3, frame1)};
+    std::memcpy(chunks[1].data.data(), &N, 4);
+
+    for (unsigned int version : {1, 2})
+        {
+        for (unsigned int offset : {0, 1})
+            {
+            write_gsd(filename, version, chunks, offset);
+            neighbor::host::TrajectoryReader reader(filename);
+            UP_ASSERT(reader.getFormat() == neighbor::host::TrajectoryReader::Format::GSD);
+            UP_ASSERT_EQUAL(reader.getNumFrames(), 2);
+
+            const neighbor::host::TrajectoryFrame& f0 = reader.read(0);
+            UP_ASSERT_EQUAL(f0.N, N);
+            UP_ASSERT_EQUAL(f0.L.x, 5.f);
+            UP_ASSERT_EQUAL(f0.origin.x, -2.5f);
+            UP_ASSERT_EQUAL(f0.lo.z, -2.5f);
+            UP_ASSERT_EQUAL(f0.hi.z, 2.5f);
+            UP_ASSERT(f0.periodic[0] && f0.periodic[1] && f0.periodic[2]);
+            UP_ASSERT(f0.diameters != nullptr);
+            UP_ASSERT_EQUAL(f0.diameters[3], diameters[3]);
+            UP_ASSERT_EQUAL(f0.positions[7].y, frame0[22]);
+
+            // the second frame takes its box and diameters from the first
+            const neighbor::host::TrajectoryFrame& f1 = reader.read(1);
+            UP_ASSERT_EQUAL(f1.N, N);
+            UP_ASSERT_EQUAL(f1.L.y, 5.f);
+            UP_ASSERT_EQUAL(f1.positions[7].y, frame1[22]);
+            UP_ASSERT(f1.diameters != nullptr);
+            UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ reader.read(2); });
+            }
+        }
+
+    // aligned positions are not copied
+        {
+        write_gsd(filename, 2, chunks);
+        neighbor::host::TrajectoryReader reader(filename);
+        const neighbor::host::TrajectoryFrame& frame = reader.read(1);
+        std::ifstream f(filename.c_str(), std::ios::binary);
+        std::vector<char> file((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        const size_t offset = 256 + 24 + 4 + 12*N + 4*N;
+        UP_ASSERT(std::memcmp(frame.positions, file.data() + offset, 12*N) == 0);
+
+        // traverse the frame on the host
+        const float rcut = 1.f;
+        neighbor::host::ThreadPool pool(2);
+        neighbor::LBVH lbvh;
+        lbvh.build(pool, frame.getInsertOp(), frame.lo, frame.hi);
+        neighbor::LBVHTraverser traverser;
+        neighbor::shared_array<unsigned int> hits(N);
+        const neighbor::shared_array<float3> images = frame.getImages();
+        UP_ASSERT_EQUAL(images.size(), 27);
+        traverser.traverse(pool,
+                           lbvh,
+                           frame.getQueryOp(rcut),
+                           neighbor::CountNeighborsOp(hits.get()),
+                           neighbor::ImageListOp<float3>(images.get(), images.size()));
+        const std::vector<unsigned int> ref = brute_force(frame, rcut);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            // the bounding sphere test is not exact, so it may count more
+            UP_ASSERT(hits[i] >= ref[i]);
+            }
+        }
+
+    // a file that is not GSD
+        {
+        std::ofstream f(filename.c_str());
+        f << "garbage";
+        }
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ neighbor::host::TrajectoryReader reader(filename, neighbor::host::TrajectoryReader::Format::GSD); });
+    UP_ASSERT_EXCEPTION(std::runtime_error, []{ neighbor::host::TrajectoryReader reader("does_not_exist.gsd"); });
+    std::remove(filename.c_str());
+    }
+
+// Test that XYZ files are read
+UP_TEST( trajectory_reader_xyz_test )
+    {
+    const std::string filename = "trajectory_reader_test.xyz";
+        {
+        std::ofstream f(filename.c_str());
+        f << "3\n";
+        f << "Lattice=\"4.0 0.0 0.0 1.0 5.0 0.0 0.0 0.0 6.0\" Properties=species:S:1:pos:R:3\n";
+        f << "A 0.5 1.0 1.5\n";
+        f << "B 2.0 3.0 4.0\r\n";
+        f << "A 3.5 4.5 5.5\n";
+        f << "\n";
+        f << "2\n";
+        f << "plain frame\n";
+        f << "A -1 0 0\n";
+        f << "A 1 2 3\n";
+        }
+    neighbor::host::TrajectoryReader reader(filename);
+    UP_ASSERT(reader.getFormat() == neighbor::host::TrajectoryReader::Format::XYZ);
+    UP_ASSERT_EQUAL(reader.getNumFrames(), 2);
+
+    const neighbor::host::TrajectoryFrame& f0 = reader.read(0);
+    UP_ASSERT_EQUAL(f0.N, 3);
+    UP_ASSERT_EQUAL(f0.L.x, 4.f);
+    UP_ASSERT_EQUAL(f0.L.y, 5.f);
+    UP_ASSERT_EQUAL(f0.L.z, 6.f);
+    UP_ASSERT_CLOSE(f0.xy, 0.2f, 1.e-6f);
+    UP_ASSERT_EQUAL(f0.positions[1].z, 4.f);
+    UP_ASSERT(f0.diameters == nullptr);
+    UP_ASSERT_EQUAL(f0.lo.x, 0.f);
+    UP_ASSERT_EQUAL(f0.hi.x, 5.f);
+    UP_ASSERT_EQUAL(f0.hi.z, 6.f);
+    UP_ASSERT_EQUAL(f0.getImages().size(), 27);
+
+    const neighbor::host::TrajectoryFrame& f1 = reader.read(1);
+    UP_ASSERT_EQUAL(f1.N, 2);
+    UP_ASSERT(!f1.periodic[0] && !f1.periodic[1] && !f1.periodic[2]);
+    UP_ASSERT_EQUAL(f1.lo.x, -1.f);
+    UP_ASSERT_EQUAL(f1.hi.z, 3.f);
+    UP_ASSERT_EQUAL(f1.getImages().size(), 1);
+    std::remove(filename.c_str());
+    }
+
+// Test that LAMMPS dumps are read
+UP_TEST( trajectory_reader_lammps_test )
+    {
+    const std::string filename = "trajectory_reader_test.lammpstrj";
+        {
+        std::ofstream f(filename.c_str());
+        f << "ITEM: TIMESTEP\n0\n";
+        f << "ITEM: NUMBER OF ATOMS\n2\n";
+        f << "ITEM: BOX BOUNDS pp pp pp\n0 10\n-1 1\n0 4\n";
+        f << "ITEM: ATOMS id type x y z diameter\n";
+        f << "1 1 1.0 0.5 2.0 1.5\n";
+        f << "2 1 9.0 -0.5 3.0 0.5\n";
+        f << "ITEM: TIMESTEP\n100\n";
+        f << "ITEM: NUMBER OF ATOMS\n1\n";
+        f << "ITEM: BOX BOUNDS xy xz yz pp pp ff\n0 12 2\n0 5 0\n0 4 0\n";
+        f << "ITEM: ATOMS id type xs ys zs\n";
+        f << "1 1 0.5 0.5 0.5\n";
+        }
+    neighbor::host::TrajectoryReader reader(filename);
+    UP_ASSERT(reader.getFormat() == neighbor::host::TrajectoryReader::Format::LAMMPS);
+    UP_ASSERT_EQUAL(reader.getNumFrames(), 2);
+
+    const neighbor::host::TrajectoryFrame& f0 = reader.read(0);
+    UP_ASSERT_EQUAL(f0.N, 2);
+    UP_ASSERT_EQUAL(f0.L.x, 10.f);
+    UP_ASSERT_EQUAL(f0.origin.y, -1.f);
+    UP_ASSERT_EQUAL(f0.positions[1].x, 9.f);
+    UP_ASSERT(f0.diameters != nullptr);
+    UP_ASSERT_EQUAL(f0.diameters[0], 1.5f);
+
+    // triclinic bounds include the tilt, which is removed from the box
+    const neighbor::host::TrajectoryFrame& f1 = reader.read(1);
+    UP_ASSERT_EQUAL(f1.N, 1);
+    UP_ASSERT_EQUAL(f1.L.x, 10.f);
+    UP_ASSERT_CLOSE(f1.xy, 0.4f, 1.e-6f);
+    UP_ASSERT(f1.periodic[0] && f1.periodic[1] && !f1.periodic[2]);
+    UP_ASSERT_CLOSE(f1.positions[0].x, 6.f, 1.e-6f);
+    UP_ASSERT_CLOSE(f1.positions[0].y, 2.5f, 1.e-6f);
+    UP_ASSERT_CLOSE(f1.positions[0].z, 2.f, 1.e-6f);
+    UP_ASSERT_EQUAL(f1.hi.x, 12.f);
+    UP_ASSERT_EQUAL(f1.getImages().size(), 9);
+    std::remove(filename.c_str());
+    }
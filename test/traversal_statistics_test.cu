@@ -0,0 +1,232 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#include <hipper/hipper_runtime.h>
+
+#include "neighbor/neighbor.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "test_systems.h"
+#include "upp11_config.h"
+UP_MAIN();
+
+// Test that the work of each query is counted and reduced
+UP_TEST( traversal_statistics_test )
+    {
+    const float L = 10.f;
+    const unsigned int N = 500;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(L, L, L);
+    neighbor::shared_array<float3> points(N);
+    makeUniformPoints(points, L, 42);
+    neighbor::shared_array<float4> spheres(N);
+    for (unsigned int i=0; i < N; ++i)
+        {
+        spheres[i] = make_float4(points[i].x, points[i].y, points[i].z, 1.5f);
+        }
+    // a query in the middle of the box only traverses the self image
+    spheres[0] = make_float4(0.5f*L, 0.5f*L, 0.5f*L, 1.5f);
+    const neighbor::PointInsertOp insert(points.get(), N);
+    const neighbor::shared_array<float3> images = makeCubicImages(L);
+    const neighbor::ImageListOp<float3> translate(images.get(), images.size());
+
+    neighbor::LBVH lbvh;
+    lbvh.build(insert, lo, hi);
+    neighbor::LBVHTraverser traverser;
+    neighbor::shared_array<unsigned int> hits(N), ref_hits(N);
+    traverser.traverse(lbvh, neighbor::SphereQueryOp(spheres.get(), N), neighbor::CountNeighborsOp(ref_hits.get()), translate);
+
+    // every overlapped primitive is accepted by the sphere query
+    neighbor::TraversalStatistics stats;
+    UP_ASSERT_EQUAL(stats.getN(), 0);
+    traverser.traverse(neighbor::LBVHTraverser::LaunchParameters(64, 0),
+                       lbvh,
+                       neighbor::SphereQueryOp(spheres.get(), N),
+                       neighbor::CountNeighborsOp(hits.get()),
+                       translate,
+                       neighbor::NullTransformOp(),
+                       stats);
+    hipper::deviceSynchronize();
+    UP_ASSERT_EQUAL(stats.getN(), N);
+    for (unsigned int i=0; i < N; ++i)
+        {
+        UP_ASSERT_EQUAL(hits[i], ref_hits[i]);
+        UP_ASSERT_EQUAL(stats.get(i, neighbor::TraversalStatistics::Count::Leaves), hits[i]);
+        UP_ASSERT_EQUAL(stats.get(i, neighbor::TraversalStatistics::Count::Rejections), 0);
+        UP_ASSERT(stats.get(i, neighbor::TraversalStatistics::Count::Nodes) >= hits[i]);
+        UP_ASSERT(stats.get(i, neighbor::TraversalStatistics::Count::Nodes) <= 27*lbvh.getNNodes());
+        UP_ASSERT(stats.get(i, neighbor::TraversalStatistics::Count::Images) >= 1);
+        UP_ASSERT(stats.get(i, neighbor::TraversalStatistics::Count::Images) <= 27);
+        }
+    UP_ASSERT_EQUAL(stats.get(0, neighbor::TraversalStatistics::Count::Images), 1);
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ stats.get(N, neighbor::TraversalStatistics::Count::Nodes); });
+
+    // reductions
+    unsigned long long total_hits = 0;
+    unsigned int max_hits = 0;
+    for (unsigned int i=0; i < N; ++i)
+        {
+        total_hits += hits[i];
+        max_hits = std::max(max_hits, hits[i]);
+        }
+    UP_ASSERT_EQUAL(stats.getTotal(neighbor::TraversalStatistics::Count::Leaves), total_hits);
+    UP_ASSERT_EQUAL(stats.getMax(neighbor::TraversalStatistics::Count::Leaves), max_hits);
+    UP_ASSERT_CLOSE(stats.getMean(neighbor::TraversalStatistics::Count::Leaves), static_cast<double>(total_hits)/N, 1.e-12);
+    for (unsigned int width : {1u, 4u})
+        {
+        const auto histogram = stats.getHistogram(neighbor::TraversalStatistics::Count::Leaves, width);
+        UP_ASSERT_EQUAL(histogram.size(), max_hits/width+1);
+        UP_ASSERT(histogram.back() > 0);
+        unsigned int sum = 0;
+        for (auto h : histogram) sum += h;
+        UP_ASSERT_EQUAL(sum, N);
+        }
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ stats.getHistogram(neighbor::TraversalStatistics::Count::Nodes, 0); });
+
+    // rejected primitives are counted, and the host traversal does the same work
+    neighbor::TraversalStatistics host_stats;
+    neighbor::host::ThreadPool pool(2);
+    traverser.traverse(pool,
+                       lbvh,
+                       EvenSphereQueryOp(spheres.get(), N),
+                       neighbor::CountNeighborsOp(hits.get()),
+                       translate,
+                       neighbor::NullTransformOp(),
+                       host_stats);
+    UP_ASSERT_EQUAL(host_stats.getN(), N);
+    for (unsigned int i=0; i < N; ++i)
+        {
+        const unsigned int leaves = host_stats.get(i, neighbor::TraversalStatistics::Count::Leaves);
+        const unsigned int rejections = host_stats.get(i, neighbor::TraversalStatistics::Count::Rejections);
+        UP_ASSERT_EQUAL(leaves, ref_hits[i]);
+        UP_ASSERT_EQUAL(leaves - rejections, hits[i]);
+        UP_ASSERT_EQUAL(host_stats.get(i, neighbor::TraversalStatistics::Count::Nodes),
+                        stats.get(i, neighbor::TraversalStatistics::Count::Nodes));
+        UP_ASSERT_EQUAL(host_stats.get(i, neighbor::TraversalStatistics::Count::Images),
+                        stats.get(i, neighbor::TraversalStatistics::Count::Images));
+        }
+    UP_ASSERT(host_stats.getTotal(neighbor::TraversalStatistics::Count::Rejections) > 0);
+
+    // statistics and timed phases together
+    neighbor::PhaseTimer timer;
+    traverser.traverse(pool,
+                       lbvh,
+                       neighbor::SphereQueryOp(spheres.get(), N),
+                       neighbor::CountNeighborsOp(hits.get()),
+                       translate,
+                       neighbor::NullTransformOp(),
+                       timer,
+                       host_stats);
+    UP_ASSERT_EQUAL(timer.getPhases().size(), 2);
+    UP_ASSERT_EQUAL(host_stats.getTotal(neighbor::TraversalStatistics::Count::Rejections), 0);
+
+    // the counts are zero without queries
+    traverser.traverse(pool,
+                       lbvh,
+                       neighbor::SphereQueryOp(spheres.get(), 0),
+                       neighbor::CountNeighborsOp(hits.get()),
+                       translate,
+                       neighbor::NullTransformOp(),
+                       host_stats);
+    UP_ASSERT_EQUAL(host_stats.getN(), 0);
+    UP_ASSERT_EQUAL(host_stats.getMean(neighbor::TraversalStatistics::Count::Nodes), 0.);
+    UP_ASSERT_EQUAL(host_stats.getHistogram(neighbor::TraversalStatistics::Count::Nodes).size(), 1);
+    }
+
+// Test the counts of a tree with one primitive
+UP_TEST( traversal_statistics_single_test )
+    {
+    neighbor::shared_array<float3> points(1);
+    points[0] = make_float3(1.f, 1.f, 1.f);
+    neighbor::shared_array<float4> spheres(2);
+    spheres[0] = make_float4(1.f, 1.f, 1.f, 0.5f);
+    spheres[1] = make_float4(3.f, 3.f, 3.f, 0.5f);
+
+    neighbor::LBVH lbvh;
+    lbvh.build(neighbor::PointInsertOp(points.get(), 1), make_float3(0.f, 0.f, 0.f), make_float3(4.f, 4.f, 4.f));
+    neighbor::LBVHTraverser traverser;
+    neighbor::shared_array<unsigned int> hits(2);
+    neighbor::TraversalStatistics stats;
+    neighbor::host::ThreadPool pool(1);
+    traverser.traverse(pool,
+                       lbvh,
+                       neighbor::SphereQueryOp(spheres.get(), 2),
+                       neighbor::CountNeighborsOp(hits.get()),
+                       neighbor::SelfOp(),
+                       neighbor::NullTransformOp(),
+                       stats);
+
+    // the first query tests the leaf, while the second misses the root
+    UP_ASSERT_EQUAL(stats.getCounts()[0].nodes, 1);
+    UP_ASSERT_EQUAL(stats.getCounts()[0].leaves, 1);
+    UP_ASSERT_EQUAL(stats.getCounts()[0].images, 1);
+    UP_ASSERT_EQUAL(stats.getCounts()[1].nodes, 0);
+    UP_ASSERT_EQUAL(stats.getCounts()[1].leaves, 0);
+    UP_ASSERT_EQUAL(stats.getCounts()[1].images, 0);
+    }
+
+// Test that the self and cached traversals count their work
+UP_TEST( traversal_statistics_self_cached_test )
+    {
+    const float L = 10.f;
+    const unsigned int N = 500;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(L, L, L);
+    neighbor::shared_array<float3> points(N);
+    makeUniformPoints(points, L, 7);
+    neighbor::shared_array<float4> spheres(N);
+    for (unsigned int i=0; i < N; ++i)
+        {
+        spheres[i] = make_float4(points[i].x, points[i].y, points[i].z, 1.f);
+        }
+    const neighbor::SphereQueryOp query(spheres.get(), N);
+
+    neighbor::LBVH lbvh;
+    lbvh.build(neighbor::PointInsertOp(points.get(), N), lo, hi);
+    neighbor::LBVHTraverser traverser;
+    const neighbor::LBVHTraverser::LaunchParameters params(64, 0);
+    neighbor::shared_array<unsigned int> hits(N);
+    neighbor::TraversalStatistics root_stats;
+    traverser.traverse(params, lbvh, query, neighbor::CountNeighborsOp(hits.get()), neighbor::SelfOp(), neighbor::NullTransformOp(), root_stats);
+    hipper::deviceSynchronize();
+    const unsigned long long root_nodes = root_stats.getTotal(neighbor::TraversalStatistics::Count::Nodes);
+
+    // self-queries skip the ancestors of their leaves
+    neighbor::TraversalStatistics self_stats, host_stats;
+    neighbor::host::ThreadPool pool(2);
+    traverser.traverseSelf(params, lbvh, query, neighbor::CountNeighborsOp(hits.get()), neighbor::SelfOp(), neighbor::NullTransformOp(), self_stats);
+    hipper::deviceSynchronize();
+    traverser.traverseSelf(pool, lbvh, query, neighbor::CountNeighborsOp(hits.get()), neighbor::SelfOp(), neighbor::NullTransformOp(), host_stats);
+    UP_ASSERT_EQUAL(self_stats.getN(), N);
+    UP_ASSERT_EQUAL(host_stats.getN(), N);
+    for (unsigned int i=0; i < N; ++i)
+        {
+        UP_ASSERT_EQUAL(self_stats.get(i, neighbor::TraversalStatistics::Count::Leaves),
+                        root_stats.get(i, neighbor::TraversalStatistics::Count::Leaves));
+        UP_ASSERT_EQUAL(self_stats.get(i, neighbor::TraversalStatistics::Count::Images), 1);
+        UP_ASSERT_EQUAL(host_stats.get(i, neighbor::TraversalStatistics::Count::Nodes),
+                        self_stats.get(i, neighbor::TraversalStatistics::Count::Nodes));
+        }
+    UP_ASSERT(self_stats.getTotal(neighbor::TraversalStatistics::Count::Nodes) < root_nodes);
+
+    // the first cached traversal starts from the root, and the second one starts from the cached entries
+    neighbor::TraversalStatistics cached_stats;
+    traverser.traverseCached(params, lbvh, query, neighbor::CountNeighborsOp(hits.get()), neighbor::SelfOp(), neighbor::NullTransformOp(), cached_stats);
+    hipper::deviceSynchronize();
+    traverser.traverseCached(pool, lbvh, query, neighbor::CountNeighborsOp(hits.get()), neighbor::SelfOp(), neighbor::NullTransformOp(), host_stats);
+    UP_ASSERT_EQUAL(host_stats.getN(), N);
+    for (unsigned int i=0; i < N; ++i)
+        {
+        UP_ASSERT_EQUAL(cached_stats.get(i, neighbor::TraversalStatistics::Count::Leaves),
+                        root_stats.get(i, neighbor::TraversalStatistics::Count::Leaves));
+        UP_ASSERT_EQUAL(host_stats.get(i, neighbor::TraversalStatistics::Count::Leaves),
+                        root_stats.get(i, neighbor::TraversalStatistics::Count::Leaves));
+        }
+    UP_ASSERT(host_stats.getTotal(neighbor::TraversalStatistics::Count::Nodes) < root_nodes);
+    UP_ASSERT(host_stats.getTotal(neighbor::TraversalStatistics::Count::Nodes) < cached_stats.getTotal(neighbor::TraversalStatistics::Count::Nodes));
+    }
@@ -0,0 +1,278 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#include <hipper/hipper_runtime.h>
+
+#include "neighbor/neighbor.h"
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "upp11_config.h"
+UP_MAIN();
+
+//! Tunable operation that records the parameter it is called with.
+class RecordTunable : public neighbor::Tunable<unsigned int>
+    {
+    public:
+        RecordTunable()
+            : neighbor::Tunable<unsigned int>(32, 1024, 32)
+            {}
+
+        unsigned int run(unsigned int N)
+            {
+            unsigned int used = 0;
+            tune("Record", "run", neighbor::TuningCache::Types<int>(), N, 0, 32, [&](const LaunchParameters& params)
+                {
+                used = params.tunable;
+                });
+            return used;
+            }
+    };
+
+// Test that the tuning cache stores configurations by problem signature
+UP_TEST( tuning_cache_test )
+    {
+    UP_ASSERT_EQUAL(neighbor::TuningCache::getBucket(0), 0);
+    UP_ASSERT_EQUAL(neighbor::TuningCache::getBucket(1), 0);
+    UP_ASSERT_EQUAL(neighbor::TuningCache::getBucket(1023), 9);
+    UP_ASSERT_EQUAL(neighbor::TuningCache::getBucket(1024), 10);
+    UP_ASSERT((neighbor::TuningCache::getTypes<int,float>() != neighbor::TuningCache::getTypes<float,int>()));
+    UP_ASSERT(neighbor::TuningCache::getTypes<int>() == neighbor::TuningCache::getTypes<int>());
+    UP_ASSERT((neighbor::TuningCache::Types<int,float>::get() == neighbor::TuningCache::getTypes<int,float>()));
+    UP_ASSERT(!neighbor::TuningCache::getHostId().empty());
+    UP_ASSERT(!neighbor::TuningCache::getDeviceId().empty());
+
+    // in memory
+    neighbor::TuningCache memory;
+    UP_ASSERT(memory.getFilename().empty());
+    const neighbor::TuningCache::Key key = {"build", neighbor::TuningCache::getTypes<neighbor::PointInsertOp>(), 10, "gpu", 0};
+    neighbor::TuningSpace::Configuration config;
+    UP_ASSERT(!memory.find(key, config));
+    memory.insert(key, {{"param", 64}});
+    UP_ASSERT(memory.find(key, config));
+    UP_ASSERT(config == neighbor::TuningSpace::Configuration({{"param", 64}}));
+    for (auto other : {neighbor::TuningCache::Key({"refit", key.types, 10, "gpu", 0}),
+                       neighbor::TuningCache::Key({"build", "other", 10, "gpu", 0}),
+                       neighbor::TuningCache::Key({"build", key.types, 11, "gpu", 0}),
+                       neighbor::TuningCache::Key({"build", key.types, 10, "cpu", 0}),
+                       neighbor::TuningCache::Key({"build", key.types, 10, "gpu", 4})})
+        {
+        UP_ASSERT(!memory.find(other, config));
+        }
+    memory.insert(key, {{"param", 128}});
+    UP_ASSERT(memory.find(key, config));
+    UP_ASSERT_EQUAL(config["param"], 128);
+    UP_ASSERT_EQUAL(memory.size(), 1);
+    memory.clear();
+    UP_ASSERT_EQUAL(memory.size(), 0);
+
+    // in a file, which is written on insert and read on construction
+    const std::string filename = "tuning_cache_test.cache";
+    std::remove(filename.c_str());
+        {
+        neighbor::TuningCache cache(filename);
+        UP_ASSERT_EQUAL(cache.getFilename(), filename);
+        UP_ASSERT_EQUAL(cache.size(), 0);
+        cache.insert(key, {{"param", 64}});
+        // separators in the key are replaced, so the key is found again after reading the file
+        cache.insert({"traverse", "a\tb", 3, "cpu\nmodel", 8}, {{"method", 2}, {"chunk", 64}});
+        }
+        {
+        neighbor::TuningCache cache(filename);
+        UP_ASSERT_EQUAL(cache.size(), 2);
+        UP_ASSERT(cache.find(key, config));
+        UP_ASSERT_EQUAL(config["param"], 64);
+        UP_ASSERT(cache.find({"traverse", "a\tb", 3, "cpu\nmodel", 8}, config));
+        UP_ASSERT(config == neighbor::TuningSpace::Configuration({{"method", 2}, {"chunk", 64}}));
+        }
+
+    // entries from other processes are merged, and damaged lines are skipped
+        {
+        neighbor::TuningCache cache(filename);
+            {
+            std::ofstream file(filename.c_str(), std::ios::app);
+            file << "refit\ttypes\t4\tgpu\t0\tparam=96" << std::endl;
+            file << "damaged\tline" << std::endl;
+            file << "query\ttypes\tx\tgpu\t0\tparam=96" << std::endl;
+            }
+        cache.insert({"query", "types", 5, "gpu", 0}, {{"param", 32}});
+        }
+        {
+        neighbor::TuningCache cache(filename);
+        UP_ASSERT_EQUAL(cache.size(), 4);
+        UP_ASSERT(cache.find({"refit", "types", 4, "gpu", 0}, config));
+        UP_ASSERT_EQUAL(config["param"], 96);
+        UP_ASSERT(cache.save());
+        }
+    std::remove(filename.c_str());
+
+    // a file that cannot be written is not an error, and the entries are kept in memory
+        {
+        neighbor::TuningCache cache("tuning_cache_test.missing/tuning_cache_test.cache");
+        cache.insert(key, {{"param", 64}});
+        UP_ASSERT(cache.find(key, config));
+        UP_ASSERT_EQUAL(config["param"], 64);
+        UP_ASSERT(!cache.save());
+        }
+    }
+
+// Test that autotuned operations start from the cached parameters
+UP_TEST( tunable_cache_test )
+    {
+    const float L = 10.f;
+    const unsigned int N = 100;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(L, L, L);
+    neighbor::shared_array<float3> points(N);
+        {
+        std::mt19937 mt(42);
+        std::uniform_real_distribution<float> U(0.f, L);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            points[i] = make_float3(U(mt), U(mt), U(mt));
+            }
+        }
+    const neighbor::PointInsertOp insert(points.get(), N);
+
+    const std::string filename = "tunable_cache_test.cache";
+    std::remove(filename.c_str());
+
+    // the parameter found by a scan is cached
+    unsigned int best;
+        {
+        neighbor::LBVH lbvh;
+        UP_ASSERT(lbvh.getTuningCache() == neighbor::TuningCache::getDefault());
+        lbvh.setTuningCache(std::make_shared<neighbor::TuningCache>(filename));
+        lbvh.setAutotuning(true);
+        neighbor::Autotuner<unsigned int>& tuner = lbvh.getAutotuner("build");
+        tuner.setPeriod(0);
+        while (true)
+            {
+            lbvh.build(insert, lo, hi);
+            if (!tuner.isTuning()) break;
+            }
+        best = tuner.getParameter();
+        UP_ASSERT_EQUAL(lbvh.getTuningCache()->size(), 1);
+        }
+
+    // a new process reads the cache and starts with the cached parameter
+        {
+        neighbor::LBVH lbvh;
+        lbvh.setTuningCache(std::make_shared<neighbor::TuningCache>(filename));
+        lbvh.setAutotuning(true);
+        lbvh.build(insert, lo, hi);
+        neighbor::Autotuner<unsigned int>& tuner = lbvh.getAutotuner("build");
+        UP_ASSERT(!tuner.isTuning());
+        UP_ASSERT_EQUAL(tuner.getParameter(), best);
+
+        // other problem sizes and operations are not cached
+        lbvh.build(neighbor::PointInsertOp(points.get(), N/4), lo, hi);
+        UP_ASSERT(tuner.isTuning());
+        lbvh.refit(insert);
+        UP_ASSERT(lbvh.getAutotuner("refit").isTuning());
+        }
+
+    // without a cache, the scan starts over
+        {
+        neighbor::LBVH lbvh;
+        lbvh.setTuningCache(nullptr);
+        lbvh.setAutotuning(true);
+        lbvh.build(insert, lo, hi);
+        UP_ASSERT(lbvh.getAutotuner("build").isTuning());
+        }
+    std::remove(filename.c_str());
+    }
+
+// Test that operations of the same name in different classes are cached separately
+UP_TEST( tunable_cache_class_test )
+    {
+    const float L = 10.f;
+    const unsigned int N = 100;
+    const float3 lo = make_float3(0.f, 0.f, 0.f);
+    const float3 hi = make_float3(L, L, L);
+    neighbor::shared_array<float3> points(N);
+        {
+        std::mt19937 mt(42);
+        std::uniform_real_distribution<float> U(0.f, L);
+        for (unsigned int i=0; i < N; ++i)
+            {
+            points[i] = make_float3(U(mt), U(mt), U(mt));
+            }
+        }
+    const neighbor::PointInsertOp insert(points.get(), N);
+    auto cache = std::make_shared<neighbor::TuningCache>();
+
+    // the LBVH caches its build
+    neighbor::LBVH lbvh;
+    lbvh.setTuningCache(cache);
+    lbvh.setAutotuning(true);
+    neighbor::Autotuner<unsigned int>& lbvh_tuner = lbvh.getAutotuner("build");
+    lbvh_tuner.setPeriod(0);
+    while (true)
+        {
+        lbvh.build(insert, lo, hi);
+        if (!lbvh_tuner.isTuning()) break;
+        }
+    UP_ASSERT_EQUAL(cache->size(), 1);
+
+    // the index does not start from the build of the LBVH, and it adds its own entry
+    neighbor::MortonIndex index;
+    index.setTuningCache(cache);
+    index.setAutotuning(true);
+    neighbor::Autotuner<unsigned int>& index_tuner = index.getAutotuner("build");
+    index_tuner.setPeriod(0);
+    index.build(insert, lo, hi);
+    UP_ASSERT(index_tuner.isTuning());
+    while (index_tuner.isTuning())
+        {
+        index.build(insert, lo, hi);
+        }
+    UP_ASSERT_EQUAL(cache->size(), 2);
+
+    const std::string types = neighbor::TuningCache::getTypes<neighbor::PointInsertOp>();
+    const unsigned int bucket = neighbor::TuningCache::getBucket(N);
+    const std::string device = neighbor::TuningCache::getDeviceId();
+    neighbor::TuningSpace::Configuration config;
+    UP_ASSERT(cache->find({"LBVH.build", types, bucket, device, 0}, config));
+    UP_ASSERT_EQUAL(config["param"], lbvh_tuner.getParameter());
+    UP_ASSERT(cache->find({"MortonIndex.build", types, bucket, device, 0}, config));
+    UP_ASSERT_EQUAL(config["param"], index_tuner.getParameter());
+    UP_ASSERT(!cache->find({"build", types, bucket, device, 0}, config));
+    }
+
+// Test that cached parameters are used without autotuning
+UP_TEST( tunable_cache_untuned_test )
+    {
+    const std::string filename = "tunable_cache_untuned_test.cache";
+    std::remove(filename.c_str());
+    const unsigned int N = 1000;
+        {
+        neighbor::TuningCache cache(filename);
+        const std::string types = neighbor::TuningCache::getTypes<int>();
+        const std::string device = neighbor::TuningCache::getDeviceId();
+        cache.insert({"Record.run", types, neighbor::TuningCache::getBucket(N), device, 0}, {{"param", 256}});
+        cache.insert({"Record.run", types, neighbor::TuningCache::getBucket(4*N), device, 0}, {{"param", 100}});
+        }
+
+    // without a cache, the default parameter is used
+    RecordTunable op;
+    op.setTuningCache(nullptr);
+    UP_ASSERT(!op.getAutotuning());
+    UP_ASSERT_EQUAL(op.run(N), 32);
+
+    // a fresh object with the cache file uses the cached parameter, but only if it is valid
+    RecordTunable cached;
+    cached.setTuningCache(std::make_shared<neighbor::TuningCache>(filename));
+    UP_ASSERT(!cached.getAutotuning());
+    UP_ASSERT_EQUAL(cached.run(N), 256);
+    UP_ASSERT_EQUAL(cached.run(2*N), 32);
+    UP_ASSERT_EQUAL(cached.run(4*N), 32);
+    std::remove(filename.c_str());
+    }
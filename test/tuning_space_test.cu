@@ -0,0 +1,127 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#include <hipper/hipper_runtime.h>
+
+#include "neighbor/neighbor.h"
+
+#include <vector>
+
+#include "upp11_config.h"
+UP_MAIN();
+
+// Test the dimensions and constraints of a tuning space
+UP_TEST( tuning_space_test )
+    {
+    neighbor::TuningSpace space;
+    UP_ASSERT_EQUAL(space.size(), 0);
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ space.getFirstValid(); });
+
+    space.addDimension("block_size", {32, 64, 128, 256});
+    space.addDimension("items", {1, 2, 4});
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ space.addDimension("items", {8}); });
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ space.addDimension("empty", {}); });
+    UP_ASSERT_EQUAL(space.getNumDimensions(), 2);
+    UP_ASSERT_EQUAL(space.size(), 12);
+    UP_ASSERT(space.getNames() == std::vector<std::string>({"block_size", "items"}));
+    UP_ASSERT(space.getValues("items") == std::vector<unsigned int>({1, 2, 4}));
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ space.getValues("leaf_size"); });
+
+    UP_ASSERT(space.isValid({{"block_size", 64}, {"items", 2}}));
+    UP_ASSERT(!space.isValid({{"block_size", 48}, {"items", 2}}));
+    UP_ASSERT(!space.isValid({{"block_size", 64}}));
+    UP_ASSERT(!space.isValid({{"block_size", 64}, {"items", 2}, {"leaf_size", 4}}));
+
+    // at most 256 items per block
+    space.addConstraint([](const neighbor::TuningSpace::Configuration& c)
+        {
+        return c.at("block_size")*c.at("items") <= 256;
+        });
+    UP_ASSERT(!space.isValid({{"block_size", 256}, {"items", 2}}));
+    UP_ASSERT(space.getFirstValid() == neighbor::TuningSpace::Configuration({{"block_size", 32}, {"items", 1}}));
+
+    space.addConstraint([](const neighbor::TuningSpace::Configuration& c)
+        {
+        return c.at("block_size") > 32;
+        });
+    UP_ASSERT(space.getFirstValid() == neighbor::TuningSpace::Configuration({{"block_size", 64}, {"items", 1}}));
+
+    space.addConstraint([](const neighbor::TuningSpace::Configuration&) { return false; });
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ space.getFirstValid(); });
+    }
+
+// Test that the search strategies find the configuration of least cost
+UP_TEST( tuning_space_search_test )
+    {
+    neighbor::TuningSpace space;
+    space.addDimension("a", {0, 1, 2, 3, 4, 5, 6, 7});
+    space.addDimension("b", {0, 1, 2, 3, 4, 5, 6, 7});
+    space.addDimension("c", {0, 1});
+
+    // separable cost with its minimum at (5,2,1)
+    unsigned int calls = 0;
+    auto cost = [&](const neighbor::TuningSpace::Configuration& config)
+        {
+        ++calls;
+        const double a = config.at("a"), b = config.at("b"), c = config.at("c");
+        return (a-5.)*(a-5.) + (b-2.)*(b-2.) + (1.-c);
+        };
+    const neighbor::TuningSpace::Configuration optimum = {{"a", 5}, {"b", 2}, {"c", 1}};
+
+    auto result = space.search(cost, neighbor::TuningSpace::Strategy::Exhaustive);
+    UP_ASSERT(result.best == optimum);
+    UP_ASSERT_EQUAL(result.cost, 0.);
+    UP_ASSERT_EQUAL(result.evaluations, 128);
+    UP_ASSERT_EQUAL(calls, 128);
+
+    // coordinate descent needs far fewer evaluations, and evaluates each configuration once
+    calls = 0;
+    result = space.search(cost, neighbor::TuningSpace::Strategy::CoordinateDescent);
+    UP_ASSERT(result.best == optimum);
+    UP_ASSERT_EQUAL(result.evaluations, calls);
+    UP_ASSERT(result.evaluations < 40);
+
+    calls = 0;
+    result = space.search(cost, {{"a", 7}, {"b", 7}, {"c", 0}});
+    UP_ASSERT(result.best == optimum);
+    UP_ASSERT_EQUAL(result.evaluations, calls);
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ space.search(cost, {{"a", 9}, {"b", 7}, {"c", 0}}); });
+
+    // the budget limits the evaluations
+    calls = 0;
+    result = space.search(cost, neighbor::TuningSpace::Strategy::CoordinateDescent, 5);
+    UP_ASSERT_EQUAL(result.evaluations, 5);
+    UP_ASSERT_EQUAL(calls, 5);
+    result = space.search(cost, neighbor::TuningSpace::Strategy::Exhaustive, 7);
+    UP_ASSERT_EQUAL(result.evaluations, 7);
+
+    // random search samples distinct configurations, so a budget of the whole space finds the optimum
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ space.search(cost, neighbor::TuningSpace::Strategy::Random); });
+    calls = 0;
+    result = space.search(cost, neighbor::TuningSpace::Strategy::Random, 20);
+    UP_ASSERT_EQUAL(result.evaluations, 20);
+    UP_ASSERT_EQUAL(calls, 20);
+    result = space.search(cost, neighbor::TuningSpace::Strategy::Random, 128);
+    UP_ASSERT(result.best == optimum);
+    UP_ASSERT_EQUAL(result.evaluations, 128);
+
+    // the same seed samples the same configurations
+    space.setSeed(7);
+    UP_ASSERT_EQUAL(space.getSeed(), 7);
+    const auto r1 = space.search(cost, neighbor::TuningSpace::Strategy::Random, 10);
+    const auto r2 = space.search(cost, neighbor::TuningSpace::Strategy::Random, 10);
+    UP_ASSERT(r1.best == r2.best);
+
+    // constraints exclude the optimum, so the best valid configuration is found instead
+    space.addConstraint([](const neighbor::TuningSpace::Configuration& c) { return c.at("a") + c.at("b") <= 5; });
+    const neighbor::TuningSpace::Configuration constrained = {{"a", 4}, {"b", 1}, {"c", 1}};
+    result = space.search(cost, neighbor::TuningSpace::Strategy::Exhaustive);
+    UP_ASSERT(result.best == constrained);
+    UP_ASSERT_EQUAL(result.cost, 2.);
+    result = space.search(cost, neighbor::TuningSpace::Strategy::Random, 1000);
+    UP_ASSERT(result.best == constrained);
+    UP_ASSERT_EQUAL(result.evaluations, 42);
+    }
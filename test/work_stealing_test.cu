@@ -0,0 +1,107 @@
+// Copyright (c) 2018-2020, Michael P. Howard
+// Copyright (c) 2021, Auburn University
+// This file is released under the Modified BSD License.
+
+// Maintainer: mphoward
+
+#include <hipper/hipper_runtime.h>
+
+#include "neighbor/neighbor.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "upp11_config.h"
+UP_MAIN();
+
+// Test that the work-stealing scheduler processes every index once and balances uneven work
+UP_TEST( work_stealing_test )
+    {
+    neighbor::host::WorkStealingScheduler scheduler;
+    UP_ASSERT_EQUAL(scheduler.getTargetChunkTime(), 50.e-6);
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ scheduler.setTargetChunkTime(0.); });
+
+    for (unsigned int num_threads : {1, 4})
+        {
+        neighbor::host::ThreadPool pool(num_threads);
+        for (unsigned int N : {0, 1, 3, 5000})
+            {
+            std::vector<std::atomic<unsigned int>> visits(N);
+            for (auto& v : visits) v = 0;
+            scheduler.run(pool, N, [&](unsigned int i)
+                {
+                ++visits[i];
+                });
+            for (unsigned int i=0; i < N; ++i)
+                {
+                UP_ASSERT_EQUAL(visits[i].load(), 1);
+                }
+            UP_ASSERT_EQUAL(scheduler.getBusyTimes().size(), num_threads);
+            UP_ASSERT_EQUAL(scheduler.getFinishTimes().size(), num_threads);
+            UP_ASSERT(scheduler.getNumChunks() >= ((N > 0) ? 1u : 0u));
+            UP_ASSERT(scheduler.getUtilization() <= 1.0);
+            UP_ASSERT(scheduler.getTailTime() <= scheduler.getElapsedTime());
+            }
+
+        // all the work is at the start of the range, so the other threads must steal it. a new scheduler
+        // starts with one index per chunk, so the first thread cannot take all the expensive indexes at once
+        neighbor::host::WorkStealingScheduler uneven;
+        uneven.setInitialChunkSize(1);
+        const unsigned int N = 400;
+        std::vector<std::atomic<unsigned int>> visits(N);
+        for (auto& v : visits) v = 0;
+        uneven.run(pool, N, [&](unsigned int i)
+            {
+            if (i < N/4)
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            ++visits[i];
+            });
+        for (unsigned int i=0; i < N; ++i)
+            {
+            UP_ASSERT_EQUAL(visits[i].load(), 1);
+            }
+        if (num_threads > 1)
+            {
+            UP_ASSERT(uneven.getNumSteals() > 0);
+
+            // the expensive indexes are spread out, so the first thread does well under all of the work
+            double busy = 0.;
+            for (const double b : uneven.getBusyTimes())
+                {
+                busy += b;
+                }
+            UP_ASSERT(uneven.getBusyTimes()[0] < 0.75*busy);
+            }
+        else
+            {
+            UP_ASSERT_EQUAL(uneven.getNumSteals(), 0);
+            }
+
+        // expensive indexes are taken in small chunks, even after the cheap indexes grew the chunk size
+        uneven.run(pool, 20, [&](unsigned int)
+            {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            });
+        UP_ASSERT(uneven.getChunkSize(0) < 64);
+        }
+
+    // cheap indexes are taken in large chunks
+    neighbor::host::ThreadPool pool(1);
+    std::atomic<unsigned int> count(0);
+    for (unsigned int i=0; i < 5; ++i)
+        {
+        scheduler.run(pool, 100000, [&](unsigned int) { ++count; });
+        }
+    UP_ASSERT_EQUAL(count.load(), 500000);
+    UP_ASSERT(scheduler.getChunkSize(0) > 64);
+
+    // the initial chunk size resets the chunk size of every thread
+    UP_ASSERT_EQUAL(scheduler.getInitialChunkSize(), 64);
+    scheduler.setInitialChunkSize(16);
+    UP_ASSERT_EQUAL(scheduler.getInitialChunkSize(), 16);
+    UP_ASSERT_EQUAL(scheduler.getChunkSize(0), 16);
+    UP_ASSERT_EQUAL(scheduler.getChunkSize(7), 16);
+    UP_ASSERT_EXCEPTION(std::runtime_error, [&]{ scheduler.setInitialChunkSize(0); });
+    }